@@ -26,16 +26,20 @@
 #include <glib.h>
 
 #include "a2dp.h"
+#include "ba-device.h"
 #include "ba-transport-pcm.h"
 #include "bluealsa-config.h"
+#include "bluealsa-dbus.h"
 #include "io.h"
 #include "rtp.h"
 #include "utils.h"
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 #include "shared/log.h"
 #include "shared/rt.h"
+#include "shared/trace.h"
 
 static const struct a2dp_channel_mode a2dp_aac_channels[] = {
 	{ A2DP_CHM_MONO, 1, AAC_CHANNELS_1 },
@@ -186,6 +190,45 @@ static unsigned int a2dp_aac_get_fdk_vbr_mode(
 	return 5;
 }
 
+struct aac_codec_ctx {
+	struct ba_transport *t;
+	a2dp_aac_t configuration;
+	void *handle;
+	/* context is fully initialized */
+	bool ready;
+};
+
+static void aac_enc_handle_free(void *handle) {
+	HANDLE_AACENCODER h = handle;
+	aacEncClose(&h);
+}
+
+static void aac_dec_handle_free(void *handle) {
+	aacDecoder_Close(handle);
+}
+
+/**
+ * Release AAC codec context.
+ *
+ * Fully initialized context is moved to the device codec cache, so it can be
+ * reused when the transport is restarted with the same configuration. */
+static void aac_codec_ctx_release(struct aac_codec_ctx *ctx, bool encoder) {
+	void (*handle_free)(void *) = encoder ? aac_enc_handle_free : aac_dec_handle_free;
+	if (ctx->ready)
+		ba_device_codec_cache_store(ctx->t->d, ctx->t->profile, A2DP_CODEC_MPEG24, encoder,
+				&ctx->configuration, sizeof(ctx->configuration), ctx->handle, handle_free);
+	else
+		handle_free(ctx->handle);
+}
+
+static void aac_enc_ctx_release(struct aac_codec_ctx *ctx) {
+	aac_codec_ctx_release(ctx, true);
+}
+
+static void aac_dec_ctx_release(struct aac_codec_ctx *ctx) {
+	aac_codec_ctx_release(ctx, false);
+}
+
 void *a2dp_aac_enc_thread(struct ba_transport_pcm *t_pcm) {
 
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
@@ -204,13 +247,25 @@ void *a2dp_aac_enc_thread(struct ba_transport_pcm *t_pcm) {
 	const unsigned int channels = t_pcm->channels;
 	const unsigned int samplerate = t_pcm->sampling;
 
+	/* Try to reuse the encoder of the previous stream. All encoder parameters
+	 * are set below anyway, but the FDK library re-initializes the encoder
+	 * only if some parameter has changed (e.g. the bitrate set by the ABR). */
+	if ((handle = ba_device_codec_cache_take(t->d, t->profile, A2DP_CODEC_MPEG24, true,
+					configuration, sizeof(*configuration))) != NULL &&
+			(err = aacEncoder_SetParam(handle, AACENC_CONTROL_STATE, AACENC_RESET_INBUFFER)) != AACENC_OK) {
+		warn("Couldn't reset cached AAC encoder: %s", aacenc_strerror(err));
+		aacEncClose(&handle);
+	}
+
 	/* create AAC encoder without the Meta Data module */
-	if ((err = aacEncOpen(&handle, 0x07, channels)) != AACENC_OK) {
+	if (handle == NULL &&
+			(err = aacEncOpen(&handle, 0x07, channels)) != AACENC_OK) {
 		error("Couldn't open AAC encoder: %s", aacenc_strerror(err));
 		goto fail_open;
 	}
 
-	pthread_cleanup_push(PTHREAD_CLEANUP(aacEncClose), &handle);
+	struct aac_codec_ctx ctx = { .t = t, .configuration = *configuration, .handle = handle };
+	pthread_cleanup_push(PTHREAD_CLEANUP(aac_enc_ctx_release), &ctx);
 
 	unsigned int aot = AOT_NONE;
 	unsigned int channelmode = channels == 1 ? MODE_1 : MODE_2;
@@ -292,15 +347,21 @@ void *a2dp_aac_enc_thread(struct ba_transport_pcm *t_pcm) {
 		goto fail_init;
 	}
 
+	ctx.ready = true;
+
 	ffb_t bt = { 0 };
-	ffb_t pcm = { 0 };
+	ffrb_t pcm = { 0 };
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &bt);
-	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(ffrb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(io_bt_batch_free), &io.bt_batch);
+	pthread_cleanup_push(PTHREAD_CLEANUP(asrc_free), &io.asrc);
 
 	const unsigned int aac_frame_size = aacinf.inputChannels * aacinf.frameLength;
 	const size_t sample_size = BA_TRANSPORT_PCM_FORMAT_BYTES(t_pcm->format);
-	if (ffb_init(&pcm, aac_frame_size, sample_size) == -1 ||
-			ffb_init_uint8_t(&bt, RTP_HEADER_LEN + aacinf.maxOutBufBytes) == -1) {
+	if (ffrb_init(&pcm, aac_frame_size, sample_size) == -1 ||
+			ffb_init_uint8_t(&bt, RTP_HEADER_LEN + aacinf.maxOutBufBytes) == -1 ||
+			io_bt_batch_init(&io, t->mtu_write) == -1 ||
+			io_asrc_init(&io, t_pcm, pcm.nmemb) == -1) {
 		error("Couldn't create data buffers: %s", strerror(errno));
 		goto fail_ffb;
 	}
@@ -313,6 +374,14 @@ void *a2dp_aac_enc_thread(struct ba_transport_pcm *t_pcm) {
 	/* RTP clock frequency equal to 90kHz */
 	rtp_state_init(&rtp, samplerate, 90000);
 
+	/* In the VBR mode the bitrate is controlled by the encoder itself, so the
+	 * adaptive bitrate might lower the CBR bitrate only - down to the quarter
+	 * of the negotiated one. */
+	io_abr_init(&io, t_pcm, configuration->vbr ? bitrate : bitrate / 4, bitrate, bitrate);
+
+	t_pcm->bitrate = bitrate;
+	bluealsa_dbus_pcm_update(t_pcm, BA_DBUS_PCM_UPDATE_BITRATE);
+
 	int in_bufferIdentifiers[] = { IN_AUDIO_DATA };
 	int out_bufferIdentifiers[] = { OUT_BITSTREAM_DATA };
 	int in_bufSizes[] = { pcm.nmemb * pcm.size };
@@ -320,9 +389,12 @@ void *a2dp_aac_enc_thread(struct ba_transport_pcm *t_pcm) {
 	int in_bufElSizes[] = { pcm.size };
 	int out_bufElSizes[] = { bt.size };
 
+	/* anchor for PCM input, updated before every encoding */
+	void *pcm_head = ffrb_head(&pcm);
+
 	AACENC_BufDesc in_buf = {
 		.numBufs = 1,
-		.bufs = (void **)&pcm.data,
+		.bufs = &pcm_head,
 		.bufferIdentifiers = in_bufferIdentifiers,
 		.bufSizes = in_bufSizes,
 		.bufElSizes = in_bufElSizes,
@@ -340,15 +412,15 @@ void *a2dp_aac_enc_thread(struct ba_transport_pcm *t_pcm) {
 	debug_transport_pcm_thread_loop(t_pcm, "START");
 	for (ba_transport_thread_state_set_running(th);;) {
 
-		ssize_t samples = ffb_len_in(&pcm);
-		switch (samples = io_poll_and_read_pcm(&io, t_pcm, pcm.tail, samples)) {
+		ssize_t samples = ffrb_len_in(&pcm);
+		switch (samples = io_poll_and_read_pcm(&io, t_pcm, ffrb_tail(&pcm), samples)) {
 		case -1:
 			if (errno == ESTALE) {
 				in_args.numInSamples = -1;
 				/* flush encoder internal buffers */
 				while (aacEncEncode(handle, NULL, &out_buf, &in_args, &out_args) == AACENC_OK)
 					continue;
-				ffb_rewind(&pcm);
+				ffrb_rewind(&pcm);
 				continue;
 			}
 			error("PCM poll and read error: %s", strerror(errno));
@@ -358,66 +430,78 @@ void *a2dp_aac_enc_thread(struct ba_transport_pcm *t_pcm) {
 			continue;
 		}
 
-		ffb_seek(&pcm, samples);
-		while ((in_args.numInSamples = ffb_len_out(&pcm)) > 0) {
+		ffrb_seek(&pcm, samples);
+		while ((in_args.numInSamples = ffrb_len_out(&pcm)) > 0) {
+
+			pcm_head = ffrb_head(&pcm);
 
 			if ((err = aacEncEncode(handle, &in_buf, &out_buf, &in_args, &out_args)) != AACENC_OK)
 				error("AAC encoding error: %s", aacenc_strerror(err));
 
 			if (out_args.numOutBytes > 0) {
 
-				size_t payload_len_max = t->mtu_write - RTP_HEADER_LEN;
-				size_t payload_len = out_args.numOutBytes;
+				struct rtp_packetizer pkt;
+				rtp_packetizer_init(&pkt, rtp_header, RTP_HEADER_LEN,
+						rtp_payload, out_args.numOutBytes, t->mtu_write);
 
 				/* If the size of the RTP packet exceeds writing MTU, the RTP payload
 				 * should be fragmented. According to the RFC 3016, fragmentation of
 				 * the audioMuxElement requires no extra header - the payload should
 				 * be fragmented and spread across multiple RTP packets. */
-				for (;;) {
+				while (rtp_packetizer_next(&pkt)) {
 
-					size_t chunk_len;
-					chunk_len = payload_len > payload_len_max ? payload_len_max : payload_len;
-					rtp_header->markbit = payload_len <= payload_len_max;
+					rtp_header->markbit = rtp_packetizer_is_last(&pkt);
 					rtp_state_new_frame(&rtp, rtp_header);
 
-					ffb_rewind(&bt);
-					ffb_seek(&bt, RTP_HEADER_LEN + chunk_len);
+					if (!rtp_packetizer_is_first(&pkt))
+						trace(TRACE_EVENT_RTP_FRAGMENT, pkt.offset, pkt.payload_len, 0);
 
-					ssize_t len = ffb_blen_out(&bt);
-					if ((len = io_bt_write(th, bt.data, len)) <= 0) {
+					ssize_t len;
+					if ((len = io_bt_writev_batch(&io, th, pkt.iov, ARRAYSIZE(pkt.iov))) <= 0) {
 						if (len == -1)
 							error("BT write error: %s", strerror(errno));
 						goto fail;
 					}
 
-					/* resend RTP header */
-					len -= RTP_HEADER_LEN;
-
-					/* break if there is no more payload data */
-					if ((payload_len -= len) == 0)
-						break;
-
-					/* move the rest of data to the beginning of payload */
-					debug("AAC payload fragmentation: extra %zu bytes", payload_len);
-					memmove(rtp_payload, rtp_payload + len, payload_len);
-
 				}
 
 			}
 
 			unsigned int pcm_frames = out_args.numInSamples / channels;
+			ssize_t len;
 			/* keep data transfer at a constant bit rate */
-			asrsync_sync(&io.asrs, pcm_frames);
+			if ((len = io_bt_batch_sync(&io, th, pcm_frames)) <= 0) {
+				if (len == -1)
+					error("BT write error: %s", strerror(errno));
+				goto fail;
+			}
 			/* move forward RTP timestamp clock */
 			rtp_state_update(&rtp, pcm_frames);
 
-			/* update busy delay (encoding overhead) */
-			t_pcm->delay = asrsync_get_busy_usec(&io.asrs) / 100;
+			/* Adapt the bitrate to the BT link condition. The encoder will
+			 * be reconfigured before encoding the next AAC frame. */
+			if (io_abr_control(&io, t_pcm, pcm_frames)) {
+				if ((err = aacEncoder_SetParam(handle, AACENC_BITRATE, io.abr.value)) != AACENC_OK)
+					error("Couldn't set bitrate: %s", aacenc_strerror(err));
+#if AACENCODER_LIB_VERSION >= 0x03041600 /* 3.4.22 */
+				else if (!config.aac_true_bps &&
+						(err = aacEncoder_SetParam(handle, AACENC_PEAK_BITRATE, io.abr.value)) != AACENC_OK)
+					error("Couldn't set peak bitrate: %s", aacenc_strerror(err));
+#endif
+				else {
+					t_pcm->bitrate = io.abr.value;
+					bluealsa_dbus_pcm_update(t_pcm, BA_DBUS_PCM_UPDATE_BITRATE);
+				}
+			}
+
+			/* Update PCM delay - encoding overhead and the duration of audio
+			 * carried by a single AAC frame (packetization delay). */
+			t_pcm->delay = asrsync_get_busy_usec(&io.asrs) / 100 +
+				aacinf.frameLength * 10000 / samplerate;
 
-			/* If the input buffer was not consumed, we have to append new data to
-			 * the existing one. Since we do not use ring buffer, we will simply
-			 * move unprocessed data to the front of our linear buffer. */
-			ffb_shift(&pcm, out_args.numInSamples);
+			/* If the input buffer was not consumed, the unprocessed data will
+			 * stay in the ring buffer and new data will be appended to it. */
+			ffrb_shift(&pcm, out_args.numInSamples);
 
 		}
 
@@ -428,6 +512,8 @@ fail:
 fail_ffb:
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
 fail_init:
 	pthread_cleanup_pop(1);
 fail_open:
@@ -445,15 +531,27 @@ void *a2dp_aac_dec_thread(struct ba_transport_pcm *t_pcm) {
 	struct ba_transport_thread *th = t_pcm->th;
 	struct io_poll io = { .timeout = -1 };
 
+	const a2dp_aac_t *configuration = &t->a2dp.configuration.aac;
 	HANDLE_AACDECODER handle;
 	AAC_DECODER_ERROR err;
 
-	if ((handle = aacDecoder_Open(TT_MP4_LATM_MCP1, 1)) == NULL) {
+	/* try to reuse the decoder of the previous stream */
+	if ((handle = ba_device_codec_cache_take(t->d, t->profile, A2DP_CODEC_MPEG24, false,
+					configuration, sizeof(*configuration))) != NULL &&
+			(err = aacDecoder_SetParam(handle, AAC_TPDEC_CLEAR_BUFFER, 1)) != AAC_DEC_OK) {
+		warn("Couldn't reset cached AAC decoder: %s", aacdec_strerror(err));
+		aacDecoder_Close(handle);
+		handle = NULL;
+	}
+
+	if (handle == NULL &&
+			(handle = aacDecoder_Open(TT_MP4_LATM_MCP1, 1)) == NULL) {
 		error("Couldn't open AAC decoder");
 		goto fail_open;
 	}
 
-	pthread_cleanup_push(PTHREAD_CLEANUP(aacDecoder_Close), handle);
+	struct aac_codec_ctx ctx = { .t = t, .configuration = *configuration, .handle = handle };
+	pthread_cleanup_push(PTHREAD_CLEANUP(aac_dec_ctx_release), &ctx);
 
 	const unsigned int channels = t_pcm->channels;
 	const unsigned int samplerate = t_pcm->sampling;
@@ -474,6 +572,8 @@ void *a2dp_aac_dec_thread(struct ba_transport_pcm *t_pcm) {
 	}
 #endif
 
+	ctx.ready = true;
+
 	ffb_t bt = { 0 };
 	ffb_t latm = { 0 };
 	ffb_t pcm = { 0 };
@@ -506,9 +606,12 @@ void *a2dp_aac_dec_thread(struct ba_transport_pcm *t_pcm) {
 
 		const uint8_t *rtp_latm;
 		const rtp_header_t *rtp_header = bt.data;
-		if ((rtp_latm = rtp_a2dp_get_payload(rtp_header)) == NULL)
+		if (!rtp_check_header_len(rtp_header, len) ||
+				(rtp_latm = rtp_a2dp_get_payload(rtp_header)) == NULL)
 			continue;
 
+		rtp_stats_update(&t_pcm->stats.rtp, rtp_header, rtp.ts_rtp_clockrate);
+
 		int missing_rtp_frames = 0;
 		rtp_state_sync_stream(&rtp, rtp_header, &missing_rtp_frames, NULL);
 
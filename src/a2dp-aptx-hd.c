@@ -29,6 +29,7 @@
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 #include "shared/log.h"
 #include "shared/rt.h"
 
@@ -118,9 +119,11 @@ void *a2dp_aptx_hd_enc_thread(struct ba_transport_pcm *t_pcm) {
 	}
 
 	ffb_t bt = { 0 };
-	ffb_t pcm = { 0 };
+	ffrb_t pcm = { 0 };
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &bt);
-	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(ffrb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(io_bt_batch_free), &io.bt_batch);
+	pthread_cleanup_push(PTHREAD_CLEANUP(asrc_free), &io.asrc);
 	pthread_cleanup_push(PTHREAD_CLEANUP(aptxhdenc_destroy), handle);
 
 	const unsigned int channels = t_pcm->channels;
@@ -129,8 +132,10 @@ void *a2dp_aptx_hd_enc_thread(struct ba_transport_pcm *t_pcm) {
 	const size_t aptx_code_len = 2 * 3 * sizeof(uint8_t);
 	const size_t mtu_write = t->mtu_write;
 
-	if (ffb_init_int32_t(&pcm, aptx_pcm_samples * ((mtu_write - RTP_HEADER_LEN) / aptx_code_len)) == -1 ||
-			ffb_init_uint8_t(&bt, mtu_write) == -1) {
+	if (ffrb_init_int32_t(&pcm, aptx_pcm_samples * ((mtu_write - RTP_HEADER_LEN) / aptx_code_len)) == -1 ||
+			ffb_init_uint8_t(&bt, mtu_write) == -1 ||
+			io_bt_batch_init(&io, mtu_write) == -1 ||
+			io_asrc_init(&io, t_pcm, pcm.nmemb) == -1) {
 		error("Couldn't create data buffers: %s", strerror(errno));
 		goto fail_ffb;
 	}
@@ -146,11 +151,11 @@ void *a2dp_aptx_hd_enc_thread(struct ba_transport_pcm *t_pcm) {
 	debug_transport_pcm_thread_loop(t_pcm, "START");
 	for (ba_transport_thread_state_set_running(th);;) {
 
-		ssize_t samples = ffb_len_in(&pcm);
-		switch (samples = io_poll_and_read_pcm(&io, t_pcm, pcm.tail, samples)) {
+		ssize_t samples = ffrb_len_in(&pcm);
+		switch (samples = io_poll_and_read_pcm(&io, t_pcm, ffrb_tail(&pcm), samples)) {
 		case -1:
 			if (errno == ESTALE) {
-				ffb_rewind(&pcm);
+				ffrb_rewind(&pcm);
 				continue;
 			}
 			error("PCM poll and read error: %s", strerror(errno));
@@ -160,10 +165,10 @@ void *a2dp_aptx_hd_enc_thread(struct ba_transport_pcm *t_pcm) {
 			continue;
 		}
 
-		ffb_seek(&pcm, samples);
-		samples = ffb_len_out(&pcm);
+		ffrb_seek(&pcm, samples);
+		samples = ffrb_len_out(&pcm);
 
-		int32_t *input = pcm.data;
+		int32_t *input = ffrb_head(&pcm);
 		size_t input_samples = samples;
 
 		/* encode and transfer obtained data */
@@ -172,34 +177,26 @@ void *a2dp_aptx_hd_enc_thread(struct ba_transport_pcm *t_pcm) {
 			/* anchor for RTP payload */
 			bt.tail = rtp_payload;
 
-			size_t output_len = ffb_len_in(&bt);
-			size_t pcm_samples = 0;
-
 			/* Generate as many apt-X frames as possible to fill the output buffer
 			 * without overflowing it. The size of the output buffer is based on
 			 * the socket MTU, so such a transfer should be most efficient. */
-			while (input_samples >= aptx_pcm_samples && output_len >= aptx_code_len) {
-
-				size_t encoded = output_len;
-				ssize_t len;
-
-				if ((len = aptxhdenc_encode(handle, input, input_samples, bt.tail, &encoded)) <= 0) {
-					error("Apt-X HD encoding error: %s", strerror(errno));
-					break;
-				}
-
-				input += len;
-				input_samples -= len;
-				ffb_seek(&bt, encoded);
-				output_len -= encoded;
-				pcm_samples += len;
+			size_t encoded = ffb_len_in(&bt);
+			ssize_t len;
 
+			if ((len = aptxhdenc_encode_block(handle, input, input_samples, bt.tail, &encoded)) <= 0) {
+				error("Apt-X HD encoding error: %s", strerror(errno));
+				break;
 			}
 
+			const size_t pcm_samples = len;
+			input += len;
+			input_samples -= len;
+			ffb_seek(&bt, encoded);
+
 			rtp_state_new_frame(&rtp, rtp_header);
 
-			ssize_t len = ffb_blen_out(&bt);
-			if ((len = io_bt_write(th, bt.data, len)) <= 0) {
+			len = ffb_blen_out(&bt);
+			if ((len = io_bt_write_batch(&io, th, bt.data, len)) <= 0) {
 				if (len == -1)
 					error("BT write error: %s", strerror(errno));
 				goto fail;
@@ -207,7 +204,11 @@ void *a2dp_aptx_hd_enc_thread(struct ba_transport_pcm *t_pcm) {
 
 			unsigned int pcm_frames = pcm_samples / channels;
 			/* keep data transfer at a constant bit rate */
-			asrsync_sync(&io.asrs, pcm_frames);
+			if ((len = io_bt_batch_sync(&io, th, pcm_frames)) <= 0) {
+				if (len == -1)
+					error("BT write error: %s", strerror(errno));
+				goto fail;
+			}
 			/* move forward RTP timestamp clock */
 			rtp.ts_pcm_frames += pcm_frames;
 
@@ -219,11 +220,10 @@ void *a2dp_aptx_hd_enc_thread(struct ba_transport_pcm *t_pcm) {
 
 		}
 
-		/* If the input buffer was not consumed (due to codesize limit), we
-		 * have to append new data to the existing one. Since we do not use
-		 * ring buffer, we will simply move unprocessed data to the front
-		 * of our linear buffer. */
-		ffb_shift(&pcm, samples - input_samples);
+		/* If the input buffer was not consumed (due to codesize limit), the
+		 * unprocessed data will stay in the ring buffer and new data will
+		 * be appended to it. */
+		ffrb_shift(&pcm, samples - input_samples);
 
 	}
 
@@ -233,6 +233,8 @@ fail_ffb:
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
 fail_init:
 	pthread_cleanup_pop(1);
 	return NULL;
@@ -288,9 +290,12 @@ void *a2dp_aptx_hd_dec_thread(struct ba_transport_pcm *t_pcm) {
 
 		const uint8_t *rtp_payload;
 		const rtp_header_t *rtp_header = bt.data;
-		if ((rtp_payload = rtp_a2dp_get_payload(rtp_header)) == NULL)
+		if (!rtp_check_header_len(rtp_header, len) ||
+				(rtp_payload = rtp_a2dp_get_payload(rtp_header)) == NULL)
 			continue;
 
+		rtp_stats_update(&t_pcm->stats.rtp, rtp_header, rtp.ts_rtp_clockrate);
+
 		int missing_rtp_frames = 0;
 		rtp_state_sync_stream(&rtp, rtp_header, &missing_rtp_frames, NULL);
 
@@ -301,21 +306,20 @@ void *a2dp_aptx_hd_dec_thread(struct ba_transport_pcm *t_pcm) {
 
 		size_t rtp_payload_len = len - (rtp_payload - (uint8_t *)bt.data);
 
-		ffb_rewind(&pcm);
-		while (rtp_payload_len >= 6) {
-
-			size_t decoded = ffb_len_in(&pcm);
-			if ((len = aptxhddec_decode(handle, rtp_payload, rtp_payload_len, pcm.tail, &decoded)) <= 0) {
-				error("Apt-X decoding error: %s", strerror(errno));
-				continue;
-			}
+		if (rtp_payload_len < 6)
+			continue;
 
-			rtp_payload += len;
-			rtp_payload_len -= len;
-			ffb_seek(&pcm, decoded);
+		ffb_rewind(&pcm);
 
+		/* decode all apt-X HD frames at once */
+		size_t decoded = ffb_len_in(&pcm);
+		if ((len = aptxhddec_decode_block(handle, rtp_payload, rtp_payload_len, pcm.tail, &decoded)) <= 0) {
+			error("Apt-X HD decoding error: %s", strerror(errno));
+			continue;
 		}
 
+		ffb_seek(&pcm, decoded);
+
 		const size_t samples = ffb_len_out(&pcm);
 		io_pcm_scale(t_pcm, pcm.data, samples);
 		if (io_pcm_write(t_pcm, pcm.data, samples) == -1)
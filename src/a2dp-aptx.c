@@ -28,6 +28,7 @@
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 #include "shared/log.h"
 #include "shared/rt.h"
 
@@ -117,9 +118,11 @@ void *a2dp_aptx_enc_thread(struct ba_transport_pcm *t_pcm) {
 	}
 
 	ffb_t bt = { 0 };
-	ffb_t pcm = { 0 };
+	ffrb_t pcm = { 0 };
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &bt);
-	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(ffrb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(io_bt_batch_free), &io.bt_batch);
+	pthread_cleanup_push(PTHREAD_CLEANUP(asrc_free), &io.asrc);
 	pthread_cleanup_push(PTHREAD_CLEANUP(aptxenc_destroy), handle);
 
 	const unsigned int channels = t_pcm->channels;
@@ -127,8 +130,10 @@ void *a2dp_aptx_enc_thread(struct ba_transport_pcm *t_pcm) {
 	const size_t aptx_code_len = 2 * sizeof(uint16_t);
 	const size_t mtu_write = t->mtu_write;
 
-	if (ffb_init_int16_t(&pcm, aptx_pcm_samples * (mtu_write / aptx_code_len)) == -1 ||
-			ffb_init_uint8_t(&bt, mtu_write) == -1) {
+	if (ffrb_init_int16_t(&pcm, aptx_pcm_samples * (mtu_write / aptx_code_len)) == -1 ||
+			ffb_init_uint8_t(&bt, mtu_write) == -1 ||
+			io_bt_batch_init(&io, mtu_write) == -1 ||
+			io_asrc_init(&io, t_pcm, pcm.nmemb) == -1) {
 		error("Couldn't create data buffers: %s", strerror(errno));
 		goto fail_ffb;
 	}
@@ -136,11 +141,11 @@ void *a2dp_aptx_enc_thread(struct ba_transport_pcm *t_pcm) {
 	debug_transport_pcm_thread_loop(t_pcm, "START");
 	for (ba_transport_thread_state_set_running(th);;) {
 
-		ssize_t samples = ffb_len_in(&pcm);
-		switch (samples = io_poll_and_read_pcm(&io, t_pcm, pcm.tail, samples)) {
+		ssize_t samples = ffrb_len_in(&pcm);
+		switch (samples = io_poll_and_read_pcm(&io, t_pcm, ffrb_tail(&pcm), samples)) {
 		case -1:
 			if (errno == ESTALE) {
-				ffb_rewind(&pcm);
+				ffrb_rewind(&pcm);
 				continue;
 			}
 			error("PCM poll and read error: %s", strerror(errno));
@@ -150,48 +155,44 @@ void *a2dp_aptx_enc_thread(struct ba_transport_pcm *t_pcm) {
 			continue;
 		}
 
-		ffb_seek(&pcm, samples);
-		samples = ffb_len_out(&pcm);
+		ffrb_seek(&pcm, samples);
+		samples = ffrb_len_out(&pcm);
 
-		int16_t *input = pcm.data;
+		int16_t *input = ffrb_head(&pcm);
 		size_t input_samples = samples;
 
 		/* encode and transfer obtained data */
 		while (input_samples >= aptx_pcm_samples) {
 
-			size_t output_len = ffb_len_in(&bt);
-			size_t pcm_samples = 0;
-
 			/* Generate as many apt-X frames as possible to fill the output buffer
 			 * without overflowing it. The size of the output buffer is based on
 			 * the socket MTU, so such a transfer should be most efficient. */
-			while (input_samples >= aptx_pcm_samples && output_len >= aptx_code_len) {
-
-				size_t encoded = output_len;
-				ssize_t len;
-
-				if ((len = aptxenc_encode(handle, input, input_samples, bt.tail, &encoded)) <= 0) {
-					error("Apt-X encoding error: %s", strerror(errno));
-					break;
-				}
-
-				input += len;
-				input_samples -= len;
-				ffb_seek(&bt, encoded);
-				output_len -= encoded;
-				pcm_samples += len;
+			size_t encoded = ffb_len_in(&bt);
+			ssize_t len;
 
+			if ((len = aptxenc_encode_block(handle, input, input_samples, bt.tail, &encoded)) <= 0) {
+				error("Apt-X encoding error: %s", strerror(errno));
+				break;
 			}
 
-			ssize_t len = ffb_blen_out(&bt);
-			if ((len = io_bt_write(th, bt.data, len)) <= 0) {
+			const size_t pcm_samples = len;
+			input += len;
+			input_samples -= len;
+			ffb_seek(&bt, encoded);
+
+			len = ffb_blen_out(&bt);
+			if ((len = io_bt_write_batch(&io, th, bt.data, len)) <= 0) {
 				if (len == -1)
 					error("BT write error: %s", strerror(errno));
 				goto fail;
 			}
 
 			/* keep data transfer at a constant bit rate */
-			asrsync_sync(&io.asrs, pcm_samples / channels);
+			if ((len = io_bt_batch_sync(&io, th, pcm_samples / channels)) <= 0) {
+				if (len == -1)
+					error("BT write error: %s", strerror(errno));
+				goto fail;
+			}
 
 			/* update busy delay (encoding overhead) */
 			t_pcm->delay = asrsync_get_busy_usec(&io.asrs) / 100;
@@ -201,11 +202,10 @@ void *a2dp_aptx_enc_thread(struct ba_transport_pcm *t_pcm) {
 
 		}
 
-		/* If the input buffer was not consumed (due to codesize limit), we
-		 * have to append new data to the existing one. Since we do not use
-		 * ring buffer, we will simply move unprocessed data to the front
-		 * of our linear buffer. */
-		ffb_shift(&pcm, samples - input_samples);
+		/* If the input buffer was not consumed (due to codesize limit), the
+		 * unprocessed data will stay in the ring buffer and new data will
+		 * be appended to it. */
+		ffrb_shift(&pcm, samples - input_samples);
 
 	}
 
@@ -215,6 +215,8 @@ fail_ffb:
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
 fail_init:
 	pthread_cleanup_pop(1);
 	return NULL;
@@ -264,24 +266,20 @@ void *a2dp_aptx_dec_thread(struct ba_transport_pcm *t_pcm) {
 		if (!ba_transport_pcm_is_active(t_pcm))
 			continue;
 
-		uint8_t *input = bt.data;
-		size_t input_len = len;
+		if (len < 4)
+			continue;
 
 		ffb_rewind(&pcm);
-		while (input_len >= 4) {
-
-			size_t decoded = ffb_len_in(&pcm);
-			if ((len = aptxdec_decode(handle, input, input_len, pcm.tail, &decoded)) <= 0) {
-				error("Apt-X decoding error: %s", strerror(errno));
-				continue;
-			}
-
-			input += len;
-			input_len -= len;
-			ffb_seek(&pcm, decoded);
 
+		/* decode all apt-X frames at once */
+		size_t decoded = ffb_len_in(&pcm);
+		if ((len = aptxdec_decode_block(handle, bt.data, len, pcm.tail, &decoded)) <= 0) {
+			error("Apt-X decoding error: %s", strerror(errno));
+			continue;
 		}
 
+		ffb_seek(&pcm, decoded);
+
 		const size_t samples = ffb_len_out(&pcm);
 		io_pcm_scale(t_pcm, pcm.data, samples);
 		if (io_pcm_write(t_pcm, pcm.data, samples) == -1)
@@ -29,6 +29,7 @@
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 #include "shared/log.h"
 #include "shared/rt.h"
 
@@ -126,17 +127,21 @@ void *a2dp_faststream_enc_thread(struct ba_transport_pcm *t_pcm) {
 	}
 
 	ffb_t bt = { 0 };
-	ffb_t pcm = { 0 };
+	ffrb_t pcm = { 0 };
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &bt);
-	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(ffrb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(io_bt_batch_free), &io.bt_batch);
+	pthread_cleanup_push(PTHREAD_CLEANUP(asrc_free), &io.asrc);
 	pthread_cleanup_push(PTHREAD_CLEANUP(sbc_finish), &sbc);
 
 	const unsigned int channels = t_pcm->channels;
 	const size_t sbc_frame_len = sbc_get_frame_length(&sbc);
 	const size_t sbc_frame_samples = sbc_get_codesize(&sbc) / sizeof(int16_t);
 
-	if (ffb_init_int16_t(&pcm, sbc_frame_samples * 3) == -1 ||
-			ffb_init_uint8_t(&bt, t->mtu_write) == -1) {
+	if (ffrb_init_int16_t(&pcm, sbc_frame_samples * 3) == -1 ||
+			ffb_init_uint8_t(&bt, t->mtu_write) == -1 ||
+			io_bt_batch_init(&io, t->mtu_write) == -1 ||
+			io_asrc_init(&io, t_pcm, pcm.nmemb) == -1) {
 		error("Couldn't create data buffers: %s", strerror(ENOMEM));
 		goto fail_ffb;
 	}
@@ -144,13 +149,13 @@ void *a2dp_faststream_enc_thread(struct ba_transport_pcm *t_pcm) {
 	debug_transport_pcm_thread_loop(t_pcm, "START");
 	for (ba_transport_thread_state_set_running(th);;) {
 
-		ssize_t samples = ffb_len_in(&pcm);
-		switch (samples = io_poll_and_read_pcm(&io, t_pcm, pcm.tail, samples)) {
+		ssize_t samples = ffrb_len_in(&pcm);
+		switch (samples = io_poll_and_read_pcm(&io, t_pcm, ffrb_tail(&pcm), samples)) {
 		case -1:
 			if (errno == ESTALE) {
 				sbc_reinit_a2dp_faststream(&sbc, 0, configuration,
 						sizeof(*configuration), is_voice);
-				ffb_rewind(&pcm);
+				ffrb_rewind(&pcm);
 				continue;
 			}
 			error("PCM poll and read error: %s", strerror(errno));
@@ -160,10 +165,10 @@ void *a2dp_faststream_enc_thread(struct ba_transport_pcm *t_pcm) {
 			continue;
 		}
 
-		ffb_seek(&pcm, samples);
-		samples = ffb_len_out(&pcm);
+		ffrb_seek(&pcm, samples);
+		samples = ffrb_len_out(&pcm);
 
-		const int16_t *input = pcm.data;
+		const int16_t *input = ffrb_head(&pcm);
 		size_t input_len = samples;
 		size_t output_len = ffb_len_in(&bt);
 		size_t pcm_frames = 0;
@@ -195,7 +200,7 @@ void *a2dp_faststream_enc_thread(struct ba_transport_pcm *t_pcm) {
 		if (sbc_frames > 0) {
 
 			ssize_t len = ffb_blen_out(&bt);
-			if ((len = io_bt_write(th, bt.data, len)) <= 0) {
+			if ((len = io_bt_write_batch(&io, th, bt.data, len)) <= 0) {
 				if (len == -1)
 					error("BT write error: %s", strerror(errno));
 				goto fail;
@@ -205,16 +210,19 @@ void *a2dp_faststream_enc_thread(struct ba_transport_pcm *t_pcm) {
 			ffb_rewind(&bt);
 
 			/* keep data transfer at a constant bit rate */
-			asrsync_sync(&io.asrs, pcm_frames);
+			if ((len = io_bt_batch_sync(&io, th, pcm_frames)) <= 0) {
+				if (len == -1)
+					error("BT write error: %s", strerror(errno));
+				goto fail;
+			}
 
 			/* update busy delay (encoding overhead) */
 			t_pcm->delay = asrsync_get_busy_usec(&io.asrs) / 100;
 
-			/* If the input buffer was not consumed (due to codesize limit), we
-			 * have to append new data to the existing one. Since we do not use
-			 * ring buffer, we will simply move unprocessed data to the front
-			 * of our linear buffer. */
-			ffb_shift(&pcm, samples - input_len);
+			/* If the input buffer was not consumed (due to codesize limit), the
+			 * unprocessed data will stay in the ring buffer and new data will
+			 * be appended to it. */
+			ffrb_shift(&pcm, samples - input_len);
 
 		}
 
@@ -226,6 +234,8 @@ fail_ffb:
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
 fail_init:
 	pthread_cleanup_pop(1);
 	return NULL;
@@ -34,8 +34,10 @@
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 #include "shared/log.h"
 #include "shared/rt.h"
+#include "shared/trace.h"
 
 static const struct a2dp_channel_mode a2dp_lc3plus_channels[] = {
 	{ A2DP_CHM_MONO, 1, LC3PLUS_CHANNELS_1 },
@@ -210,9 +212,11 @@ void *a2dp_lc3plus_enc_thread(struct ba_transport_pcm *t_pcm) {
 	}
 
 	ffb_t bt = { 0 };
-	ffb_t pcm = { 0 };
+	ffrb_t pcm = { 0 };
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &bt);
-	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(ffrb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(io_bt_batch_free), &io.bt_batch);
+	pthread_cleanup_push(PTHREAD_CLEANUP(asrc_free), &io.asrc);
 
 	const size_t lc3plus_ch_samples = lc3plus_enc_get_input_samples(handle);
 	const size_t lc3plus_frame_samples = lc3plus_ch_samples * channels;
@@ -237,8 +241,10 @@ void *a2dp_lc3plus_enc_thread(struct ba_transport_pcm *t_pcm) {
 	pthread_cleanup_push(PTHREAD_CLEANUP(free), pcm_ch1);
 	pthread_cleanup_push(PTHREAD_CLEANUP(free), pcm_ch2);
 
-	if (ffb_init_int32_t(&pcm, ffb_pcm_len) == -1 ||
+	if (ffrb_init_int32_t(&pcm, ffb_pcm_len) == -1 ||
 			ffb_init_uint8_t(&bt, ffb_bt_len) == -1 ||
+			io_bt_batch_init(&io, t->mtu_write) == -1 ||
+			io_asrc_init(&io, t_pcm, pcm.nmemb) == -1 ||
 			pcm_ch1 == NULL || pcm_ch2 == NULL) {
 		error("Couldn't create data buffers: %s", strerror(errno));
 		goto fail_ffb;
@@ -257,8 +263,8 @@ void *a2dp_lc3plus_enc_thread(struct ba_transport_pcm *t_pcm) {
 	debug_transport_pcm_thread_loop(t_pcm, "START");
 	for (ba_transport_thread_state_set_running(th);;) {
 
-		ssize_t samples = ffb_len_in(&pcm);
-		switch (samples = io_poll_and_read_pcm(&io, t_pcm, pcm.tail, samples)) {
+		ssize_t samples = ffrb_len_in(&pcm);
+		switch (samples = io_poll_and_read_pcm(&io, t_pcm, ffrb_tail(&pcm), samples)) {
 		case -1:
 			if (errno == ESTALE) {
 				int encoded = 0;
@@ -267,7 +273,7 @@ void *a2dp_lc3plus_enc_thread(struct ba_transport_pcm *t_pcm) {
 				memset(pcm_ch2, 0, lc3plus_ch_samples * sizeof(*pcm_ch2));
 				/* flush encoder internal buffers by feeding it with silence */
 				lc3plus_enc24(handle, pcm_ch_buffers, rtp_payload, &encoded, scratch);
-				ffb_rewind(&pcm);
+				ffrb_rewind(&pcm);
 				continue;
 			}
 			error("PCM poll and read error: %s", strerror(errno));
@@ -277,13 +283,13 @@ void *a2dp_lc3plus_enc_thread(struct ba_transport_pcm *t_pcm) {
 			continue;
 		}
 
-		ffb_seek(&pcm, samples);
-		samples = ffb_len_out(&pcm);
+		ffrb_seek(&pcm, samples);
+		samples = ffrb_len_out(&pcm);
 
 		/* anchor for RTP payload */
 		bt.tail = rtp_payload;
 
-		const int32_t *input = pcm.data;
+		const int32_t *input = ffrb_head(&pcm);
 		size_t input_samples = samples;
 		size_t output_len = ffb_len_in(&bt);
 		size_t pcm_frames = 0;
@@ -316,67 +322,58 @@ void *a2dp_lc3plus_enc_thread(struct ba_transport_pcm *t_pcm) {
 
 		if (lc3plus_frames > 0) {
 
-			size_t payload_len_max = t->mtu_write - rtp_headers_len;
-			size_t payload_len = ffb_blen_out(&bt) - rtp_headers_len;
-			memset(rtp_media_header, 0, sizeof(*rtp_media_header));
-			rtp_media_header->frame_count = lc3plus_frames;
+			struct rtp_packetizer pkt;
+			rtp_packetizer_init(&pkt, rtp_header, rtp_headers_len,
+					rtp_payload, ffb_blen_out(&bt) - rtp_headers_len, t->mtu_write);
 
 			/* If the size of the RTP packet exceeds writing MTU, the RTP payload
 			 * should be fragmented. The fragmentation scheme is defined by the
 			 * vendor specific LC3plus Bluetooth A2DP specification. */
+			const bool fragmented = rtp_packetizer_remaining(&pkt) > 1;
 
-			if (payload_len > payload_len_max) {
-				rtp_media_header->fragmented = 1;
-				rtp_media_header->first_fragment = 1;
-				rtp_media_header->frame_count = DIV_ROUND_UP(payload_len, payload_len_max);
-			}
+			while (rtp_packetizer_next(&pkt)) {
 
-			for (;;) {
+				memset(rtp_media_header, 0, sizeof(*rtp_media_header));
+				rtp_media_header->frame_count = lc3plus_frames;
 
-				size_t chunk_len;
-				chunk_len = payload_len > payload_len_max ? payload_len_max : payload_len;
-				rtp_state_new_frame(&rtp, rtp_header);
+				if (fragmented) {
+					rtp_media_header->fragmented = 1;
+					rtp_media_header->first_fragment = rtp_packetizer_is_first(&pkt);
+					rtp_media_header->last_fragment = rtp_packetizer_is_last(&pkt);
+					/* number of remaining fragments (including this one) */
+					rtp_media_header->frame_count = rtp_packetizer_remaining(&pkt);
+					if (!rtp_packetizer_is_first(&pkt))
+						trace(TRACE_EVENT_RTP_FRAGMENT, pkt.offset, pkt.payload_len, 0);
+				}
 
-				ffb_rewind(&bt);
-				ffb_seek(&bt, rtp_headers_len + chunk_len);
+				rtp_state_new_frame(&rtp, rtp_header);
 
-				ssize_t len = ffb_blen_out(&bt);
-				if ((len = io_bt_write(th, bt.data, len)) <= 0) {
+				ssize_t len;
+				if ((len = io_bt_writev_batch(&io, th, pkt.iov, ARRAYSIZE(pkt.iov))) <= 0) {
 					if (len == -1)
 						error("BT write error: %s", strerror(errno));
 					goto fail;
 				}
 
-				/* resend RTP headers */
-				len -= rtp_headers_len;
-
-				/* break if there is no more payload data */
-				if ((payload_len -= len) == 0)
-					break;
-
-				/* move the rest of data to the beginning of payload */
-				debug("LC3plus payload fragmentation: extra %zu bytes", payload_len);
-				memmove(rtp_payload, rtp_payload + len, payload_len);
-
-				rtp_media_header->first_fragment = 0;
-				rtp_media_header->last_fragment = payload_len <= payload_len_max;
-				rtp_media_header->frame_count--;
-
 			}
 
+			ssize_t len;
 			/* keep data transfer at a constant bit rate */
-			asrsync_sync(&io.asrs, pcm_frames);
+			if ((len = io_bt_batch_sync(&io, th, pcm_frames)) <= 0) {
+				if (len == -1)
+					error("BT write error: %s", strerror(errno));
+				goto fail;
+			}
 			/* move forward RTP timestamp clock */
 			rtp_state_update(&rtp, pcm_frames);
 
 			/* update busy delay (encoding overhead) */
 			t_pcm->delay = asrsync_get_busy_usec(&io.asrs) / 100;
 
-			/* If the input buffer was not consumed (due to codesize limit), we
-			 * have to append new data to the existing one. Since we do not use
-			 * ring buffer, we will simply move unprocessed data to the front
-			 * of our linear buffer. */
-			ffb_shift(&pcm, samples - input_samples);
+			/* If the input buffer was not consumed (due to codesize limit), the
+			 * unprocessed data will stay in the ring buffer and new data will
+			 * be appended to it. */
+			ffrb_shift(&pcm, samples - input_samples);
 
 		}
 
@@ -389,6 +386,8 @@ fail_ffb:
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
 fail_setup:
 	pthread_cleanup_pop(1);
 fail_init:
@@ -477,9 +476,12 @@ void *a2dp_lc3plus_dec_thread(struct ba_transport_pcm *t_pcm) {
 
 		const rtp_header_t *rtp_header = bt.data;
 		const rtp_media_header_t *rtp_media_header;
-		if ((rtp_media_header = rtp_a2dp_get_payload(rtp_header)) == NULL)
+		if (!rtp_check_header_len(rtp_header, len) ||
+				(rtp_media_header = rtp_a2dp_get_payload(rtp_header)) == NULL)
 			continue;
 
+		rtp_stats_update(&t_pcm->stats.rtp, rtp_header, rtp.ts_rtp_clockrate);
+
 		int missing_rtp_frames = 0;
 		int missing_pcm_frames = 0;
 		rtp_state_sync_stream(&rtp, rtp_header, &missing_rtp_frames, &missing_pcm_frames);
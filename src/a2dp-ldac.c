@@ -26,6 +26,7 @@
 #include <ldacBT_abr.h>
 
 #include "a2dp.h"
+#include "ba-device.h"
 #include "ba-transport-pcm.h"
 #include "bluealsa-config.h"
 #include "io.h"
@@ -34,6 +35,7 @@
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 #include "shared/log.h"
 #include "shared/rt.h"
 
@@ -116,6 +118,75 @@ void a2dp_ldac_transport_init(struct ba_transport *t) {
 
 }
 
+/**
+ * LDAC encoder handles kept in the device codec cache. */
+struct ldac_enc_handles {
+	HANDLE_LDAC_BT bt;
+	HANDLE_LDAC_ABR abr;
+};
+
+struct ldac_enc_ctx {
+	struct ba_transport *t;
+	a2dp_ldac_t configuration;
+	struct ldac_enc_handles *handles;
+	/* handles were initialized successfully */
+	bool ready;
+};
+
+static void ldac_enc_handles_free(void *ptr) {
+	struct ldac_enc_handles *handles = ptr;
+	if (handles->bt != NULL)
+		ldacBT_free_handle(handles->bt);
+	if (handles->abr != NULL)
+		ldac_ABR_free_handle(handles->abr);
+	free(handles);
+}
+
+/**
+ * Get LDAC encoder handles.
+ *
+ * The LDAC library can not reset the encoder state, however, a closed
+ * handle can be initialized again. So, if there are cached handles of the
+ * previous stream, they are reused instead of allocating new ones. */
+static int ldac_enc_ctx_init(struct ldac_enc_ctx *ctx, struct ba_transport *t) {
+
+	ctx->t = t;
+	ctx->configuration = t->a2dp.configuration.ldac;
+	ctx->ready = false;
+
+	if ((ctx->handles = ba_device_codec_cache_take(t->d, t->profile,
+					A2DP_CODEC_VENDOR_LDAC, true, &ctx->configuration,
+					sizeof(ctx->configuration))) != NULL)
+		return 0;
+
+	if ((ctx->handles = calloc(1, sizeof(*ctx->handles))) == NULL)
+		return -1;
+
+	if ((ctx->handles->bt = ldacBT_get_handle()) == NULL ||
+			(ctx->handles->abr = ldac_ABR_get_handle()) == NULL) {
+		ldac_enc_handles_free(ctx->handles);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Move LDAC encoder handles to the device codec cache. */
+static void ldac_enc_ctx_release(struct ldac_enc_ctx *ctx) {
+
+	if (!ctx->ready) {
+		ldac_enc_handles_free(ctx->handles);
+		return;
+	}
+
+	ldacBT_close_handle(ctx->handles->bt);
+	ba_device_codec_cache_store(ctx->t->d, ctx->t->profile, A2DP_CODEC_VENDOR_LDAC,
+			true, &ctx->configuration, sizeof(ctx->configuration),
+			ctx->handles, ldac_enc_handles_free);
+
+}
+
 void *a2dp_ldac_enc_thread(struct ba_transport_pcm *t_pcm) {
 
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
@@ -125,21 +196,16 @@ void *a2dp_ldac_enc_thread(struct ba_transport_pcm *t_pcm) {
 	struct ba_transport_thread *th = t_pcm->th;
 	struct io_poll io = { .timeout = -1 };
 
-	HANDLE_LDAC_BT handle;
-	if ((handle = ldacBT_get_handle()) == NULL) {
-		error("Couldn't get LDAC handle: %s", strerror(errno));
+	struct ldac_enc_ctx ctx;
+	if (ldac_enc_ctx_init(&ctx, t) == -1) {
+		error("Couldn't get LDAC handles: %s", strerror(errno));
 		goto fail_open_ldac;
 	}
 
-	pthread_cleanup_push(PTHREAD_CLEANUP(ldacBT_free_handle), handle);
-
-	HANDLE_LDAC_ABR handle_abr;
-	if ((handle_abr = ldac_ABR_get_handle()) == NULL) {
-		error("Couldn't get LDAC ABR handle: %s", strerror(errno));
-		goto fail_open_ldac_abr;
-	}
+	pthread_cleanup_push(PTHREAD_CLEANUP(ldac_enc_ctx_release), &ctx);
 
-	pthread_cleanup_push(PTHREAD_CLEANUP(ldac_ABR_free_handle), handle_abr);
+	HANDLE_LDAC_BT handle = ctx.handles->bt;
+	HANDLE_LDAC_ABR handle_abr = ctx.handles->abr;
 
 	const a2dp_ldac_t *configuration = &t->a2dp.configuration.ldac;
 	const size_t sample_size = BA_TRANSPORT_PCM_FORMAT_BYTES(t_pcm->format);
@@ -162,13 +228,19 @@ void *a2dp_ldac_enc_thread(struct ba_transport_pcm *t_pcm) {
 		goto fail_init;
 	}
 
+	ctx.ready = true;
+
 	ffb_t bt = { 0 };
-	ffb_t pcm = { 0 };
+	ffrb_t pcm = { 0 };
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &bt);
-	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
-
-	if (ffb_init_int32_t(&pcm, ldac_pcm_samples) == -1 ||
-			ffb_init_uint8_t(&bt, t->mtu_write) == -1) {
+	pthread_cleanup_push(PTHREAD_CLEANUP(ffrb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(io_bt_batch_free), &io.bt_batch);
+	pthread_cleanup_push(PTHREAD_CLEANUP(asrc_free), &io.asrc);
+
+	if (ffrb_init_int32_t(&pcm, ldac_pcm_samples) == -1 ||
+			ffb_init_uint8_t(&bt, t->mtu_write) == -1 ||
+			io_bt_batch_init(&io, t->mtu_write) == -1 ||
+			io_asrc_init(&io, t_pcm, pcm.nmemb) == -1) {
 		error("Couldn't create data buffers: %s", strerror(errno));
 		goto fail_ffb;
 	}
@@ -186,14 +258,14 @@ void *a2dp_ldac_enc_thread(struct ba_transport_pcm *t_pcm) {
 	debug_transport_pcm_thread_loop(t_pcm, "START");
 	for (ba_transport_thread_state_set_running(th);;) {
 
-		ssize_t samples = ffb_len_in(&pcm);
-		switch (samples = io_poll_and_read_pcm(&io, t_pcm, pcm.tail, samples)) {
+		ssize_t samples = ffrb_len_in(&pcm);
+		switch (samples = io_poll_and_read_pcm(&io, t_pcm, ffrb_tail(&pcm), samples)) {
 		case -1:
 			if (errno == ESTALE) {
 				int tmp;
 				/* flush encoder internal buffers */
 				ldacBT_encode(handle, NULL, &tmp, rtp_payload, &tmp, &tmp);
-				ffb_rewind(&pcm);
+				ffrb_rewind(&pcm);
 				continue;
 			}
 			error("PCM poll and read error: %s", strerror(errno));
@@ -203,10 +275,10 @@ void *a2dp_ldac_enc_thread(struct ba_transport_pcm *t_pcm) {
 			continue;
 		}
 
-		ffb_seek(&pcm, samples);
-		samples = ffb_len_out(&pcm);
+		ffrb_seek(&pcm, samples);
+		samples = ffrb_len_out(&pcm);
 
-		int16_t *input = pcm.data;
+		int16_t *input = ffrb_head(&pcm);
 		size_t input_len = samples;
 
 		/* encode and transfer obtained data */
@@ -244,7 +316,7 @@ void *a2dp_ldac_enc_thread(struct ba_transport_pcm *t_pcm) {
 				errno = 0;
 
 				ssize_t len = ffb_blen_out(&bt);
-				if ((len = io_bt_write(th, bt.data, len)) <= 0) {
+				if ((len = io_bt_write_batch(&io, th, bt.data, len)) <= 0) {
 					if (len == -1)
 						error("BT write error: %s", strerror(errno));
 					goto fail;
@@ -262,8 +334,13 @@ void *a2dp_ldac_enc_thread(struct ba_transport_pcm *t_pcm) {
 			}
 
 			unsigned int pcm_frames = pcm_samples / channels;
+			ssize_t len;
 			/* keep data transfer at a constant bit rate */
-			asrsync_sync(&io.asrs, pcm_frames);
+			if ((len = io_bt_batch_sync(&io, th, pcm_frames)) <= 0) {
+				if (len == -1)
+					error("BT write error: %s", strerror(errno));
+				goto fail;
+			}
 			/* move forward RTP timestamp clock */
 			rtp_state_update(&rtp, pcm_frames);
 
@@ -272,11 +349,10 @@ void *a2dp_ldac_enc_thread(struct ba_transport_pcm *t_pcm) {
 
 		}
 
-		/* If the input buffer was not consumed (due to codesize limit), we
-		 * have to append new data to the existing one. Since we do not use
-		 * ring buffer, we will simply move unprocessed data to the front
-		 * of our linear buffer. */
-		ffb_shift(&pcm, samples - input_len);
+		/* If the input buffer was not consumed (due to codesize limit), the
+		 * unprocessed data will stay in the ring buffer and new data will
+		 * be appended to it. */
+		ffrb_shift(&pcm, samples - input_len);
 
 	}
 
@@ -285,9 +361,9 @@ fail:
 fail_ffb:
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
-fail_init:
 	pthread_cleanup_pop(1);
-fail_open_ldac_abr:
+	pthread_cleanup_pop(1);
+fail_init:
 	pthread_cleanup_pop(1);
 fail_open_ldac:
 	pthread_cleanup_pop(1);
@@ -350,9 +426,12 @@ void *a2dp_ldac_dec_thread(struct ba_transport_pcm *t_pcm) {
 
 		const rtp_header_t *rtp_header = bt.data;
 		const rtp_media_header_t *rtp_media_header;
-		if ((rtp_media_header = rtp_a2dp_get_payload(rtp_header)) == NULL)
+		if (!rtp_check_header_len(rtp_header, len) ||
+				(rtp_media_header = rtp_a2dp_get_payload(rtp_header)) == NULL)
 			continue;
 
+		rtp_stats_update(&t_pcm->stats.rtp, rtp_header, rtp.ts_rtp_clockrate);
+
 		int missing_rtp_frames = 0;
 		rtp_state_sync_stream(&rtp, rtp_header, &missing_rtp_frames, NULL);
 
@@ -38,8 +38,10 @@
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 #include "shared/log.h"
 #include "shared/rt.h"
+#include "shared/trace.h"
 
 static const struct a2dp_channel_mode a2dp_mpeg_channels[] = {
 	{ A2DP_CHM_MONO, 1, MPEG_CHANNEL_MODE_MONO },
@@ -278,9 +280,11 @@ void *a2dp_mp3_enc_thread(struct ba_transport_pcm *t_pcm) {
 	}
 
 	ffb_t bt = { 0 };
-	ffb_t pcm = { 0 };
+	ffrb_t pcm = { 0 };
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &bt);
-	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(ffrb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(io_bt_batch_free), &io.bt_batch);
+	pthread_cleanup_push(PTHREAD_CLEANUP(asrc_free), &io.asrc);
 
 	const size_t mpeg_pcm_samples = lame_get_framesize(handle);
 	const size_t rtp_headers_len = RTP_HEADER_LEN + sizeof(rtp_mpeg_audio_header_t);
@@ -289,8 +293,10 @@ void *a2dp_mp3_enc_thread(struct ba_transport_pcm *t_pcm) {
 	 * function requires a little bit more space. */
 	const size_t mpeg_frame_len = 4 * 1024;
 
-	if (ffb_init_int16_t(&pcm, mpeg_pcm_samples) == -1 ||
-			ffb_init_uint8_t(&bt, rtp_headers_len + mpeg_frame_len) == -1) {
+	if (ffrb_init_int16_t(&pcm, mpeg_pcm_samples) == -1 ||
+			ffb_init_uint8_t(&bt, rtp_headers_len + mpeg_frame_len) == -1 ||
+			io_bt_batch_init(&io, t->mtu_write) == -1 ||
+			io_asrc_init(&io, t_pcm, pcm.nmemb) == -1) {
 		error("Couldn't create data buffers: %s", strerror(errno));
 		goto fail_ffb;
 	}
@@ -308,12 +314,12 @@ void *a2dp_mp3_enc_thread(struct ba_transport_pcm *t_pcm) {
 	debug_transport_pcm_thread_loop(t_pcm, "START");
 	for (ba_transport_thread_state_set_running(th);;) {
 
-		ssize_t samples = ffb_len_in(&pcm);
-		switch (samples = io_poll_and_read_pcm(&io, t_pcm, pcm.tail, samples)) {
+		ssize_t samples = ffrb_len_in(&pcm);
+		switch (samples = io_poll_and_read_pcm(&io, t_pcm, ffrb_tail(&pcm), samples)) {
 		case -1:
 			if (errno == ESTALE) {
 				lame_encode_flush(handle, rtp_payload, mpeg_frame_len);
-				ffb_rewind(&pcm);
+				ffrb_rewind(&pcm);
 				continue;
 			}
 			error("PCM poll and read error: %s", strerror(errno));
@@ -323,8 +329,8 @@ void *a2dp_mp3_enc_thread(struct ba_transport_pcm *t_pcm) {
 			continue;
 		}
 
-		ffb_seek(&pcm, samples);
-		samples = ffb_len_out(&pcm);
+		ffrb_seek(&pcm, samples);
+		samples = ffrb_len_out(&pcm);
 
 		/* anchor for RTP payload */
 		bt.tail = rtp_payload;
@@ -333,64 +339,53 @@ void *a2dp_mp3_enc_thread(struct ba_transport_pcm *t_pcm) {
 		ssize_t len;
 
 		if ((len = channels == 1 ?
-					lame_encode_buffer(handle, pcm.data, NULL, pcm_frames, bt.tail, ffb_len_in(&bt)) :
-					lame_encode_buffer_interleaved(handle, pcm.data, pcm_frames, bt.tail, ffb_len_in(&bt))) < 0) {
+					lame_encode_buffer(handle, ffrb_head(&pcm), NULL, pcm_frames, bt.tail, ffb_len_in(&bt)) :
+					lame_encode_buffer_interleaved(handle, ffrb_head(&pcm), pcm_frames, bt.tail, ffb_len_in(&bt))) < 0) {
 			error("LAME encoding error: %s", lame_encode_strerror(len));
 			continue;
 		}
 
 		if (len > 0) {
 
-			size_t payload_len_max = t->mtu_write - RTP_HEADER_LEN - sizeof(*rtp_mpeg_audio_header);
-			size_t payload_len_total = len;
-			size_t payload_len = len;
+			struct rtp_packetizer pkt;
+			rtp_packetizer_init(&pkt, rtp_header, rtp_headers_len,
+					rtp_payload, len, t->mtu_write);
 
-			for (;;) {
+			while (rtp_packetizer_next(&pkt)) {
 
-				size_t chunk_len;
-				chunk_len = payload_len > payload_len_max ? payload_len_max : payload_len;
-				rtp_header->markbit = payload_len <= payload_len_max;
+				rtp_header->markbit = rtp_packetizer_is_last(&pkt);
 				rtp_state_new_frame(&rtp, rtp_header);
-				rtp_mpeg_audio_header->offset = payload_len_total - payload_len;
+				rtp_mpeg_audio_header->offset = pkt.offset;
 
-				ffb_rewind(&bt);
-				ffb_seek(&bt, RTP_HEADER_LEN + sizeof(*rtp_mpeg_audio_header) + chunk_len);
+				if (!rtp_packetizer_is_first(&pkt))
+					trace(TRACE_EVENT_RTP_FRAGMENT, pkt.offset, pkt.payload_len, 0);
 
-				len = ffb_blen_out(&bt);
-				if ((len = io_bt_write(th, bt.data, len)) <= 0) {
+				if ((len = io_bt_writev_batch(&io, th, pkt.iov, ARRAYSIZE(pkt.iov))) <= 0) {
 					if (len == -1)
 						error("BT write error: %s", strerror(errno));
 					goto fail;
 				}
 
-				/* account written payload only */
-				len -= RTP_HEADER_LEN + sizeof(*rtp_mpeg_audio_header);
-
-				/* break if the last part of the payload has been written */
-				if ((payload_len -= len) == 0)
-					break;
-
-				/* move rest of data to the beginning of the payload */
-				debug("Payload fragmentation: extra %zd bytes", payload_len);
-				memmove(rtp_payload, rtp_payload + len, payload_len);
-
 			}
 
 		}
 
 		/* keep data transfer at a constant bit rate */
-		asrsync_sync(&io.asrs, pcm_frames);
+		if ((len = io_bt_batch_sync(&io, th, pcm_frames)) <= 0) {
+			if (len == -1)
+				error("BT write error: %s", strerror(errno));
+			goto fail;
+		}
 		/* move forward RTP timestamp clock */
 		rtp_state_update(&rtp, pcm_frames);
 
 		/* update busy delay (encoding overhead) */
 		t_pcm->delay = asrsync_get_busy_usec(&io.asrs) / 100;
 
-		/* If the input buffer was not consumed (due to frame alignment), we
-		 * have to append new data to the existing one. Since we do not use
-		 * ring buffer, we will simply move unprocessed data to the front
-		 * of our linear buffer. */
-		ffb_shift(&pcm, pcm_frames * channels);
+		/* If the input buffer was not consumed (due to frame alignment), the
+		 * unprocessed data will stay in the ring buffer and new data will
+		 * be appended to it. */
+		ffrb_shift(&pcm, pcm_frames * channels);
 
 	}
 
@@ -399,6 +394,8 @@ fail:
 fail_ffb:
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
 fail_setup:
 	pthread_cleanup_pop(1);
 fail_init:
@@ -501,9 +498,12 @@ void *a2dp_mpeg_dec_thread(struct ba_transport_pcm *t_pcm) {
 
 		const rtp_header_t *rtp_header = bt.data;
 		const rtp_mpeg_audio_header_t *rtp_mpeg_header;
-		if ((rtp_mpeg_header = rtp_a2dp_get_payload(rtp_header)) == NULL)
+		if (!rtp_check_header_len(rtp_header, len) ||
+				(rtp_mpeg_header = rtp_a2dp_get_payload(rtp_header)) == NULL)
 			continue;
 
+		rtp_stats_update(&t_pcm->stats.rtp, rtp_header, rtp.ts_rtp_clockrate);
+
 		int missing_rtp_frames = 0;
 		rtp_state_sync_stream(&rtp, rtp_header, &missing_rtp_frames, NULL);
 
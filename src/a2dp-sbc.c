@@ -16,6 +16,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
@@ -24,14 +25,18 @@
 #include <sbc/sbc.h>
 
 #include "a2dp.h"
+#include "audio-plc.h"
+#include "ba-device.h"
 #include "ba-transport-pcm.h"
 #include "bluealsa-config.h"
+#include "bluealsa-dbus.h"
 #include "codec-sbc.h"
 #include "io.h"
 #include "rtp.h"
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 #include "shared/log.h"
 #include "shared/rt.h"
 
@@ -154,6 +159,97 @@ void a2dp_sbc_transport_init(struct ba_transport *t) {
 
 }
 
+/**
+ * Adjust selected SBC configuration for the low-latency mode.
+ *
+ * The duration of the SBC frame is the product of the number of blocks and
+ * the number of sub-bands. In order to minimize the encoding latency, the
+ * smallest values supported by both sides are selected.
+ *
+ * @param codec Local SBC codec.
+ * @param configuration Selected SBC configuration which shall be adjusted.
+ * @param capabilities Capabilities of the remote SEP. */
+void a2dp_sbc_select_low_latency(
+		const struct a2dp_codec *codec,
+		a2dp_sbc_t *configuration,
+		const a2dp_sbc_t *capabilities) {
+
+	const uint8_t block_length = capabilities->block_length &
+		codec->capabilities.sbc.block_length;
+	if (block_length & SBC_BLOCK_LENGTH_4)
+		configuration->block_length = SBC_BLOCK_LENGTH_4;
+	else if (block_length & SBC_BLOCK_LENGTH_8)
+		configuration->block_length = SBC_BLOCK_LENGTH_8;
+	else if (block_length & SBC_BLOCK_LENGTH_12)
+		configuration->block_length = SBC_BLOCK_LENGTH_12;
+
+	const uint8_t subbands = capabilities->subbands &
+		codec->capabilities.sbc.subbands;
+	if (subbands & SBC_SUBBANDS_4)
+		configuration->subbands = SBC_SUBBANDS_4;
+
+}
+
+/**
+ * Get the bitrate of the SBC stream in bits per second. */
+static unsigned int a2dp_sbc_get_bitrate(sbc_t *sbc) {
+	return 8000000ULL * sbc_get_frame_length(sbc) / sbc_get_frame_duration(sbc);
+}
+
+struct sbc_codec_ctx {
+	struct ba_transport *t;
+	a2dp_sbc_t configuration;
+	bool encoder;
+	sbc_t *sbc;
+};
+
+static void sbc_handle_free(void *sbc) {
+	sbc_finish(sbc);
+	free(sbc);
+}
+
+/**
+ * Initialize SBC codec context.
+ *
+ * If there is a cached context initialized with the same configuration, it
+ * is reused instead of allocating a new one. */
+static int sbc_codec_ctx_init(struct sbc_codec_ctx *ctx, struct ba_transport *t,
+		bool encoder, sbc_t *sbc) {
+
+	ctx->t = t;
+	ctx->configuration = t->a2dp.configuration.sbc;
+	ctx->encoder = encoder;
+	ctx->sbc = sbc;
+
+	sbc_t *cached;
+	if ((cached = ba_device_codec_cache_take(t->d, t->profile, A2DP_CODEC_SBC, encoder,
+					&ctx->configuration, sizeof(ctx->configuration))) != NULL) {
+		*sbc = *cached;
+		free(cached);
+		if (sbc_reinit_a2dp(sbc, 0, &ctx->configuration, sizeof(ctx->configuration)) == 0)
+			return 0;
+		sbc_finish(sbc);
+	}
+
+	return sbc_init_a2dp(sbc, 0, &ctx->configuration, sizeof(ctx->configuration));
+}
+
+/**
+ * Move SBC codec context to the device codec cache. */
+static void sbc_codec_ctx_release(struct sbc_codec_ctx *ctx) {
+
+	sbc_t *sbc;
+	if ((sbc = malloc(sizeof(*sbc))) == NULL) {
+		sbc_finish(ctx->sbc);
+		return;
+	}
+
+	*sbc = *ctx->sbc;
+	ba_device_codec_cache_store(ctx->t->d, ctx->t->profile, A2DP_CODEC_SBC, ctx->encoder,
+			&ctx->configuration, sizeof(ctx->configuration), sbc, sbc_handle_free);
+
+}
+
 void *a2dp_sbc_enc_thread(struct ba_transport_pcm *t_pcm) {
 
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
@@ -164,24 +260,30 @@ void *a2dp_sbc_enc_thread(struct ba_transport_pcm *t_pcm) {
 	struct io_poll io = { .timeout = -1 };
 
 	sbc_t sbc;
+	struct sbc_codec_ctx ctx;
 	const a2dp_sbc_t *configuration = &t->a2dp.configuration.sbc;
-	if ((errno = -sbc_init_a2dp(&sbc, 0, configuration, sizeof(*configuration))) != 0) {
+	if ((errno = -sbc_codec_ctx_init(&ctx, t, true, &sbc)) != 0) {
 		error("Couldn't initialize SBC codec: %s", strerror(errno));
 		goto fail_init;
 	}
 
 	ffb_t bt = { 0 };
-	ffb_t pcm = { 0 };
+	ffrb_t pcm = { 0 };
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &bt);
-	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
-	pthread_cleanup_push(PTHREAD_CLEANUP(sbc_finish), &sbc);
+	pthread_cleanup_push(PTHREAD_CLEANUP(ffrb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(io_bt_batch_free), &io.bt_batch);
+	pthread_cleanup_push(PTHREAD_CLEANUP(asrc_free), &io.asrc);
+	pthread_cleanup_push(PTHREAD_CLEANUP(sbc_codec_ctx_release), &ctx);
 
 	const size_t sbc_frame_samples = sbc_get_codesize(&sbc) / sizeof(int16_t);
 	const unsigned int channels = t_pcm->channels;
 	const unsigned int samplerate = t_pcm->sampling;
 
-	/* initialize SBC encoder bit-pool */
-	sbc.bitpool = sbc_a2dp_get_bitpool(configuration, config.sbc_quality);
+	/* Initialize SBC encoder bit-pool. The bit-pool selected by the quality
+	 * mode is used as the upper limit for the adaptive bitrate controller. */
+	const uint8_t bitpool = sbc_a2dp_get_bitpool(configuration, config.sbc_quality);
+	io_abr_init(&io, t_pcm, configuration->min_bitpool, bitpool, bitpool);
+	sbc.bitpool = io.abr.value;
 	/* ensure libsbc uses little-endian PCM on all architectures */
 	sbc.endian = SBC_LE;
 
@@ -194,7 +296,7 @@ void *a2dp_sbc_enc_thread(struct ba_transport_pcm *t_pcm) {
 	 * for the MTU value, but the speed might suffer significantly. */
 	const size_t rtp_headers_len = RTP_HEADER_LEN + sizeof(rtp_media_header_t);
 	const size_t mtu_write_payload_len = t->mtu_write - rtp_headers_len;
-	const size_t sbc_frame_len = sbc_get_frame_length(&sbc);
+	size_t sbc_frame_len = sbc_get_frame_length(&sbc);
 
 	size_t ffb_pcm_len = sbc_frame_samples;
 	if (mtu_write_payload_len / sbc_frame_len > 1)
@@ -205,8 +307,10 @@ void *a2dp_sbc_enc_thread(struct ba_transport_pcm *t_pcm) {
 		warn("Writing MTU too small for one single SBC frame: %zu < %zu",
 				t->mtu_write, RTP_HEADER_LEN + sizeof(rtp_media_header_t) + sbc_frame_len);
 
-	if (ffb_init_int16_t(&pcm, ffb_pcm_len) == -1 ||
-			ffb_init_uint8_t(&bt, t->mtu_write) == -1) {
+	if (ffrb_init_int16_t(&pcm, ffb_pcm_len) == -1 ||
+			ffb_init_uint8_t(&bt, t->mtu_write) == -1 ||
+			io_bt_batch_init(&io, t->mtu_write) == -1 ||
+			io_asrc_init(&io, t_pcm, pcm.nmemb) == -1) {
 		error("Couldn't create data buffers: %s", strerror(errno));
 		goto fail_ffb;
 	}
@@ -222,17 +326,20 @@ void *a2dp_sbc_enc_thread(struct ba_transport_pcm *t_pcm) {
 	/* RTP clock frequency equal to audio samplerate */
 	rtp_state_init(&rtp, samplerate, samplerate);
 
+	t_pcm->bitrate = a2dp_sbc_get_bitrate(&sbc);
+	bluealsa_dbus_pcm_update(t_pcm, BA_DBUS_PCM_UPDATE_BITRATE);
+
 	debug_transport_pcm_thread_loop(t_pcm, "START");
 	for (ba_transport_thread_state_set_running(th);;) {
 
-		ssize_t samples = ffb_len_in(&pcm);
-		switch (samples = io_poll_and_read_pcm(&io, t_pcm, pcm.tail, samples)) {
+		ssize_t samples = ffrb_len_in(&pcm);
+		switch (samples = io_poll_and_read_pcm(&io, t_pcm, ffrb_tail(&pcm), samples)) {
 		case -1:
 			if (errno == ESTALE) {
 				sbc_reinit_a2dp(&sbc, 0, configuration, sizeof(*configuration));
-				sbc.bitpool = sbc_a2dp_get_bitpool(configuration, config.sbc_quality);
+				sbc.bitpool = io.abr.value;
 				sbc.endian = SBC_LE;
-				ffb_rewind(&pcm);
+				ffrb_rewind(&pcm);
 				continue;
 			}
 			error("PCM poll and read error: %s", strerror(errno));
@@ -242,73 +349,104 @@ void *a2dp_sbc_enc_thread(struct ba_transport_pcm *t_pcm) {
 			continue;
 		}
 
-		ffb_seek(&pcm, samples);
-		samples = ffb_len_out(&pcm);
+		ffrb_seek(&pcm, samples);
+		samples = ffrb_len_out(&pcm);
 
-		/* anchor for RTP payload */
-		bt.tail = rtp_payload;
-
-		const int16_t *input = pcm.data;
+		const int16_t *input = ffrb_head(&pcm);
 		size_t input_samples = samples;
-		size_t output_len = ffb_len_in(&bt);
-		size_t pcm_frames = 0;
-		size_t sbc_frames = 0;
 
 		/* Generate as many SBC frames as possible, but less than a 4-bit media
 		 * header frame counter can contain. The size of the output buffer is
-		 * based on the socket MTU, so such transfer should be most efficient. */
-		while (input_samples >= sbc_frame_samples &&
-				output_len >= sbc_frame_len &&
-				/* do not overflow RTP frame counter */
-				sbc_frames < ((1 << 4) - 1)) {
-
-			ssize_t len;
-			ssize_t encoded;
-
-			if ((len = sbc_encode(&sbc, input, input_samples * sizeof(int16_t),
-							bt.tail, output_len, &encoded)) < 0) {
-				error("SBC encoding error: %s", sbc_strerror(len));
-				break;
-			}
+		 * based on the socket MTU, so such transfer should be most efficient.
+		 * In the low-latency mode SBC frames are short, so sending each one in
+		 * its own RTP packet would flood the link with thousands of packets
+		 * per second. Instead, every RTP packet carries about 2.5 ms of audio,
+		 * which matches the transfer chunk of the ALSA plugin. */
+		size_t sbc_frames_min = 1;
+		size_t sbc_frames_max = (1 << 4) - 1;
+		if (atomic_load_explicit(&t_pcm->latency, memory_order_relaxed) ==
+				BA_TRANSPORT_PCM_LATENCY_LOW) {
+			sbc_frames_max = MIN(sbc_frames_max, pcm.nmemb / sbc_frame_samples);
+			sbc_frames_max = MIN(sbc_frames_max,
+					samplerate / 400 / (sbc_frame_samples / channels));
+			sbc_frames_min = sbc_frames_max = MAX(sbc_frames_max, 1);
+		}
 
-			len = len / sizeof(int16_t);
-			input += len;
-			input_samples -= len;
-			ffb_seek(&bt, encoded);
-			output_len -= encoded;
-			pcm_frames += len / channels;
-			sbc_frames++;
+		while (input_samples >= sbc_frames_min * sbc_frame_samples) {
 
-		}
+			/* anchor for RTP payload */
+			bt.tail = rtp_payload;
+
+			size_t output_len = ffb_len_in(&bt);
+			size_t pcm_frames = 0;
+			size_t sbc_frames = 0;
 
-		if (sbc_frames > 0) {
+			while (input_samples >= sbc_frame_samples &&
+					output_len >= sbc_frame_len &&
+					sbc_frames < sbc_frames_max) {
+
+				ssize_t len;
+				ssize_t encoded;
+
+				if ((len = sbc_encode(&sbc, input, input_samples * sizeof(int16_t),
+								bt.tail, output_len, &encoded)) < 0) {
+					error("SBC encoding error: %s", sbc_strerror(len));
+					break;
+				}
+
+				len = len / sizeof(int16_t);
+				input += len;
+				input_samples -= len;
+				ffb_seek(&bt, encoded);
+				output_len -= encoded;
+				pcm_frames += len / channels;
+				sbc_frames++;
+
+			}
+
+			if (sbc_frames == 0)
+				break;
 
 			rtp_state_new_frame(&rtp, rtp_header);
 			rtp_media_header->frame_count = sbc_frames;
 
 			ssize_t len = ffb_blen_out(&bt);
-			if ((len = io_bt_write(th, bt.data, len)) <= 0) {
+			if ((len = io_bt_write_batch(&io, th, bt.data, len)) <= 0) {
 				if (len == -1)
 					error("BT write error: %s", strerror(errno));
 				goto fail;
 			}
 
 			/* keep data transfer at a constant bit rate */
-			asrsync_sync(&io.asrs, pcm_frames);
+			if ((len = io_bt_batch_sync(&io, th, pcm_frames)) <= 0) {
+				if (len == -1)
+					error("BT write error: %s", strerror(errno));
+				goto fail;
+			}
 			/* move forward RTP timestamp clock */
 			rtp_state_update(&rtp, pcm_frames);
 
-			/* update busy delay (encoding overhead) */
-			t_pcm->delay = asrsync_get_busy_usec(&io.asrs) / 100;
+			/* Adapt the bit-pool to the BT link condition. The new value will
+			 * be used starting from the next SBC frame. */
+			if (io_abr_control(&io, t_pcm, pcm_frames)) {
+				sbc.bitpool = io.abr.value;
+				sbc_frame_len = sbc_get_frame_length(&sbc);
+				t_pcm->bitrate = a2dp_sbc_get_bitrate(&sbc);
+				bluealsa_dbus_pcm_update(t_pcm, BA_DBUS_PCM_UPDATE_BITRATE);
+			}
 
-			/* If the input buffer was not consumed (due to codesize limit), we
-			 * have to append new data to the existing one. Since we do not use
-			 * ring buffer, we will simply move unprocessed data to the front
-			 * of our linear buffer. */
-			ffb_shift(&pcm, samples - input_samples);
+			/* Update PCM delay - encoding overhead and the duration of audio
+			 * carried by a single RTP packet (packetization delay). */
+			t_pcm->delay = asrsync_get_busy_usec(&io.asrs) / 100 +
+				pcm_frames * 10000 / samplerate;
 
 		}
 
+		/* If the input buffer was not consumed (due to codesize limit), the
+		 * unprocessed data will stay in the ring buffer and new data will be
+		 * appended to it. */
+		ffrb_shift(&pcm, samples - input_samples);
+
 	}
 
 fail:
@@ -317,6 +455,8 @@ fail_ffb:
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
 fail_init:
 	pthread_cleanup_pop(1);
 	return NULL;
@@ -335,8 +475,8 @@ void *a2dp_sbc_dec_thread(struct ba_transport_pcm *t_pcm) {
 	struct io_poll io = { .timeout = -1 };
 
 	sbc_t sbc;
-	if ((errno = -sbc_init_a2dp(&sbc, 0, &t->a2dp.configuration.sbc,
-					sizeof(t->a2dp.configuration.sbc))) != 0) {
+	struct sbc_codec_ctx ctx;
+	if ((errno = -sbc_codec_ctx_init(&ctx, t, false, &sbc)) != 0) {
 		error("Couldn't initialize SBC codec: %s", strerror(errno));
 		goto fail_init;
 	}
@@ -346,12 +486,17 @@ void *a2dp_sbc_dec_thread(struct ba_transport_pcm *t_pcm) {
 
 	ffb_t bt = { 0 };
 	ffb_t pcm = { 0 };
-	pthread_cleanup_push(PTHREAD_CLEANUP(sbc_finish), &sbc);
+	struct rtp_jitter_buffer jb = { 0 };
+	struct audio_plc plc = { 0 };
+	pthread_cleanup_push(PTHREAD_CLEANUP(sbc_codec_ctx_release), &ctx);
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &bt);
 	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &pcm);
+	pthread_cleanup_push(PTHREAD_CLEANUP(rtp_jitter_buffer_free), &jb);
+	pthread_cleanup_push(PTHREAD_CLEANUP(audio_plc_free), &plc);
 
 	const unsigned int channels = t_pcm->channels;
 	const unsigned int samplerate = t_pcm->sampling;
+	const bool jitter_buffer = config.a2dp.jitter_buffer_time > 0;
 
 	if (ffb_init_int16_t(&pcm, sbc_get_codesize(&sbc)) == -1 ||
 			ffb_init_uint8_t(&bt, t->mtu_read) == -1) {
@@ -359,6 +504,15 @@ void *a2dp_sbc_dec_thread(struct ba_transport_pcm *t_pcm) {
 		goto fail_ffb;
 	}
 
+	/* reorder RTP packets and conceal lost ones */
+	if (jitter_buffer && (
+				rtp_jitter_buffer_init(&jb, t->mtu_read, samplerate,
+					config.a2dp.jitter_buffer_time) == -1 ||
+				audio_plc_init(&plc, channels) == -1)) {
+		error("Couldn't create jitter buffer: %s", strerror(errno));
+		goto fail_ffb;
+	}
+
 	struct rtp_state rtp = { .synced = false };
 	/* RTP clock frequency equal to audio samplerate */
 	rtp_state_init(&rtp, samplerate, samplerate);
@@ -378,51 +532,103 @@ void *a2dp_sbc_dec_thread(struct ba_transport_pcm *t_pcm) {
 		}
 
 		const rtp_header_t *rtp_header = bt.data;
-		const rtp_media_header_t *rtp_media_header;
-		if ((rtp_media_header = rtp_a2dp_get_payload(rtp_header)) == NULL)
+		size_t rtp_len = len;
+
+		if (!rtp_check_header_len(rtp_header, rtp_len))
 			continue;
 
-		int missing_rtp_frames = 0;
-		rtp_state_sync_stream(&rtp, rtp_header, &missing_rtp_frames, NULL);
+		rtp_stats_update(&t_pcm->stats.rtp, rtp_header, rtp.ts_rtp_clockrate);
 
 		if (!ba_transport_pcm_is_active(t_pcm)) {
 			rtp.synced = false;
+			if (jitter_buffer)
+				rtp_jitter_buffer_reset(&jb);
 			continue;
 		}
 
-		const uint8_t *rtp_payload = (uint8_t *)(rtp_media_header + 1);
-		size_t rtp_payload_len = len - (rtp_payload - (uint8_t *)bt.data);
+		if (jitter_buffer) {
 
-		/* decode retrieved SBC frames */
-		size_t frames = rtp_media_header->frame_count;
-		while (frames--) {
+			rtp_jitter_buffer_put(&jb, bt.data, len);
 
-			size_t decoded;
-			if ((len = sbc_decode(&sbc, rtp_payload, rtp_payload_len,
-							pcm.data, ffb_blen_in(&pcm), &decoded)) < 0) {
-				error("SBC decoding error: %s", sbc_strerror(len));
-				break;
+			/* report current jitter buffer depth as a part of the PCM delay */
+			const unsigned int delay = rtp_jitter_buffer_get_depth_usec(&jb) / 100;
+			if (t_pcm->delay != delay) {
+				t_pcm->delay = delay;
+				bluealsa_dbus_pcm_update(t_pcm, BA_DBUS_PCM_UPDATE_DELAY);
 			}
 
-#if DEBUG
-			if (sbc_bitpool != sbc.bitpool) {
-				sbc_bitpool = sbc.bitpool;
-				sbc_print_internals(&sbc);
+			if ((rtp_header = rtp_jitter_buffer_get(&jb, &rtp_len)) == NULL)
+				continue;
+
+		}
+
+		/* Without the jitter buffer, this loop is executed only once for
+		 * the received packet. Otherwise, it decodes all released packets. */
+		do {
+
+			const rtp_media_header_t *rtp_media_header;
+			if ((rtp_media_header = rtp_a2dp_get_payload(rtp_header)) == NULL)
+				continue;
+
+			int missing_rtp_frames = 0;
+			int missing_pcm_frames = 0;
+			rtp_state_sync_stream(&rtp, rtp_header, &missing_rtp_frames,
+					jitter_buffer ? &missing_pcm_frames : NULL);
+
+			/* Conceal audio carried by lost packets. Gaps longer than one
+			 * second are most likely stream discontinuities, though. */
+			if (missing_pcm_frames > 0 && (unsigned int)missing_pcm_frames <= samplerate) {
+				size_t frames = missing_pcm_frames;
+				while (frames > 0) {
+					size_t samples = ffb_len_in(&pcm);
+					if (samples > frames * channels)
+						samples = frames * channels;
+					audio_plc_fillin(&plc, pcm.data, samples / channels);
+					io_pcm_scale(t_pcm, pcm.data, samples);
+					if (io_pcm_write(t_pcm, pcm.data, samples) == -1)
+						error("FIFO write error: %s", strerror(errno));
+					frames -= samples / channels;
+				}
 			}
+
+			const uint8_t *rtp_payload = (uint8_t *)(rtp_media_header + 1);
+			size_t rtp_payload_len = rtp_len - (rtp_payload - (uint8_t *)rtp_header);
+
+			/* decode retrieved SBC frames */
+			size_t frames = rtp_media_header->frame_count;
+			while (frames--) {
+
+				size_t decoded;
+				if ((len = sbc_decode(&sbc, rtp_payload, rtp_payload_len,
+								pcm.data, ffb_blen_in(&pcm), &decoded)) < 0) {
+					error("SBC decoding error: %s", sbc_strerror(len));
+					break;
+				}
+
+#if DEBUG
+				if (sbc_bitpool != sbc.bitpool) {
+					sbc_bitpool = sbc.bitpool;
+					sbc_print_internals(&sbc);
+				}
 #endif
 
-			rtp_payload += len;
-			rtp_payload_len -= len;
+				rtp_payload += len;
+				rtp_payload_len -= len;
 
-			const size_t samples = decoded / sizeof(int16_t);
-			io_pcm_scale(t_pcm, pcm.data, samples);
-			if (io_pcm_write(t_pcm, pcm.data, samples) == -1)
-				error("FIFO write error: %s", strerror(errno));
+				const size_t samples = decoded / sizeof(int16_t);
+				if (jitter_buffer)
+					audio_plc_rx(&plc, pcm.data, samples / channels);
+				io_pcm_scale(t_pcm, pcm.data, samples);
+				if (io_pcm_write(t_pcm, pcm.data, samples) == -1)
+					error("FIFO write error: %s", strerror(errno));
 
-			/* update local state with decoded PCM frames */
-			rtp_state_update(&rtp, samples / channels);
+				/* update local state with decoded PCM frames */
+				rtp_state_update(&rtp, samples / channels);
 
-		}
+			}
+
+		} while (jitter_buffer &&
+				(rtp_header = rtp_jitter_buffer_get(&jb, &rtp_len)) != NULL);
 
 	}
 
@@ -432,6 +638,8 @@ fail_ffb:
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
 	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
+	pthread_cleanup_pop(1);
 fail_init:
 	pthread_cleanup_pop(1);
 	return NULL;
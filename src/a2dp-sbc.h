@@ -18,6 +18,7 @@
 
 #include "a2dp.h"
 #include "ba-transport.h"
+#include "shared/a2dp-codecs.h"
 
 extern struct a2dp_codec a2dp_sbc_sink;
 extern struct a2dp_codec a2dp_sbc_source;
@@ -26,4 +27,9 @@ void a2dp_sbc_init(void);
 void a2dp_sbc_transport_init(struct ba_transport *t);
 int a2dp_sbc_transport_start(struct ba_transport *t);
 
+void a2dp_sbc_select_low_latency(
+		const struct a2dp_codec *codec,
+		a2dp_sbc_t *configuration,
+		const a2dp_sbc_t *capabilities);
+
 #endif
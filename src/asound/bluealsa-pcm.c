@@ -40,6 +40,7 @@
 #include "shared/hex.h"
 #include "shared/log.h"
 #include "shared/rt.h"
+#include "shared/shm-ring.h"
 
 #define BA_PAUSE_STATE_RUNNING 0
 #define BA_PAUSE_STATE_PAUSED  (1 << 0)
@@ -72,11 +73,17 @@ struct bluealsa_pcm {
 	/* requested BlueALSA PCM */
 	struct ba_pcm ba_pcm;
 
-	/* PCM FIFO */
+	/* PCM FIFO; in case of the shared memory transport it is
+	 * the event file descriptor signaled by the server */
 	int ba_pcm_fd;
 	/* PCM control socket */
 	int ba_pcm_ctrl_fd;
 
+	/* shared memory ring buffer used instead of the FIFO */
+	struct shm_ring ba_pcm_shm;
+	/* event file descriptor for notifying the server */
+	int ba_pcm_shm_event_fd;
+
 	/* Indicates that the server is connected. */
 	atomic_bool connected;
 
@@ -93,6 +100,8 @@ struct bluealsa_pcm {
 	_Atomic snd_pcm_uframes_t io_hw_boundary;
 	/* Permit the application to modify the frequency of poll() events. */
 	_Atomic snd_pcm_uframes_t io_avail_min;
+	/* maximum number of frames transferred in a single IO iteration */
+	snd_pcm_uframes_t io_transfer_max;
 	pthread_t io_thread;
 	bool io_started;
 
@@ -175,7 +184,11 @@ static void io_thread_update_delay(struct bluealsa_pcm *pcm,
 	unsigned int nread = 0;
 
 	gettimestamp(&now);
-	ioctl(pcm->ba_pcm_fd, FIONREAD, &nread);
+	if (pcm->ba_pcm_shm.hdr != NULL)
+		/* exact number of bytes queued in the shared memory */
+		nread = shm_ring_used(&pcm->ba_pcm_shm);
+	else
+		ioctl(pcm->ba_pcm_fd, FIONREAD, &nread);
 
 	pthread_mutex_lock(&pcm->mutex);
 
@@ -197,6 +210,54 @@ static void io_thread_update_delay(struct bluealsa_pcm *pcm,
 
 }
 
+/**
+ * Transfer data via the shared memory ring buffer.
+ *
+ * This function transfers the whole buffer "atomically", i.e. it blocks
+ * until all data is written (playback) or read (capture).
+ *
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+static int io_thread_shm_transfer(struct bluealsa_pcm *pcm, char *buffer, size_t len) {
+
+	const bool is_capture = pcm->io.stream == SND_PCM_STREAM_CAPTURE;
+	struct pollfd pfd = { pcm->ba_pcm_fd, POLLIN, 0 };
+
+	while (len != 0) {
+
+		ssize_t ret;
+		if (is_capture)
+			ret = shm_ring_read(&pcm->ba_pcm_shm, buffer, len);
+		else
+			ret = shm_ring_write(&pcm->ba_pcm_shm, buffer, len);
+
+		if (ret == -1)
+			return -1;
+		if (ret > 0) {
+			eventfd_write(pcm->ba_pcm_shm_event_fd, 1);
+			buffer += ret;
+			len -= ret;
+			continue;
+		}
+
+		if (shm_ring_is_closed(&pcm->ba_pcm_shm))
+			return errno = EPIPE, -1;
+
+		/* wait for the server to consume or produce data */
+		if (poll(&pfd, 1, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		eventfd_t event;
+		eventfd_read(pcm->ba_pcm_fd, &event);
+
+	}
+
+	return 0;
+}
+
 /**
  * IO thread, which facilitates ring buffer. */
 static void *io_thread(snd_pcm_ioplug_t *io) {
@@ -272,8 +333,9 @@ static void *io_thread(snd_pcm_ioplug_t *io) {
 		/* current offset of the head pointer in the IO buffer */
 		snd_pcm_uframes_t offset = io_hw_ptr % io->buffer_size;
 
-		/* Transfer at most 1 period of frames in each iteration ... */
-		snd_pcm_uframes_t frames = io->period_size;
+		/* Transfer at most 1 period of frames (or a smaller chunk in the
+		 * low-latency mode) in each iteration ... */
+		snd_pcm_uframes_t frames = pcm->io_transfer_max;
 		/* ... but do not try to transfer more frames than are available in the
 		 * ring buffer! */
 		if (frames > avail)
@@ -296,7 +358,25 @@ static void *io_thread(snd_pcm_ioplug_t *io) {
 			io_hw_ptr -= pcm->io_hw_boundary;
 
 		ssize_t ret = 0;
-		if (io->stream == SND_PCM_STREAM_CAPTURE) {
+		if (pcm->ba_pcm_shm.hdr != NULL) {
+
+			/* The shared memory transfer does not involve any system call as
+			 * long as there is enough data/space in the ring buffer. */
+			if (io_thread_shm_transfer(pcm, head, len) == -1) {
+				if (errno != EPIPE)
+					SNDERR("PCM shared memory transfer error: %s", strerror(errno));
+				pcm->connected = false;
+				goto fail;
+			}
+
+			io_thread_update_delay(pcm, io_hw_ptr);
+
+			/* synchronize playback time */
+			if (io->stream == SND_PCM_STREAM_PLAYBACK)
+				asrsync_sync(&asrs, frames);
+
+		}
+		else if (io->stream == SND_PCM_STREAM_CAPTURE) {
 
 			/* Read the whole period "atomically". This will assure, that frames
 			 * are not fragmented, so the pointer can be correctly updated. */
@@ -561,16 +641,42 @@ static int bluealsa_hw_params(snd_pcm_ioplug_t *io, snd_pcm_hw_params_t *params)
 	pcm->frame_size = (snd_pcm_format_physical_width(io->format) * io->channels) / 8;
 
 	DBusError err = DBUS_ERROR_INIT;
-	if (!bluealsa_dbus_pcm_open(&pcm->dbus_ctx, pcm->ba_pcm.pcm_path,
-				&pcm->ba_pcm_fd, &pcm->ba_pcm_ctrl_fd, &err)) {
-		debug2("Couldn't open PCM: %s", err.message);
+	int shm_fd = -1;
+
+	/* Prefer shared memory transport, but fall back to the FIFO if it is not
+	 * supported by the server. */
+	if (bluealsa_dbus_pcm_open_shm(&pcm->dbus_ctx, pcm->ba_pcm.pcm_path, &shm_fd,
+				&pcm->ba_pcm_shm_event_fd, &pcm->ba_pcm_fd, &pcm->ba_pcm_ctrl_fd, &err)) {
+		int rv = shm_ring_attach(&pcm->ba_pcm_shm, shm_fd);
+		int err_ = errno;
+		close(shm_fd);
+		if (rv == -1) {
+			debug2("Couldn't attach PCM shared memory: %s", strerror(err_));
+			close(pcm->ba_pcm_fd);
+			close(pcm->ba_pcm_ctrl_fd);
+			close(pcm->ba_pcm_shm_event_fd);
+			pcm->ba_pcm_fd = -1;
+			pcm->ba_pcm_ctrl_fd = -1;
+			pcm->ba_pcm_shm_event_fd = -1;
+			return -err_;
+		}
+	}
+	else {
+		debug2("Couldn't open PCM with shared memory: %s", err.message);
 		dbus_error_free(&err);
-		return -EBUSY;
+		if (!bluealsa_dbus_pcm_open(&pcm->dbus_ctx, pcm->ba_pcm.pcm_path,
+					&pcm->ba_pcm_fd, &pcm->ba_pcm_ctrl_fd, &err)) {
+			debug2("Couldn't open PCM: %s", err.message);
+			dbus_error_free(&err);
+			return -EBUSY;
+		}
 	}
 
 	pcm->connected = true;
 
-	if (pcm->io.stream == SND_PCM_STREAM_PLAYBACK)
+	if (pcm->ba_pcm_shm.hdr != NULL)
+		pcm->delay_fifo_size = pcm->ba_pcm_shm.size / pcm->frame_size;
+	else if (pcm->io.stream == SND_PCM_STREAM_PLAYBACK)
 		/* By default, the size of the pipe buffer is set to a too large value for
 		 * our purpose. On modern Linux system it is 65536 bytes. Large buffer in
 		 * the playback mode might contribute to an unnecessary audio delay. Since
@@ -586,6 +692,16 @@ static int bluealsa_hw_params(snd_pcm_ioplug_t *io, snd_pcm_hw_params_t *params)
 	/* ALSA default for avail min is one period. */
 	pcm->io_avail_min = period_size;
 
+	/* In the low-latency playback mode transfer frames in chunks of about
+	 * 2.5 ms instead of whole periods. Since the transfer is synchronized
+	 * with the playback time, this way the server never has more than one
+	 * chunk queued in the FIFO on top of the FIFO buffer itself. */
+	pcm->io_transfer_max = period_size;
+	if (pcm->io.stream == SND_PCM_STREAM_PLAYBACK &&
+			pcm->ba_pcm.latency == BA_PCM_LATENCY_LOW &&
+			pcm->io_transfer_max > io->rate / 400)
+		pcm->io_transfer_max = io->rate / 400;
+
 	debug2("Selected HW buffer: %zd periods x %zd bytes %c= %zd bytes",
 			buffer_size / period_size, pcm->frame_size * period_size,
 			period_size * (buffer_size / period_size) == buffer_size ? '=' : '<',
@@ -607,9 +723,13 @@ static int bluealsa_hw_free(snd_pcm_ioplug_t *io) {
 		rv |= close(pcm->ba_pcm_fd);
 	if (pcm->ba_pcm_ctrl_fd != -1)
 		rv |= close(pcm->ba_pcm_ctrl_fd);
+	if (pcm->ba_pcm_shm_event_fd != -1)
+		rv |= close(pcm->ba_pcm_shm_event_fd);
+	shm_ring_free(&pcm->ba_pcm_shm);
 
 	pcm->ba_pcm_fd = -1;
 	pcm->ba_pcm_ctrl_fd = -1;
+	pcm->ba_pcm_shm_event_fd = -1;
 	pcm->connected = false;
 
 	return rv == 0 ? 0 : -errno;
@@ -1148,6 +1268,14 @@ static int str2softvol(const char *str) {
 	return snd_config_get_bool_ascii(str);
 }
 
+static int str2latency(const char *str) {
+	if (strcasecmp(str, "normal") == 0)
+		return BA_PCM_LATENCY_NORMAL;
+	if (strcasecmp(str, "low") == 0)
+		return BA_PCM_LATENCY_LOW;
+	return -1;
+}
+
 static snd_pcm_format_t get_snd_pcm_format(uint16_t format) {
 	switch (format) {
 	case 0x0108:
@@ -1221,9 +1349,10 @@ static int bluealsa_set_hw_constraint(struct bluealsa_pcm *pcm) {
 	/* In order to prevent audio tearing and minimize CPU utilization, we're
 	 * going to setup period size constraint. The limit is derived from the
 	 * transport sampling rate and the number of channels, so the period
-	 * "time" size will be constant, and should be about 10ms. The upper
-	 * limit will not be constrained. */
-	unsigned int min_p = pcm->ba_pcm.sampling / 100 * pcm->ba_pcm.channels *
+	 * "time" size will be constant, and should be about 10ms (2.5ms in the
+	 * low-latency mode). The upper limit will not be constrained. */
+	const unsigned int min_p_rate = pcm->ba_pcm.latency == BA_PCM_LATENCY_LOW ? 400 : 100;
+	unsigned int min_p = pcm->ba_pcm.sampling / min_p_rate * pcm->ba_pcm.channels *
 		snd_pcm_format_physical_width(get_snd_pcm_format(pcm->ba_pcm.format)) / 8;
 
 	if ((err = snd_pcm_ioplug_set_param_minmax(io, SND_PCM_IOPLUG_HW_PERIOD_BYTES,
@@ -1305,6 +1434,14 @@ static bool bluealsa_update_pcm_volume(struct bluealsa_pcm *pcm,
 	return bluealsa_dbus_pcm_update(&pcm->dbus_ctx, &pcm->ba_pcm, BLUEALSA_PCM_VOLUME, err);
 }
 
+static bool bluealsa_update_pcm_latency(struct bluealsa_pcm *pcm,
+		int latency, DBusError *err) {
+	if (latency < 0 || (unsigned int)latency == pcm->ba_pcm.latency)
+		return true;
+	pcm->ba_pcm.latency = latency;
+	return bluealsa_dbus_pcm_update(&pcm->dbus_ctx, &pcm->ba_pcm, BLUEALSA_PCM_LATENCY, err);
+}
+
 static bool bluealsa_update_pcm_softvol(struct bluealsa_pcm *pcm,
 		int softvol, DBusError *err) {
 	if (softvol < 0 || !!softvol == pcm->ba_pcm.soft_volume)
@@ -1322,6 +1459,7 @@ SND_PCM_PLUGIN_DEFINE_FUNC(bluealsa) {
 	const char *codec = NULL;
 	const char *volume = NULL;
 	const char *softvol = NULL;
+	const char *latency = NULL;
 	long delay = 0;
 	struct bluealsa_pcm *pcm;
 	int ret;
@@ -1387,6 +1525,15 @@ SND_PCM_PLUGIN_DEFINE_FUNC(bluealsa) {
 				softvol = NULL;
 			continue;
 		}
+		if (strcmp(id, "latency") == 0) {
+			if (snd_config_get_string(n, &latency) < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			if (strcmp(latency, "unchanged") == 0)
+				latency = NULL;
+			continue;
+		}
 		if (strcmp(id, "delay") == 0) {
 			if (snd_config_get_integer(n, &delay) < 0) {
 				SNDERR("Invalid type for %s", id);
@@ -1424,12 +1571,19 @@ SND_PCM_PLUGIN_DEFINE_FUNC(bluealsa) {
 		return -EINVAL;
 	}
 
+	int pcm_latency = -1;
+	if (latency != NULL && (pcm_latency = str2latency(latency)) < 0) {
+		SNDERR("Invalid latency [normal, low]: %s", latency);
+		return -EINVAL;
+	}
+
 	if ((pcm = calloc(1, sizeof(*pcm))) == NULL)
 		return -ENOMEM;
 
 	pcm->event_fd = -1;
 	pcm->ba_pcm_fd = -1;
 	pcm->ba_pcm_ctrl_fd = -1;
+	pcm->ba_pcm_shm_event_fd = -1;
 	pcm->delay_ex = delay;
 	pthread_mutex_init(&pcm->mutex, NULL);
 	pthread_cond_init(&pcm->pause_cond, NULL);
@@ -1479,6 +1633,13 @@ SND_PCM_PLUGIN_DEFINE_FUNC(bluealsa) {
 	pcm->io.callback = &bluealsa_callback;
 	pcm->io.private_data = pcm;
 
+	/* Latency class shall be set before the codec selection, because it
+	 * might affect the codec configuration selected by the server. */
+	if (!bluealsa_update_pcm_latency(pcm, pcm_latency, &err)) {
+		SNDERR("Couldn't set BlueALSA PCM latency: %s", err.message);
+		dbus_error_free(&err);
+	}
+
 	if (codec != NULL && codec[0] != '\0') {
 		if (bluealsa_select_pcm_codec(pcm, codec, &err)) {
 			/* Changing the codec may change the audio format, sampling rate and/or
@@ -0,0 +1,126 @@
+/*
+ * BlueALSA - audio-plc.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "audio-plc.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "shared/defs.h"
+
+/**
+ * Initialize packet loss concealment.
+ *
+ * If BlueALSA was built without spandsp library (mSBC support), missing
+ * audio is replaced with silence.
+ *
+ * @param plc Address of the PLC structure.
+ * @param channels The number of channels in the PCM signal.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int audio_plc_init(struct audio_plc *plc, unsigned int channels) {
+
+	if (channels == 0 || channels > AUDIO_PLC_MAX_CHANNELS)
+		return errno = EINVAL, -1;
+
+	plc->channels = channels;
+
+#if ENABLE_MSBC
+	memset(plc->plc, 0, sizeof(plc->plc));
+	for (unsigned int i = 0; i < channels; i++)
+		if ((plc->plc[i] = plc_init(NULL)) == NULL) {
+			audio_plc_free(plc);
+			return errno = ENOMEM, -1;
+		}
+#endif
+
+	return 0;
+}
+
+/**
+ * Free resources allocated with the audio_plc_init(). */
+void audio_plc_free(struct audio_plc *plc) {
+#if ENABLE_MSBC
+	for (unsigned int i = 0; i < plc->channels; i++) {
+		plc_free(plc->plc[i]);
+		plc->plc[i] = NULL;
+	}
+#else
+	(void)plc;
+#endif
+}
+
+#if ENABLE_MSBC
+static void audio_plc_process(struct audio_plc *plc, int16_t *buffer,
+		size_t frames, bool fillin) {
+
+	/* The spandsp PLC works on a single channel, so the signal
+	 * has to be de-interleaved in chunks of a fixed size. */
+	const unsigned int channels = plc->channels;
+	int16_t tmp[256];
+
+	for (unsigned int ch = 0; ch < channels; ch++)
+		for (size_t offset = 0; offset < frames; offset += ARRAYSIZE(tmp)) {
+
+			size_t i, n = frames - offset;
+			if (n > ARRAYSIZE(tmp))
+				n = ARRAYSIZE(tmp);
+
+			int16_t *data = &buffer[offset * channels + ch];
+			if (fillin)
+				plc_fillin(plc->plc[ch], tmp, n);
+			else {
+				for (i = 0; i < n; i++)
+					tmp[i] = data[i * channels];
+				plc_rx(plc->plc[ch], tmp, n);
+			}
+
+			for (i = 0; i < n; i++)
+				data[i * channels] = tmp[i];
+
+		}
+
+}
+#endif
+
+/**
+ * Record correctly received PCM signal.
+ *
+ * This function shall be called for every chunk of decoded PCM signal. It
+ * updates the signal history used for concealment and smoothly blends the
+ * received signal with the previously concealed one.
+ *
+ * @param plc The PLC structure.
+ * @param buffer Interleaved PCM signal, which might be modified in place.
+ * @param frames The number of PCM frames in the buffer. */
+void audio_plc_rx(struct audio_plc *plc, int16_t *buffer, size_t frames) {
+#if ENABLE_MSBC
+	audio_plc_process(plc, buffer, frames, false);
+#else
+	(void)plc;
+	(void)buffer;
+	(void)frames;
+#endif
+}
+
+/**
+ * Synthesize PCM signal in place of missing audio.
+ *
+ * @param plc The PLC structure.
+ * @param buffer The buffer where the concealment signal will be stored.
+ * @param frames The number of PCM frames to synthesize. */
+void audio_plc_fillin(struct audio_plc *plc, int16_t *buffer, size_t frames) {
+#if ENABLE_MSBC
+	audio_plc_process(plc, buffer, frames, true);
+#else
+	memset(buffer, 0, frames * plc->channels * sizeof(*buffer));
+#endif
+}
@@ -0,0 +1,46 @@
+/*
+ * BlueALSA - audio-plc.h
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#pragma once
+#ifndef BLUEALSA_AUDIOPLC_H_
+#define BLUEALSA_AUDIOPLC_H_
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if ENABLE_MSBC
+# include <spandsp.h>
+#endif
+
+/**
+ * The maximal number of channels supported by the PLC. */
+#define AUDIO_PLC_MAX_CHANNELS 8
+
+/**
+ * Packet loss concealment for interleaved S16 PCM signal. */
+struct audio_plc {
+	unsigned int channels;
+#if ENABLE_MSBC
+	/* per-channel concealment state */
+	plc_state_t *plc[AUDIO_PLC_MAX_CHANNELS];
+#endif
+};
+
+int audio_plc_init(struct audio_plc *plc, unsigned int channels);
+void audio_plc_free(struct audio_plc *plc);
+
+void audio_plc_rx(struct audio_plc *plc, int16_t *buffer, size_t frames);
+void audio_plc_fillin(struct audio_plc *plc, int16_t *buffer, size_t frames);
+
+#endif
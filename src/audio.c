@@ -1,6 +1,6 @@
 /*
  * BlueALSA - audio.c
- * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
  *
  * This file is a part of bluez-alsa.
  *
@@ -17,7 +17,55 @@
 
 #include <glib.h>
 
+#if AUDIO_IMPL_HAVE_X86
+# include <immintrin.h>
+#endif
+#if AUDIO_IMPL_HAVE_NEON
+# include <arm_neon.h>
+#endif
+
 #include "shared/defs.h"
+#include "shared/log.h"
+
+/* Fixed-point representation of the neutral scaling factor. */
+#define AUDIO_Q15_ONE (INT32_C(1) << 15)
+#define AUDIO_Q31_ONE (INT64_C(1) << 31)
+
+/**
+ * PCM processing kernels.
+ *
+ * All kernels operate on interleaved stereo signal, or in case of scaling
+ * and silencing on a sequence of samples where even samples belong to the
+ * 1st channel and odd samples belong to the 2nd channel. */
+struct audio_kernels {
+	void (*interleave_s16_2le)(const int16_t *ch1, const int16_t *ch2,
+			size_t frames, int16_t *dest);
+	void (*interleave_s32_4le)(const int32_t *ch1, const int32_t *ch2,
+			size_t frames, int32_t *dest);
+	void (*deinterleave_s16_2le)(const int16_t *src, size_t frames,
+			int16_t *dest1, int16_t *dest2);
+	void (*deinterleave_s32_4le)(const int32_t *src, size_t frames,
+			int32_t *dest1, int32_t *dest2);
+	void (*scale_s16_2le)(int16_t *buffer, size_t samples,
+			int32_t ch1, int32_t ch2);
+	void (*scale_s32_4le)(int32_t *buffer, size_t samples,
+			int64_t ch1, int64_t ch2);
+	void (*silence_s16_2le)(int16_t *buffer, size_t samples,
+			bool ch1, bool ch2);
+	void (*silence_s32_4le)(int32_t *buffer, size_t samples,
+			bool ch1, bool ch2);
+	void (*pack_s16_2le_s24_3le)(const int16_t *src, size_t samples,
+			uint8_t *dest);
+	void (*pack_s24_4le_s24_3le)(const int32_t *src, size_t samples,
+			uint8_t *dest);
+	void (*unpack_s24_3le_s16_2le)(const uint8_t *src, size_t samples,
+			int16_t *dest);
+	void (*unpack_s24_3le_s24_4le)(const uint8_t *src, size_t samples,
+			int32_t *dest);
+	void (*mix_s16_2le)(int16_t *dest, const int16_t *src, size_t samples);
+	void (*mix_s24_4le)(int32_t *dest, const int32_t *src, size_t samples);
+	void (*mix_s32_4le)(int32_t *dest, const int32_t *src, size_t samples);
+};
 
 /**
  * Convert audio volume change in dB to loudness.
@@ -39,48 +87,994 @@ double audio_loudness_to_decibel(double value) {
 	return 10 * log2(value);
 }
 
+/**
+ * Convert scaling factor to the Q15 fixed-point gain.
+ *
+ * @param scale The scaling factor, where 1.0 is the neutral value.
+ * @return The Q15 gain saturated to the 32-bit integer range. */
+int32_t audio_scale_to_q15(double scale) {
+	if (scale <= 0)
+		return 0;
+	if (scale >= (double)INT32_MAX / AUDIO_Q15_ONE)
+		return INT32_MAX;
+	return lround(scale * AUDIO_Q15_ONE);
+}
+
+/**
+ * Convert scaling factor to the Q31 fixed-point gain.
+ *
+ * @param scale The scaling factor, where 1.0 is the neutral value.
+ * @return The Q31 gain with the integer part limited to 32 bits. */
+int64_t audio_scale_to_q31(double scale) {
+	if (scale <= 0)
+		return 0;
+	/* limit gain, so the integer part fits in 32 bits */
+	if (scale >= (double)INT32_MAX)
+		return (int64_t)INT32_MAX << 31;
+	return llround(scale * AUDIO_Q31_ONE);
+}
+
+/**
+ * Multiply S16 sample by the Q15 gain with saturation.
+ *
+ * The result is rounded toward zero, which for gains being a power of two
+ * gives the same result as the integer division. */
+static inline int16_t audio_mul_s16_q15(int16_t sample, int32_t gain) {
+	int64_t v = (int64_t)sample * gain / AUDIO_Q15_ONE;
+	return MIN(MAX(v, INT16_MIN), INT16_MAX);
+}
+
+/**
+ * Multiply S32 sample by the Q31 gain with saturation. */
+static inline int32_t audio_mul_s32_q31(int32_t sample, int64_t gain) {
+	/* Split the gain into integer and fractional parts, so the intermediate
+	 * result will not overflow 64-bit integer. Since both parts are positive,
+	 * the rounding toward zero is not affected by such split. */
+	const int64_t gain_int = gain >> 31;
+	const int64_t gain_frac = gain & (AUDIO_Q31_ONE - 1);
+	int64_t v = sample * gain_int + sample * gain_frac / AUDIO_Q31_ONE;
+	return MIN(MAX(v, INT32_MIN), INT32_MAX);
+}
+
+static void audio_interleave_s16_2le_generic(const int16_t *ch1,
+		const int16_t *ch2, size_t frames, int16_t *dest) {
+	for (size_t f = 0; f < frames; f++) {
+		*dest++ = ch1[f];
+		*dest++ = ch2[f];
+	}
+}
+
+static void audio_interleave_s32_4le_generic(const int32_t *ch1,
+		const int32_t *ch2, size_t frames, int32_t *dest) {
+	for (size_t f = 0; f < frames; f++) {
+		*dest++ = ch1[f];
+		*dest++ = ch2[f];
+	}
+}
+
+static void audio_deinterleave_s16_2le_generic(const int16_t *src,
+		size_t frames, int16_t *dest1, int16_t *dest2) {
+	for (size_t f = 0; f < frames; f++) {
+		dest1[f] = *src++;
+		dest2[f] = *src++;
+	}
+}
+
+static void audio_deinterleave_s32_4le_generic(const int32_t *src,
+		size_t frames, int32_t *dest1, int32_t *dest2) {
+	for (size_t f = 0; f < frames; f++) {
+		dest1[f] = *src++;
+		dest2[f] = *src++;
+	}
+}
+
+static void audio_scale_s16_2le_generic(int16_t *buffer, size_t samples,
+		int32_t ch1, int32_t ch2) {
+	for (size_t i = 0; i < samples; i++) {
+		const int32_t gain = i % 2 == 0 ? ch1 : ch2;
+		int16_t s = audio_mul_s16_q15((int16_t)le16toh(buffer[i]), gain);
+		buffer[i] = htole16(s);
+	}
+}
+
+static void audio_scale_s32_4le_generic(int32_t *buffer, size_t samples,
+		int64_t ch1, int64_t ch2) {
+	for (size_t i = 0; i < samples; i++) {
+		const int64_t gain = i % 2 == 0 ? ch1 : ch2;
+		int32_t s = audio_mul_s32_q31((int32_t)le32toh(buffer[i]), gain);
+		buffer[i] = htole32(s);
+	}
+}
+
+static void audio_silence_s16_2le_generic(int16_t *buffer, size_t samples,
+		bool ch1, bool ch2) {
+	const uint16_t mask[] = { ch1 ? 0 : 0xFFFF, ch2 ? 0 : 0xFFFF };
+	for (size_t i = 0; i < samples; i++)
+		buffer[i] &= mask[i % 2];
+}
+
+static void audio_silence_s32_4le_generic(int32_t *buffer, size_t samples,
+		bool ch1, bool ch2) {
+	const uint32_t mask[] = { ch1 ? 0 : 0xFFFFFFFF, ch2 ? 0 : 0xFFFFFFFF };
+	for (size_t i = 0; i < samples; i++)
+		buffer[i] &= mask[i % 2];
+}
+
+static void audio_pack_s16_2le_s24_3le_generic(const int16_t *src,
+		size_t samples, uint8_t *dest) {
+	for (size_t i = 0; i < samples; i++) {
+		*dest++ = 0;
+		*dest++ = src[i];
+		*dest++ = src[i] >> 8;
+	}
+}
+
+static void audio_pack_s24_4le_s24_3le_generic(const int32_t *src,
+		size_t samples, uint8_t *dest) {
+	for (size_t i = 0; i < samples; i++) {
+		*dest++ = src[i];
+		*dest++ = src[i] >> 8;
+		*dest++ = src[i] >> 16;
+	}
+}
+
+static void audio_unpack_s24_3le_s16_2le_generic(const uint8_t *src,
+		size_t samples, int16_t *dest) {
+	for (size_t i = 0; i < samples; i++, src += 3)
+		dest[i] = src[1] | (src[2] << 8);
+}
+
+static void audio_unpack_s24_3le_s24_4le_generic(const uint8_t *src,
+		size_t samples, int32_t *dest) {
+	for (size_t i = 0; i < samples; i++, src += 3)
+		dest[i] = (int32_t)((uint32_t)src[0] << 8 | (uint32_t)src[1] << 16 |
+				(uint32_t)src[2] << 24) >> 8;
+}
+
+static void audio_mix_s16_2le_generic(int16_t *dest, const int16_t *src,
+		size_t samples) {
+	for (size_t i = 0; i < samples; i++) {
+		const int32_t s = (int16_t)le16toh(dest[i]) + (int16_t)le16toh(src[i]);
+		dest[i] = htole16(MIN(MAX(s, INT16_MIN), INT16_MAX));
+	}
+}
+
+static void audio_mix_s32_4le_generic(int32_t *dest, const int32_t *src,
+		size_t samples) {
+	for (size_t i = 0; i < samples; i++) {
+		const int64_t s = (int64_t)(int32_t)le32toh(dest[i]) + (int32_t)le32toh(src[i]);
+		dest[i] = htole32(MIN(MAX(s, INT32_MIN), INT32_MAX));
+	}
+}
+
+/* The 24-bit sample is moved to the most significant bytes, so the 32-bit
+ * saturation can be used. It also ignores the padding byte of the input. */
+static void audio_mix_s24_4le_generic(int32_t *dest, const int32_t *src,
+		size_t samples) {
+	for (size_t i = 0; i < samples; i++) {
+		const int64_t s = (int64_t)(int32_t)(le32toh(dest[i]) << 8) +
+			(int32_t)(le32toh(src[i]) << 8);
+		dest[i] = htole32((int32_t)MIN(MAX(s, INT32_MIN), INT32_MAX) >> 8);
+	}
+}
+
+static const struct audio_kernels audio_kernels_generic = {
+	.interleave_s16_2le = audio_interleave_s16_2le_generic,
+	.interleave_s32_4le = audio_interleave_s32_4le_generic,
+	.deinterleave_s16_2le = audio_deinterleave_s16_2le_generic,
+	.deinterleave_s32_4le = audio_deinterleave_s32_4le_generic,
+	.scale_s16_2le = audio_scale_s16_2le_generic,
+	.scale_s32_4le = audio_scale_s32_4le_generic,
+	.silence_s16_2le = audio_silence_s16_2le_generic,
+	.silence_s32_4le = audio_silence_s32_4le_generic,
+	.pack_s16_2le_s24_3le = audio_pack_s16_2le_s24_3le_generic,
+	.pack_s24_4le_s24_3le = audio_pack_s24_4le_s24_3le_generic,
+	.unpack_s24_3le_s16_2le = audio_unpack_s24_3le_s16_2le_generic,
+	.unpack_s24_3le_s24_4le = audio_unpack_s24_3le_s24_4le_generic,
+	.mix_s16_2le = audio_mix_s16_2le_generic,
+	.mix_s24_4le = audio_mix_s24_4le_generic,
+	.mix_s32_4le = audio_mix_s32_4le_generic,
+};
+
+#if AUDIO_IMPL_HAVE_X86
+
+__attribute__ ((target("sse2")))
+static void audio_interleave_s16_2le_sse2(const int16_t *ch1,
+		const int16_t *ch2, size_t frames, int16_t *dest) {
+	size_t f = 0;
+	for (; f + 8 <= frames; f += 8) {
+		const __m128i l = _mm_loadu_si128((const __m128i *)&ch1[f]);
+		const __m128i r = _mm_loadu_si128((const __m128i *)&ch2[f]);
+		_mm_storeu_si128((__m128i *)&dest[2 * f], _mm_unpacklo_epi16(l, r));
+		_mm_storeu_si128((__m128i *)&dest[2 * f + 8], _mm_unpackhi_epi16(l, r));
+	}
+	audio_interleave_s16_2le_generic(&ch1[f], &ch2[f], frames - f, &dest[2 * f]);
+}
+
+__attribute__ ((target("sse2")))
+static void audio_interleave_s32_4le_sse2(const int32_t *ch1,
+		const int32_t *ch2, size_t frames, int32_t *dest) {
+	size_t f = 0;
+	for (; f + 4 <= frames; f += 4) {
+		const __m128i l = _mm_loadu_si128((const __m128i *)&ch1[f]);
+		const __m128i r = _mm_loadu_si128((const __m128i *)&ch2[f]);
+		_mm_storeu_si128((__m128i *)&dest[2 * f], _mm_unpacklo_epi32(l, r));
+		_mm_storeu_si128((__m128i *)&dest[2 * f + 4], _mm_unpackhi_epi32(l, r));
+	}
+	audio_interleave_s32_4le_generic(&ch1[f], &ch2[f], frames - f, &dest[2 * f]);
+}
+
+__attribute__ ((target("sse2")))
+static void audio_deinterleave_s16_2le_sse2(const int16_t *src,
+		size_t frames, int16_t *dest1, int16_t *dest2) {
+	size_t f = 0;
+	for (; f + 8 <= frames; f += 8) {
+		/* treat every stereo frame as a single 32-bit value */
+		const __m128i a = _mm_loadu_si128((const __m128i *)&src[2 * f]);
+		const __m128i b = _mm_loadu_si128((const __m128i *)&src[2 * f + 8]);
+		const __m128i l = _mm_packs_epi32(
+				_mm_srai_epi32(_mm_slli_epi32(a, 16), 16),
+				_mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+		const __m128i r = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+		_mm_storeu_si128((__m128i *)&dest1[f], l);
+		_mm_storeu_si128((__m128i *)&dest2[f], r);
+	}
+	audio_deinterleave_s16_2le_generic(&src[2 * f], frames - f, &dest1[f], &dest2[f]);
+}
+
+__attribute__ ((target("sse2")))
+static void audio_deinterleave_s32_4le_sse2(const int32_t *src,
+		size_t frames, int32_t *dest1, int32_t *dest2) {
+	size_t f = 0;
+	for (; f + 4 <= frames; f += 4) {
+		const __m128 a = _mm_loadu_ps((const float *)&src[2 * f]);
+		const __m128 b = _mm_loadu_ps((const float *)&src[2 * f + 4]);
+		_mm_storeu_ps((float *)&dest1[f], _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps((float *)&dest2[f], _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	audio_deinterleave_s32_4le_generic(&src[2 * f], frames - f, &dest1[f], &dest2[f]);
+}
+
+__attribute__ ((target("sse2")))
+static void audio_scale_s16_2le_sse2(int16_t *buffer, size_t samples,
+		int32_t ch1, int32_t ch2) {
+
+	/* Amplification is not supported by the vectorized code path. */
+	if (ch1 > AUDIO_Q15_ONE || ch2 > AUDIO_Q15_ONE)
+		return audio_scale_s16_2le_generic(buffer, samples, ch1, ch2);
+
+	/* Neutral gain does not fit in 16-bit integer, so channels with such
+	 * gain are passed through with the help of a bit mask. */
+	const int16_t g1 = MIN(ch1, INT16_MAX);
+	const int16_t g2 = MIN(ch2, INT16_MAX);
+	const int16_t k1 = ch1 == AUDIO_Q15_ONE ? -1 : 0;
+	const int16_t k2 = ch2 == AUDIO_Q15_ONE ? -1 : 0;
+	const __m128i gain = _mm_set_epi16(g2, g1, g2, g1, g2, g1, g2, g1);
+	const __m128i keep = _mm_set_epi16(k2, k1, k2, k1, k2, k1, k2, k1);
+	const __m128i bias = _mm_set1_epi32(AUDIO_Q15_ONE - 1);
+
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		const __m128i x = _mm_loadu_si128((const __m128i *)&buffer[i]);
+		const __m128i lo = _mm_mullo_epi16(x, gain);
+		const __m128i hi = _mm_mulhi_epi16(x, gain);
+		__m128i p0 = _mm_unpacklo_epi16(lo, hi);
+		__m128i p1 = _mm_unpackhi_epi16(lo, hi);
+		/* round toward zero */
+		p0 = _mm_add_epi32(p0, _mm_and_si128(_mm_srai_epi32(p0, 31), bias));
+		p1 = _mm_add_epi32(p1, _mm_and_si128(_mm_srai_epi32(p1, 31), bias));
+		__m128i y = _mm_packs_epi32(_mm_srai_epi32(p0, 15), _mm_srai_epi32(p1, 15));
+		y = _mm_or_si128(_mm_and_si128(keep, x), _mm_andnot_si128(keep, y));
+		_mm_storeu_si128((__m128i *)&buffer[i], y);
+	}
+
+	audio_scale_s16_2le_generic(&buffer[i], samples - i, ch1, ch2);
+
+}
+
+__attribute__ ((target("sse2")))
+static void audio_silence_s16_2le_sse2(int16_t *buffer, size_t samples,
+		bool ch1, bool ch2) {
+	const int16_t m1 = ch1 ? 0 : -1;
+	const int16_t m2 = ch2 ? 0 : -1;
+	const __m128i mask = _mm_set_epi16(m2, m1, m2, m1, m2, m1, m2, m1);
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		__m128i *ptr = (__m128i *)&buffer[i];
+		_mm_storeu_si128(ptr, _mm_and_si128(_mm_loadu_si128(ptr), mask));
+	}
+	audio_silence_s16_2le_generic(&buffer[i], samples - i, ch1, ch2);
+}
+
+__attribute__ ((target("sse2")))
+static void audio_silence_s32_4le_sse2(int32_t *buffer, size_t samples,
+		bool ch1, bool ch2) {
+	const int32_t m1 = ch1 ? 0 : -1;
+	const int32_t m2 = ch2 ? 0 : -1;
+	const __m128i mask = _mm_set_epi32(m2, m1, m2, m1);
+	size_t i = 0;
+	for (; i + 4 <= samples; i += 4) {
+		__m128i *ptr = (__m128i *)&buffer[i];
+		_mm_storeu_si128(ptr, _mm_and_si128(_mm_loadu_si128(ptr), mask));
+	}
+	audio_silence_s32_4le_generic(&buffer[i], samples - i, ch1, ch2);
+}
+
+__attribute__ ((target("sse2")))
+static void audio_mix_s16_2le_sse2(int16_t *dest, const int16_t *src,
+		size_t samples) {
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		__m128i *ptr = (__m128i *)&dest[i];
+		const __m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+		_mm_storeu_si128(ptr, _mm_adds_epi16(_mm_loadu_si128(ptr), x));
+	}
+	audio_mix_s16_2le_generic(&dest[i], &src[i], samples - i);
+}
+
+/**
+ * Saturating addition of signed 32-bit integers.
+ *
+ * The sum overflows if both operands have the same sign and the sign of
+ * the sum is different. In such case the sum is replaced with the limit
+ * of the operand sign. */
+__attribute__ ((target("sse2")))
+static inline __m128i audio_adds_epi32_sse2(__m128i a, __m128i b) {
+	const __m128i s = _mm_add_epi32(a, b);
+	const __m128i overflow = _mm_srai_epi32(
+			_mm_andnot_si128(_mm_xor_si128(a, b), _mm_xor_si128(a, s)), 31);
+	const __m128i limit = _mm_xor_si128(_mm_srai_epi32(a, 31), _mm_set1_epi32(INT32_MAX));
+	return _mm_or_si128(_mm_and_si128(overflow, limit), _mm_andnot_si128(overflow, s));
+}
+
+__attribute__ ((target("sse2")))
+static void audio_mix_s24_4le_sse2(int32_t *dest, const int32_t *src,
+		size_t samples) {
+	size_t i = 0;
+	for (; i + 4 <= samples; i += 4) {
+		__m128i *ptr = (__m128i *)&dest[i];
+		const __m128i a = _mm_slli_epi32(_mm_loadu_si128(ptr), 8);
+		const __m128i b = _mm_slli_epi32(_mm_loadu_si128((const __m128i *)&src[i]), 8);
+		_mm_storeu_si128(ptr, _mm_srai_epi32(audio_adds_epi32_sse2(a, b), 8));
+	}
+	audio_mix_s24_4le_generic(&dest[i], &src[i], samples - i);
+}
+
+__attribute__ ((target("sse2")))
+static void audio_mix_s32_4le_sse2(int32_t *dest, const int32_t *src,
+		size_t samples) {
+	size_t i = 0;
+	for (; i + 4 <= samples; i += 4) {
+		__m128i *ptr = (__m128i *)&dest[i];
+		const __m128i x = _mm_loadu_si128((const __m128i *)&src[i]);
+		_mm_storeu_si128(ptr, audio_adds_epi32_sse2(_mm_loadu_si128(ptr), x));
+	}
+	audio_mix_s32_4le_generic(&dest[i], &src[i], samples - i);
+}
+
+/* SSE2 does not provide signed 32-bit multiplication with 64-bit result,
+ * so for S32 scaling the generic implementation is used. Also, there is
+ * no byte shuffle in SSE2, so 24-bit packing is done by generic code. */
+static const struct audio_kernels audio_kernels_sse2 = {
+	.interleave_s16_2le = audio_interleave_s16_2le_sse2,
+	.interleave_s32_4le = audio_interleave_s32_4le_sse2,
+	.deinterleave_s16_2le = audio_deinterleave_s16_2le_sse2,
+	.deinterleave_s32_4le = audio_deinterleave_s32_4le_sse2,
+	.scale_s16_2le = audio_scale_s16_2le_sse2,
+	.scale_s32_4le = audio_scale_s32_4le_generic,
+	.silence_s16_2le = audio_silence_s16_2le_sse2,
+	.silence_s32_4le = audio_silence_s32_4le_sse2,
+	.pack_s16_2le_s24_3le = audio_pack_s16_2le_s24_3le_generic,
+	.pack_s24_4le_s24_3le = audio_pack_s24_4le_s24_3le_generic,
+	.unpack_s24_3le_s16_2le = audio_unpack_s24_3le_s16_2le_generic,
+	.unpack_s24_3le_s24_4le = audio_unpack_s24_3le_s24_4le_generic,
+	.mix_s16_2le = audio_mix_s16_2le_sse2,
+	.mix_s24_4le = audio_mix_s24_4le_sse2,
+	.mix_s32_4le = audio_mix_s32_4le_sse2,
+};
+
+/* Store 8 packed 24-bit samples (24 bytes) held in the first 12 bytes of
+ * the lo and hi vectors. */
+__attribute__ ((target("ssse3")))
+static inline void audio_store_s24_3le_ssse3(uint8_t *dest, __m128i lo, __m128i hi) {
+	_mm_storeu_si128((__m128i *)dest, _mm_or_si128(lo, _mm_slli_si128(hi, 12)));
+	_mm_storel_epi64((__m128i *)&dest[16], _mm_srli_si128(hi, 4));
+}
+
+__attribute__ ((target("ssse3")))
+static void audio_pack_s16_2le_s24_3le_ssse3(const int16_t *src,
+		size_t samples, uint8_t *dest) {
+	const __m128i lo = _mm_setr_epi8(-1, 0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, -1, -1, -1);
+	const __m128i hi = _mm_setr_epi8(-1, 8, 9, -1, 10, 11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1);
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)&src[i]);
+		audio_store_s24_3le_ssse3(&dest[3 * i],
+				_mm_shuffle_epi8(v, lo), _mm_shuffle_epi8(v, hi));
+	}
+	audio_pack_s16_2le_s24_3le_generic(&src[i], samples - i, &dest[3 * i]);
+}
+
+__attribute__ ((target("ssse3")))
+static void audio_pack_s24_4le_s24_3le_ssse3(const int32_t *src,
+		size_t samples, uint8_t *dest) {
+	const __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)&src[i]);
+		const __m128i b = _mm_loadu_si128((const __m128i *)&src[i + 4]);
+		audio_store_s24_3le_ssse3(&dest[3 * i],
+				_mm_shuffle_epi8(a, mask), _mm_shuffle_epi8(b, mask));
+	}
+	audio_pack_s24_4le_s24_3le_generic(&src[i], samples - i, &dest[3 * i]);
+}
+
+__attribute__ ((target("ssse3")))
+static void audio_unpack_s24_3le_s16_2le_ssse3(const uint8_t *src,
+		size_t samples, int16_t *dest) {
+	const __m128i lo = _mm_setr_epi8(1, 2, 4, 5, 7, 8, 10, 11, 13, 14, -1, -1, -1, -1, -1, -1);
+	const __m128i hi = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, 3, 4, 6, 7);
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)&src[3 * i]);
+		const __m128i b = _mm_loadl_epi64((const __m128i *)&src[3 * i + 16]);
+		_mm_storeu_si128((__m128i *)&dest[i],
+				_mm_or_si128(_mm_shuffle_epi8(a, lo), _mm_shuffle_epi8(b, hi)));
+	}
+	audio_unpack_s24_3le_s16_2le_generic(&src[3 * i], samples - i, &dest[i]);
+}
+
+__attribute__ ((target("ssse3")))
+static void audio_unpack_s24_3le_s24_4le_ssse3(const uint8_t *src,
+		size_t samples, int32_t *dest) {
+	/* place 24-bit samples in the upper bytes, so the arithmetic
+	 * shift will extend the sign */
+	const __m128i mask = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		const __m128i a = _mm_loadu_si128((const __m128i *)&src[3 * i]);
+		const __m128i b = _mm_loadl_epi64((const __m128i *)&src[3 * i + 16]);
+		const __m128i c = _mm_alignr_epi8(b, a, 12);
+		_mm_storeu_si128((__m128i *)&dest[i], _mm_srai_epi32(_mm_shuffle_epi8(a, mask), 8));
+		_mm_storeu_si128((__m128i *)&dest[i + 4], _mm_srai_epi32(_mm_shuffle_epi8(c, mask), 8));
+	}
+	audio_unpack_s24_3le_s24_4le_generic(&src[3 * i], samples - i, &dest[i]);
+}
+
+/* SSSE3 adds byte shuffle, which is used for 24-bit packing. */
+static const struct audio_kernels audio_kernels_ssse3 = {
+	.interleave_s16_2le = audio_interleave_s16_2le_sse2,
+	.interleave_s32_4le = audio_interleave_s32_4le_sse2,
+	.deinterleave_s16_2le = audio_deinterleave_s16_2le_sse2,
+	.deinterleave_s32_4le = audio_deinterleave_s32_4le_sse2,
+	.scale_s16_2le = audio_scale_s16_2le_sse2,
+	.scale_s32_4le = audio_scale_s32_4le_generic,
+	.silence_s16_2le = audio_silence_s16_2le_sse2,
+	.silence_s32_4le = audio_silence_s32_4le_sse2,
+	.pack_s16_2le_s24_3le = audio_pack_s16_2le_s24_3le_ssse3,
+	.pack_s24_4le_s24_3le = audio_pack_s24_4le_s24_3le_ssse3,
+	.unpack_s24_3le_s16_2le = audio_unpack_s24_3le_s16_2le_ssse3,
+	.unpack_s24_3le_s24_4le = audio_unpack_s24_3le_s24_4le_ssse3,
+	.mix_s16_2le = audio_mix_s16_2le_sse2,
+	.mix_s24_4le = audio_mix_s24_4le_sse2,
+	.mix_s32_4le = audio_mix_s32_4le_sse2,
+};
+
+__attribute__ ((target("avx2")))
+static void audio_scale_s16_2le_avx2(int16_t *buffer, size_t samples,
+		int32_t ch1, int32_t ch2) {
+
+	if (ch1 > AUDIO_Q15_ONE || ch2 > AUDIO_Q15_ONE)
+		return audio_scale_s16_2le_generic(buffer, samples, ch1, ch2);
+
+	const int16_t g1 = MIN(ch1, INT16_MAX);
+	const int16_t g2 = MIN(ch2, INT16_MAX);
+	const int16_t k1 = ch1 == AUDIO_Q15_ONE ? -1 : 0;
+	const int16_t k2 = ch2 == AUDIO_Q15_ONE ? -1 : 0;
+	const __m256i gain = _mm256_set1_epi32((uint16_t)g1 | (uint32_t)(uint16_t)g2 << 16);
+	const __m256i keep = _mm256_set1_epi32((uint16_t)k1 | (uint32_t)(uint16_t)k2 << 16);
+	const __m256i bias = _mm256_set1_epi32(AUDIO_Q15_ONE - 1);
+
+	size_t i = 0;
+	for (; i + 16 <= samples; i += 16) {
+		const __m256i x = _mm256_loadu_si256((const __m256i *)&buffer[i]);
+		const __m256i lo = _mm256_mullo_epi16(x, gain);
+		const __m256i hi = _mm256_mulhi_epi16(x, gain);
+		/* unpack and pack operate within 128-bit lanes,
+		 * so the order of samples is preserved */
+		__m256i p0 = _mm256_unpacklo_epi16(lo, hi);
+		__m256i p1 = _mm256_unpackhi_epi16(lo, hi);
+		p0 = _mm256_add_epi32(p0, _mm256_and_si256(_mm256_srai_epi32(p0, 31), bias));
+		p1 = _mm256_add_epi32(p1, _mm256_and_si256(_mm256_srai_epi32(p1, 31), bias));
+		__m256i y = _mm256_packs_epi32(_mm256_srai_epi32(p0, 15), _mm256_srai_epi32(p1, 15));
+		y = _mm256_blendv_epi8(y, x, keep);
+		_mm256_storeu_si256((__m256i *)&buffer[i], y);
+	}
+
+	audio_scale_s16_2le_generic(&buffer[i], samples - i, ch1, ch2);
+
+}
+
+__attribute__ ((target("avx2")))
+static void audio_scale_s32_4le_avx2(int32_t *buffer, size_t samples,
+		int64_t ch1, int64_t ch2) {
+
+	if (ch1 > AUDIO_Q31_ONE || ch2 > AUDIO_Q31_ONE)
+		return audio_scale_s32_4le_generic(buffer, samples, ch1, ch2);
+
+	const __m256i g1 = _mm256_set1_epi32(MIN(ch1, INT32_MAX));
+	const __m256i g2 = _mm256_set1_epi32(MIN(ch2, INT32_MAX));
+	const int32_t k1 = ch1 == AUDIO_Q31_ONE ? -1 : 0;
+	const int32_t k2 = ch2 == AUDIO_Q31_ONE ? -1 : 0;
+	const __m256i keep = _mm256_set_epi32(k2, k1, k2, k1, k2, k1, k2, k1);
+	const __m256i bias = _mm256_set1_epi64x(AUDIO_Q31_ONE - 1);
+	const __m256i zero = _mm256_setzero_si256();
+
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		const __m256i x = _mm256_loadu_si256((const __m256i *)&buffer[i]);
+		/* 64-bit products of even and odd samples */
+		__m256i pe = _mm256_mul_epi32(x, g1);
+		__m256i po = _mm256_mul_epi32(_mm256_srli_epi64(x, 32), g2);
+		/* round toward zero */
+		pe = _mm256_add_epi64(pe, _mm256_and_si256(_mm256_cmpgt_epi64(zero, pe), bias));
+		po = _mm256_add_epi64(po, _mm256_and_si256(_mm256_cmpgt_epi64(zero, po), bias));
+		/* Result fits in 32 bits, so the logical shift can be used. Odd results
+		 * are placed directly in the upper half of 64-bit elements. */
+		__m256i y = _mm256_blend_epi32(_mm256_srli_epi64(pe, 31),
+				_mm256_slli_epi64(po, 1), 0xAA);
+		y = _mm256_blendv_epi8(y, x, keep);
+		_mm256_storeu_si256((__m256i *)&buffer[i], y);
+	}
+
+	audio_scale_s32_4le_generic(&buffer[i], samples - i, ch1, ch2);
+
+}
+
+__attribute__ ((target("avx2")))
+static void audio_mix_s16_2le_avx2(int16_t *dest, const int16_t *src,
+		size_t samples) {
+	size_t i = 0;
+	for (; i + 16 <= samples; i += 16) {
+		__m256i *ptr = (__m256i *)&dest[i];
+		const __m256i x = _mm256_loadu_si256((const __m256i *)&src[i]);
+		_mm256_storeu_si256(ptr, _mm256_adds_epi16(_mm256_loadu_si256(ptr), x));
+	}
+	audio_mix_s16_2le_sse2(&dest[i], &src[i], samples - i);
+}
+
+__attribute__ ((target("avx2")))
+static inline __m256i audio_adds_epi32_avx2(__m256i a, __m256i b) {
+	const __m256i s = _mm256_add_epi32(a, b);
+	const __m256i overflow = _mm256_srai_epi32(
+			_mm256_andnot_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, s)), 31);
+	const __m256i limit = _mm256_xor_si256(_mm256_srai_epi32(a, 31), _mm256_set1_epi32(INT32_MAX));
+	return _mm256_blendv_epi8(s, limit, overflow);
+}
+
+__attribute__ ((target("avx2")))
+static void audio_mix_s24_4le_avx2(int32_t *dest, const int32_t *src,
+		size_t samples) {
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		__m256i *ptr = (__m256i *)&dest[i];
+		const __m256i a = _mm256_slli_epi32(_mm256_loadu_si256(ptr), 8);
+		const __m256i b = _mm256_slli_epi32(_mm256_loadu_si256((const __m256i *)&src[i]), 8);
+		_mm256_storeu_si256(ptr, _mm256_srai_epi32(audio_adds_epi32_avx2(a, b), 8));
+	}
+	audio_mix_s24_4le_sse2(&dest[i], &src[i], samples - i);
+}
+
+__attribute__ ((target("avx2")))
+static void audio_mix_s32_4le_avx2(int32_t *dest, const int32_t *src,
+		size_t samples) {
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		__m256i *ptr = (__m256i *)&dest[i];
+		const __m256i x = _mm256_loadu_si256((const __m256i *)&src[i]);
+		_mm256_storeu_si256(ptr, audio_adds_epi32_avx2(_mm256_loadu_si256(ptr), x));
+	}
+	audio_mix_s32_4le_sse2(&dest[i], &src[i], samples - i);
+}
+
+static const struct audio_kernels audio_kernels_avx2 = {
+	.interleave_s16_2le = audio_interleave_s16_2le_sse2,
+	.interleave_s32_4le = audio_interleave_s32_4le_sse2,
+	.deinterleave_s16_2le = audio_deinterleave_s16_2le_sse2,
+	.deinterleave_s32_4le = audio_deinterleave_s32_4le_sse2,
+	.scale_s16_2le = audio_scale_s16_2le_avx2,
+	.scale_s32_4le = audio_scale_s32_4le_avx2,
+	.silence_s16_2le = audio_silence_s16_2le_sse2,
+	.silence_s32_4le = audio_silence_s32_4le_sse2,
+	.pack_s16_2le_s24_3le = audio_pack_s16_2le_s24_3le_ssse3,
+	.pack_s24_4le_s24_3le = audio_pack_s24_4le_s24_3le_ssse3,
+	.unpack_s24_3le_s16_2le = audio_unpack_s24_3le_s16_2le_ssse3,
+	.unpack_s24_3le_s24_4le = audio_unpack_s24_3le_s24_4le_ssse3,
+	.mix_s16_2le = audio_mix_s16_2le_avx2,
+	.mix_s24_4le = audio_mix_s24_4le_avx2,
+	.mix_s32_4le = audio_mix_s32_4le_avx2,
+};
+
+#endif
+
+#if AUDIO_IMPL_HAVE_NEON
+
+static void audio_interleave_s16_2le_neon(const int16_t *ch1,
+		const int16_t *ch2, size_t frames, int16_t *dest) {
+	size_t f = 0;
+	for (; f + 8 <= frames; f += 8) {
+		const int16x8x2_t v = {{ vld1q_s16(&ch1[f]), vld1q_s16(&ch2[f]) }};
+		vst2q_s16(&dest[2 * f], v);
+	}
+	audio_interleave_s16_2le_generic(&ch1[f], &ch2[f], frames - f, &dest[2 * f]);
+}
+
+static void audio_interleave_s32_4le_neon(const int32_t *ch1,
+		const int32_t *ch2, size_t frames, int32_t *dest) {
+	size_t f = 0;
+	for (; f + 4 <= frames; f += 4) {
+		const int32x4x2_t v = {{ vld1q_s32(&ch1[f]), vld1q_s32(&ch2[f]) }};
+		vst2q_s32(&dest[2 * f], v);
+	}
+	audio_interleave_s32_4le_generic(&ch1[f], &ch2[f], frames - f, &dest[2 * f]);
+}
+
+static void audio_deinterleave_s16_2le_neon(const int16_t *src,
+		size_t frames, int16_t *dest1, int16_t *dest2) {
+	size_t f = 0;
+	for (; f + 8 <= frames; f += 8) {
+		const int16x8x2_t v = vld2q_s16(&src[2 * f]);
+		vst1q_s16(&dest1[f], v.val[0]);
+		vst1q_s16(&dest2[f], v.val[1]);
+	}
+	audio_deinterleave_s16_2le_generic(&src[2 * f], frames - f, &dest1[f], &dest2[f]);
+}
+
+static void audio_deinterleave_s32_4le_neon(const int32_t *src,
+		size_t frames, int32_t *dest1, int32_t *dest2) {
+	size_t f = 0;
+	for (; f + 4 <= frames; f += 4) {
+		const int32x4x2_t v = vld2q_s32(&src[2 * f]);
+		vst1q_s32(&dest1[f], v.val[0]);
+		vst1q_s32(&dest2[f], v.val[1]);
+	}
+	audio_deinterleave_s32_4le_generic(&src[2 * f], frames - f, &dest1[f], &dest2[f]);
+}
+
+static void audio_scale_s16_2le_neon(int16_t *buffer, size_t samples,
+		int32_t ch1, int32_t ch2) {
+
+	if (ch1 > AUDIO_Q15_ONE || ch2 > AUDIO_Q15_ONE)
+		return audio_scale_s16_2le_generic(buffer, samples, ch1, ch2);
+
+	const int16_t g1 = MIN(ch1, INT16_MAX);
+	const int16_t g2 = MIN(ch2, INT16_MAX);
+	const uint16_t k1 = ch1 == AUDIO_Q15_ONE ? 0xFFFF : 0;
+	const uint16_t k2 = ch2 == AUDIO_Q15_ONE ? 0xFFFF : 0;
+	const int16x4_t gain = { g1, g2, g1, g2 };
+	const uint16x8_t keep = { k1, k2, k1, k2, k1, k2, k1, k2 };
+	const int32x4_t bias = vdupq_n_s32(AUDIO_Q15_ONE - 1);
+
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8) {
+		const int16x8_t x = vld1q_s16(&buffer[i]);
+		int32x4_t p0 = vmull_s16(vget_low_s16(x), gain);
+		int32x4_t p1 = vmull_s16(vget_high_s16(x), gain);
+		/* round toward zero */
+		p0 = vaddq_s32(p0, vandq_s32(vshrq_n_s32(p0, 31), bias));
+		p1 = vaddq_s32(p1, vandq_s32(vshrq_n_s32(p1, 31), bias));
+		const int16x8_t y = vcombine_s16(
+				vqmovn_s32(vshrq_n_s32(p0, 15)), vqmovn_s32(vshrq_n_s32(p1, 15)));
+		vst1q_s16(&buffer[i], vbslq_s16(keep, x, y));
+	}
+
+	audio_scale_s16_2le_generic(&buffer[i], samples - i, ch1, ch2);
+
+}
+
+static void audio_scale_s32_4le_neon(int32_t *buffer, size_t samples,
+		int64_t ch1, int64_t ch2) {
+
+	if (ch1 > AUDIO_Q31_ONE || ch2 > AUDIO_Q31_ONE)
+		return audio_scale_s32_4le_generic(buffer, samples, ch1, ch2);
+
+	const int32_t g1 = MIN(ch1, INT32_MAX);
+	const int32_t g2 = MIN(ch2, INT32_MAX);
+	const uint32_t k1 = ch1 == AUDIO_Q31_ONE ? 0xFFFFFFFF : 0;
+	const uint32_t k2 = ch2 == AUDIO_Q31_ONE ? 0xFFFFFFFF : 0;
+	const int32x2_t gain = { g1, g2 };
+	const uint32x4_t keep = { k1, k2, k1, k2 };
+	const int64x2_t bias = vdupq_n_s64(AUDIO_Q31_ONE - 1);
+
+	size_t i = 0;
+	for (; i + 4 <= samples; i += 4) {
+		const int32x4_t x = vld1q_s32(&buffer[i]);
+		int64x2_t p0 = vmull_s32(vget_low_s32(x), gain);
+		int64x2_t p1 = vmull_s32(vget_high_s32(x), gain);
+		/* round toward zero */
+		p0 = vaddq_s64(p0, vandq_s64(vshrq_n_s64(p0, 63), bias));
+		p1 = vaddq_s64(p1, vandq_s64(vshrq_n_s64(p1, 63), bias));
+		const int32x4_t y = vcombine_s32(vshrn_n_s64(p0, 31), vshrn_n_s64(p1, 31));
+		vst1q_s32(&buffer[i], vbslq_s32(keep, x, y));
+	}
+
+	audio_scale_s32_4le_generic(&buffer[i], samples - i, ch1, ch2);
+
+}
+
+static void audio_silence_s16_2le_neon(int16_t *buffer, size_t samples,
+		bool ch1, bool ch2) {
+	const int16_t m1 = ch1 ? 0 : -1;
+	const int16_t m2 = ch2 ? 0 : -1;
+	const int16x8_t mask = { m1, m2, m1, m2, m1, m2, m1, m2 };
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8)
+		vst1q_s16(&buffer[i], vandq_s16(vld1q_s16(&buffer[i]), mask));
+	audio_silence_s16_2le_generic(&buffer[i], samples - i, ch1, ch2);
+}
+
+static void audio_silence_s32_4le_neon(int32_t *buffer, size_t samples,
+		bool ch1, bool ch2) {
+	const int32_t m1 = ch1 ? 0 : -1;
+	const int32_t m2 = ch2 ? 0 : -1;
+	const int32x4_t mask = { m1, m2, m1, m2 };
+	size_t i = 0;
+	for (; i + 4 <= samples; i += 4)
+		vst1q_s32(&buffer[i], vandq_s32(vld1q_s32(&buffer[i]), mask));
+	audio_silence_s32_4le_generic(&buffer[i], samples - i, ch1, ch2);
+}
+
+static void audio_pack_s16_2le_s24_3le_neon(const int16_t *src,
+		size_t samples, uint8_t *dest) {
+	size_t i = 0;
+	for (; i + 16 <= samples; i += 16) {
+		/* split samples into low and high bytes */
+		const uint8x16x2_t v = vld2q_u8((const uint8_t *)&src[i]);
+		const uint8x16x3_t w = {{ vdupq_n_u8(0), v.val[0], v.val[1] }};
+		vst3q_u8(&dest[3 * i], w);
+	}
+	audio_pack_s16_2le_s24_3le_generic(&src[i], samples - i, &dest[3 * i]);
+}
+
+static void audio_pack_s24_4le_s24_3le_neon(const int32_t *src,
+		size_t samples, uint8_t *dest) {
+	size_t i = 0;
+	for (; i + 16 <= samples; i += 16) {
+		const uint8x16x4_t v = vld4q_u8((const uint8_t *)&src[i]);
+		const uint8x16x3_t w = {{ v.val[0], v.val[1], v.val[2] }};
+		vst3q_u8(&dest[3 * i], w);
+	}
+	audio_pack_s24_4le_s24_3le_generic(&src[i], samples - i, &dest[3 * i]);
+}
+
+static void audio_unpack_s24_3le_s16_2le_neon(const uint8_t *src,
+		size_t samples, int16_t *dest) {
+	size_t i = 0;
+	for (; i + 16 <= samples; i += 16) {
+		const uint8x16x3_t v = vld3q_u8(&src[3 * i]);
+		const uint8x16x2_t w = {{ v.val[1], v.val[2] }};
+		vst2q_u8((uint8_t *)&dest[i], w);
+	}
+	audio_unpack_s24_3le_s16_2le_generic(&src[3 * i], samples - i, &dest[i]);
+}
+
+static void audio_unpack_s24_3le_s24_4le_neon(const uint8_t *src,
+		size_t samples, int32_t *dest) {
+	size_t i = 0;
+	for (; i + 16 <= samples; i += 16) {
+		const uint8x16x3_t v = vld3q_u8(&src[3 * i]);
+		/* replicate the sign bit of the most significant byte */
+		const uint8x16_t sign = vreinterpretq_u8_s8(
+				vshrq_n_s8(vreinterpretq_s8_u8(v.val[2]), 7));
+		const uint8x16x4_t w = {{ v.val[0], v.val[1], v.val[2], sign }};
+		vst4q_u8((uint8_t *)&dest[i], w);
+	}
+	audio_unpack_s24_3le_s24_4le_generic(&src[3 * i], samples - i, &dest[i]);
+}
+
+static void audio_mix_s16_2le_neon(int16_t *dest, const int16_t *src,
+		size_t samples) {
+	size_t i = 0;
+	for (; i + 8 <= samples; i += 8)
+		vst1q_s16(&dest[i], vqaddq_s16(vld1q_s16(&dest[i]), vld1q_s16(&src[i])));
+	audio_mix_s16_2le_generic(&dest[i], &src[i], samples - i);
+}
+
+static void audio_mix_s24_4le_neon(int32_t *dest, const int32_t *src,
+		size_t samples) {
+	size_t i = 0;
+	for (; i + 4 <= samples; i += 4) {
+		const int32x4_t a = vshlq_n_s32(vld1q_s32(&dest[i]), 8);
+		const int32x4_t b = vshlq_n_s32(vld1q_s32(&src[i]), 8);
+		vst1q_s32(&dest[i], vshrq_n_s32(vqaddq_s32(a, b), 8));
+	}
+	audio_mix_s24_4le_generic(&dest[i], &src[i], samples - i);
+}
+
+static void audio_mix_s32_4le_neon(int32_t *dest, const int32_t *src,
+		size_t samples) {
+	size_t i = 0;
+	for (; i + 4 <= samples; i += 4)
+		vst1q_s32(&dest[i], vqaddq_s32(vld1q_s32(&dest[i]), vld1q_s32(&src[i])));
+	audio_mix_s32_4le_generic(&dest[i], &src[i], samples - i);
+}
+
+static const struct audio_kernels audio_kernels_neon = {
+	.interleave_s16_2le = audio_interleave_s16_2le_neon,
+	.interleave_s32_4le = audio_interleave_s32_4le_neon,
+	.deinterleave_s16_2le = audio_deinterleave_s16_2le_neon,
+	.deinterleave_s32_4le = audio_deinterleave_s32_4le_neon,
+	.scale_s16_2le = audio_scale_s16_2le_neon,
+	.scale_s32_4le = audio_scale_s32_4le_neon,
+	.silence_s16_2le = audio_silence_s16_2le_neon,
+	.silence_s32_4le = audio_silence_s32_4le_neon,
+	.pack_s16_2le_s24_3le = audio_pack_s16_2le_s24_3le_neon,
+	.pack_s24_4le_s24_3le = audio_pack_s24_4le_s24_3le_neon,
+	.unpack_s24_3le_s16_2le = audio_unpack_s24_3le_s16_2le_neon,
+	.unpack_s24_3le_s24_4le = audio_unpack_s24_3le_s24_4le_neon,
+	.mix_s16_2le = audio_mix_s16_2le_neon,
+	.mix_s24_4le = audio_mix_s24_4le_neon,
+	.mix_s32_4le = audio_mix_s32_4le_neon,
+};
+
+#endif
+
+/* currently selected PCM processing kernels */
+static const struct audio_kernels *audio_kernels = &audio_kernels_generic;
+static enum audio_impl audio_kernels_impl = AUDIO_IMPL_GENERIC;
+
+static const struct audio_kernels *audio_impl_get_kernels(enum audio_impl impl) {
+	switch (impl) {
+	case AUDIO_IMPL_GENERIC:
+		return &audio_kernels_generic;
+#if AUDIO_IMPL_HAVE_X86
+	case AUDIO_IMPL_SSE2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2") ? &audio_kernels_sse2 : NULL;
+	case AUDIO_IMPL_SSSE3:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("ssse3") ? &audio_kernels_ssse3 : NULL;
+	case AUDIO_IMPL_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") ? &audio_kernels_avx2 : NULL;
+#endif
+#if AUDIO_IMPL_HAVE_NEON
+	case AUDIO_IMPL_NEON:
+		return &audio_kernels_neon;
+#endif
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * Get the name of the PCM processing implementation. */
+const char *audio_impl_name(enum audio_impl impl) {
+	switch (impl) {
+	case AUDIO_IMPL_GENERIC:
+		return "generic";
+	case AUDIO_IMPL_SSE2:
+		return "SSE2";
+	case AUDIO_IMPL_SSSE3:
+		return "SSSE3";
+	case AUDIO_IMPL_AVX2:
+		return "AVX2";
+	case AUDIO_IMPL_NEON:
+		return "NEON";
+	}
+	return "unknown";
+}
+
+/**
+ * Get currently selected PCM processing implementation. */
+enum audio_impl audio_impl_get(void) {
+	return audio_kernels_impl;
+}
+
+/**
+ * Select PCM processing implementation.
+ *
+ * Note:
+ * This function is not thread-safe. It shall be called before any PCM
+ * processing function is used, e.g. during the application startup.
+ *
+ * @param impl The implementation to select.
+ * @return On success this function returns 0. If the implementation is
+ *   not supported by the build or the CPU, -1 is returned. */
+int audio_impl_select(enum audio_impl impl) {
+
+	const struct audio_kernels *kernels;
+	if ((kernels = audio_impl_get_kernels(impl)) == NULL)
+		return -1;
+
+	audio_kernels = kernels;
+	audio_kernels_impl = impl;
+	return 0;
+}
+
+/**
+ * Initialize PCM processing with the best implementation available. */
+void audio_init(void) {
+
+	const enum audio_impl impls[] = {
+		AUDIO_IMPL_AVX2,
+		AUDIO_IMPL_NEON,
+		AUDIO_IMPL_SSSE3,
+		AUDIO_IMPL_SSE2,
+		AUDIO_IMPL_GENERIC,
+	};
+
+	for (size_t i = 0; i < ARRAYSIZE(impls); i++)
+		if (audio_impl_select(impls[i]) == 0)
+			break;
+
+	debug("Using %s PCM processing implementation",
+			audio_impl_name(audio_kernels_impl));
+
+}
+
 /**
  * Join channels into interleaved S16 PCM signal. */
 void audio_interleave_s16_2le(const int16_t *ch1, const int16_t *ch2,
 		size_t frames, unsigned int channels, int16_t *dest) {
-	const int16_t *src[] = { ch1, ch2 };
-	g_assert_cmpint(channels, <=, ARRAYSIZE(src));
-	for (size_t f = 0; f < frames; f++)
-		for (unsigned int c = 0; c < channels; c++)
-			*dest++ = src[c][f];
+	switch (channels) {
+	case 1:
+		memcpy(dest, ch1, frames * sizeof(*dest));
+		break;
+	case 2:
+		audio_kernels->interleave_s16_2le(ch1, ch2, frames, dest);
+		break;
+	default:
+		g_assert_not_reached();
+	}
 }
 
 /**
  * Join channels into interleaved S32 PCM signal. */
 void audio_interleave_s32_4le(const int32_t *ch1, const int32_t *ch2,
 		size_t frames, unsigned int channels, int32_t *dest) {
-	const int32_t *src[] = { ch1, ch2 };
-	g_assert_cmpint(channels, <=, ARRAYSIZE(src));
-	for (size_t f = 0; f < frames; f++)
-		for (unsigned int c = 0; c < channels; c++)
-			*dest++ = src[c][f];
+	switch (channels) {
+	case 1:
+		memcpy(dest, ch1, frames * sizeof(*dest));
+		break;
+	case 2:
+		audio_kernels->interleave_s32_4le(ch1, ch2, frames, dest);
+		break;
+	default:
+		g_assert_not_reached();
+	}
 }
 
 /**
  * Split interleaved S16 PCM signal into channels. */
 void audio_deinterleave_s16_2le(const int16_t *src, size_t frames,
 		unsigned int channels, int16_t *dest1, int16_t *dest2) {
-	int16_t *dest[] = { dest1, dest2 };
-	g_assert_cmpint(channels, <=, ARRAYSIZE(dest));
-	for (size_t f = 0; f < frames; f++)
-		for (unsigned int c = 0; c < channels; c++)
-			dest[c][f] = *src++;
+	switch (channels) {
+	case 1:
+		memcpy(dest1, src, frames * sizeof(*dest1));
+		break;
+	case 2:
+		audio_kernels->deinterleave_s16_2le(src, frames, dest1, dest2);
+		break;
+	default:
+		g_assert_not_reached();
+	}
 }
 
 /**
  * Split interleaved S32 PCM signal into channels. */
 void audio_deinterleave_s32_4le(const int32_t *src, size_t frames,
 		unsigned int channels, int32_t *dest1, int32_t *dest2) {
-	int32_t *dest[] = { dest1, dest2 };
-	g_assert_cmpint(channels, <=, ARRAYSIZE(dest));
-	for (size_t f = 0; f < frames; f++)
-		for (unsigned int c = 0; c < channels; c++)
-			dest[c][f] = *src++;
+	switch (channels) {
+	case 1:
+		memcpy(dest1, src, frames * sizeof(*dest1));
+		break;
+	case 2:
+		audio_kernels->deinterleave_s32_4le(src, frames, dest1, dest2);
+		break;
+	default:
+		g_assert_not_reached();
+	}
 }
 
 /**
@@ -88,7 +1082,8 @@ void audio_deinterleave_s32_4le(const int32_t *src, size_t frames,
  *
  * Neutral value for scaling factor is 1.0. It is possible to increase
  * signal gain by using scaling factor values greater than 1, however,
- * clipping will most certainly occur.
+ * clipping will most certainly occur. Internally, the signal is scaled
+ * with Q15 fixed-point gain and saturated to the 16-bit range.
  *
  * @param buffer Address to the buffer where the PCM signal is stored.
  * @param frames The number of PCM frames in the buffer.
@@ -97,54 +1092,107 @@ void audio_deinterleave_s32_4le(const int32_t *src, size_t frames,
  * @param ch1 The scaling factor for 2nd channel. */
 void audio_scale_s16_2le(int16_t *buffer, size_t frames,
 		unsigned int channels, double ch1, double ch2) {
-	audio_silence_s16_2le(buffer, frames, channels, ch1 == 0, ch2 == 0);
-	switch (channels) {
-	case 1:
-		if (ch1 != 0 && ch1 != 1)
-			while (frames--) {
-				int16_t s1 = (int16_t)le16toh(buffer[frames]) * ch1;
-				buffer[frames] = htole16(s1);
-			}
-		break;
-	case 2:
-		if ((ch1 != 0 && ch1 != 1) || (ch2 != 0 && ch2 != 1))
-			while (frames--) {
-				int16_t s1 = (int16_t)le16toh(buffer[2 * frames]) * ch1;
-				buffer[2 * frames] = htole16(s1);
-				int16_t s2 = (int16_t)le16toh(buffer[2 * frames + 1]) * ch2;
-				buffer[2 * frames + 1] = htole16(s2);
-			}
-		break;
-	default:
-		g_assert_not_reached();
-	}
+	audio_scale_s16_2le_q15(buffer, frames, channels,
+			audio_scale_to_q15(ch1), audio_scale_to_q15(ch2));
+}
+
+/**
+ * Scale S16_2LE PCM signal with precomputed Q15 gains.
+ *
+ * @param buffer Address to the buffer where the PCM signal is stored.
+ * @param frames The number of PCM frames in the buffer.
+ * @param channels The number of channels in the buffer.
+ * @param ch1 The Q15 gain for 1st channel.
+ * @param ch1 The Q15 gain for 2nd channel. */
+void audio_scale_s16_2le_q15(int16_t *buffer, size_t frames,
+		unsigned int channels, int32_t ch1, int32_t ch2) {
+
+	if (channels == 1)
+		ch2 = ch1;
+	g_assert_cmpint(channels, <=, 2);
+
+	/* mute or pass-through only */
+	if ((ch1 == 0 || ch1 == AUDIO_Q15_ONE) && (ch2 == 0 || ch2 == AUDIO_Q15_ONE))
+		return audio_silence_s16_2le(buffer, frames, channels, ch1 == 0, ch2 == 0);
+
+	audio_kernels->scale_s16_2le(buffer, frames * channels, ch1, ch2);
+
 }
 
 /**
- * Scale S32_4LE PCM signal. */
+ * Scale S32_4LE PCM signal.
+ *
+ * Internally, the signal is scaled with Q31 fixed-point gain and
+ * saturated to the 32-bit range. */
 void audio_scale_s32_4le(int32_t *buffer, size_t frames,
 		unsigned int channels, double ch1, double ch2) {
-	audio_silence_s32_4le(buffer, frames, channels, ch1 == 0, ch2 == 0);
-	switch (channels) {
-	case 1:
-		if (ch1 != 0 && ch1 != 1)
-			while (frames--) {
-				int32_t s1 = (int32_t)le32toh(buffer[frames]) * ch1;
-				buffer[frames] = htole32(s1);
-			}
-		break;
-	case 2:
-		if ((ch1 != 0 && ch1 != 1) || (ch2 != 0 && ch2 != 1))
-			while (frames--) {
-				int32_t s1 = (int32_t)le32toh(buffer[2 * frames]) * ch1;
-				buffer[2 * frames] = htole32(s1);
-				int32_t s2 = (int32_t)le32toh(buffer[2 * frames + 1]) * ch2;
-				buffer[2 * frames + 1] = htole32(s2);
-			}
-		break;
-	default:
-		g_assert_not_reached();
+	audio_scale_s32_4le_q31(buffer, frames, channels,
+			audio_scale_to_q31(ch1), audio_scale_to_q31(ch2));
+}
+
+/**
+ * Scale S32_4LE PCM signal with precomputed Q31 gains.
+ *
+ * The whole processing is done with the 64-bit integer arithmetic, so
+ * this function does not require FPU. Gains above 0 dB saturate the
+ * signal instead of wrapping it around. */
+void audio_scale_s32_4le_q31(int32_t *buffer, size_t frames,
+		unsigned int channels, int64_t ch1, int64_t ch2) {
+
+	if (channels == 1)
+		ch2 = ch1;
+	g_assert_cmpint(channels, <=, 2);
+
+	/* mute or pass-through only */
+	if ((ch1 == 0 || ch1 == AUDIO_Q31_ONE) && (ch2 == 0 || ch2 == AUDIO_Q31_ONE))
+		return audio_silence_s32_4le(buffer, frames, channels, ch1 == 0, ch2 == 0);
+
+	audio_kernels->scale_s32_4le(buffer, frames * channels, ch1, ch2);
+
+}
+
+/**
+ * Get next value of the xorshift32 pseudo-random generator. */
+static inline uint32_t audio_dither_rand(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+/**
+ * Reduce S32_4LE PCM signal to S16_2LE.
+ *
+ * Samples are rounded to the nearest 16-bit value and saturated. If the
+ * dither state is given, triangular probability density function (TPDF)
+ * dither with the amplitude of +/-1 LSB of the 16-bit signal is added
+ * before rounding, which decorrelates the quantization error from the
+ * signal at the cost of slightly increased noise floor.
+ *
+ * @param src Address to the buffer with the S32_4LE PCM signal.
+ * @param samples The number of samples in the buffer.
+ * @param dest Address to the buffer for the S16_2LE PCM signal.
+ * @param dither If not NULL, the dither generator state. It shall be
+ *   initialized to a non-zero value and preserved between calls. */
+void audio_reduce_s32_4le_to_s16_2le(const int32_t *src, size_t samples,
+		int16_t *dest, uint32_t *dither) {
+
+	if (dither != NULL && *dither == 0)
+		*dither = 0x9E3779B9;
+
+	for (size_t i = 0; i < samples; i++) {
+		int64_t v = (int32_t)le32toh(src[i]);
+		if (dither != NULL) {
+			/* sum of two uniform distributions gives the triangular one */
+			const uint32_t r1 = audio_dither_rand(dither) >> 16;
+			const uint32_t r2 = audio_dither_rand(dither) >> 16;
+			v += (int64_t)r1 + r2 - 0xFFFF;
+		}
+		v = (v + 0x8000) >> 16;
+		dest[i] = htole16(MIN(MAX(v, INT16_MIN), INT16_MAX));
 	}
+
 }
 
 /**
@@ -157,11 +1205,8 @@ void audio_silence_s16_2le(int16_t *buffer, size_t frames,
 			memset(buffer, 0, frames * sizeof(*buffer));
 		break;
 	case 2:
-		if (ch1 || ch2) {
-			uint32_t mask = be32toh((ch1 ? 0 : 0xFFFF0000) | (ch2 ? 0 : 0xFFFF));
-			while (frames--)
-				((uint32_t *)buffer)[frames] &= mask;
-		}
+		if (ch1 || ch2)
+			audio_kernels->silence_s16_2le(buffer, frames * 2, ch1, ch2);
 		break;
 	default:
 		g_assert_not_reached();
@@ -178,16 +1223,78 @@ void audio_silence_s32_4le(int32_t *buffer, size_t frames,
 			memset(buffer, 0, frames * sizeof(*buffer));
 		break;
 	case 2:
-		if (ch1 || ch2) {
-			uint32_t mask_ch1 = ch1 ? 0 : 0xFFFFFFFF;
-			uint32_t mask_ch2 = ch2 ? 0 : 0xFFFFFFFF;
-			for (size_t i = 0; i < frames * 2; i += 2) {
-				buffer[i + 0] &= mask_ch1;
-				buffer[i + 1] &= mask_ch2;
-			}
-		}
+		if (ch1 || ch2)
+			audio_kernels->silence_s32_4le(buffer, frames * 2, ch1, ch2);
 		break;
 	default:
 		g_assert_not_reached();
 	}
 }
+
+/**
+ * Pack S16_2LE PCM signal into the 24-bit packed format.
+ *
+ * The 16-bit sample is placed in the most significant bytes of the 24-bit
+ * sample, so the signal level is preserved.
+ *
+ * @param src Interleaved S16_2LE PCM signal.
+ * @param samples The number of samples (not frames) to pack.
+ * @param dest Address of the buffer for 3 * samples bytes. */
+void audio_pack_s16_2le_to_s24_3le(const int16_t *src, size_t samples,
+		uint8_t *dest) {
+	audio_kernels->pack_s16_2le_s24_3le(src, samples, dest);
+}
+
+/**
+ * Pack S24_4LE PCM signal into the 24-bit packed format.
+ *
+ * @param src Interleaved S24_4LE PCM signal.
+ * @param samples The number of samples (not frames) to pack.
+ * @param dest Address of the buffer for 3 * samples bytes. */
+void audio_pack_s24_4le_to_s24_3le(const int32_t *src, size_t samples,
+		uint8_t *dest) {
+	audio_kernels->pack_s24_4le_s24_3le(src, samples, dest);
+}
+
+/**
+ * Unpack 24-bit packed PCM signal into S16_2LE format.
+ *
+ * The least significant byte of every 24-bit sample is discarded. */
+void audio_unpack_s24_3le_to_s16_2le(const uint8_t *src, size_t samples,
+		int16_t *dest) {
+	audio_kernels->unpack_s24_3le_s16_2le(src, samples, dest);
+}
+
+/**
+ * Unpack 24-bit packed PCM signal into sign-extended S24_4LE format. */
+void audio_unpack_s24_3le_to_s24_4le(const uint8_t *src, size_t samples,
+		int32_t *dest) {
+	audio_kernels->unpack_s24_3le_s24_4le(src, samples, dest);
+}
+
+/**
+ * Mix S16_2LE PCM signal into the destination buffer.
+ *
+ * Samples are added with saturation, so the mix of loud signals is clipped
+ * instead of being wrapped around.
+ *
+ * @param dest Address of the buffer with the PCM signal to mix into.
+ * @param src Address of the PCM signal to mix.
+ * @param samples The number of samples (not frames) to mix. */
+void audio_mix_s16_2le(int16_t *dest, const int16_t *src, size_t samples) {
+	audio_kernels->mix_s16_2le(dest, src, samples);
+}
+
+/**
+ * Mix S24_4LE PCM signal into the destination buffer.
+ *
+ * The result is saturated to the 24-bit range and sign-extended. */
+void audio_mix_s24_4le(int32_t *dest, const int32_t *src, size_t samples) {
+	audio_kernels->mix_s24_4le(dest, src, samples);
+}
+
+/**
+ * Mix S32_4LE PCM signal into the destination buffer. */
+void audio_mix_s32_4le(int32_t *dest, const int32_t *src, size_t samples) {
+	audio_kernels->mix_s32_4le(dest, src, samples);
+}
@@ -1,6 +1,6 @@
 /*
  * BlueALSA - audio.h
- * Copyright (c) 2016-2021 Arkadiusz Bokowy
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
  *
  * This file is a part of bluez-alsa.
  *
@@ -20,9 +20,35 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+# define AUDIO_IMPL_HAVE_X86 1
+#endif
+#if defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+# define AUDIO_IMPL_HAVE_NEON 1
+#endif
+
+/**
+ * PCM processing implementations. */
+enum audio_impl {
+	AUDIO_IMPL_GENERIC = 0,
+	AUDIO_IMPL_SSE2,
+	AUDIO_IMPL_SSSE3,
+	AUDIO_IMPL_AVX2,
+	AUDIO_IMPL_NEON,
+};
+
+void audio_init(void);
+
+int audio_impl_select(enum audio_impl impl);
+enum audio_impl audio_impl_get(void);
+const char *audio_impl_name(enum audio_impl impl);
+
 double audio_decibel_to_loudness(double value);
 double audio_loudness_to_decibel(double value);
 
+int32_t audio_scale_to_q15(double scale);
+int64_t audio_scale_to_q31(double scale);
+
 void audio_interleave_s16_2le(const int16_t *ch1, const int16_t *ch2,
 		size_t frames, unsigned int channels, int16_t *dest);
 void audio_interleave_s32_4le(const int32_t *ch1, const int32_t *ch2,
@@ -41,10 +67,32 @@ void audio_scale_s32_4le(int32_t *buffer, size_t frames,
 		unsigned int channels, double ch1, double ch2);
 #define audio_scale_s24_4le audio_scale_s32_4le
 
+void audio_scale_s16_2le_q15(int16_t *buffer, size_t frames,
+		unsigned int channels, int32_t ch1, int32_t ch2);
+void audio_scale_s32_4le_q31(int32_t *buffer, size_t frames,
+		unsigned int channels, int64_t ch1, int64_t ch2);
+#define audio_scale_s24_4le_q31 audio_scale_s32_4le_q31
+
+void audio_reduce_s32_4le_to_s16_2le(const int32_t *src, size_t samples,
+		int16_t *dest, uint32_t *dither);
+
 void audio_silence_s16_2le(int16_t *buffer, size_t frames,
 		unsigned int channels, bool ch1, bool ch2);
 void audio_silence_s32_4le(int32_t *buffer, size_t frames,
 		unsigned int channels, bool ch1, bool ch2);
 #define audio_silence_s24_4le audio_silence_s32_4le
 
+void audio_pack_s16_2le_to_s24_3le(const int16_t *src, size_t samples,
+		uint8_t *dest);
+void audio_pack_s24_4le_to_s24_3le(const int32_t *src, size_t samples,
+		uint8_t *dest);
+void audio_unpack_s24_3le_to_s16_2le(const uint8_t *src, size_t samples,
+		int16_t *dest);
+void audio_unpack_s24_3le_to_s24_4le(const uint8_t *src, size_t samples,
+		int32_t *dest);
+
+void audio_mix_s16_2le(int16_t *dest, const int16_t *src, size_t samples);
+void audio_mix_s24_4le(int32_t *dest, const int32_t *src, size_t samples);
+void audio_mix_s32_4le(int32_t *dest, const int32_t *src, size_t samples);
+
 #endif
@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <bluetooth/hci.h>
 #include <bluetooth/hci_lib.h>
@@ -23,6 +24,7 @@
 #include "bluealsa-config.h"
 #include "hci.h"
 #include "hfp.h"
+#include "io-engine.h"
 #include "utils.h"
 #include "shared/log.h"
 
@@ -50,6 +52,8 @@ struct ba_adapter *ba_adapter_new(int dev_id) {
 		warn("Couldn't get HCI version: %s", strerror(errno));
 
 	a->sco_dispatcher = config.main_thread;
+	a->sco_dispatcher_source = -1;
+	a->sco_dispatcher_fd = -1;
 	a->ref_count = 1;
 
 	sprintf(a->ba_dbus_path, "/org/bluealsa/%s", a->hci.name);
@@ -149,6 +153,11 @@ void ba_adapter_unref(struct ba_adapter *a) {
 			warn("Couldn't join SCO dispatcher thread: %s", strerror(err));
 	}
 
+	if (a->sco_dispatcher_source != -1) {
+		io_engine_del(a->sco_dispatcher_source);
+		close(a->sco_dispatcher_fd);
+	}
+
 	g_hash_table_unref(a->devices);
 	pthread_mutex_destroy(&a->devices_mutex);
 	free(a);
@@ -33,6 +33,9 @@ struct ba_adapter {
 
 	/* incoming SCO links dispatcher */
 	pthread_t sco_dispatcher;
+	/* IO engine source and socket of the SCO dispatcher */
+	int sco_dispatcher_source;
+	int sco_dispatcher_fd;
 
 	/* data for D-Bus management */
 	char ba_dbus_path[32];
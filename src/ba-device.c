@@ -13,11 +13,15 @@
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
 
 #include "ba-transport.h"
 #include "bluealsa-config.h"
 #include "hci.h"
+#include "hfp.h"
 #include "storage.h"
+#include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
 #include "shared/log.h"
 
@@ -47,6 +51,9 @@ struct ba_device *ba_device_new(
 	pthread_mutex_init(&d->transports_mutex, NULL);
 	d->transports = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, NULL);
 
+	pthread_mutex_init(&d->codec_cache_mtx, NULL);
+	d->codec_cache = g_array_new(FALSE, FALSE, sizeof(struct ba_device_codec_ctx));
+
 	pthread_mutex_lock(&adapter->devices_mutex);
 	g_hash_table_insert(adapter->devices, &d->addr, d);
 	pthread_mutex_unlock(&adapter->devices_mutex);
@@ -143,11 +150,141 @@ void ba_device_unref(struct ba_device *d) {
 	debug("Freeing device: %s", batostr_(&d->addr));
 	g_assert_cmpint(ref_count, ==, 0);
 
+	for (size_t i = 0; i < d->codec_cache->len; i++) {
+		struct ba_device_codec_ctx *ctx = &g_array_index(d->codec_cache, struct ba_device_codec_ctx, i);
+		ctx->handle_free(ctx->handle);
+	}
+
 	ba_adapter_unref(a);
 	g_hash_table_unref(d->transports);
 	pthread_mutex_destroy(&d->transports_mutex);
+	g_array_unref(d->codec_cache);
+	pthread_mutex_destroy(&d->codec_cache_mtx);
 	g_free(d->bluez_dbus_path);
 	g_free(d->ba_battery_dbus_path);
 	g_free(d->ba_dbus_path);
 	free(d);
 }
+
+static ssize_t device_codec_cache_find(
+		const struct ba_device *d,
+		uint32_t profile,
+		uint16_t codec_id,
+		bool encoder) {
+	for (size_t i = 0; i < d->codec_cache->len; i++) {
+		const struct ba_device_codec_ctx *ctx = &g_array_index(d->codec_cache, struct ba_device_codec_ctx, i);
+		if (ctx->profile == profile && ctx->codec_id == codec_id && ctx->encoder == encoder)
+			return i;
+	}
+	return -1;
+}
+
+/**
+ * Take cached codec context out of the device codec cache.
+ *
+ * @param d Pointer to the device structure.
+ * @param profile The transport profile. It distinguishes A2DP codec IDs
+ *   from the HFP ones.
+ * @param codec_id The ID of the A2DP or HFP codec.
+ * @param encoder If true, look for the encoder context, otherwise look for
+ *   the decoder context.
+ * @param configuration The codec configuration.
+ * @param size The size of the codec configuration.
+ * @return If the context initialized with exactly the same configuration was
+ *   found, this function returns its handle and the caller becomes its owner.
+ *   Otherwise, NULL is returned. */
+void *ba_device_codec_cache_take(
+		struct ba_device *d,
+		uint32_t profile,
+		uint16_t codec_id,
+		bool encoder,
+		const void *configuration,
+		size_t size) {
+
+	void *handle = NULL;
+	ssize_t i;
+
+	pthread_mutex_lock(&d->codec_cache_mtx);
+
+	if ((i = device_codec_cache_find(d, profile, codec_id, encoder)) != -1) {
+		struct ba_device_codec_ctx *ctx = &g_array_index(d->codec_cache, struct ba_device_codec_ctx, i);
+		if (ctx->configuration_size == size &&
+				(size == 0 || memcmp(ctx->configuration, configuration, size) == 0)) {
+			handle = ctx->handle;
+			g_array_remove_index_fast(d->codec_cache, i);
+		}
+	}
+
+	pthread_mutex_unlock(&d->codec_cache_mtx);
+
+	if (handle != NULL)
+		debug("Reusing cached %s context: %s",
+				encoder ? "encoder" : "decoder",
+				profile & BA_TRANSPORT_PROFILE_MASK_SCO ?
+					hfp_codec_id_to_string(codec_id) :
+					a2dp_codecs_codec_id_to_string(codec_id));
+
+	return handle;
+}
+
+/**
+ * Store codec context in the device codec cache.
+ *
+ * There is at most one cached context for every codec and direction, so the
+ * previously stored context (if any) is released. The ownership of the given
+ * handle is transferred to the device.
+ *
+ * @param d Pointer to the device structure.
+ * @param profile The transport profile.
+ * @param codec_id The ID of the A2DP or HFP codec.
+ * @param encoder True for the encoder context, false for the decoder one.
+ * @param configuration The configuration used for context initialization.
+ * @param size The size of the codec configuration. It might be 0 for codecs
+ *   without configuration (e.g. mSBC).
+ * @param handle The codec context handle.
+ * @param handle_free Function used for releasing the codec context. */
+void ba_device_codec_cache_store(
+		struct ba_device *d,
+		uint32_t profile,
+		uint16_t codec_id,
+		bool encoder,
+		const void *configuration,
+		size_t size,
+		void *handle,
+		void (*handle_free)(void *handle)) {
+
+	if (size > sizeof(((struct ba_device_codec_ctx *)NULL)->configuration)) {
+		handle_free(handle);
+		return;
+	}
+
+	struct ba_device_codec_ctx ctx = {
+		.profile = profile,
+		.codec_id = codec_id,
+		.encoder = encoder,
+		.configuration_size = size,
+		.handle = handle,
+		.handle_free = handle_free,
+	};
+
+	if (size > 0)
+		memcpy(ctx.configuration, configuration, size);
+
+	struct ba_device_codec_ctx old = { .handle = NULL };
+	ssize_t i;
+
+	pthread_mutex_lock(&d->codec_cache_mtx);
+
+	if ((i = device_codec_cache_find(d, profile, codec_id, encoder)) != -1) {
+		old = g_array_index(d->codec_cache, struct ba_device_codec_ctx, i);
+		g_array_index(d->codec_cache, struct ba_device_codec_ctx, i) = ctx;
+	}
+	else
+		g_array_append_val(d->codec_cache, ctx);
+
+	pthread_mutex_unlock(&d->codec_cache_mtx);
+
+	if (old.handle != NULL)
+		old.handle_free(old.handle);
+
+}
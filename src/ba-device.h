@@ -17,12 +17,30 @@
 #endif
 
 #include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include <bluetooth/bluetooth.h>
 #include <glib.h>
 
 #include "ba-adapter.h"
+#include "shared/a2dp-codecs.h"
+
+/**
+ * Initialized codec context kept for the reuse. */
+struct ba_device_codec_ctx {
+	/* transport profile, codec ID and direction */
+	uint32_t profile;
+	uint16_t codec_id;
+	bool encoder;
+	/* configuration used for the context initialization */
+	uint8_t configuration[sizeof(a2dp_t)];
+	size_t configuration_size;
+	/* codec library handle and its destructor */
+	void *handle;
+	void (*handle_free)(void *handle);
+};
 
 struct ba_device {
 
@@ -68,6 +86,12 @@ struct ba_device {
 	pthread_mutex_t transports_mutex;
 	GHashTable *transports;
 
+	/* Codec contexts of stopped transports. Restarting a transport with the
+	 * same codec configuration reuses the context instead of creating a new
+	 * one, which cuts the stream start latency. */
+	pthread_mutex_t codec_cache_mtx;
+	GArray *codec_cache;
+
 	/* memory self-management */
 	int ref_count;
 
@@ -86,4 +110,21 @@ struct ba_device *ba_device_ref(
 void ba_device_destroy(struct ba_device *d);
 void ba_device_unref(struct ba_device *d);
 
+void *ba_device_codec_cache_take(
+		struct ba_device *d,
+		uint32_t profile,
+		uint16_t codec_id,
+		bool encoder,
+		const void *configuration,
+		size_t size);
+void ba_device_codec_cache_store(
+		struct ba_device *d,
+		uint32_t profile,
+		uint16_t codec_id,
+		bool encoder,
+		const void *configuration,
+		size_t size,
+		void *handle,
+		void (*handle_free)(void *handle));
+
 #endif
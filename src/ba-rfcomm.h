@@ -121,6 +121,9 @@ struct ba_rfcomm {
 	/* exported RFCOMM D-Bus API */
 	char *ba_dbus_path;
 	bool ba_dbus_exported;
+	/* properties waiting for the D-Bus update */
+	unsigned int ba_dbus_update_mask;
+	int64_t ba_dbus_update_time;
 
 	/* BlueZ does not trigger profile disconnection signal when the Bluetooth
 	 * link has been lost (e.g. device power down). However, it is required to
@@ -22,6 +22,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <unistd.h>
 
 #include <glib.h>
@@ -39,8 +41,12 @@
 #if ENABLE_OFONO
 # include "ofono.h"
 #endif
+#include "storage.h"
 #include "shared/defs.h"
 #include "shared/log.h"
+#include "shared/rt.h"
+
+static void transport_pcm_volume_publish(struct ba_transport_pcm *pcm);
 
 static const char *transport_get_dbus_path_type(
 		enum ba_transport_profile profile) {
@@ -62,6 +68,15 @@ static const char *transport_get_dbus_path_type(
 	}
 }
 
+static void transport_pcm_mix_set_volume(struct ba_transport_pcm_mix *mix,
+		unsigned int volume) {
+	const int level = ba_transport_pcm_volume_range_to_level(volume, 100);
+	const double scale = volume == 0 ? 0 : pow(10, (0.01 * level) / 20);
+	mix->volume = volume;
+	mix->scale_q15 = audio_scale_to_q15(scale);
+	mix->scale_q31 = audio_scale_to_q31(scale);
+}
+
 int transport_pcm_init(
 		struct ba_transport_pcm *pcm,
 		enum ba_transport_pcm_mode mode,
@@ -72,6 +87,7 @@ int transport_pcm_init(
 	pcm->t = t;
 	pcm->mode = mode;
 	pcm->fd = -1;
+	pcm->shm_event_fd = -1;
 	pcm->active = true;
 
 	/* link PCM and transport thread */
@@ -82,6 +98,15 @@ int transport_pcm_init(
 	pcm->volume[1].level = config.volume_init_level;
 	ba_transport_pcm_volume_set(&pcm->volume[0], NULL, NULL, NULL);
 	ba_transport_pcm_volume_set(&pcm->volume[1], NULL, NULL, NULL);
+	transport_pcm_mix_set_volume(&pcm->mix, 100);
+
+	histogram_reset(&pcm->stats.codec);
+	histogram_reset(&pcm->stats.bt_write);
+	histogram_reset(&pcm->stats.poll_read);
+	histogram_reset(&pcm->stats.sync_overdue);
+	histogram_reset(&pcm->stats.first_packet);
+	histogram_reset(&pcm->stats.open_first_packet);
+	rtp_stats_reset(&pcm->stats.rtp);
 
 	pthread_mutex_init(&pcm->mutex, NULL);
 	pthread_mutex_init(&pcm->delay_adjustments_mtx, NULL);
@@ -89,6 +114,7 @@ int transport_pcm_init(
 	pthread_cond_init(&pcm->cond, NULL);
 
 	pcm->delay_adjustments = g_hash_table_new(NULL, NULL);
+	pcm->rtp_reports = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
 	pcm->ba_dbus_path = g_strdup_printf("%s/%s/%s",
 			t->d->ba_dbus_path, transport_get_dbus_path_type(t->profile),
@@ -110,7 +136,10 @@ void transport_pcm_free(
 	pthread_cond_destroy(&pcm->cond);
 
 	g_hash_table_unref(pcm->delay_adjustments);
+	g_hash_table_unref(pcm->rtp_reports);
 	g_free(pcm->ba_dbus_path);
+	free(pcm->mix_buffer);
+	free(pcm->clients);
 
 }
 
@@ -170,6 +199,9 @@ int ba_transport_pcm_start(
 	sigset_t sigset, oldset;
 	int ret = -1;
 
+	/* make sure that the IO thread will see current volume */
+	transport_pcm_volume_publish(pcm);
+
 	pthread_mutex_lock(&th->mutex);
 
 	th->master = master;
@@ -184,6 +216,11 @@ int ba_transport_pcm_start(
 
 	ba_transport_ref(t);
 
+	/* starting point for the time-to-first-packet statistic */
+	gettimestamp(&pcm->stats.ts_start);
+	/* new thread receives a new RTP stream */
+	pcm->stats.rtp.synced = false;
+
 	/* Before creating a new thread, we have to block all signals (new thread
 	 * will inherit signal mask). This is required, because we are using thread
 	 * cancellation for stopping transport thread, and it seems that the
@@ -224,6 +261,28 @@ fail:
 	return ret == 0 ? 0 : -1;
 }
 
+/**
+ * Close PCM client endpoint. */
+static void transport_pcm_endpoint_close(int *fd, struct shm_ring *shm,
+		int *shm_event_fd) {
+
+	close(*fd);
+	*fd = -1;
+
+	if (shm->hdr != NULL) {
+		/* Let the client know that the server side is gone. Unlike the FIFO,
+		 * the shared memory does not provide any EOF-like indication. */
+		shm_ring_close(shm);
+		eventfd_write(*shm_event_fd, 1);
+		close(*shm_event_fd);
+		*shm_event_fd = -1;
+		shm_ring_free(shm);
+	}
+
+}
+
+/**
+ * Release all PCM clients. */
 int ba_transport_pcm_release(struct ba_transport_pcm *pcm) {
 
 #if DEBUG
@@ -232,17 +291,284 @@ int ba_transport_pcm_release(struct ba_transport_pcm *pcm) {
 		g_assert_cmpint(pthread_mutex_trylock(&pcm->mutex), !=, 0);
 #endif
 
+	for (size_t i = 0; i < pcm->clients_len; i++) {
+		struct ba_transport_pcm_client *c = &pcm->clients[i];
+		debug("Closing PCM mixing client [%u]: %d", c->mix.id, c->fd);
+		transport_pcm_endpoint_close(&c->fd, &c->shm, &c->shm_event_fd);
+	}
+	pcm->clients_len = 0;
+
 	if (pcm->fd == -1)
 		goto final;
 
 	debug("Closing PCM: %d", pcm->fd);
-	close(pcm->fd);
-	pcm->fd = -1;
+	transport_pcm_endpoint_close(&pcm->fd, &pcm->shm, &pcm->shm_event_fd);
 
 final:
 	return 0;
 }
 
+/**
+ * Get the maximal number of clients which can open the PCM.
+ *
+ * Software mixing is supported for the A2DP source playback PCM only. All
+ * other PCMs can be opened by a single client at a time. */
+size_t ba_transport_pcm_clients_max(const struct ba_transport_pcm *pcm) {
+	const struct ba_transport *t = pcm->t;
+	if (pcm == &t->a2dp.pcm &&
+			t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE)
+		return MIN(MAX(config.a2dp.max_clients, 1), BA_TRANSPORT_PCM_CLIENTS_MAX);
+	return 1;
+}
+
+static void transport_pcm_mix_init(struct ba_transport_pcm *pcm,
+		struct ba_transport_pcm_mix *mix) {
+	/* zero is not a valid client ID */
+	if (++pcm->clients_seq == 0)
+		pcm->clients_seq++;
+	mix->id = pcm->clients_seq;
+	transport_pcm_mix_set_volume(mix, 100);
+}
+
+/**
+ * Attach new client to the PCM.
+ *
+ * The first client becomes the main client of the PCM - its endpoint is
+ * stored directly in the PCM structure and it drives the PCM IO thread. If
+ * the PCM supports software mixing, subsequent clients are mixed into the
+ * stream of the main client.
+ *
+ * This function shall be called with the PCM mutex locked.
+ *
+ * @param pcm Transport PCM structure.
+ * @param fd The FIFO file descriptor or the shared memory event fd.
+ * @param shm The shared memory ring buffer or NULL in case of the FIFO. On
+ *   success, the ownership of the ring buffer is transferred to the PCM.
+ * @param shm_event_fd The event fd for notifying the client.
+ * @return On success this function returns the ID of the new client.
+ *   Otherwise, 0 is returned and errno is set to indicate the error. */
+unsigned int ba_transport_pcm_client_attach(
+		struct ba_transport_pcm *pcm,
+		int fd,
+		const struct shm_ring *shm,
+		int shm_event_fd) {
+
+	if (pcm->fd == -1) {
+		pcm->fd = fd;
+		if (shm != NULL) {
+			pcm->shm = *shm;
+			pcm->shm_event_fd = shm_event_fd;
+		}
+		transport_pcm_mix_init(pcm, &pcm->mix);
+		return pcm->mix.id;
+	}
+
+	if (pcm->clients_len + 1 >= ba_transport_pcm_clients_max(pcm))
+		return errno = EBUSY, 0;
+
+	if (pcm->clients == NULL &&
+			(pcm->clients = calloc(BA_TRANSPORT_PCM_CLIENTS_MAX - 1,
+					sizeof(*pcm->clients))) == NULL)
+		return 0;
+
+	struct ba_transport_pcm_client *c = &pcm->clients[pcm->clients_len++];
+	const struct shm_ring shm_none = { 0 };
+
+	c->fd = fd;
+	c->shm = shm != NULL ? *shm : shm_none;
+	c->shm_event_fd = shm != NULL ? shm_event_fd : -1;
+	c->active = true;
+	c->partial_len = 0;
+	transport_pcm_mix_init(pcm, &c->mix);
+
+	debug("New PCM mixing client [%u]: %d", c->mix.id, c->fd);
+	return c->mix.id;
+}
+
+/**
+ * Look up additional PCM client.
+ *
+ * This function shall be called with the PCM mutex locked.
+ *
+ * @return This function returns the additional client with the given ID,
+ *   or NULL if there is no such client. The main client is not returned. */
+struct ba_transport_pcm_client *ba_transport_pcm_client_lookup(
+		struct ba_transport_pcm *pcm,
+		unsigned int id) {
+	for (size_t i = 0; i < pcm->clients_len; i++)
+		if (pcm->clients[i].mix.id == id)
+			return &pcm->clients[i];
+	return NULL;
+}
+
+static void transport_pcm_client_remove(struct ba_transport_pcm *pcm,
+		struct ba_transport_pcm_client *c) {
+	const size_t i = c - pcm->clients;
+	memmove(c, c + 1, (--pcm->clients_len - i) * sizeof(*c));
+}
+
+/**
+ * Release single PCM client.
+ *
+ * If the main client is released and there are additional clients, the
+ * oldest additional client becomes the new main client, so the PCM IO
+ * thread continues without interruption.
+ *
+ * This function shall be called with the PCM mutex locked. */
+int ba_transport_pcm_client_release(
+		struct ba_transport_pcm *pcm,
+		unsigned int id) {
+
+	struct ba_transport_pcm_client *c;
+
+	if (pcm->fd != -1 && pcm->mix.id == id) {
+
+		debug("Closing PCM: %d", pcm->fd);
+		transport_pcm_endpoint_close(&pcm->fd, &pcm->shm, &pcm->shm_event_fd);
+
+		if (pcm->clients_len > 0) {
+			c = &pcm->clients[0];
+			debug("Promoting PCM mixing client [%u]: %d", c->mix.id, c->fd);
+			pcm->fd = c->fd;
+			pcm->shm = c->shm;
+			pcm->shm_event_fd = c->shm_event_fd;
+			pcm->active = c->active;
+			pcm->mix = c->mix;
+			transport_pcm_client_remove(pcm, c);
+		}
+
+		return 0;
+	}
+
+	if ((c = ba_transport_pcm_client_lookup(pcm, id)) != NULL) {
+		debug("Closing PCM mixing client [%u]: %d", c->mix.id, c->fd);
+		transport_pcm_endpoint_close(&c->fd, &c->shm, &c->shm_event_fd);
+		transport_pcm_client_remove(pcm, c);
+	}
+
+	return 0;
+}
+
+/**
+ * Check whether the given client is the main client of the PCM. */
+bool ba_transport_pcm_client_is_main(
+		const struct ba_transport_pcm *pcm,
+		unsigned int id) {
+	pthread_mutex_lock(MUTABLE(&pcm->mutex));
+	const bool is_main = pcm->fd != -1 && pcm->mix.id == id;
+	pthread_mutex_unlock(MUTABLE(&pcm->mutex));
+	return is_main;
+}
+
+/**
+ * Pause or resume PCM client.
+ *
+ * Paused client is not mixed into the PCM stream. In case of the main
+ * client, the PCM is paused as well, but if there are additional clients,
+ * they are still mixed into silence. */
+int ba_transport_pcm_client_pause(
+		struct ba_transport_pcm *pcm,
+		unsigned int id,
+		bool pause) {
+
+	if (ba_transport_pcm_client_is_main(pcm, id))
+		return pause ? ba_transport_pcm_pause(pcm) : ba_transport_pcm_resume(pcm);
+
+	pthread_mutex_lock(&pcm->mutex);
+
+	struct ba_transport_pcm_client *c;
+	if ((c = ba_transport_pcm_client_lookup(pcm, id)) != NULL) {
+		debug("PCM mixing client %s [%u]: %d", pause ? "pause" : "resume", id, c->fd);
+		c->active = !pause;
+	}
+
+	pthread_mutex_unlock(&pcm->mutex);
+	return 0;
+}
+
+/**
+ * Drop PCM client buffer.
+ *
+ * @return On success this function returns the number of dropped samples
+ *   of the additional client, or 0 for the main client. Otherwise, -1 is
+ *   returned and errno is set to indicate the error. */
+ssize_t ba_transport_pcm_client_drop(
+		struct ba_transport_pcm *pcm,
+		unsigned int id) {
+	if (ba_transport_pcm_client_is_main(pcm, id))
+		return ba_transport_pcm_drop(pcm);
+	return io_pcm_client_flush(pcm, id);
+}
+
+/**
+ * Get the number of bytes queued in the PCM client buffer.
+ *
+ * @return On success this function returns the number of bytes which have
+ *   not been read by the IO thread yet. Otherwise, -1 is returned and errno
+ *   is set to indicate the error. */
+ssize_t ba_transport_pcm_client_queued(
+		struct ba_transport_pcm *pcm,
+		unsigned int id) {
+
+	struct ba_transport_pcm_client *c = NULL;
+	ssize_t ret = -1;
+	int fd = -1;
+
+	pthread_mutex_lock(&pcm->mutex);
+
+	const struct shm_ring *shm = NULL;
+	if (pcm->fd != -1 && pcm->mix.id == id) {
+		fd = pcm->fd;
+		shm = &pcm->shm;
+	}
+	else if ((c = ba_transport_pcm_client_lookup(pcm, id)) != NULL) {
+		fd = c->fd;
+		shm = &c->shm;
+	}
+
+	if (shm == NULL)
+		errno = ENOENT;
+	else if (shm->hdr != NULL)
+		ret = shm_ring_used(shm);
+	else {
+		int queued;
+		if (ioctl(fd, FIONREAD, &queued) != -1)
+			ret = queued;
+	}
+
+	pthread_mutex_unlock(&pcm->mutex);
+	return ret;
+}
+
+/**
+ * Set software mixing volume of the PCM client.
+ *
+ * @param volume Client volume in the [0, 100] range.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int ba_transport_pcm_client_set_volume(
+		struct ba_transport_pcm *pcm,
+		unsigned int id,
+		unsigned int volume) {
+
+	if (volume > 100)
+		return errno = EINVAL, -1;
+
+	int ret = 0;
+	pthread_mutex_lock(&pcm->mutex);
+
+	struct ba_transport_pcm_client *c;
+	if (pcm->fd != -1 && pcm->mix.id == id)
+		transport_pcm_mix_set_volume(&pcm->mix, volume);
+	else if ((c = ba_transport_pcm_client_lookup(pcm, id)) != NULL)
+		transport_pcm_mix_set_volume(&c->mix, volume);
+	else
+		ret = -1, errno = ENOENT;
+
+	pthread_mutex_unlock(&pcm->mutex);
+	return ret;
+}
+
 int ba_transport_pcm_pause(struct ba_transport_pcm *pcm) {
 
 	pthread_mutex_lock(&pcm->mutex);
@@ -263,8 +589,21 @@ int ba_transport_pcm_resume(struct ba_transport_pcm *pcm) {
 	return ba_transport_thread_signal_send(pcm->th, BA_TRANSPORT_THREAD_SIGNAL_PCM_RESUME);
 }
 
+/**
+ * Start PCM drain.
+ *
+ * This function does not wait for the drain to complete. The caller shall
+ * poll the drain state with the ba_transport_pcm_drain_check() function.
+ *
+ * @param pcm Transport PCM structure.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
 int ba_transport_pcm_drain(struct ba_transport_pcm *pcm) {
 
+	const struct ba_transport_thread_signal_msg msg = {
+		.signal = BA_TRANSPORT_THREAD_SIGNAL_PCM_SYNC,
+		.value = BA_TRANSPORT_PCM_DRAIN_SYNC_TIMEOUT };
+
 	pthread_mutex_lock(&pcm->mutex);
 
 	if (!ba_transport_thread_state_check_running(pcm->th)) {
@@ -275,25 +614,60 @@ int ba_transport_pcm_drain(struct ba_transport_pcm *pcm) {
 	debug("PCM drain: %d", pcm->fd);
 
 	pcm->synced = false;
-	ba_transport_thread_signal_send(pcm->th, BA_TRANSPORT_THREAD_SIGNAL_PCM_SYNC);
 
-	while (!pcm->synced)
-		pthread_cond_wait(&pcm->cond, &pcm->mutex);
+	pthread_mutex_unlock(&pcm->mutex);
+
+	/* The signal is sent without the PCM lock, because the IO thread takes
+	 * this lock before dispatching signals. With the full signal queue it
+	 * would never make room for our signal. */
+	return ba_transport_thread_signal_send_msg(pcm->th, &msg);
+}
+
+/**
+ * Check whether the PCM drain has been completed.
+ *
+ * The drain is completed when the IO thread has processed all samples from
+ * the PCM FIFO and, in case of the A2DP source, when the BT socket output
+ * queue is back at the level reported for the empty queue. BlueZ does not
+ * provide any API for the controller buffer drain, so this is the best
+ * approximation of the playback end we can get.
+ *
+ * @param pcm Transport PCM structure.
+ * @return This function returns true if the drain has been completed or
+ *   if it can not be completed at all (e.g. the IO thread has terminated),
+ *   false otherwise. */
+bool ba_transport_pcm_drain_check(struct ba_transport_pcm *pcm) {
+
+	struct ba_transport *t = pcm->t;
 
+	pthread_mutex_lock(&pcm->mutex);
+	const bool running = ba_transport_thread_state_check_running(pcm->th);
+	const bool synced = pcm->synced;
 	pthread_mutex_unlock(&pcm->mutex);
 
-	/* TODO: Asynchronous transport release.
-	 *
-	 * Unfortunately, BlueZ does not provide API for internal buffer drain.
-	 * Also, there is no specification for Bluetooth playback drain. In order
-	 * to make sure, that all samples are played out, we have to wait some
-	 * arbitrary time before releasing transport. In order to make it right,
-	 * there is a requirement for an asynchronous release mechanism, which
-	 * is not implemented - it requires a little bit of refactoring. */
-	usleep(200000);
+	if (!running)
+		return true;
+	if (!synced)
+		return false;
+
+	if (pcm == &t->a2dp.pcm &&
+			t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE) {
+
+		int outq = 0;
+		int rv = -1;
+
+		pthread_mutex_lock(&t->bt_fd_mtx);
+		if (t->bt_fd != -1)
+			rv = ioctl(t->bt_fd, TIOCOUTQ, &outq);
+		pthread_mutex_unlock(&t->bt_fd_mtx);
+
+		if (rv != -1 && outq != t->a2dp.bt_fd_coutq_init)
+			return false;
+
+	}
 
 	debug("PCM drained");
-	return 0;
+	return true;
 }
 
 int ba_transport_pcm_drop(struct ba_transport_pcm *pcm) {
@@ -364,6 +738,71 @@ void ba_transport_pcm_volume_set(
 	/* calculate PCM scale factor */
 	const bool muted = volume->soft_mute || volume->hard_mute;
 	volume->scale = muted ? 0 : pow(10, (0.01 * volume->level) / 20);
+	/* Precompute fixed-point gains, so the IO thread will not have
+	 * to convert the scale factor for every processed PCM chunk. */
+	volume->scale_q15 = audio_scale_to_q15(volume->scale);
+	volume->scale_q31 = audio_scale_to_q31(volume->scale);
+
+}
+
+/**
+ * Publish PCM volume snapshot for the IO threads. */
+static void transport_pcm_volume_publish(struct ba_transport_pcm *pcm) {
+
+	pthread_mutex_lock(&pcm->mutex);
+
+	const struct ba_transport_pcm_volume_snapshot snapshot = {
+		.soft_volume = pcm->soft_volume,
+		.scale = { pcm->volume[0].scale, pcm->volume[1].scale },
+		.scale_q15 = { pcm->volume[0].scale_q15, pcm->volume[1].scale_q15 },
+		.scale_q31 = { pcm->volume[0].scale_q31, pcm->volume[1].scale_q31 },
+	};
+
+	/* Mark the snapshot as being updated. The compare-and-swap succeeds only
+	 * for an even (stable) sequence value, which serializes concurrent
+	 * writers, e.g. the RFCOMM thread and the D-Bus handler. */
+	unsigned int seq = 0;
+	while (!atomic_compare_exchange_weak_explicit(&pcm->volume_snapshot_seq,
+				&seq, seq + 1, memory_order_acquire, memory_order_relaxed))
+		seq &= ~1U;
+	atomic_thread_fence(memory_order_release);
+
+	pcm->volume_snapshot = snapshot;
+
+	atomic_store_explicit(&pcm->volume_snapshot_seq, seq + 2, memory_order_release);
+
+	pthread_mutex_unlock(&pcm->mutex);
+
+}
+
+/**
+ * Synchronize PCM volume with the IO threads and the persistent storage.
+ *
+ * This function shall be called after every modification of the PCM
+ * volume or the software volume switch. */
+void ba_transport_pcm_volume_sync(struct ba_transport_pcm *pcm) {
+	transport_pcm_volume_publish(pcm);
+	storage_pcm_data_mark_dirty(pcm);
+}
+
+/**
+ * Get PCM volume snapshot without locking the PCM mutex.
+ *
+ * This function is safe to be called from the real-time IO thread. It will
+ * never block, however, it might retry if the snapshot is being updated. */
+void ba_transport_pcm_volume_snapshot(
+		const struct ba_transport_pcm *pcm,
+		struct ba_transport_pcm_volume_snapshot *snapshot) {
+
+	atomic_uint *seq_ptr = MUTABLE(&pcm->volume_snapshot_seq);
+	unsigned int seq;
+
+	do {
+		while ((seq = atomic_load_explicit(seq_ptr, memory_order_acquire)) & 1)
+			continue;
+		*snapshot = pcm->volume_snapshot;
+		atomic_thread_fence(memory_order_acquire);
+	} while (seq != atomic_load_explicit(seq_ptr, memory_order_relaxed));
 
 }
 
@@ -371,6 +810,8 @@ int ba_transport_pcm_volume_update(struct ba_transport_pcm *pcm) {
 
 	struct ba_transport *t = pcm->t;
 
+	ba_transport_pcm_volume_sync(pcm);
+
 	/* In case of A2DP Source or HSP/HFP Audio Gateway skip notifying Bluetooth
 	 * device if we are using software volume control. This will prevent volume
 	 * double scaling - firstly by us and then by Bluetooth headset/speaker. */
@@ -17,11 +17,18 @@
 #endif
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
 
 #include <glib.h>
 
+#include "rtp.h"
+#include "shared/histogram.h"
+#include "shared/shm-ring.h"
+
 enum ba_transport_pcm_mode {
 	/* PCM used for capturing audio */
 	BA_TRANSPORT_PCM_MODE_SOURCE,
@@ -29,6 +36,13 @@ enum ba_transport_pcm_mode {
 	BA_TRANSPORT_PCM_MODE_SINK,
 };
 
+enum ba_transport_pcm_latency {
+	/* favor robustness and codec efficiency */
+	BA_TRANSPORT_PCM_LATENCY_NORMAL,
+	/* favor low audio delay (e.g. for gaming) */
+	BA_TRANSPORT_PCM_LATENCY_LOW,
+};
+
 /**
  * Builder for 16-bit PCM stream format identifier. */
 #define BA_TRANSPORT_PCM_FORMAT(sign, width, bytes, endian) \
@@ -54,6 +68,92 @@ struct ba_transport_pcm_volume {
 	/* calculated PCM scale factor based on decibel formula
 	 * pow(10, dB / 20); for muted channel it shall equal 0 */
 	double scale;
+	/* precomputed fixed-point representations of the scale factor */
+	int32_t scale_q15;
+	int64_t scale_q31;
+};
+
+/**
+ * Immutable snapshot of the PCM volume configuration used by the IO
+ * threads. It is published with a sequence lock, so reading it does
+ * not require taking the PCM mutex. */
+struct ba_transport_pcm_volume_snapshot {
+	/* internal software volume control */
+	bool soft_volume;
+	/* PCM scale factors for left [0] and right [1] channel */
+	double scale[2];
+	int32_t scale_q15[2];
+	int64_t scale_q31[2];
+};
+
+/**
+ * Hot-path timing statistics of the PCM IO thread. All values are
+ * recorded in microseconds. */
+struct ba_transport_pcm_stats {
+	/* codec processing time per chunk of read data */
+	struct histogram codec;
+	/* time spent in writing data to the BT socket */
+	struct histogram bt_write;
+	/* time from the poll() wake-up to data being read */
+	struct histogram poll_read;
+	/* overdue time of the transfer rate synchronization */
+	struct histogram sync_overdue;
+	/* time from the IO thread start to the first packet */
+	struct histogram first_packet;
+	/* time from the PCM Open call to the first packet */
+	struct histogram open_first_packet;
+	/* receiver statistics of the incoming RTP stream */
+	struct rtp_stats rtp;
+	/* time-stamp of the last data read, used by the IO thread only */
+	struct timespec ts_read;
+	/* time-stamp of the IO thread start, zeroed after the first packet */
+	struct timespec ts_start;
+	/* time-stamp (in microseconds) of the last PCM Open call, zeroed
+	 * after the first packet - it is set by the D-Bus Open handler */
+	atomic_uint_least64_t ts_open;
+};
+
+/* upper limit for the number of clients mixed into a single PCM */
+#define BA_TRANSPORT_PCM_CLIENTS_MAX 16
+
+/* upper limit for the number of D-Bus clients
+ * with tracked RTP statistics report interval */
+#define BA_TRANSPORT_PCM_RTP_REPORTS_MAX 16
+
+/* time in milliseconds without new PCM data after
+ * which the PCM FIFO is considered to be drained */
+#define BA_TRANSPORT_PCM_DRAIN_SYNC_TIMEOUT 100
+
+/**
+ * Software mixing parameters of the PCM client. */
+struct ba_transport_pcm_mix {
+	/* ID of the client, unique within the PCM */
+	unsigned int id;
+	/* client volume in the [0, 100] range */
+	unsigned int volume;
+	/* precomputed fixed-point volume scale factor */
+	int32_t scale_q15;
+	int64_t scale_q31;
+};
+
+/**
+ * Additional PCM client.
+ *
+ * Audio of additional clients is read by the IO thread together with the
+ * audio of the main client (the one stored directly in the PCM structure)
+ * and it is mixed into a single stream before encoding. */
+struct ba_transport_pcm_client {
+	struct ba_transport_pcm_mix mix;
+	/* FIFO file descriptor or the shared memory event fd */
+	int fd;
+	struct shm_ring shm;
+	int shm_event_fd;
+	/* indicates whether client is not paused */
+	bool active;
+	/* trailing partial frame of the last FIFO read,
+	 * up to 8 channels of 32-bit samples */
+	uint8_t partial[8 * sizeof(int32_t)];
+	size_t partial_len;
 };
 
 struct ba_transport_thread;
@@ -73,12 +173,34 @@ struct ba_transport_pcm {
 	/* updates notification */
 	pthread_cond_t cond;
 
-	/* FIFO file descriptor */
+	/* FIFO file descriptor; in case of the shared memory transport
+	 * it is an event file descriptor signaled by the client */
 	int fd;
 
+	/* shared memory ring buffer used instead of the FIFO */
+	struct shm_ring shm;
+	/* event file descriptor for notifying the client
+	 * about the shared memory ring buffer updates */
+	int shm_event_fd;
+
 	/* indicates whether PCM shall be active */
 	bool active;
 
+	/* Latency class of the PCM. It is read by the IO thread without
+	 * taking the PCM mutex, so the change is applied on the fly. */
+	_Atomic enum ba_transport_pcm_latency latency;
+
+	/* mixing parameters of the main client */
+	struct ba_transport_pcm_mix mix;
+	/* additional clients mixed into the main client stream */
+	struct ba_transport_pcm_client *clients;
+	size_t clients_len;
+	/* the last assigned client ID */
+	unsigned int clients_seq;
+	/* buffer for reading additional clients, used by the IO thread */
+	void *mix_buffer;
+	size_t mix_buffer_size;
+
 	/* 16-bit stream format identifier */
 	uint16_t format;
 	/* number of audio channels */
@@ -90,12 +212,22 @@ struct ba_transport_pcm {
 	 * audio encoding or decoding and data transfer. */
 	unsigned int delay;
 
+	/* Current bitrate of the encoded stream in bits per second. It is set
+	 * by the IO thread; zero if not known. */
+	unsigned int bitrate;
+
 	/* guard delay adjustments access */
 	pthread_mutex_t delay_adjustments_mtx;
 	/* PCM delay adjustments in 1/10 of millisecond, set by client API to allow
 	 * user correction of delay reporting inaccuracy. */
 	GHashTable *delay_adjustments;
 
+	/* The last RTP statistics reports returned to the D-Bus clients, keyed
+	 * by the unique bus name of the client. These reports are used as the
+	 * beginning of the client's next report interval. It is accessed by
+	 * the D-Bus dispatching thread only. */
+	GHashTable *rtp_reports;
+
 	/* indicates whether FIFO buffer was synchronized */
 	bool synced;
 
@@ -106,12 +238,26 @@ struct ba_transport_pcm {
 	 * a monophonic sound, only the left [0] channel shall be used. */
 	struct ba_transport_pcm_volume volume[2];
 
+	/* Volume snapshot sequence counter. Odd value indicates
+	 * that the snapshot update is in progress. */
+	atomic_uint volume_snapshot_seq;
+	struct ba_transport_pcm_volume_snapshot volume_snapshot;
+
+	/* PCM data is waiting for the persistent storage update */
+	atomic_bool storage_dirty;
+
+	/* IO thread timing statistics */
+	struct ba_transport_pcm_stats stats;
+
 	/* new PCM client mutex */
 	pthread_mutex_t client_mtx;
 
 	/* exported PCM D-Bus API */
 	char *ba_dbus_path;
 	bool ba_dbus_exported;
+	/* properties waiting for the D-Bus update */
+	unsigned int ba_dbus_update_mask;
+	int64_t ba_dbus_update_time;
 
 };
 
@@ -142,9 +288,41 @@ int ba_transport_pcm_start(
 
 int ba_transport_pcm_release(struct ba_transport_pcm *pcm);
 
+size_t ba_transport_pcm_clients_max(
+		const struct ba_transport_pcm *pcm);
+unsigned int ba_transport_pcm_client_attach(
+		struct ba_transport_pcm *pcm,
+		int fd,
+		const struct shm_ring *shm,
+		int shm_event_fd);
+int ba_transport_pcm_client_release(
+		struct ba_transport_pcm *pcm,
+		unsigned int id);
+struct ba_transport_pcm_client *ba_transport_pcm_client_lookup(
+		struct ba_transport_pcm *pcm,
+		unsigned int id);
+bool ba_transport_pcm_client_is_main(
+		const struct ba_transport_pcm *pcm,
+		unsigned int id);
+int ba_transport_pcm_client_pause(
+		struct ba_transport_pcm *pcm,
+		unsigned int id,
+		bool pause);
+ssize_t ba_transport_pcm_client_drop(
+		struct ba_transport_pcm *pcm,
+		unsigned int id);
+ssize_t ba_transport_pcm_client_queued(
+		struct ba_transport_pcm *pcm,
+		unsigned int id);
+int ba_transport_pcm_client_set_volume(
+		struct ba_transport_pcm *pcm,
+		unsigned int id,
+		unsigned int volume);
+
 int ba_transport_pcm_pause(struct ba_transport_pcm *pcm);
 int ba_transport_pcm_resume(struct ba_transport_pcm *pcm);
 int ba_transport_pcm_drain(struct ba_transport_pcm *pcm);
+bool ba_transport_pcm_drain_check(struct ba_transport_pcm *pcm);
 int ba_transport_pcm_drop(struct ba_transport_pcm *pcm);
 
 bool ba_transport_pcm_is_active(const struct ba_transport_pcm *pcm);
@@ -161,6 +339,12 @@ void ba_transport_pcm_volume_set(
 int ba_transport_pcm_volume_update(
 		struct ba_transport_pcm *pcm);
 
+void ba_transport_pcm_volume_sync(
+		struct ba_transport_pcm *pcm);
+void ba_transport_pcm_volume_snapshot(
+		const struct ba_transport_pcm *pcm,
+		struct ba_transport_pcm_volume_snapshot *snapshot);
+
 int ba_transport_pcm_get_delay(
 		const struct ba_transport_pcm *pcm);
 
@@ -15,14 +15,18 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <poll.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <bluetooth/bluetooth.h>
@@ -42,12 +46,20 @@
 #include "bluez.h"
 #include "hci.h"
 #include "hfp.h"
+#include "io-engine.h"
 #include "sco.h"
 #include "storage.h"
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
 #include "shared/log.h"
 #include "shared/rt.h"
+#include "shared/trace.h"
+
+/**
+ * Guard transport group membership. This lock shall be acquired before
+ * the group lock of the leader transport. None of the group locks shall
+ * be acquired while holding PCM locks and vice versa. */
+static pthread_mutex_t transport_group_mtx = PTHREAD_MUTEX_INITIALIZER;
 
 static int ba_transport_pcms_full_lock(struct ba_transport *t) {
 	if (t->profile & BA_TRANSPORT_PROFILE_MASK_A2DP) {
@@ -98,13 +110,15 @@ static int transport_thread_init(
 	th->t = t;
 	th->state = BA_TRANSPORT_THREAD_STATE_TERMINATED;
 	th->bt_fd = -1;
-	th->pipe[0] = -1;
-	th->pipe[1] = -1;
+	th->event_fd = -1;
 
 	pthread_mutex_init(&th->mutex, NULL);
 	pthread_cond_init(&th->cond, NULL);
 
-	if (pipe(th->pipe) == -1)
+	if (mpscq_init(&th->signals, BA_TRANSPORT_THREAD_SIGNAL_QUEUE_SIZE,
+				sizeof(struct ba_transport_thread_signal_msg)) == -1)
+		return -1;
+	if ((th->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
 		return -1;
 
 	return 0;
@@ -179,10 +193,9 @@ static void transport_thread_free(
 		struct ba_transport_thread *th) {
 	if (th->bt_fd != -1)
 		close(th->bt_fd);
-	if (th->pipe[0] != -1)
-		close(th->pipe[0]);
-	if (th->pipe[1] != -1)
-		close(th->pipe[1]);
+	if (th->event_fd != -1)
+		close(th->event_fd);
+	mpscq_free(&th->signals);
 	pthread_mutex_destroy(&th->mutex);
 	pthread_cond_destroy(&th->cond);
 }
@@ -330,46 +343,96 @@ int ba_transport_thread_bt_release(
 	return 0;
 }
 
+/**
+ * Send signal to the transport IO thread.
+ *
+ * @param th Transport thread.
+ * @param signal Signal without payload.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
 int ba_transport_thread_signal_send(
 		struct ba_transport_thread *th,
 		enum ba_transport_thread_signal signal) {
+	const struct ba_transport_thread_signal_msg msg = { .signal = signal };
+	return ba_transport_thread_signal_send_msg(th, &msg);
+}
 
-	int ret = -1;
+/**
+ * Send signal with payload to the transport IO thread.
+ *
+ * Signals are delivered in the order of sending. If the signal queue is
+ * full, this function waits until the IO thread makes some room, so the
+ * signal is never lost. Hence, it shall not be called with a lock which
+ * might be taken by the IO thread before it dispatches signals, e.g. the
+ * PCM mutex.
+ *
+ * @param th Transport thread.
+ * @param msg Address of the signal message.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int ba_transport_thread_signal_send_msg(
+		struct ba_transport_thread *th,
+		const struct ba_transport_thread_signal_msg *msg) {
 
-	pthread_mutex_lock(&th->mutex);
+	const struct timespec delay = { .tv_nsec = 1000000 };
 
-	if (th->state != BA_TRANSPORT_THREAD_STATE_RUNNING) {
-		errno = ESRCH;
-		goto fail;
-	}
+	for (;;) {
+
+		if (!ba_transport_thread_state_check_running(th))
+			return errno = ESRCH, -1;
+
+		if (mpscq_push(&th->signals, msg))
+			break;
+
+		/* Queue is full - make sure that the IO thread has been woken up
+		 * and give it some time to dispatch pending signals. */
+		eventfd_write(th->event_fd, 1);
+		nanosleep(&delay, NULL);
 
-	if (write(th->pipe[1], &signal, sizeof(signal)) != sizeof(signal)) {
-		warn("Couldn't write transport thread signal: %s", strerror(errno));
-		goto fail;
 	}
 
-	ret = 0;
+	/* Ring the doorbell. The eventfd counter saturates instead of blocking,
+	 * so the only possible error here is a programming error. */
+	if (eventfd_write(th->event_fd, 1) == -1) {
+		warn("Couldn't notify transport thread: %s", strerror(errno));
+		return -1;
+	}
 
-fail:
-	pthread_mutex_unlock(&th->mutex);
-	return ret;
+	trace(TRACE_EVENT_SIGNAL_SEND, msg->signal, msg->value, 0);
+	return 0;
 }
 
+/**
+ * Receive pending signal in the transport IO thread.
+ *
+ * The notification eventfd is cleared only when all pending signals have
+ * been received. Hence, this function shall be called in a loop until it
+ * returns -1, in order to dispatch all signals with a single wake-up.
+ *
+ * @param th Transport thread.
+ * @param msg Address where the received signal shall be stored.
+ * @return If there is a pending signal, this function returns 0. Otherwise,
+ *   -1 is returned and errno is set to EAGAIN. */
 int ba_transport_thread_signal_recv(
 		struct ba_transport_thread *th,
-		enum ba_transport_thread_signal *signal) {
+		struct ba_transport_thread_signal_msg *msg) {
 
-	ssize_t ret;
-	while ((ret = read(th->pipe[0], signal, sizeof(*signal))) == -1 &&
-			errno == EINTR)
-		continue;
+	if (mpscq_pop(&th->signals, msg))
+		goto received;
 
-	if (ret == sizeof(*signal))
-		return 0;
+	eventfd_t value;
+	eventfd_read(th->event_fd, &value);
 
-	warn("Couldn't read transport thread signal: %s", strerror(errno));
-	*signal = BA_TRANSPORT_THREAD_SIGNAL_PING;
-	return -1;
+	/* The signal might have been queued right before clearing the eventfd
+	 * counter, so check the queue once again not to lose the wake-up. */
+	if (mpscq_pop(&th->signals, msg))
+		goto received;
+
+	return errno = EAGAIN, -1;
+
+received:
+	trace(TRACE_EVENT_SIGNAL_RECV, msg->signal, msg->value, 0);
+	return 0;
 }
 
 static void transport_threads_cancel(struct ba_transport *t) {
@@ -385,8 +448,103 @@ static void transport_threads_cancel(struct ba_transport *t) {
 
 }
 
+/**
+ * Check whether the leader of the transport group has an active client. */
+static bool transport_group_leader_has_clients(struct ba_transport *t) {
+
+	struct ba_transport *leader;
+	bool rv = false;
+
+	/* Take the reference to the leader, so we will not hold the global group
+	 * lock while acquiring the PCM lock of the leader transport. */
+	pthread_mutex_lock(&transport_group_mtx);
+	if ((leader = t->a2dp.group_leader) != NULL)
+		ba_transport_ref(leader);
+	pthread_mutex_unlock(&transport_group_mtx);
+
+	if (leader != NULL) {
+		pthread_mutex_lock(&leader->a2dp.pcm.mutex);
+		rv = leader->a2dp.pcm.fd != -1;
+		pthread_mutex_unlock(&leader->a2dp.pcm.mutex);
+		ba_transport_unref(leader);
+	}
+
+	return rv;
+}
+
+/**
+ * Release BT sockets of all transport group members.
+ *
+ * Members which are not used by any other client will be stopped. */
+static void transport_group_stop_members(struct ba_transport *t) {
+
+	struct ba_transport *members[BA_TRANSPORT_GROUP_MAX_MEMBERS];
+	size_t i, count = 0;
+
+	pthread_mutex_lock(&t->a2dp.group_mtx);
+
+	for (i = 0; i < t->a2dp.group_size; i++) {
+		struct ba_transport_group_member *m = &t->a2dp.group[i];
+		if (m->bt_fd != -1) {
+			close(m->bt_fd);
+			m->bt_fd = -1;
+		}
+		members[count++] = ba_transport_ref(m->t);
+	}
+
+	pthread_mutex_unlock(&t->a2dp.group_mtx);
+
+	/* Stop members outside of the group lock, because the member might
+	 * be leaving the group at the same time. */
+	for (i = 0; i < count; i++) {
+		ba_transport_stop_if_no_clients(members[i]);
+		ba_transport_unref(members[i]);
+	}
+
+}
+
+/**
+ * Remove transport from the group it is a member of. */
+static void transport_group_leave(struct ba_transport *t) {
+
+	struct ba_transport *leader;
+
+	pthread_mutex_lock(&transport_group_mtx);
+
+	if ((leader = t->a2dp.group_leader) != NULL) {
+
+		pthread_mutex_lock(&leader->a2dp.group_mtx);
+
+		for (size_t i = 0; i < leader->a2dp.group_size; i++) {
+			struct ba_transport_group_member *m = &leader->a2dp.group[i];
+			if (m->t != t)
+				continue;
+			if (m->bt_fd != -1)
+				close(m->bt_fd);
+			memmove(m, m + 1, (--leader->a2dp.group_size - i) * sizeof(*m));
+			break;
+		}
+
+		pthread_mutex_unlock(&leader->a2dp.group_mtx);
+		t->a2dp.group_leader = NULL;
+
+	}
+
+	pthread_mutex_unlock(&transport_group_mtx);
+
+	/* release reference taken by the group leader */
+	if (leader != NULL)
+		ba_transport_unref(t);
+
+}
+
 static void transport_threads_cancel_if_no_clients(struct ba_transport *t) {
 
+	/* Check the group leader before taking our own PCM locks, because the
+	 * leader might be checking its group members at the same time. */
+	const bool leader_has_clients = t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE &&
+		transport_group_leader_has_clients(t);
+
 	/* Hold PCM client and data locks. The data lock is required because we
 	 * are going to check the PCM FIFO file descriptor. The client lock is
 	 * required to prevent PCM clients from opening PCM in the middle of our
@@ -402,8 +560,11 @@ static void transport_threads_cancel_if_no_clients(struct ba_transport *t) {
 	if (!t->stopping) {
 		if (t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE) {
 			/* Release bidirectional A2DP transport only in case when there
-			 * is no active PCM connection - neither encoder nor decoder. */
-			if (t->a2dp.pcm.fd == -1 && t->a2dp.pcm_bc.fd == -1)
+			 * is no active PCM connection - neither encoder nor decoder. Also,
+			 * keep the transport if it is a member of a transport group which
+			 * leader has an active PCM connection. */
+			if (t->a2dp.pcm.fd == -1 && t->a2dp.pcm_bc.fd == -1 &&
+					!leader_has_clients)
 				t->stopping = stop = true;
 		}
 		else if (t->profile & BA_TRANSPORT_PROFILE_MASK_AG) {
@@ -428,6 +589,8 @@ static void transport_threads_cancel_if_no_clients(struct ba_transport *t) {
 
 	if (stop) {
 		transport_threads_cancel(t);
+		if (t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE)
+			transport_group_stop_members(t);
 	}
 
 }
@@ -481,6 +644,45 @@ exit:
 	return NULL;
 }
 
+/**
+ * Transport thread manager command handler for the IO engine mode. */
+static void transport_thread_manager_callback(int fd, uint32_t events, void *userdata) {
+	(void)events;
+
+	struct ba_transport *t = userdata;
+	enum ba_transport_thread_manager_command cmd;
+
+	if (read(fd, &cmd, sizeof(cmd)) != sizeof(cmd)) {
+		error("Couldn't read manager command: %s", strerror(errno));
+		return;
+	}
+
+	switch (cmd) {
+	case BA_TRANSPORT_THREAD_MANAGER_TERMINATE:
+		break;
+	case BA_TRANSPORT_THREAD_MANAGER_CANCEL_THREADS:
+		io_engine_timer_set(t->thread_manager_timer, 0);
+		transport_threads_cancel(t);
+		break;
+	case BA_TRANSPORT_THREAD_MANAGER_CANCEL_IF_NO_CLIENTS:
+		debug("PCM clients check keep-alive: %d ms", config.keep_alive_time);
+		if (config.keep_alive_time == 0)
+			transport_threads_cancel_if_no_clients(t);
+		else if (config.keep_alive_time > 0)
+			io_engine_timer_set(t->thread_manager_timer, config.keep_alive_time);
+		break;
+	}
+
+}
+
+/**
+ * Transport keep-alive timer handler for the IO engine mode. */
+static void transport_thread_manager_timer_callback(int fd, uint32_t events, void *userdata) {
+	(void)fd;
+	(void)events;
+	transport_threads_cancel_if_no_clients(userdata);
+}
+
 static int transport_thread_manager_send_command(struct ba_transport *t,
 		enum ba_transport_thread_manager_command cmd) {
 	if (write(t->thread_manager_pipe[1], &cmd, sizeof(cmd)) == sizeof(cmd))
@@ -525,6 +727,8 @@ static struct ba_transport *transport_new(
 	t->thread_manager_thread_id = config.main_thread;
 	t->thread_manager_pipe[0] = -1;
 	t->thread_manager_pipe[1] = -1;
+	t->thread_manager_source = -1;
+	t->thread_manager_timer = -1;
 
 	err = 0;
 	err |= transport_thread_init(&t->thread_enc, t);
@@ -534,7 +738,16 @@ static struct ba_transport *transport_new(
 
 	if (pipe(t->thread_manager_pipe) == -1)
 		goto fail;
-	if ((errno = pthread_create(&t->thread_manager_thread_id,
+
+	if (config.io_engine_workers > 0) {
+		/* In the IO engine mode there is no dedicated manager thread. */
+		if ((t->thread_manager_timer = io_engine_add_timer(
+						transport_thread_manager_timer_callback, t)) == -1 ||
+				(t->thread_manager_source = io_engine_add(t->thread_manager_pipe[0],
+						EPOLLIN, transport_thread_manager_callback, t)) == -1)
+			goto fail;
+	}
+	else if ((errno = pthread_create(&t->thread_manager_thread_id,
 			NULL, PTHREAD_FUNC(transport_thread_manager), t)) != 0) {
 		t->thread_manager_thread_id = config.main_thread;
 		goto fail;
@@ -692,6 +905,8 @@ struct ba_transport *ba_transport_new_a2dp(
 	memcpy(&t->a2dp.configuration, configuration, codec->capabilities_size);
 	t->a2dp.state = BLUEZ_A2DP_TRANSPORT_STATE_IDLE;
 
+	pthread_mutex_init(&t->a2dp.group_mtx, NULL);
+
 	transport_pcm_init(&t->a2dp.pcm,
 			is_sink ? BA_TRANSPORT_PCM_MODE_SOURCE : BA_TRANSPORT_PCM_MODE_SINK,
 			is_sink ? &t->thread_dec : &t->thread_enc);
@@ -999,6 +1214,11 @@ void ba_transport_destroy(struct ba_transport *t) {
 	if (t->profile & BA_TRANSPORT_PROFILE_MASK_A2DP) {
 		bluealsa_dbus_pcm_unregister(&t->a2dp.pcm);
 		bluealsa_dbus_pcm_unregister(&t->a2dp.pcm_bc);
+		if (t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE) {
+			/* dissolve the group of this transport and leave other group */
+			ba_transport_group_set(t, NULL, 0);
+			transport_group_leave(t);
+		}
 	}
 	else if (t->profile & BA_TRANSPORT_PROFILE_MASK_SCO) {
 		bluealsa_dbus_pcm_unregister(&t->sco.pcm_spk);
@@ -1065,6 +1285,7 @@ void ba_transport_unref(struct ba_transport *t) {
 	if (t->profile & BA_TRANSPORT_PROFILE_MASK_A2DP) {
 		transport_pcm_free(&t->a2dp.pcm);
 		transport_pcm_free(&t->a2dp.pcm_bc);
+		pthread_mutex_destroy(&t->a2dp.group_mtx);
 	}
 	else if (t->profile & BA_TRANSPORT_PROFILE_MASK_SCO) {
 		if (t->sco.rfcomm != NULL)
@@ -1098,6 +1319,11 @@ void ba_transport_unref(struct ba_transport *t) {
 		pthread_join(t->thread_manager_thread_id, NULL);
 	}
 
+	if (t->thread_manager_source != -1)
+		io_engine_del(t->thread_manager_source);
+	if (t->thread_manager_timer != -1)
+		io_engine_del(t->thread_manager_timer);
+
 	transport_thread_free(&t->thread_enc);
 	transport_thread_free(&t->thread_dec);
 
@@ -1435,6 +1661,260 @@ final:
 	return ret;
 }
 
+/**
+ * Set members of the A2DP transport group.
+ *
+ * All PCM data written to the leader transport will be encoded only once
+ * and the encoded packets will be sent to the leader and to all members
+ * of its group. Hence, all members have to use exactly the same codec
+ * configuration as the leader.
+ *
+ * @param t The group leader transport.
+ * @param members An array of member transports. It shall not contain the
+ *   leader transport itself.
+ * @param count The number of members. If zero, the group is dissolved.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int ba_transport_group_set(
+		struct ba_transport *t,
+		struct ba_transport * const *members,
+		size_t count) {
+
+	struct ba_transport_group_member old[BA_TRANSPORT_GROUP_MAX_MEMBERS];
+	size_t i, j, old_size;
+
+	if (!(t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE))
+		return errno = ENOTSUP, -1;
+	if (count > BA_TRANSPORT_GROUP_MAX_MEMBERS)
+		return errno = E2BIG, -1;
+
+	const uint16_t codec_id = ba_transport_get_codec(t);
+	for (i = 0; i < count; i++) {
+		struct ba_transport *m = members[i];
+		if (m == t || !(m->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE))
+			return errno = EINVAL, -1;
+		/* Packets are encoded only once, so the configuration
+		 * of all group members has to be exactly the same. */
+		if (ba_transport_get_codec(m) != codec_id ||
+				memcmp(&m->a2dp.configuration, &t->a2dp.configuration,
+					t->a2dp.codec->capabilities_size) != 0)
+			return errno = EINVAL, -1;
+		for (j = 0; j < i; j++)
+			if (members[j] == m)
+				return errno = EINVAL, -1;
+		/* member transport shall not be used by other clients */
+		pthread_mutex_lock(&m->a2dp.pcm.mutex);
+		const int pcm_fd = m->a2dp.pcm.fd;
+		pthread_mutex_unlock(&m->a2dp.pcm.mutex);
+		if (pcm_fd != -1)
+			return errno = EBUSY, -1;
+	}
+
+	pthread_mutex_lock(&transport_group_mtx);
+
+	/* Nested groups are not supported. */
+	if (count > 0 && t->a2dp.group_leader != NULL)
+		goto fail;
+	for (i = 0; i < count; i++)
+		if (members[i]->a2dp.group_size > 0 || (
+					members[i]->a2dp.group_leader != NULL &&
+					members[i]->a2dp.group_leader != t))
+			goto fail;
+
+	pthread_mutex_lock(&t->a2dp.group_mtx);
+
+	old_size = t->a2dp.group_size;
+	memcpy(old, t->a2dp.group, old_size * sizeof(*old));
+
+	for (i = 0; i < count; i++) {
+		struct ba_transport_group_member *m = &t->a2dp.group[i];
+		m->t = members[i];
+		m->bt_fd = -1;
+		/* Take over BT socket and reference of the already existing member,
+		 * so the audio will not be interrupted for such member. */
+		for (j = 0; j < old_size; j++)
+			if (old[j].t == members[i]) {
+				m->bt_fd = old[j].bt_fd;
+				old[j].t = NULL;
+				break;
+			}
+		if (j == old_size)
+			ba_transport_ref(m->t);
+	}
+
+	t->a2dp.group_size = count;
+
+	pthread_mutex_unlock(&t->a2dp.group_mtx);
+
+	for (i = 0; i < old_size; i++)
+		if (old[i].t != NULL)
+			old[i].t->a2dp.group_leader = NULL;
+	for (i = 0; i < count; i++)
+		members[i]->a2dp.group_leader = t;
+
+	pthread_mutex_unlock(&transport_group_mtx);
+
+	/* release transports removed from the group */
+	for (i = 0; i < old_size; i++) {
+		if (old[i].t == NULL)
+			continue;
+		if (old[i].bt_fd != -1)
+			close(old[i].bt_fd);
+		ba_transport_stop_if_no_clients(old[i].t);
+		ba_transport_unref(old[i].t);
+	}
+
+	return 0;
+
+fail:
+	pthread_mutex_unlock(&transport_group_mtx);
+	return errno = EBUSY, -1;
+}
+
+/**
+ * Acquire BT sockets of all transport group members.
+ *
+ * This function shall be called after the group leader transport has
+ * been acquired. Members which can not be acquired are skipped. */
+void ba_transport_group_acquire(struct ba_transport *t) {
+
+	struct ba_transport *members[BA_TRANSPORT_GROUP_MAX_MEMBERS];
+	size_t i, j, count = 0;
+
+	pthread_mutex_lock(&t->a2dp.group_mtx);
+	for (i = 0; i < t->a2dp.group_size; i++)
+		if (t->a2dp.group[i].bt_fd == -1)
+			members[count++] = ba_transport_ref(t->a2dp.group[i].t);
+	pthread_mutex_unlock(&t->a2dp.group_mtx);
+
+	for (i = 0; i < count; i++) {
+
+		struct ba_transport *m = members[i];
+		int fd;
+
+		if ((fd = ba_transport_acquire(m)) == -1) {
+			error("Couldn't acquire group member transport: %s", strerror(errno));
+			goto next;
+		}
+
+		/* Packets encoded by the leader have to fit into member's MTU. */
+		if (m->mtu_write < t->mtu_write) {
+			warn("Group member write MTU too small: %zu < %zu",
+					m->mtu_write, t->mtu_write);
+			ba_transport_release(m);
+			goto next;
+		}
+
+		if ((fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) == -1) {
+			error("Couldn't duplicate group member BT socket: %s", strerror(errno));
+			goto next;
+		}
+
+		debug("Acquired group member transport: %d", fd);
+
+		pthread_mutex_lock(&t->a2dp.group_mtx);
+		/* make sure that the member was not removed in the meantime */
+		for (j = 0; j < t->a2dp.group_size; j++)
+			if (t->a2dp.group[j].t == m && t->a2dp.group[j].bt_fd == -1) {
+				t->a2dp.group[j].bt_fd = fd;
+				fd = -1;
+				break;
+			}
+		pthread_mutex_unlock(&t->a2dp.group_mtx);
+
+		if (fd != -1)
+			close(fd);
+
+next:
+		ba_transport_unref(m);
+	}
+
+}
+
+/**
+ * Send messages to all transport group members.
+ *
+ * The caller shall hold the group lock of the leader transport. */
+static void transport_group_sendmsg(
+		struct ba_transport *t,
+		const struct msghdr *msgs,
+		size_t count) {
+	for (size_t i = 0; i < t->a2dp.group_size; i++) {
+		struct ba_transport_group_member *m = &t->a2dp.group[i];
+		for (size_t j = 0; m->bt_fd != -1 && j < count; j++)
+			if (sendmsg(m->bt_fd, &msgs[j], MSG_DONTWAIT | MSG_NOSIGNAL) == -1) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK) {
+					debug("Group member BT socket not ready: Dropping packets: %zu",
+							count - j);
+					break;
+				}
+				warn("Couldn't write to group member: %s", strerror(errno));
+				close(m->bt_fd);
+				m->bt_fd = -1;
+			}
+	}
+}
+
+/**
+ * Write encoded packets to all transport group members.
+ *
+ * This function never blocks. If the BT socket of a member is not ready
+ * for writing, packets for such member are dropped, so one slow sink will
+ * not stall the whole group.
+ *
+ * @param t The group leader transport.
+ * @param packets An array of encoded packets.
+ * @param count The number of packets. */
+void ba_transport_group_write(
+		struct ba_transport *t,
+		const struct iovec *packets,
+		size_t count) {
+
+	struct msghdr msgs[16];
+
+	pthread_mutex_lock(&t->a2dp.group_mtx);
+
+	/* group size is zero for transports which are not group leaders */
+	while (t->a2dp.group_size > 0 && count > 0) {
+		size_t i, n = count < ARRAYSIZE(msgs) ? count : ARRAYSIZE(msgs);
+		for (i = 0; i < n; i++)
+			msgs[i] = (struct msghdr){
+				.msg_iov = (struct iovec *)&packets[i], .msg_iovlen = 1 };
+		transport_group_sendmsg(t, msgs, n);
+		packets += n;
+		count -= n;
+	}
+
+	pthread_mutex_unlock(&t->a2dp.group_mtx);
+
+}
+
+/**
+ * Write single encoded packet gathered from many buffers to all transport
+ * group members. See ba_transport_group_write() for details.
+ *
+ * @param t The group leader transport.
+ * @param iov The IO vectors which constitute the packet.
+ * @param iovcnt The number of IO vectors. */
+void ba_transport_group_writev(
+		struct ba_transport *t,
+		const struct iovec *iov,
+		size_t iovcnt) {
+	const struct msghdr msg = { .msg_iov = (struct iovec *)iov, .msg_iovlen = iovcnt };
+	pthread_mutex_lock(&t->a2dp.group_mtx);
+	transport_group_sendmsg(t, &msg, 1);
+	pthread_mutex_unlock(&t->a2dp.group_mtx);
+}
+
+/**
+ * Check whether the transport is a member of a transport group. */
+bool ba_transport_group_is_member(struct ba_transport *t) {
+	pthread_mutex_lock(&transport_group_mtx);
+	const bool rv = t->a2dp.group_leader != NULL;
+	pthread_mutex_unlock(&transport_group_mtx);
+	return rv;
+}
+
 int ba_transport_set_a2dp_state(
 		struct ba_transport *t,
 		enum bluez_a2dp_transport_state state) {
@@ -20,6 +20,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <time.h>
 
 #include "a2dp.h"
@@ -27,6 +28,7 @@
 #include "ba-transport-pcm.h"
 #include "bluez.h"
 #include "shared/a2dp-codecs.h"
+#include "shared/mpscq.h"
 
 enum ba_transport_thread_state {
 	BA_TRANSPORT_THREAD_STATE_IDLE,
@@ -47,6 +49,20 @@ enum ba_transport_thread_signal {
 	BA_TRANSPORT_THREAD_SIGNAL_PCM_DROP,
 };
 
+/**
+ * Maximal number of pending transport thread signals. */
+#define BA_TRANSPORT_THREAD_SIGNAL_QUEUE_SIZE 32
+
+/**
+ * Transport thread signal with optional payload. */
+struct ba_transport_thread_signal_msg {
+	enum ba_transport_thread_signal signal;
+	/* Signal specific payload. For the PCM_SYNC signal it is the time in
+	 * milliseconds without new PCM data after which the PCM FIFO is
+	 * considered to be drained. */
+	int value;
+};
+
 struct ba_transport_thread {
 
 	/* backward reference to transport */
@@ -68,8 +84,10 @@ struct ba_transport_thread {
 	bool master;
 	/* clone of BT socket */
 	int bt_fd;
-	/* notification PIPE */
-	int pipe[2];
+	/* queue of pending signals */
+	mpscq_t signals;
+	/* signal notification eventfd */
+	int event_fd;
 
 };
 
@@ -112,9 +130,12 @@ int ba_transport_thread_bt_release(
 int ba_transport_thread_signal_send(
 		struct ba_transport_thread *th,
 		enum ba_transport_thread_signal signal);
+int ba_transport_thread_signal_send_msg(
+		struct ba_transport_thread *th,
+		const struct ba_transport_thread_signal_msg *msg);
 int ba_transport_thread_signal_recv(
 		struct ba_transport_thread *th,
-		enum ba_transport_thread_signal *signal);
+		struct ba_transport_thread_signal_msg *msg);
 
 enum ba_transport_thread_manager_command {
 	BA_TRANSPORT_THREAD_MANAGER_TERMINATE = 0,
@@ -145,6 +166,19 @@ enum ba_transport_profile {
 #define BA_TRANSPORT_PROFILE_MASK_HF \
 	(BA_TRANSPORT_PROFILE_HSP_HS | BA_TRANSPORT_PROFILE_HFP_HF)
 
+/**
+ * Maximal number of members in the A2DP transport group. */
+#define BA_TRANSPORT_GROUP_MAX_MEMBERS 16
+
+/**
+ * Member of the A2DP transport group. */
+struct ba_transport_group_member {
+	/* referenced member transport */
+	struct ba_transport *t;
+	/* clone of the member BT socket */
+	int bt_fd;
+};
+
 struct ba_transport {
 
 	/* backward reference to device */
@@ -192,6 +226,9 @@ struct ba_transport {
 	/* thread for managing IO threads */
 	pthread_t thread_manager_thread_id;
 	int thread_manager_pipe[2];
+	/* IO engine sources used instead of the manager thread */
+	int thread_manager_source;
+	int thread_manager_timer;
 
 	/* indicates IO threads stopping */
 	pthread_cond_t stopped;
@@ -228,6 +265,15 @@ struct ba_transport {
 			 * subsequent ioctl() calls. */
 			int bt_fd_coutq_init;
 
+			/* Transport group (leader side). Every packet encoded by the leader
+			 * transport is also written to the BT sockets of group members. */
+			pthread_mutex_t group_mtx;
+			struct ba_transport_group_member group[BA_TRANSPORT_GROUP_MAX_MEMBERS];
+			size_t group_size;
+			/* Transport group (member side). Guarded by the global transport
+			 * group lock. */
+			struct ba_transport *group_leader;
+
 		} a2dp;
 
 		struct {
@@ -318,6 +364,23 @@ int ba_transport_stop_if_no_clients(struct ba_transport *t);
 int ba_transport_acquire(struct ba_transport *t);
 int ba_transport_release(struct ba_transport *t);
 
+int ba_transport_group_set(
+		struct ba_transport *t,
+		struct ba_transport * const *members,
+		size_t count);
+void ba_transport_group_acquire(
+		struct ba_transport *t);
+void ba_transport_group_write(
+		struct ba_transport *t,
+		const struct iovec *packets,
+		size_t count);
+void ba_transport_group_writev(
+		struct ba_transport *t,
+		const struct iovec *iov,
+		size_t iovcnt);
+bool ba_transport_group_is_member(
+		struct ba_transport *t);
+
 int ba_transport_set_a2dp_state(
 		struct ba_transport *t,
 		enum bluez_a2dp_transport_state state);
@@ -32,7 +32,10 @@ struct ba_config config = {
 
 	.keep_alive_time = 0,
 
+	.dbus_update_rate = 20,
+
 	.io_thread_rt_priority = 0,
+	.io_engine_workers = 0,
 
 	.volume_init_level = 0,
 
@@ -88,6 +91,14 @@ struct ba_config config = {
 	.a2dp.volume = false,
 	.a2dp.force_mono = false,
 	.a2dp.force_44100 = false,
+	.a2dp.write_batch_time = 0,
+	.a2dp.drift_compensation = false,
+	.a2dp.jitter_buffer_time = 0,
+	.a2dp.abr = false,
+	.a2dp.abr_queue_low = 1,
+	.a2dp.abr_queue_high = 4,
+	.a2dp.abr_recovery_time = 5000,
+	.a2dp.max_clients = 1,
 
 	/* Try to use high SBC encoding quality as a default. */
 	.sbc_quality = SBC_QUALITY_HIGH,
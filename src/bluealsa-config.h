@@ -65,9 +65,26 @@ struct ba_config {
 	 * infinite time. This option applies for the source profile only. */
 	int keep_alive_time;
 
+	/* The maximal rate (in Hz) of the D-Bus PropertiesChanged signals emitted
+	 * for a single PCM or RFCOMM object. Property changes which occur more
+	 * frequently are accumulated and emitted together. Set this value to 0
+	 * in order to emit every change immediately. */
+	unsigned int dbus_update_rate;
+
 	/* real-time scheduling priority of transport IO threads */
 	int io_thread_rt_priority;
 
+	/* Process data as fast as possible instead of keeping the constant bit
+	 * rate in the encoder threads. This option is intended for codec
+	 * benchmarking and shall not be used with real Bluetooth devices. */
+	bool io_disable_pacing;
+
+	/* The number of IO engine worker threads. If set to zero, every transport
+	 * uses dedicated management thread and every adapter uses dedicated SCO
+	 * dispatcher thread. Otherwise, these tasks are handled by the pool of
+	 * epoll-based worker threads. */
+	unsigned int io_engine_workers;
+
 	/* the initial volume level */
 	int volume_init_level;
 
@@ -125,6 +142,36 @@ struct ba_config {
 		 * to force lower sampling in order to save Bluetooth bandwidth. */
 		bool force_44100;
 
+		/* The number of milliseconds of audio for which encoded packets are
+		 * queued before being written to the BT socket with a single system
+		 * call. Set this value to 0 in order to disable write batching. */
+		unsigned int write_batch_time;
+
+		/* Compensate the clock drift between the PCM source and the remote
+		 * A2DP sink by resampling PCM data in the encoder threads. */
+		bool drift_compensation;
+
+		/* The maximal depth in milliseconds of the jitter buffer used by the
+		 * A2DP sink decoders for reordering RTP packets and concealing lost
+		 * ones. Set this value to 0 in order to disable jitter buffering. */
+		unsigned int jitter_buffer_time;
+
+		/* Adapt the bitrate of the SBC and AAC encoders to the number of
+		 * packets queued in the BT socket. The bitrate is decreased when the
+		 * queue reaches the high threshold and it is increased when the queue
+		 * stays at or below the low threshold for the recovery time given in
+		 * milliseconds. */
+		bool abr;
+		unsigned int abr_queue_low;
+		unsigned int abr_queue_high;
+		unsigned int abr_recovery_time;
+
+		/* The maximal number of clients which can open the A2DP source
+		 * playback PCM at the same time. Audio of all clients is mixed in
+		 * the encoder thread. Set this value to 1 in order to disable the
+		 * software mixing. */
+		unsigned int max_clients;
+
 	} a2dp;
 
 	/* BlueALSA supports 5 SBC qualities: low, medium, high, XQ and XQ+. The XQ
@@ -17,12 +17,16 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <bluetooth/hci.h>
@@ -33,6 +37,7 @@
 #include <glib.h>
 
 #include "a2dp.h"
+#include "a2dp-sbc.h"
 #include "ba-adapter.h"
 #include "ba-device.h"
 #include "ba-transport.h"
@@ -41,14 +46,46 @@
 #include "bluez.h"
 #include "dbus.h"
 #include "hfp.h"
+#include "rtp.h"
+#include "storage.h"
 #include "utils.h"
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
+#include "shared/histogram.h"
 #include "shared/log.h"
+#include "shared/rt.h"
+#include "shared/trace.h"
+
+/* Changes of these PCM properties alter the stream configuration, so they
+ * are always announced immediately, regardless of the update rate limit. */
+#define BA_DBUS_PCM_UPDATE_IMMEDIATE ( \
+		BA_DBUS_PCM_UPDATE_RUNNING | \
+		BA_DBUS_PCM_UPDATE_FORMAT | \
+		BA_DBUS_PCM_UPDATE_CHANNELS | \
+		BA_DBUS_PCM_UPDATE_SAMPLING | \
+		BA_DBUS_PCM_UPDATE_CODEC | \
+		BA_DBUS_PCM_UPDATE_CODEC_CONFIG)
 
 static const char *bluealsa_dbus_manager_path = "/org/bluealsa";
 static GDBusObjectManagerServer *bluealsa_dbus_manager = NULL;
 
+/* Objects with accumulated property changes which were not announced yet,
+ * because the previous PropertiesChanged signal was emitted too recently.
+ * The lock protects these lists, the update mask and the update timestamp
+ * of all PCM and RFCOMM objects, as well as the exported flag. */
+static pthread_mutex_t bluealsa_dbus_update_mtx = PTHREAD_MUTEX_INITIALIZER;
+static GSList *bluealsa_dbus_update_pcms = NULL;
+static GSList *bluealsa_dbus_update_rfcomms = NULL;
+static unsigned int bluealsa_dbus_update_source_id = 0;
+
+/* PCM control channels are dispatched by a dedicated worker thread, so
+ * client commands are not delayed by (and do not delay) the main loop.
+ * If the worker could not be created, the default context is used. */
+static GMainContext *bluealsa_dbus_ctrl_context = NULL;
+/* Threads for the PCM Open calls which may block on the transport
+ * acquisition, so slow devices do not starve the D-Bus thread pool. */
+static GThreadPool *bluealsa_dbus_open_pool = NULL;
+
 static GVariant *ba_variant_new_bluealsa_version(void) {
 	return g_variant_new_string(PACKAGE_VERSION);
 }
@@ -262,6 +299,10 @@ static GVariant *ba_variant_new_pcm_delay(const struct ba_transport_pcm *pcm) {
 	return g_variant_new_uint16(ba_transport_pcm_get_delay(pcm));
 }
 
+static GVariant *ba_variant_new_pcm_bitrate(const struct ba_transport_pcm *pcm) {
+	return g_variant_new_uint32(pcm->bitrate);
+}
+
 static GVariant *ba_variant_new_pcm_delay_adjustment(const struct ba_transport_pcm *pcm) {
 	return g_variant_new_int16(ba_transport_pcm_delay_adjustment_get(pcm));
 }
@@ -270,6 +311,13 @@ static GVariant *ba_variant_new_pcm_soft_volume(const struct ba_transport_pcm *p
 	return g_variant_new_boolean(pcm->soft_volume);
 }
 
+static GVariant *ba_variant_new_pcm_latency(const struct ba_transport_pcm *pcm) {
+	if (atomic_load_explicit(&pcm->latency, memory_order_relaxed) ==
+			BA_TRANSPORT_PCM_LATENCY_LOW)
+		return g_variant_new_string(BLUEALSA_PCM_LATENCY_LOW);
+	return g_variant_new_string(BLUEALSA_PCM_LATENCY_NORMAL);
+}
+
 static uint8_t ba_volume_pack_dbus_volume(bool muted, int value) {
 	return (muted << 7) | (((uint8_t)value) & 0x7F);
 }
@@ -364,11 +412,108 @@ static GVariant *bluealsa_manager_get_property(const char *property,
 	return NULL;
 }
 
+static void bluealsa_manager_get_trace_thread(pid_t tid, const char *name,
+		const struct trace_record *records, size_t nmemb, void *userdata) {
+
+	GVariantBuilder *trace = userdata;
+	GVariantBuilder builder;
+
+	g_variant_builder_init(&builder, G_VARIANT_TYPE("a(tuuuu)"));
+	for (size_t i = 0; i < nmemb; i++)
+		g_variant_builder_add(&builder, "(tuuuu)", records[i].timestamp,
+				records[i].event, records[i].args[0], records[i].args[1],
+				records[i].args[2]);
+
+	g_variant_builder_add(trace, "(usa(tuuuu))", tid, name, &builder);
+
+}
+
+static void bluealsa_manager_get_trace(GDBusMethodInvocation *inv, void *userdata) {
+	(void)userdata;
+
+	if (!atomic_load(&trace_enabled)) {
+		g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
+				G_DBUS_ERROR_NOT_SUPPORTED, "Tracing not enabled");
+		return;
+	}
+
+	GVariantBuilder trace;
+	g_variant_builder_init(&trace, G_VARIANT_TYPE("a(usa(tuuuu))"));
+
+	if (trace_dump(bluealsa_manager_get_trace_thread, &trace) == -1) {
+		g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
+				G_DBUS_ERROR_FAILED, "Dump trace: %s", strerror(errno));
+		g_variant_builder_clear(&trace);
+		return;
+	}
+
+	g_dbus_method_invocation_return_value(inv, g_variant_new("(a(usa(tuuuu)))", &trace));
+	g_variant_builder_clear(&trace);
+
+}
+
+static void *bluealsa_dbus_ctrl_worker(void *userdata) {
+	GMainLoop *loop = userdata;
+	g_main_context_push_thread_default(bluealsa_dbus_ctrl_context);
+	g_main_loop_run(loop);
+	g_main_context_pop_thread_default(bluealsa_dbus_ctrl_context);
+	g_main_loop_unref(loop);
+	return NULL;
+}
+
+static void bluealsa_pcm_open_worker(void *data, void *userdata);
+
+/**
+ * Start PCM control channel worker and PCM Open thread pool. */
+static void bluealsa_dbus_workers_init(void) {
+
+	GError *err = NULL;
+	if ((bluealsa_dbus_open_pool = g_thread_pool_new(bluealsa_pcm_open_worker,
+					NULL, -1, FALSE, &err)) == NULL) {
+		warn("Couldn't create PCM open thread pool: %s", err->message);
+		g_error_free(err);
+	}
+
+	GMainContext *context = g_main_context_new();
+	GMainLoop *loop = g_main_loop_new(context, FALSE);
+	bluealsa_dbus_ctrl_context = context;
+
+	/* See the ba_transport_pcm_start() function for information
+	 * why we have to mask all signals. */
+	sigset_t sigset, oldset;
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+
+	pthread_t thread;
+	int ret;
+	if ((ret = pthread_create(&thread, NULL, bluealsa_dbus_ctrl_worker, loop)) != 0) {
+		warn("Couldn't create PCM control worker: %s", strerror(ret));
+		/* fall back to the main loop dispatching */
+		bluealsa_dbus_ctrl_context = NULL;
+		g_main_loop_unref(loop);
+		g_main_context_unref(context);
+	}
+	else {
+		pthread_setname_np(thread, "ba-dbus-ctrl");
+		pthread_detach(thread);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+}
+
 /**
  * Register BlueALSA D-Bus manager interfaces. */
 void bluealsa_dbus_register(void) {
 
+	static const GDBusMethodCallDispatcher dispatchers[] = {
+		{ .method = "GetTrace",
+			.handler = bluealsa_manager_get_trace },
+		{ 0 },
+	};
+
 	static const GDBusInterfaceSkeletonVTable vtable = {
+		.dispatchers = dispatchers,
 		.get_property = bluealsa_manager_get_property,
 	};
 
@@ -382,13 +527,77 @@ void bluealsa_dbus_register(void) {
 	bluealsa_dbus_manager = g_dbus_object_manager_server_new(bluealsa_dbus_manager_path);
 	g_dbus_object_manager_server_set_connection(bluealsa_dbus_manager, config.dbus);
 
+	bluealsa_dbus_workers_init();
+
+}
+
+/* interval of the PCM drain completion checks */
+#define BLUEALSA_PCM_DRAIN_CHECK_INTERVAL_MS 10
+/* upper limit for the PCM drain time */
+#define BLUEALSA_PCM_DRAIN_TIMEOUT_US (3 * G_USEC_PER_SEC)
+
+/**
+ * PCM control channel of a single client. */
+struct bluealsa_pcm_ctrl {
+	struct ba_transport_pcm *pcm;
+	/* ID of the PCM client */
+	unsigned int id;
+	/* control context source of the pending drain, NULL if none */
+	GSource *drain_source;
+};
+
+struct bluealsa_pcm_drain {
+	struct bluealsa_pcm_ctrl *ctrl;
+	GIOChannel *ch;
+	gint64 deadline;
+};
+
+static void bluealsa_pcm_ctrl_free(struct bluealsa_pcm_ctrl *ctrl) {
+	if (ctrl->drain_source != NULL)
+		g_source_destroy(ctrl->drain_source);
+	ba_transport_pcm_unref(ctrl->pcm);
+	g_free(ctrl);
+}
+
+static void bluealsa_pcm_drain_free(struct bluealsa_pcm_drain *drain) {
+	drain->ctrl->drain_source = NULL;
+	g_io_channel_unref(drain->ch);
+	g_free(drain);
+}
+
+/**
+ * Reply to the PCM drain command as soon as the drain is completed.
+ *
+ * The drain of the main client is completed when the PCM IO thread has
+ * processed all samples. Additional clients are drained as soon as their
+ * buffers are empty. */
+static gboolean bluealsa_pcm_drain_check(void *userdata) {
+	struct bluealsa_pcm_drain *drain = userdata;
+	struct ba_transport_pcm *pcm = drain->ctrl->pcm;
+	const unsigned int id = drain->ctrl->id;
+
+	const bool drained = ba_transport_pcm_client_is_main(pcm, id) ?
+		ba_transport_pcm_drain_check(pcm) :
+		ba_transport_pcm_client_queued(pcm, id) <= 0;
+
+	if (!drained) {
+		if (g_get_monotonic_time() < drain->deadline)
+			return G_SOURCE_CONTINUE;
+		warn("PCM drain timeout: %s", pcm->ba_dbus_path);
+	}
+
+	size_t len;
+	g_io_channel_write_chars(drain->ch, "OK", -1, &len, NULL);
+	g_io_channel_flush(drain->ch, NULL);
+	return G_SOURCE_REMOVE;
 }
 
 static gboolean bluealsa_pcm_controller(GIOChannel *ch, GIOCondition condition,
 		void *userdata) {
 	(void)condition;
 
-	struct ba_transport_pcm *pcm = userdata;
+	struct bluealsa_pcm_ctrl *ctrl = userdata;
+	struct ba_transport_pcm *pcm = ctrl->pcm;
 	char command[32];
 	size_t len;
 
@@ -397,22 +606,46 @@ static gboolean bluealsa_pcm_controller(GIOChannel *ch, GIOCondition condition,
 		error("Couldn't read controller channel");
 		return TRUE;
 	case G_IO_STATUS_NORMAL:
+		/* Client shall wait for the drain reply before sending a new
+		 * command. If it does not, complete the pending drain right
+		 * away, so the order of replies is preserved. */
+		if (ctrl->drain_source != NULL) {
+			size_t written;
+			g_source_destroy(ctrl->drain_source);
+			g_io_channel_write_chars(ch, "OK", -1, &written, NULL);
+			g_io_channel_flush(ch, NULL);
+		}
 		if (strncmp(command, BLUEALSA_PCM_CTRL_DRAIN, len) == 0) {
-			if (pcm->mode == BA_TRANSPORT_PCM_MODE_SINK)
-				ba_transport_pcm_drain(pcm);
+			if (pcm->mode == BA_TRANSPORT_PCM_MODE_SINK &&
+					(!ba_transport_pcm_client_is_main(pcm, ctrl->id) ||
+					 ba_transport_pcm_drain(pcm) == 0)) {
+				/* The reply will be sent when the drain is completed, so other
+				 * control channels are not blocked in the meantime. */
+				struct bluealsa_pcm_drain *drain = g_new0(struct bluealsa_pcm_drain, 1);
+				drain->ctrl = ctrl;
+				drain->ch = g_io_channel_ref(ch);
+				drain->deadline = g_get_monotonic_time() + BLUEALSA_PCM_DRAIN_TIMEOUT_US;
+				GSource *source = g_timeout_source_new(BLUEALSA_PCM_DRAIN_CHECK_INTERVAL_MS);
+				g_source_set_callback(source, bluealsa_pcm_drain_check,
+						drain, (GDestroyNotify)bluealsa_pcm_drain_free);
+				g_source_attach(source, bluealsa_dbus_ctrl_context);
+				ctrl->drain_source = source;
+				g_source_unref(source);
+				return TRUE;
+			}
 			g_io_channel_write_chars(ch, "OK", -1, &len, NULL);
 		}
 		else if (strncmp(command, BLUEALSA_PCM_CTRL_DROP, len) == 0) {
 			if (pcm->mode == BA_TRANSPORT_PCM_MODE_SINK)
-				ba_transport_pcm_drop(pcm);
+				ba_transport_pcm_client_drop(pcm, ctrl->id);
 			g_io_channel_write_chars(ch, "OK", -1, &len, NULL);
 		}
 		else if (strncmp(command, BLUEALSA_PCM_CTRL_PAUSE, len) == 0) {
-			ba_transport_pcm_pause(pcm);
+			ba_transport_pcm_client_pause(pcm, ctrl->id, true);
 			g_io_channel_write_chars(ch, "OK", -1, &len, NULL);
 		}
 		else if (strncmp(command, BLUEALSA_PCM_CTRL_RESUME, len) == 0) {
-			ba_transport_pcm_resume(pcm);
+			ba_transport_pcm_client_pause(pcm, ctrl->id, false);
 			g_io_channel_write_chars(ch, "OK", -1, &len, NULL);
 		}
 		else {
@@ -424,10 +657,17 @@ static gboolean bluealsa_pcm_controller(GIOChannel *ch, GIOCondition condition,
 	case G_IO_STATUS_AGAIN:
 		return TRUE;
 	case G_IO_STATUS_EOF:
+		if (ctrl->drain_source != NULL)
+			g_source_destroy(ctrl->drain_source);
 		pthread_mutex_lock(&pcm->mutex);
-		ba_transport_pcm_release(pcm);
-		ba_transport_thread_signal_send(pcm->th, BA_TRANSPORT_THREAD_SIGNAL_PCM_CLOSE);
+		ba_transport_pcm_client_release(pcm, ctrl->id);
+		const bool closed = pcm->fd == -1;
 		pthread_mutex_unlock(&pcm->mutex);
+		/* When the main client is closed, one of the additional clients
+		 * takes over the PCM. Notify the IO thread only if there is no
+		 * client left. */
+		if (closed)
+			ba_transport_thread_signal_send(pcm->th, BA_TRANSPORT_THREAD_SIGNAL_PCM_CLOSE);
 		/* Check whether we've just closed the last PCM client and in
 		 * such a case schedule transport IO threads termination. */
 		ba_transport_stop_if_no_clients(pcm->t);
@@ -438,13 +678,36 @@ static gboolean bluealsa_pcm_controller(GIOChannel *ch, GIOCondition condition,
 	return TRUE;
 }
 
-static void bluealsa_pcm_open(GDBusMethodInvocation *inv, void *userdata) {
+/**
+ * Deferred PCM Open method call. */
+struct bluealsa_pcm_open {
+	GDBusMethodInvocation *inv;
+	struct ba_transport_pcm *pcm;
+	/* transfer PCM stream via the shared memory ring buffer */
+	bool shm;
+	/* time-stamp of the method call in microseconds */
+	uint64_t ts_open;
+};
+
+/**
+ * Open PCM stream.
+ *
+ * This function might block until the transport is acquired and its IO
+ * thread is running, so it shall be called by the PCM Open worker. */
+static void bluealsa_pcm_open_stream(const struct bluealsa_pcm_open *req) {
+
+	GDBusMethodInvocation *inv = req->inv;
+	struct ba_transport_pcm *pcm = req->pcm;
+	const bool shm = req->shm;
 
-	struct ba_transport_pcm *pcm = userdata;
 	const bool is_sink = pcm->mode == BA_TRANSPORT_PCM_MODE_SINK;
 	struct ba_transport_thread *th = pcm->th;
 	struct ba_transport *t = pcm->t;
-	int pcm_fds[4] = { -1, -1, -1, -1 };
+	/* PIPE or memfd and event fds, and PCM control socket */
+	int pcm_fds[6] = { -1, -1, -1, -1, -1, -1 };
+	/* client copies of the event fds */
+	int shm_fds[2] = { -1, -1 };
+	struct shm_ring shm_ring = { 0 };
 	size_t i;
 
 	/* Prevent two (or more) clients trying to
@@ -459,28 +722,73 @@ static void bluealsa_pcm_open(GDBusMethodInvocation *inv, void *userdata) {
 		goto fail;
 	}
 
+	/* encoder of the group member is driven by the group leader */
+	if (pcm == &t->a2dp.pcm &&
+			t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE &&
+			ba_transport_group_is_member(t)) {
+		g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
+				G_DBUS_ERROR_FAILED, "Transport group member: %s", strerror(EBUSY));
+		goto fail;
+	}
+
+	/* check whether there is room for a new (mixed) client */
 	pthread_mutex_lock(&pcm->mutex);
-	const int pcm_fd = pcm->fd;
+	const bool busy = pcm->fd != -1 &&
+		pcm->clients_len + 1 >= ba_transport_pcm_clients_max(pcm);
 	pthread_mutex_unlock(&pcm->mutex);
 
-	if (pcm_fd != -1) {
+	if (busy) {
 		g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
 				G_DBUS_ERROR_FAILED, "%s", strerror(EBUSY));
 		goto fail;
 	}
 
-	/* create PCM stream PIPE and PCM control socket */
-	if (pipe2(&pcm_fds[0], O_CLOEXEC) == -1 ||
-			socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, &pcm_fds[2]) == -1) {
-		g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
-				G_DBUS_ERROR_FAILED, "Create PIPE: %s", strerror(errno));
-		goto fail;
+	if (shm) {
+
+		/* Use buffer sizes similar to the ones of the PIPE. In the playback
+		 * mode the buffer shall be small to minimize the audio delay. In the
+		 * low-latency mode it is shrunk even further, below the page size
+		 * which is the lower limit for the PIPE. */
+		size_t size = is_sink ? 4096 : 65536;
+		if (is_sink && atomic_load_explicit(&pcm->latency,
+					memory_order_relaxed) == BA_TRANSPORT_PCM_LATENCY_LOW)
+			size = 1024;
+
+		/* create shared memory ring buffer and notification event fds */
+		if ((pcm_fds[0] = shm_ring_create(&shm_ring, size)) == -1 ||
+				(pcm_fds[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1 ||
+				(pcm_fds[2] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1 ||
+				(shm_fds[0] = dup(pcm_fds[1])) == -1 ||
+				(shm_fds[1] = dup(pcm_fds[2])) == -1) {
+			g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
+					errno == ENOSYS ? G_DBUS_ERROR_NOT_SUPPORTED : G_DBUS_ERROR_FAILED,
+					"Create shared memory: %s", strerror(errno));
+			goto fail;
+		}
+
+	}
+	else {
+
+		/* create PCM stream PIPE */
+		if (pipe2(&pcm_fds[0], O_CLOEXEC) == -1) {
+			g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
+					G_DBUS_ERROR_FAILED, "Create PIPE: %s", strerror(errno));
+			goto fail;
+		}
+
+		/* set our internal endpoint as non-blocking. */
+		if (fcntl(pcm_fds[is_sink ? 0 : 1], F_SETFL, O_NONBLOCK) == -1) {
+			g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
+					G_DBUS_ERROR_FAILED, "Setup PIPE: %s", strerror(errno));
+			goto fail;
+		}
+
 	}
 
-	/* set our internal endpoint as non-blocking. */
-	if (fcntl(pcm_fds[is_sink ? 0 : 1], F_SETFL, O_NONBLOCK) == -1) {
+	/* create PCM control socket */
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0, &pcm_fds[4]) == -1) {
 		g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
-				G_DBUS_ERROR_FAILED, "Setup PIPE: %s", strerror(errno));
+				G_DBUS_ERROR_FAILED, "Create PIPE: %s", strerror(errno));
 		goto fail;
 	}
 
@@ -505,31 +813,79 @@ static void bluealsa_pcm_open(GDBusMethodInvocation *inv, void *userdata) {
 			goto fail;
 		}
 
+		if (pcm == &t->a2dp.pcm &&
+				t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE)
+			ba_transport_group_acquire(t);
+
 	}
 
 	pthread_mutex_lock(&pcm->mutex);
-	/* get correct PIPE endpoint - PIPE is unidirectional */
-	pcm->fd = pcm_fds[is_sink ? 0 : 1];
-	/* set newly opened PCM as active */
-	pcm->active = true;
+
+	/* If the PCM is already opened, the new client will be mixed into
+	 * the stream of the main client. */
+	const bool mixing = pcm->fd != -1;
+
+	unsigned int id;
+	if (shm)
+		/* The client notifies us via the first event fd, so it will be used
+		 * in place of the PIPE endpoint for polling, and we notify the client
+		 * via the second one. */
+		id = ba_transport_pcm_client_attach(pcm, pcm_fds[1], &shm_ring, pcm_fds[2]);
+	else
+		/* get correct PIPE endpoint - PIPE is unidirectional */
+		id = ba_transport_pcm_client_attach(pcm, pcm_fds[is_sink ? 0 : 1], NULL, -1);
+
+	if (id == 0) {
+		pthread_mutex_unlock(&pcm->mutex);
+		g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
+				G_DBUS_ERROR_FAILED, "%s", strerror(errno));
+		goto fail;
+	}
+
+	if (!mixing) {
+		/* set newly opened PCM as active */
+		pcm->active = true;
+		/* starting point for the open-to-first-packet statistic */
+		atomic_store_explicit(&pcm->stats.ts_open, req->ts_open, memory_order_relaxed);
+	}
+
 	pthread_mutex_unlock(&pcm->mutex);
 
-	GIOChannel *ch = g_io_channel_unix_new(pcm_fds[2]);
+	struct bluealsa_pcm_ctrl *ctrl = g_new0(struct bluealsa_pcm_ctrl, 1);
+	ctrl->pcm = ba_transport_pcm_ref(pcm);
+	ctrl->id = id;
+
+	GIOChannel *ch = g_io_channel_unix_new(pcm_fds[4]);
 	g_io_channel_set_close_on_unref(ch, TRUE);
 	g_io_channel_set_encoding(ch, NULL, NULL);
+	pcm_fds[4] = -1;
 
-	g_io_add_watch_full(ch, G_PRIORITY_DEFAULT, G_IO_IN,
-			bluealsa_pcm_controller, ba_transport_pcm_ref(pcm),
-			(GDestroyNotify)ba_transport_pcm_unref);
+	GSource *watch = g_io_create_watch(ch, G_IO_IN);
+	g_source_set_callback(watch, G_SOURCE_FUNC(bluealsa_pcm_controller),
+			ctrl, (GDestroyNotify)bluealsa_pcm_ctrl_free);
+	g_source_attach(watch, bluealsa_dbus_ctrl_context);
+	g_source_unref(watch);
 	g_io_channel_unref(ch);
 
-	/* notify our audio thread that the FIFO is ready */
-	ba_transport_thread_signal_send(th, BA_TRANSPORT_THREAD_SIGNAL_PCM_OPEN);
-
-	int fds[2] = { pcm_fds[is_sink ? 1 : 0], pcm_fds[3] };
-	GUnixFDList *fd_list = g_unix_fd_list_new_from_array(fds, 2);
-	g_dbus_method_invocation_return_value_with_unix_fd_list(inv,
-			g_variant_new("(hh)", 0, 1), fd_list);
+	/* Notify our audio thread that the FIFO is ready. Additional clients
+	 * are picked up by the IO thread with the next read, so the running
+	 * stream is not resynchronized. */
+	if (!mixing)
+		ba_transport_thread_signal_send(th, BA_TRANSPORT_THREAD_SIGNAL_PCM_OPEN);
+
+	GUnixFDList *fd_list;
+	if (shm) {
+		int fds[4] = { pcm_fds[0], shm_fds[0], shm_fds[1], pcm_fds[5] };
+		fd_list = g_unix_fd_list_new_from_array(fds, 4);
+		g_dbus_method_invocation_return_value_with_unix_fd_list(inv,
+				g_variant_new("(hhhh)", 0, 1, 2, 3), fd_list);
+	}
+	else {
+		int fds[2] = { pcm_fds[is_sink ? 1 : 0], pcm_fds[5] };
+		fd_list = g_unix_fd_list_new_from_array(fds, 2);
+		g_dbus_method_invocation_return_value_with_unix_fd_list(inv,
+				g_variant_new("(hh)", 0, 1), fd_list);
+	}
 	g_object_unref(fd_list);
 
 	pthread_mutex_unlock(&pcm->client_mtx);
@@ -537,10 +893,53 @@ static void bluealsa_pcm_open(GDBusMethodInvocation *inv, void *userdata) {
 
 fail:
 	pthread_mutex_unlock(&pcm->client_mtx);
+	shm_ring_free(&shm_ring);
 	/* clean up created file descriptors */
 	for (i = 0; i < ARRAYSIZE(pcm_fds); i++)
 		if (pcm_fds[i] != -1)
 			close(pcm_fds[i]);
+	for (i = 0; i < ARRAYSIZE(shm_fds); i++)
+		if (shm_fds[i] != -1)
+			close(shm_fds[i]);
+}
+
+static void bluealsa_pcm_open_worker(void *data, void *userdata) {
+	(void)userdata;
+	struct bluealsa_pcm_open *req = data;
+	bluealsa_pcm_open_stream(req);
+	ba_transport_pcm_unref(req->pcm);
+	g_free(req);
+}
+
+/**
+ * Hand over the PCM Open call to the worker thread.
+ *
+ * The method invocation is completed by the worker, so the D-Bus dispatching
+ * thread is not blocked by the transport acquisition. */
+static void bluealsa_pcm_open_defer(GDBusMethodInvocation *inv,
+		struct ba_transport_pcm *pcm, bool shm) {
+
+	struct timespec ts;
+	gettimestamp(&ts);
+
+	struct bluealsa_pcm_open *req = g_new0(struct bluealsa_pcm_open, 1);
+	req->inv = inv;
+	req->pcm = ba_transport_pcm_ref(pcm);
+	req->shm = shm;
+	req->ts_open = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+	if (bluealsa_dbus_open_pool == NULL ||
+			!g_thread_pool_push(bluealsa_dbus_open_pool, req, NULL))
+		bluealsa_pcm_open_worker(req, NULL);
+
+}
+
+static void bluealsa_pcm_open(GDBusMethodInvocation *inv, void *userdata) {
+	bluealsa_pcm_open_defer(inv, userdata, false);
+}
+
+static void bluealsa_pcm_open_shm(GDBusMethodInvocation *inv, void *userdata) {
+	bluealsa_pcm_open_defer(inv, userdata, true);
 }
 
 static void bluealsa_pcm_get_codecs(GDBusMethodInvocation *inv, void *userdata) {
@@ -704,6 +1103,11 @@ static void bluealsa_pcm_select_codec(GDBusMethodInvocation *inv, void *userdata
 		if (a2dp_select_configuration(codec, &sep->configuration, sep->capabilities_size) == -1)
 			goto fail;
 
+		/* minimize the SBC frame duration in the low-latency mode */
+		if (codec_id == A2DP_CODEC_SBC && atomic_load_explicit(&pcm->latency,
+					memory_order_relaxed) == BA_TRANSPORT_PCM_LATENCY_LOW)
+			a2dp_sbc_select_low_latency(codec, &sep->configuration.sbc, &sep->capabilities.sbc);
+
 		/* use codec configuration blob provided by user */
 		if (a2dp_configuration_size != 0) {
 			uint32_t rv;
@@ -780,6 +1184,7 @@ static void bluealsa_pcm_set_delay_adjustment(GDBusMethodInvocation *inv, void *
 	}
 
 	ba_transport_pcm_delay_adjustment_set(pcm, codec_id, adjustment);
+	storage_pcm_data_mark_dirty(pcm);
 	bluealsa_dbus_pcm_update(pcm, BA_DBUS_PCM_UPDATE_DELAY_ADJUSTMENT);
 	g_dbus_method_invocation_return_value(inv, NULL);
 
@@ -818,6 +1223,274 @@ static void bluealsa_pcm_get_delay_adjustments(GDBusMethodInvocation *inv, void
 
 }
 
+static GVariant *bluealsa_pcm_stats_histogram_to_gvariant(const struct histogram *h) {
+
+	struct histogram_summary summary;
+	histogram_get_summary(h, &summary);
+
+	GVariantBuilder props;
+	g_variant_builder_init(&props, G_VARIANT_TYPE("a{sv}"));
+
+	g_variant_builder_add(&props, "{sv}", "Count", g_variant_new_uint64(summary.count));
+	g_variant_builder_add(&props, "{sv}", "Min", g_variant_new_uint32(summary.min));
+	g_variant_builder_add(&props, "{sv}", "Max", g_variant_new_uint32(summary.max));
+	g_variant_builder_add(&props, "{sv}", "Mean", g_variant_new_uint32(summary.mean));
+	g_variant_builder_add(&props, "{sv}", "P50", g_variant_new_uint32(summary.p50));
+	g_variant_builder_add(&props, "{sv}", "P90", g_variant_new_uint32(summary.p90));
+	g_variant_builder_add(&props, "{sv}", "P99", g_variant_new_uint32(summary.p99));
+	g_variant_builder_add(&props, "{sv}", "P999", g_variant_new_uint32(summary.p999));
+
+	return g_variant_builder_end(&props);
+}
+
+/**
+ * Lookup A2DP source transport by the BlueALSA PCM D-Bus object path. */
+static struct ba_transport *bluealsa_dbus_pcm_lookup_transport(const char *path) {
+
+	struct ba_adapter *a = NULL;
+	struct ba_device *d = NULL;
+	struct ba_transport *t = NULL;
+	bdaddr_t addr;
+	int hci_dev_id;
+
+	if ((hci_dev_id = g_dbus_bluez_object_path_to_hci_dev_id(path)) == -1 ||
+			g_dbus_bluez_object_path_to_bdaddr(path, &addr) == NULL)
+		goto final;
+	if ((a = ba_adapter_lookup(hci_dev_id)) == NULL ||
+			(d = ba_device_lookup(a, &addr)) == NULL)
+		goto final;
+
+	GHashTableIter iter;
+	struct ba_transport *tmp;
+
+	pthread_mutex_lock(&d->transports_mutex);
+	g_hash_table_iter_init(&iter, d->transports);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer)&tmp))
+		if (tmp->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE &&
+				tmp->a2dp.pcm.ba_dbus_path != NULL &&
+				strcmp(tmp->a2dp.pcm.ba_dbus_path, path) == 0) {
+			t = tmp;
+			t->ref_count++;
+			break;
+		}
+	pthread_mutex_unlock(&d->transports_mutex);
+
+final:
+	if (d != NULL)
+		ba_device_unref(d);
+	if (a != NULL)
+		ba_adapter_unref(a);
+	return t;
+}
+
+static void bluealsa_pcm_set_group(GDBusMethodInvocation *inv, void *userdata) {
+
+	GVariant *params = g_dbus_method_invocation_get_parameters(inv);
+	struct ba_transport_pcm *pcm = userdata;
+	struct ba_transport *t = pcm->t;
+	struct ba_transport *members[BA_TRANSPORT_GROUP_MAX_MEMBERS];
+	const char *errmsg = NULL;
+	GVariantIter *paths;
+	const char *path;
+	size_t i, count = 0;
+
+	g_variant_get(params, "(ao)", &paths);
+
+	if (pcm != &t->a2dp.pcm ||
+			!(t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE)) {
+		errmsg = "Transport group not supported";
+		goto fail;
+	}
+
+	while (g_variant_iter_next(paths, "&o", &path)) {
+		if (count == ARRAYSIZE(members)) {
+			errmsg = "Too many group members";
+			goto fail;
+		}
+		if ((members[count] = bluealsa_dbus_pcm_lookup_transport(path)) == NULL) {
+			errmsg = "Group member PCM not found";
+			goto fail;
+		}
+		count++;
+	}
+
+	if (ba_transport_group_set(t, members, count) == -1)
+		goto fail;
+
+	/* acquire new members if the group is already streaming */
+	pthread_mutex_lock(&pcm->mutex);
+	const bool running = pcm->fd != -1;
+	pthread_mutex_unlock(&pcm->mutex);
+	if (running)
+		ba_transport_group_acquire(t);
+
+	g_dbus_method_invocation_return_value(inv, NULL);
+	goto final;
+
+fail:
+	if (errmsg == NULL)
+		errmsg = strerror(errno);
+	error("Couldn't set transport group: %s", errmsg);
+	g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
+			G_DBUS_ERROR_INVALID_ARGS, "%s", errmsg);
+
+final:
+	for (i = 0; i < count; i++)
+		ba_transport_unref(members[i]);
+	g_variant_iter_free(paths);
+}
+
+static void bluealsa_pcm_get_statistics(GDBusMethodInvocation *inv, void *userdata) {
+
+	struct ba_transport_pcm *pcm = userdata;
+	const struct ba_transport_pcm_stats *stats = &pcm->stats;
+
+	GVariantBuilder statistics;
+	g_variant_builder_init(&statistics, G_VARIANT_TYPE("a{sa{sv}}"));
+
+	g_variant_builder_add(&statistics, "{s@a{sv}}", "Codec",
+			bluealsa_pcm_stats_histogram_to_gvariant(&stats->codec));
+	g_variant_builder_add(&statistics, "{s@a{sv}}", "BTWrite",
+			bluealsa_pcm_stats_histogram_to_gvariant(&stats->bt_write));
+	g_variant_builder_add(&statistics, "{s@a{sv}}", "PollRead",
+			bluealsa_pcm_stats_histogram_to_gvariant(&stats->poll_read));
+	g_variant_builder_add(&statistics, "{s@a{sv}}", "SyncOverdue",
+			bluealsa_pcm_stats_histogram_to_gvariant(&stats->sync_overdue));
+	g_variant_builder_add(&statistics, "{s@a{sv}}", "FirstPacket",
+			bluealsa_pcm_stats_histogram_to_gvariant(&stats->first_packet));
+	g_variant_builder_add(&statistics, "{s@a{sv}}", "OpenFirstPacket",
+			bluealsa_pcm_stats_histogram_to_gvariant(&stats->open_first_packet));
+
+	g_dbus_method_invocation_return_value(inv, g_variant_new("(a{sa{sv}})", &statistics));
+	g_variant_builder_clear(&statistics);
+
+}
+
+static void bluealsa_pcm_get_rtp_statistics(GDBusMethodInvocation *inv, void *userdata) {
+
+	struct ba_transport_pcm *pcm = userdata;
+	struct ba_transport *t = pcm->t;
+
+	if (pcm != &t->a2dp.pcm ||
+			!(t->profile & BA_TRANSPORT_PROFILE_A2DP_SINK)) {
+		g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
+				G_DBUS_ERROR_NOT_SUPPORTED, "RTP statistics not supported");
+		return;
+	}
+
+	const char *sender = g_dbus_method_invocation_get_sender(inv);
+	struct rtp_stats_report *prior = NULL;
+	struct rtp_stats_report report;
+
+	if (sender != NULL &&
+			(prior = g_hash_table_lookup(pcm->rtp_reports, sender)) == NULL) {
+		/* Snapshots of disconnected clients are not tracked, so drop all
+		 * of them once the limit is reached to keep the table bounded. */
+		if (g_hash_table_size(pcm->rtp_reports) >= BA_TRANSPORT_PCM_RTP_REPORTS_MAX)
+			g_hash_table_remove_all(pcm->rtp_reports);
+	}
+
+	rtp_stats_get_report(&pcm->stats.rtp, &report, prior);
+
+	if (sender != NULL) {
+		if (prior == NULL)
+			g_hash_table_insert(pcm->rtp_reports, g_strdup(sender),
+					prior = g_new(struct rtp_stats_report, 1));
+		*prior = report;
+	}
+
+	GVariantBuilder props;
+	g_variant_builder_init(&props, G_VARIANT_TYPE("a{sv}"));
+
+	g_variant_builder_add(&props, "{sv}", "ExtendedHighestSequence", g_variant_new_uint32(report.seq_ext_max));
+	g_variant_builder_add(&props, "{sv}", "Expected", g_variant_new_uint64(report.expected));
+	g_variant_builder_add(&props, "{sv}", "Received", g_variant_new_uint64(report.received));
+	g_variant_builder_add(&props, "{sv}", "Lost", g_variant_new_int64(report.lost));
+	g_variant_builder_add(&props, "{sv}", "IntervalExpected", g_variant_new_uint64(report.interval_expected));
+	g_variant_builder_add(&props, "{sv}", "IntervalLost", g_variant_new_int64(report.interval_lost));
+	g_variant_builder_add(&props, "{sv}", "Duplicated", g_variant_new_uint64(report.duplicated));
+	g_variant_builder_add(&props, "{sv}", "Reordered", g_variant_new_uint64(report.reordered));
+	g_variant_builder_add(&props, "{sv}", "Jitter", g_variant_new_uint32(report.jitter));
+	g_variant_builder_add(&props, "{sv}", "ClockRate", g_variant_new_uint32(report.clockrate));
+	g_variant_builder_add(&props, "{sv}", "LossBursts",
+			bluealsa_pcm_stats_histogram_to_gvariant(&pcm->stats.rtp.loss_bursts));
+
+	g_dbus_method_invocation_return_value(inv, g_variant_new("(a{sv})", &props));
+	g_variant_builder_clear(&props);
+
+}
+
+static void bluealsa_pcm_get_clients(GDBusMethodInvocation *inv, void *userdata) {
+
+	struct ba_transport_pcm *pcm = userdata;
+	struct ba_transport_pcm_mix mixes[BA_TRANSPORT_PCM_CLIENTS_MAX];
+	bool actives[BA_TRANSPORT_PCM_CLIENTS_MAX];
+	size_t count = 0;
+
+	pthread_mutex_lock(&pcm->mutex);
+
+	const size_t frame_size = BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format) * pcm->channels;
+	const unsigned int sampling = pcm->sampling;
+	const unsigned int delay = pcm->delay;
+
+	if (pcm->fd != -1) {
+		mixes[count] = pcm->mix;
+		actives[count++] = pcm->active;
+		for (size_t i = 0; i < pcm->clients_len; i++) {
+			mixes[count] = pcm->clients[i].mix;
+			actives[count++] = pcm->clients[i].active;
+		}
+	}
+
+	pthread_mutex_unlock(&pcm->mutex);
+
+	GVariantBuilder clients;
+	g_variant_builder_init(&clients, G_VARIANT_TYPE("a{ua{sv}}"));
+
+	for (size_t i = 0; i < count; i++) {
+
+		/* delay of the client includes audio queued in its buffer */
+		ssize_t queued;
+		unsigned int client_delay = delay;
+		if ((queued = ba_transport_pcm_client_queued(pcm, mixes[i].id)) > 0 &&
+				frame_size != 0 && sampling != 0)
+			client_delay += (uint64_t)queued / frame_size * 10000 / sampling;
+
+		GVariantBuilder props;
+		g_variant_builder_init(&props, G_VARIANT_TYPE("a{sv}"));
+		g_variant_builder_add(&props, "{sv}", "Main", g_variant_new_boolean(i == 0));
+		g_variant_builder_add(&props, "{sv}", "Active", g_variant_new_boolean(actives[i]));
+		g_variant_builder_add(&props, "{sv}", "Volume", g_variant_new_byte(mixes[i].volume));
+		g_variant_builder_add(&props, "{sv}", "Delay", g_variant_new_uint16(MIN(client_delay, UINT16_MAX)));
+		g_variant_builder_add(&clients, "{ua{sv}}", mixes[i].id, &props);
+
+	}
+
+	g_dbus_method_invocation_return_value(inv, g_variant_new("(a{ua{sv}})", &clients));
+	g_variant_builder_clear(&clients);
+
+}
+
+static void bluealsa_pcm_set_client_volume(GDBusMethodInvocation *inv, void *userdata) {
+
+	GVariant *params = g_dbus_method_invocation_get_parameters(inv);
+	struct ba_transport_pcm *pcm = userdata;
+
+	uint32_t id;
+	uint8_t volume;
+
+	g_variant_get(params, "(uy)", &id, &volume);
+
+	if (ba_transport_pcm_client_set_volume(pcm, id, volume) == -1) {
+		g_dbus_method_invocation_return_error(inv, G_DBUS_ERROR,
+				G_DBUS_ERROR_INVALID_ARGS, "Set client volume: %s", strerror(errno));
+		return;
+	}
+
+	g_dbus_method_invocation_return_value(inv, NULL);
+
+}
+
 static void bluealsa_rfcomm_open(GDBusMethodInvocation *inv, void *userdata) {
 
 	struct ba_rfcomm *r = userdata;
@@ -881,10 +1554,14 @@ static GVariant *bluealsa_pcm_get_property(const char *property,
 		return ba_variant_new_pcm_delay(pcm);
 	if (strcmp(property, "DelayAdjustment") == 0)
 		return ba_variant_new_pcm_delay_adjustment(pcm);
+	if (strcmp(property, "Bitrate") == 0)
+		return ba_variant_new_pcm_bitrate(pcm);
 	if (strcmp(property, "SoftVolume") == 0)
 		return ba_variant_new_pcm_soft_volume(pcm);
 	if (strcmp(property, "Volume") == 0)
 		return ba_variant_new_pcm_volume(pcm);
+	if (strcmp(property, "Latency") == 0)
+		return ba_variant_new_pcm_latency(pcm);
 
 	g_assert_not_reached();
 	return NULL;
@@ -898,12 +1575,12 @@ unavailable:
 
 static bool bluealsa_pcm_set_property(const char *property, GVariant *value,
 		GError **error, void *userdata) {
-	(void)error;
 
 	struct ba_transport_pcm *pcm = userdata;
 
 	if (strcmp(property, "SoftVolume") == 0) {
 		pcm->soft_volume = g_variant_get_boolean(value);
+		ba_transport_pcm_volume_sync(pcm);
 		bluealsa_dbus_pcm_update(pcm, BA_DBUS_PCM_UPDATE_SOFT_VOLUME);
 		return TRUE;
 	}
@@ -935,6 +1612,29 @@ static bool bluealsa_pcm_set_property(const char *property, GVariant *value,
 		return TRUE;
 	}
 
+	if (strcmp(property, "Latency") == 0) {
+
+		const char *latency = g_variant_get_string(value, NULL);
+		if (strcmp(latency, BLUEALSA_PCM_LATENCY_NORMAL) == 0)
+			atomic_store_explicit(&pcm->latency,
+					BA_TRANSPORT_PCM_LATENCY_NORMAL, memory_order_relaxed);
+		else if (strcmp(latency, BLUEALSA_PCM_LATENCY_LOW) == 0)
+			atomic_store_explicit(&pcm->latency,
+					BA_TRANSPORT_PCM_LATENCY_LOW, memory_order_relaxed);
+		else {
+			if (error != NULL)
+				*error = g_error_new(G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+						"Invalid latency class: %s", latency);
+			return FALSE;
+		}
+
+		debug("Setting latency class: %s", latency);
+
+		storage_pcm_data_mark_dirty(pcm);
+		bluealsa_dbus_pcm_update(pcm, BA_DBUS_PCM_UPDATE_LATENCY);
+		return TRUE;
+	}
+
 	g_assert_not_reached();
 	return FALSE;
 }
@@ -946,6 +1646,8 @@ int bluealsa_dbus_pcm_register(struct ba_transport_pcm *pcm) {
 	static const GDBusMethodCallDispatcher dispatchers[] = {
 		{ .method = "Open",
 			.handler = bluealsa_pcm_open },
+		{ .method = "OpenShm",
+			.handler = bluealsa_pcm_open_shm },
 		{ .method = "GetCodecs",
 			.handler = bluealsa_pcm_get_codecs },
 		{ .method = "SelectCodec",
@@ -954,6 +1656,16 @@ int bluealsa_dbus_pcm_register(struct ba_transport_pcm *pcm) {
 			.handler = bluealsa_pcm_set_delay_adjustment },
 		{ .method = "GetDelayAdjustments",
 			.handler = bluealsa_pcm_get_delay_adjustments },
+		{ .method = "GetStatistics",
+			.handler = bluealsa_pcm_get_statistics },
+		{ .method = "GetRTPStatistics",
+			.handler = bluealsa_pcm_get_rtp_statistics },
+		{ .method = "SetGroup",
+			.handler = bluealsa_pcm_set_group },
+		{ .method = "GetClients",
+			.handler = bluealsa_pcm_get_clients },
+		{ .method = "SetClientVolume",
+			.handler = bluealsa_pcm_set_client_volume },
 		{ 0 },
 	};
 
@@ -980,7 +1692,10 @@ int bluealsa_dbus_pcm_register(struct ba_transport_pcm *pcm) {
 
 	g_dbus_object_skeleton_add_interface(skeleton, G_DBUS_INTERFACE_SKELETON(ifs_pcm));
 	g_dbus_object_manager_server_export(bluealsa_dbus_manager, skeleton);
+
+	pthread_mutex_lock(&bluealsa_dbus_update_mtx);
 	pcm->ba_dbus_exported = true;
+	pthread_mutex_unlock(&bluealsa_dbus_update_mtx);
 
 fail:
 
@@ -992,7 +1707,7 @@ fail:
 	return 0;
 }
 
-void bluealsa_dbus_pcm_update(struct ba_transport_pcm *pcm, unsigned int mask) {
+static void bluealsa_dbus_pcm_emit(struct ba_transport_pcm *pcm, unsigned int mask) {
 
 	GVariantBuilder props;
 	g_variant_builder_init(&props, G_VARIANT_TYPE("a{sv}"));
@@ -1013,10 +1728,14 @@ void bluealsa_dbus_pcm_update(struct ba_transport_pcm *pcm, unsigned int mask) {
 		g_variant_builder_add(&props, "{sv}", "Delay", ba_variant_new_pcm_delay(pcm));
 	if (mask & BA_DBUS_PCM_UPDATE_DELAY_ADJUSTMENT)
 		g_variant_builder_add(&props, "{sv}", "DelayAdjustment", ba_variant_new_pcm_delay_adjustment(pcm));
+	if (mask & BA_DBUS_PCM_UPDATE_BITRATE)
+		g_variant_builder_add(&props, "{sv}", "Bitrate", ba_variant_new_pcm_bitrate(pcm));
 	if (mask & BA_DBUS_PCM_UPDATE_SOFT_VOLUME)
 		g_variant_builder_add(&props, "{sv}", "SoftVolume", ba_variant_new_pcm_soft_volume(pcm));
 	if (mask & BA_DBUS_PCM_UPDATE_VOLUME)
 		g_variant_builder_add(&props, "{sv}", "Volume", ba_variant_new_pcm_volume(pcm));
+	if (mask & BA_DBUS_PCM_UPDATE_LATENCY)
+		g_variant_builder_add(&props, "{sv}", "Latency", ba_variant_new_pcm_latency(pcm));
 
 	g_dbus_connection_emit_properties_changed(config.dbus,
 			pcm->ba_dbus_path, BLUEALSA_IFACE_PCM, &props, NULL);
@@ -1024,13 +1743,192 @@ void bluealsa_dbus_pcm_update(struct ba_transport_pcm *pcm, unsigned int mask) {
 
 }
 
+static GVariantBuilder *bluealsa_dbus_rfcomm_props_new(const struct ba_rfcomm *r,
+		unsigned int mask) {
+
+	GVariantBuilder *props = g_variant_builder_new(G_VARIANT_TYPE("a{sv}"));
+
+	if (mask & BA_DBUS_RFCOMM_UPDATE_FEATURES)
+		g_variant_builder_add(props, "{sv}", "Features", ba_variant_new_rfcomm_features(r));
+	if (mask & BA_DBUS_RFCOMM_UPDATE_BATTERY)
+		g_variant_builder_add(props, "{sv}", "Battery", ba_variant_new_device_battery(r->sco->d));
+
+	return props;
+}
+
+static void bluealsa_dbus_rfcomm_emit(struct ba_rfcomm *r, unsigned int mask) {
+	GVariantBuilder *props = bluealsa_dbus_rfcomm_props_new(r, mask);
+	g_dbus_connection_emit_properties_changed(config.dbus,
+			r->ba_dbus_path, BLUEALSA_IFACE_RFCOMM, props, NULL);
+	g_variant_builder_unref(props);
+}
+
+/**
+ * Property changes taken out of the pending updates lists. */
+struct bluealsa_dbus_update {
+	/* referenced PCM and its changed properties */
+	struct ba_transport_pcm *pcm;
+	unsigned int mask;
+	/* RFCOMM objects are not reference counted, so for
+	 * them the signal properties are built up front */
+	char *path;
+	GVariantBuilder *props;
+};
+
+/**
+ * Emit accumulated property changes which are due. */
+static gboolean bluealsa_dbus_update_dispatch(void *userdata) {
+	(void)userdata;
+
+	const int64_t interval = 1000000 / config.dbus_update_rate;
+	const int64_t now = g_get_monotonic_time();
+	gboolean rv = G_SOURCE_CONTINUE;
+	GArray *updates = g_array_new(FALSE, FALSE, sizeof(struct bluealsa_dbus_update));
+	GSList *el, *next;
+
+	/* Take due updates out of the pending lists, but emit them after the
+	 * lock is released, so other threads announcing property changes are
+	 * not blocked by the D-Bus connection. */
+	pthread_mutex_lock(&bluealsa_dbus_update_mtx);
+
+	for (el = bluealsa_dbus_update_pcms; el != NULL; el = next) {
+		struct ba_transport_pcm *pcm = el->data;
+		next = el->next;
+		if (now - pcm->ba_dbus_update_time < interval)
+			continue;
+		struct bluealsa_dbus_update update = {
+			.pcm = ba_transport_pcm_ref(pcm),
+			.mask = pcm->ba_dbus_update_mask };
+		g_array_append_val(updates, update);
+		pcm->ba_dbus_update_mask = 0;
+		pcm->ba_dbus_update_time = now;
+		bluealsa_dbus_update_pcms = g_slist_delete_link(bluealsa_dbus_update_pcms, el);
+	}
+
+	for (el = bluealsa_dbus_update_rfcomms; el != NULL; el = next) {
+		struct ba_rfcomm *r = el->data;
+		next = el->next;
+		if (now - r->ba_dbus_update_time < interval)
+			continue;
+		struct bluealsa_dbus_update update = {
+			.path = g_strdup(r->ba_dbus_path),
+			.props = bluealsa_dbus_rfcomm_props_new(r, r->ba_dbus_update_mask) };
+		g_array_append_val(updates, update);
+		r->ba_dbus_update_mask = 0;
+		r->ba_dbus_update_time = now;
+		bluealsa_dbus_update_rfcomms = g_slist_delete_link(bluealsa_dbus_update_rfcomms, el);
+	}
+
+	if (bluealsa_dbus_update_pcms == NULL &&
+			bluealsa_dbus_update_rfcomms == NULL) {
+		bluealsa_dbus_update_source_id = 0;
+		rv = G_SOURCE_REMOVE;
+	}
+
+	pthread_mutex_unlock(&bluealsa_dbus_update_mtx);
+
+	for (size_t i = 0; i < updates->len; i++) {
+		struct bluealsa_dbus_update *update = &g_array_index(updates, struct bluealsa_dbus_update, i);
+		if (update->pcm != NULL) {
+			bluealsa_dbus_pcm_emit(update->pcm, update->mask);
+			ba_transport_pcm_unref(update->pcm);
+			continue;
+		}
+		g_dbus_connection_emit_properties_changed(config.dbus,
+				update->path, BLUEALSA_IFACE_RFCOMM, update->props, NULL);
+		g_variant_builder_unref(update->props);
+		g_free(update->path);
+	}
+
+	g_array_unref(updates);
+	return rv;
+}
+
+/**
+ * Accumulate property changes of the given object.
+ *
+ * This function shall be called with the update lock held.
+ *
+ * @param list Address of the list of objects with pending updates.
+ * @param object The object which properties have changed.
+ * @param object_mask Address of the pending update mask of the object.
+ * @param object_time Address of the last update timestamp of the object.
+ * @param mask Properties which have changed.
+ * @param immediate If true, the update is not subject to the rate limit.
+ * @return This function returns the mask of properties which shall be
+ *   emitted right away. Zero means that the update has been deferred. */
+static unsigned int bluealsa_dbus_update_coalesce(GSList **list, void *object,
+		unsigned int *object_mask, int64_t *object_time, unsigned int mask,
+		bool immediate) {
+
+	const int64_t now = g_get_monotonic_time();
+	const bool pending = *object_mask != 0;
+	mask |= *object_mask;
+
+	if (immediate ||
+			config.dbus_update_rate == 0 ||
+			now - *object_time >= 1000000 / config.dbus_update_rate) {
+		if (pending)
+			*list = g_slist_remove(*list, object);
+		*object_mask = 0;
+		*object_time = now;
+		return mask;
+	}
+
+	if (!pending)
+		*list = g_slist_prepend(*list, object);
+	*object_mask = mask;
+
+	if (bluealsa_dbus_update_source_id == 0)
+		bluealsa_dbus_update_source_id = g_timeout_add(
+				MAX(1000 / config.dbus_update_rate, 1), bluealsa_dbus_update_dispatch, NULL);
+
+	return 0;
+}
+
+/**
+ * Announce PCM property changes.
+ *
+ * Changes are emitted with the PropertiesChanged signal. Subsequent changes
+ * which occur within the update interval given by the configured update
+ * rate are accumulated and emitted together from the main loop. */
+void bluealsa_dbus_pcm_update(struct ba_transport_pcm *pcm, unsigned int mask) {
+
+	pthread_mutex_lock(&bluealsa_dbus_update_mtx);
+
+	if (mask != 0 && pcm->ba_dbus_exported)
+		mask = bluealsa_dbus_update_coalesce(&bluealsa_dbus_update_pcms, pcm,
+				&pcm->ba_dbus_update_mask, &pcm->ba_dbus_update_time, mask,
+				mask & BA_DBUS_PCM_UPDATE_IMMEDIATE);
+	else
+		mask = 0;
+
+	pthread_mutex_unlock(&bluealsa_dbus_update_mtx);
+
+	if (mask != 0)
+		bluealsa_dbus_pcm_emit(pcm, mask);
+
+}
+
 void bluealsa_dbus_pcm_unregister(struct ba_transport_pcm *pcm) {
 
-	if (!pcm->ba_dbus_exported)
+	pthread_mutex_lock(&bluealsa_dbus_update_mtx);
+
+	/* Drop pending updates, so the dispatcher will
+	 * not access this PCM once it is released. */
+	if (pcm->ba_dbus_update_mask != 0)
+		bluealsa_dbus_update_pcms = g_slist_remove(bluealsa_dbus_update_pcms, pcm);
+	pcm->ba_dbus_update_mask = 0;
+
+	const bool exported = pcm->ba_dbus_exported;
+	pcm->ba_dbus_exported = false;
+
+	pthread_mutex_unlock(&bluealsa_dbus_update_mtx);
+
+	if (!exported)
 		return;
 
 	g_dbus_object_manager_server_unexport(bluealsa_dbus_manager, pcm->ba_dbus_path);
-	pcm->ba_dbus_exported = false;
 
 }
 
@@ -1080,7 +1978,10 @@ int bluealsa_dbus_rfcomm_register(struct ba_rfcomm *r) {
 
 	g_dbus_object_skeleton_add_interface(skeleton, G_DBUS_INTERFACE_SKELETON(ifs_rfcomm));
 	g_dbus_object_manager_server_export(bluealsa_dbus_manager, skeleton);
+
+	pthread_mutex_lock(&bluealsa_dbus_update_mtx);
 	r->ba_dbus_exported = true;
+	pthread_mutex_unlock(&bluealsa_dbus_update_mtx);
 
 fail:
 
@@ -1092,25 +1993,44 @@ fail:
 	return 0;
 }
 
+/**
+ * Announce RFCOMM property changes.
+ *
+ * Changes are subject to the same rate limit as PCM property changes. */
 void bluealsa_dbus_rfcomm_update(struct ba_rfcomm *r, unsigned int mask) {
 
-	GVariantBuilder props;
-	g_variant_builder_init(&props, G_VARIANT_TYPE("a{sv}"));
+	pthread_mutex_lock(&bluealsa_dbus_update_mtx);
 
-	if (mask & BA_DBUS_RFCOMM_UPDATE_FEATURES)
-		g_variant_builder_add(&props, "{sv}", "Features", ba_variant_new_rfcomm_features(r));
-	if (mask & BA_DBUS_RFCOMM_UPDATE_BATTERY)
-		g_variant_builder_add(&props, "{sv}", "Battery", ba_variant_new_device_battery(r->sco->d));
+	if (mask != 0 && r->ba_dbus_exported)
+		mask = bluealsa_dbus_update_coalesce(&bluealsa_dbus_update_rfcomms, r,
+				&r->ba_dbus_update_mask, &r->ba_dbus_update_time, mask,
+				mask & BA_DBUS_RFCOMM_UPDATE_FEATURES);
+	else
+		mask = 0;
 
-	g_dbus_connection_emit_properties_changed(config.dbus,
-			r->ba_dbus_path, BLUEALSA_IFACE_RFCOMM, &props, NULL);
-	g_variant_builder_clear(&props);
+	pthread_mutex_unlock(&bluealsa_dbus_update_mtx);
+
+	if (mask != 0)
+		bluealsa_dbus_rfcomm_emit(r, mask);
 
 }
 
 void bluealsa_dbus_rfcomm_unregister(struct ba_rfcomm *r) {
-	if (!r->ba_dbus_exported)
+
+	pthread_mutex_lock(&bluealsa_dbus_update_mtx);
+
+	if (r->ba_dbus_update_mask != 0)
+		bluealsa_dbus_update_rfcomms = g_slist_remove(bluealsa_dbus_update_rfcomms, r);
+	r->ba_dbus_update_mask = 0;
+
+	const bool exported = r->ba_dbus_exported;
+	r->ba_dbus_exported = false;
+
+	pthread_mutex_unlock(&bluealsa_dbus_update_mtx);
+
+	if (!exported)
 		return;
+
 	g_dbus_object_manager_server_unexport(bluealsa_dbus_manager, r->ba_dbus_path);
-	r->ba_dbus_exported = false;
+
 }
@@ -32,6 +32,8 @@
 #define BA_DBUS_PCM_UPDATE_SOFT_VOLUME      (1 << 7)
 #define BA_DBUS_PCM_UPDATE_VOLUME           (1 << 8)
 #define BA_DBUS_PCM_UPDATE_RUNNING          (1 << 9)
+#define BA_DBUS_PCM_UPDATE_BITRATE          (1 << 10)
+#define BA_DBUS_PCM_UPDATE_LATENCY          (1 << 11)
 
 #define BA_DBUS_RFCOMM_UPDATE_FEATURES (1 << 0)
 #define BA_DBUS_RFCOMM_UPDATE_BATTERY  (1 << 1)
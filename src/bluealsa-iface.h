@@ -42,6 +42,9 @@
 #define BLUEALSA_PCM_MODE_SINK   "sink"
 #define BLUEALSA_PCM_MODE_SOURCE "source"
 
+#define BLUEALSA_PCM_LATENCY_NORMAL "normal"
+#define BLUEALSA_PCM_LATENCY_LOW    "low"
+
 typedef struct {
 	GDBusInterfaceSkeletonEx parent;
 } OrgBluealsaManager1Skeleton;
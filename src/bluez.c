@@ -1476,6 +1476,7 @@ static void bluez_signal_transport_changed(GDBusConnection *conn, const char *se
 				ba_transport_pcm_volume_set(&t->a2dp.pcm.volume[1], &level, NULL, NULL);
 				pthread_mutex_unlock(&t->a2dp.pcm.mutex);
 
+				ba_transport_pcm_volume_sync(&t->a2dp.pcm);
 				bluealsa_dbus_pcm_update(&t->a2dp.pcm, BA_DBUS_PCM_UPDATE_VOLUME);
 
 			}
@@ -18,8 +18,10 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <glib.h>
 #include <openaptx.h>
 
+#include "audio.h"
 #include "shared/defs.h"
 #include "shared/log.h"
 
@@ -107,45 +109,72 @@ HANDLE_APTX aptxhddec_init(void) {
 }
 #endif
 
+#if WITH_LIBOPENAPTX
+/**
+ * The number of apt-X code words processed by a single libopenaptx call.
+ *
+ * The libopenaptx library operates on the 24-bit packed PCM, so the PCM
+ * signal is converted in chunks with the help of an intermediate buffer. */
+# define APTX_CHUNK_CODEWORDS 64
+#endif
+
 #if ENABLE_APTX
 /**
  * Encode stereo PCM.
  *
+ * This function encodes as many apt-X code words (4 stereo PCM frames, each
+ * encoded into 4 bytes) as fits into the output buffer.
+ *
+ * @param handle Initialized encoder handler.
+ * @param input Interleaved stereo S16_2LE PCM signal.
+ * @param samples The number of samples in the input buffer.
+ * @param output Address of the output buffer.
+ * @param len The size of the output buffer. Upon return, this variable is
+ *   set to the number of bytes written to the output buffer.
  * @returns On success, this function returns the number of processed input
  *   samples. On error, -1 is returned. */
-ssize_t aptxenc_encode(HANDLE_APTX handle, const int16_t *input, size_t samples,
+ssize_t aptxenc_encode_block(HANDLE_APTX handle, const int16_t *input, size_t samples,
 		void *output, size_t *len) {
 
-	if (samples < 8 || *len < 4)
+	const size_t codewords = MIN(samples / 8, *len / 4);
+	uint8_t *code = output;
+	size_t i;
+
+	if (codewords == 0)
 		return errno = EINVAL, -1;
 
 #if WITH_LIBOPENAPTX
 
-	const uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */] = {
-		0, input[0], input[0] >> 8, 0, input[1], input[1] >> 8,
-		0, input[2], input[2] >> 8, 0, input[3], input[3] >> 8,
-		0, input[4], input[4] >> 8, 0, input[5], input[5] >> 8,
-		0, input[6], input[6] >> 8, 0, input[7], input[7] >> 8,
-	};
+	uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */ * APTX_CHUNK_CODEWORDS];
 
-	size_t rv;
-	if ((rv = aptx_encode(handle, pcm, sizeof(pcm), output, *len, len)) != sizeof(pcm))
-		return -1;
+	for (i = 0; i < codewords; ) {
 
-	return rv / 3;
+		const size_t n = MIN(codewords - i, APTX_CHUNK_CODEWORDS);
+		audio_pack_s16_2le_to_s24_3le(&input[i * 8], n * 8, pcm);
+
+		size_t written;
+		if (aptx_encode(handle, pcm, n * 24, &code[i * 4], n * 4, &written) != n * 24)
+			return -1;
+
+		i += n;
+	}
 
 #else
 
-	int32_t pcm_l[4] = { input[0], input[2], input[4], input[6] };
-	int32_t pcm_r[4] = { input[1], input[3], input[5], input[7] };
+	for (i = 0; i < codewords; i++, input += 8) {
 
-	if (aptxbtenc_encodestereo(handle, pcm_l, pcm_r, output) != 0)
-		return -1;
+		int32_t pcm_l[4] = { input[0], input[2], input[4], input[6] };
+		int32_t pcm_r[4] = { input[1], input[3], input[5], input[7] };
 
-	*len = 4;
-	return 8;
+		if (aptxbtenc_encodestereo(handle, pcm_l, pcm_r, &code[i * 4]) != 0)
+			return -1;
+
+	}
 
 #endif
+
+	*len = codewords * 4;
+	return codewords * 8;
 }
 #endif
 
@@ -153,50 +182,79 @@ ssize_t aptxenc_encode(HANDLE_APTX handle, const int16_t *input, size_t samples,
 /**
  * Decode stereo PCM.
  *
+ * This function decodes as many apt-X code words as fits into the output
+ * buffer. Note, that the libopenaptx library might output one extra code
+ * word of PCM signal during the stream synchronization, so the output
+ * buffer shall have space for such extra data.
+ *
+ * @param handle Initialized decoder handler.
+ * @param input Address of the apt-X encoded data.
+ * @param len The size of the input buffer.
+ * @param output Address of the buffer for interleaved S16_2LE PCM signal.
+ * @param samples The number of samples which fits into the output buffer.
+ *   Upon return, this variable is set to the number of decoded samples.
  * @returns On success, this function returns the number of processed input
  *   bytes. On error, -1 is returned. */
-ssize_t aptxdec_decode(HANDLE_APTX handle, const void *input, size_t len,
+ssize_t aptxdec_decode_block(HANDLE_APTX handle, const void *input, size_t len,
 		int16_t *output, size_t *samples) {
 
-	if (len < 4 || *samples < 8)
-		return errno = EINVAL, -1;
+	const uint8_t *code = input;
+	size_t i;
 
 #if WITH_LIBOPENAPTX
 
-	uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */ * 2];
-	size_t written, dropped;
-	int synced;
+	if (len < 4 || *samples < 8 * 2)
+		return errno = EINVAL, -1;
 
-	if ((len = aptx_decode_sync(handle, input, 4, pcm, sizeof(pcm),
-					&written, &synced, &dropped)) != 4)
-		return -1;
+	/* reserve space for the extra output code word */
+	const size_t codewords = MIN(len / 4, *samples / 8 - 1);
+	uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */ * (APTX_CHUNK_CODEWORDS + 1)];
+	size_t decoded = 0;
 
-	if (!synced && dropped > 0)
-		info("Apt-X stream out of sync: Dropped bytes: %zd", dropped);
+	for (i = 0; i < codewords; ) {
+
+		const size_t n = MIN(codewords - i, APTX_CHUNK_CODEWORDS);
+		size_t written, dropped;
+		int synced;
+
+		if (aptx_decode_sync(handle, &code[i * 4], n * 4, pcm, sizeof(pcm),
+					&written, &synced, &dropped) != n * 4)
+			return -1;
+
+		if (!synced && dropped > 0)
+			info("Apt-X stream out of sync: Dropped bytes: %zd", dropped);
+
+		audio_unpack_s24_3le_to_s16_2le(pcm, written / 3, &output[decoded]);
+		decoded += written / 3;
+		i += n;
 
-	size_t i;
-	for (i = 0; i < written / 3 / 2; i++) {
-		*output++ = pcm[i * 6 + 0 + 1] | (pcm[i * 6 + 0 + 2] << 8);
-		*output++ = pcm[i * 6 + 3 + 1] | (pcm[i * 6 + 3 + 2] << 8);
 	}
 
-	*samples = written / 3;
-	return len;
+	*samples = decoded;
+	return codewords * 4;
 
 #else
 
-	int32_t pcm_l[4], pcm_r[4];
-	if (aptxbtdec_decodestereo(handle, pcm_l, pcm_r, input) != 0)
-		return -1;
+	if (len < 4 || *samples < 8)
+		return errno = EINVAL, -1;
+
+	const size_t codewords = MIN(len / 4, *samples / 8);
+
+	for (i = 0; i < codewords; i++) {
+
+		int32_t pcm_l[4], pcm_r[4];
+		if (aptxbtdec_decodestereo(handle, pcm_l, pcm_r, &code[i * 4]) != 0)
+			return -1;
+
+		for (size_t j = 0; j < ARRAYSIZE(pcm_l); j++) {
+			*output++ = pcm_l[j];
+			*output++ = pcm_r[j];
+		}
 
-	size_t i;
-	for (i = 0; i < ARRAYSIZE(pcm_l); i++) {
-		*output++ = pcm_l[i];
-		*output++ = pcm_r[i];
 	}
 
-	*samples = 8;
-	return 4;
+	*samples = codewords * 8;
+	return codewords * 4;
 
 #endif
 }
@@ -206,49 +264,67 @@ ssize_t aptxdec_decode(HANDLE_APTX handle, const void *input, size_t len,
 /**
  * Encode stereo PCM (HD variant).
  *
+ * This function encodes as many apt-X HD code words (4 stereo PCM frames,
+ * each encoded into 6 bytes) as fits into the output buffer.
+ *
+ * @param handle Initialized encoder handler.
+ * @param input Interleaved stereo S24_4LE PCM signal.
+ * @param samples The number of samples in the input buffer.
+ * @param output Address of the output buffer.
+ * @param len The size of the output buffer. Upon return, this variable is
+ *   set to the number of bytes written to the output buffer.
  * @returns On success, this function returns the number of processed input
  *   samples. On error, -1 is returned. */
-ssize_t aptxhdenc_encode(HANDLE_APTX handle, const int32_t *input, size_t samples,
+ssize_t aptxhdenc_encode_block(HANDLE_APTX handle, const int32_t *input, size_t samples,
 		void *output, size_t *len) {
 
-	if (samples < 8 || *len < 6)
+	const size_t codewords = MIN(samples / 8, *len / 6);
+	uint8_t *code = output;
+	size_t i;
+
+	if (codewords == 0)
 		return errno = EINVAL, -1;
 
 #if WITH_LIBOPENAPTX
 
-	const uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */] = {
-		input[0], input[0] >> 8, input[0] >> 16, input[1], input[1] >> 8, input[1] >> 16,
-		input[2], input[2] >> 8, input[2] >> 16, input[3], input[3] >> 8, input[3] >> 16,
-		input[4], input[4] >> 8, input[4] >> 16, input[5], input[5] >> 8, input[5] >> 16,
-		input[6], input[6] >> 8, input[6] >> 16, input[7], input[7] >> 8, input[7] >> 16,
-	};
+	uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */ * APTX_CHUNK_CODEWORDS];
+
+	for (i = 0; i < codewords; ) {
+
+		const size_t n = MIN(codewords - i, APTX_CHUNK_CODEWORDS);
+		audio_pack_s24_4le_to_s24_3le(&input[i * 8], n * 8, pcm);
 
-	size_t rv;
-	if ((rv = aptx_encode(handle, pcm, sizeof(pcm), output, *len, len)) != sizeof(pcm))
-		return -1;
+		size_t written;
+		if (aptx_encode(handle, pcm, n * 24, &code[i * 6], n * 6, &written) != n * 24)
+			return -1;
 
-	return rv / 3;
+		i += n;
+	}
 
 #else
 
-	int32_t pcm_l[4] = { input[0], input[2], input[4], input[6] };
-	int32_t pcm_r[4] = { input[1], input[3], input[5], input[7] };
-	uint32_t code[2];
+	for (i = 0; i < codewords; i++, input += 8, code += 6) {
+
+		int32_t pcm_l[4] = { input[0], input[2], input[4], input[6] };
+		int32_t pcm_r[4] = { input[1], input[3], input[5], input[7] };
+		uint32_t tmp[2];
 
-	if (aptxhdbtenc_encodestereo(handle, pcm_l, pcm_r, code) != 0)
-		return -1;
+		if (aptxhdbtenc_encodestereo(handle, pcm_l, pcm_r, tmp) != 0)
+			return -1;
 
-	((uint8_t *)output)[0] = code[0] >> 16;
-	((uint8_t *)output)[1] = code[0] >> 8;
-	((uint8_t *)output)[2] = code[0];
-	((uint8_t *)output)[3] = code[1] >> 16;
-	((uint8_t *)output)[4] = code[1] >> 8;
-	((uint8_t *)output)[5] = code[1];
+		code[0] = tmp[0] >> 16;
+		code[1] = tmp[0] >> 8;
+		code[2] = tmp[0];
+		code[3] = tmp[1] >> 16;
+		code[4] = tmp[1] >> 8;
+		code[5] = tmp[1];
 
-	*len = 6;
-	return 8;
+	}
 
 #endif
+
+	*len = codewords * 6;
+	return codewords * 8;
 }
 #endif
 
@@ -256,57 +332,81 @@ ssize_t aptxhdenc_encode(HANDLE_APTX handle, const int32_t *input, size_t sample
 /**
  * Decode stereo PCM (HD variant).
  *
+ * This function decodes as many apt-X HD code words as fits into the output
+ * buffer. For the output buffer requirements see aptxdec_decode_block().
+ *
+ * @param handle Initialized decoder handler.
+ * @param input Address of the apt-X HD encoded data.
+ * @param len The size of the input buffer.
+ * @param output Address of the buffer for interleaved S24_4LE PCM signal.
+ * @param samples The number of samples which fits into the output buffer.
+ *   Upon return, this variable is set to the number of decoded samples.
  * @returns On success, this function returns the number of processed input
  *   bytes. On error, -1 is returned. */
-ssize_t aptxhddec_decode(HANDLE_APTX handle, const void *input, size_t len,
+ssize_t aptxhddec_decode_block(HANDLE_APTX handle, const void *input, size_t len,
 		int32_t *output, size_t *samples) {
 
-	if (len < 6 || *samples < 8)
-		return errno = EINVAL, -1;
+	const uint8_t *code = input;
+	size_t i;
 
 #if WITH_LIBOPENAPTX
 
-	uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */ * 2];
-	size_t written, dropped;
-	int synced;
+	if (len < 6 || *samples < 8 * 2)
+		return errno = EINVAL, -1;
+
+	/* reserve space for the extra output code word */
+	const size_t codewords = MIN(len / 6, *samples / 8 - 1);
+	uint8_t pcm[3 /* 24bit */ * 8 /* 4 samples * 2 channels */ * (APTX_CHUNK_CODEWORDS + 1)];
+	size_t decoded = 0;
 
-	if ((len = aptx_decode_sync(handle, input, 6, pcm, sizeof(pcm),
-					&written, &synced, &dropped)) != 6)
-		return -1;
+	for (i = 0; i < codewords; ) {
 
-	if (!synced && dropped > 0)
-		info("Apt-X HD stream out of sync: Dropped bytes: %zd", dropped);
+		const size_t n = MIN(codewords - i, APTX_CHUNK_CODEWORDS);
+		size_t written, dropped;
+		int synced;
+
+		if (aptx_decode_sync(handle, &code[i * 6], n * 6, pcm, sizeof(pcm),
+					&written, &synced, &dropped) != n * 6)
+			return -1;
+
+		if (!synced && dropped > 0)
+			info("Apt-X HD stream out of sync: Dropped bytes: %zd", dropped);
+
+		audio_unpack_s24_3le_to_s24_4le(pcm, written / 3, &output[decoded]);
+		decoded += written / 3;
+		i += n;
 
-	size_t i;
-	int32_t base;
-	for (i = 0; i < written / 3 / 2; i++) {
-		base = pcm[i * 6 + 0 + 2] & 0x80 ? 0xFF000000 : 0;
-		*output++ = base | pcm[i * 6 + 0 + 0] | (pcm[i * 6 + 0 + 1] << 8) | (pcm[i * 6 + 0 + 2] << 16);
-		base = pcm[i * 6 + 3 + 2] & 0x80 ? 0xFF000000 : 0;
-		*output++ = base | pcm[i * 6 + 3 + 0] | (pcm[i * 6 + 3 + 1] << 8) | (pcm[i * 6 + 3 + 2] << 16);
 	}
 
-	*samples = written / 3;
-	return len;
+	*samples = decoded;
+	return codewords * 6;
 
 #else
 
-	const uint32_t code[2] = {
-		(((uint8_t *)input)[0] << 16) | (((uint8_t *)input)[1] << 8) | ((uint8_t *)input)[2],
-		(((uint8_t *)input)[3] << 16) | (((uint8_t *)input)[4] << 8) | ((uint8_t *)input)[5] };
-	int32_t pcm_l[4], pcm_r[4];
+	if (len < 6 || *samples < 8)
+		return errno = EINVAL, -1;
 
-	if (aptxhdbtdec_decodestereo(handle, pcm_l, pcm_r, code) != 0)
-		return -1;
+	const size_t codewords = MIN(len / 6, *samples / 8);
+
+	for (i = 0; i < codewords; i++, code += 6) {
+
+		const uint32_t tmp[2] = {
+			(code[0] << 16) | (code[1] << 8) | code[2],
+			(code[3] << 16) | (code[4] << 8) | code[5] };
+		int32_t pcm_l[4], pcm_r[4];
+
+		if (aptxhdbtdec_decodestereo(handle, pcm_l, pcm_r, tmp) != 0)
+			return -1;
+
+		for (size_t j = 0; j < ARRAYSIZE(pcm_l); j++) {
+			*output++ = pcm_l[j];
+			*output++ = pcm_r[j];
+		}
 
-	size_t i;
-	for (i = 0; i < ARRAYSIZE(pcm_l); i++) {
-		*output++ = pcm_l[i];
-		*output++ = pcm_r[i];
 	}
 
-	*samples = 8;
-	return 6;
+	*samples = codewords * 8;
+	return codewords * 6;
 
 #endif
 }
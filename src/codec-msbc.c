@@ -87,7 +87,7 @@ int msbc_init(struct esco_msbc *msbc) {
 			goto fail;
 		/* Allocate buffer for 1 decoded frame, optional 3 PLC frames and
 		 * some extra frames to account for async PCM samples reading. */
-		if (ffb_init_int16_t(&msbc->pcm, MSBC_CODESAMPLES * 6) == -1)
+		if (ffrb_init_int16_t(&msbc->pcm, MSBC_CODESAMPLES * 6) == -1)
 			goto fail;
 	}
 
@@ -112,7 +112,7 @@ int msbc_init(struct esco_msbc *msbc) {
 #endif
 
 	ffb_rewind(&msbc->data);
-	ffb_rewind(&msbc->pcm);
+	ffrb_rewind(&msbc->pcm);
 
 	msbc->seq_initialized = false;
 	msbc->seq_number = 0;
@@ -141,11 +141,13 @@ void msbc_finish(struct esco_msbc *msbc) {
 	sbc_finish(&msbc->sbc);
 
 	ffb_free(&msbc->data);
-	ffb_free(&msbc->pcm);
+	ffrb_free(&msbc->pcm);
 
 	plc_free(msbc->plc);
 	msbc->plc = NULL;
 
+	msbc->initialized = false;
+
 }
 
 /**
@@ -157,7 +159,7 @@ ssize_t msbc_decode(struct esco_msbc *msbc) {
 
 	const uint8_t *input = msbc->data.data;
 	size_t input_len = ffb_blen_out(&msbc->data);
-	size_t output_len = ffb_blen_in(&msbc->pcm);
+	size_t output_len = ffrb_blen_in(&msbc->pcm);
 	ssize_t rv = 0;
 
 	const size_t tmp = input_len;
@@ -190,15 +192,15 @@ ssize_t msbc_decode(struct esco_msbc *msbc) {
 
 		msbc->seq_number = _seq;
 
-		plc_fillin(msbc->plc, msbc->pcm.tail, missing * MSBC_CODESAMPLES);
-		ffb_seek(&msbc->pcm, missing * MSBC_CODESAMPLES);
+		plc_fillin(msbc->plc, ffrb_tail(&msbc->pcm), missing * MSBC_CODESAMPLES);
+		ffrb_seek(&msbc->pcm, missing * MSBC_CODESAMPLES);
 		rv += missing * MSBC_CODESAMPLES;
 
 	}
 
 	ssize_t len;
 	if ((len = sbc_decode(&msbc->sbc, frame->payload, sizeof(frame->payload),
-					msbc->pcm.tail, output_len, NULL)) < 0) {
+					ffrb_tail(&msbc->pcm), output_len, NULL)) < 0) {
 
 		/* Move forward one byte to avoid getting stuck in
 		 * decoding the same mSBC packet all over again. */
@@ -207,8 +209,8 @@ ssize_t msbc_decode(struct esco_msbc *msbc) {
 #if MSBC_DECODE_ERROR_PLC
 
 		warn("Couldn't decode mSBC frame: %s", sbc_strerror(len));
-		plc_fillin(msbc->plc, msbc->pcm.tail, MSBC_CODESAMPLES);
-		ffb_seek(&msbc->pcm, MSBC_CODESAMPLES);
+		plc_fillin(msbc->plc, ffrb_tail(&msbc->pcm), MSBC_CODESAMPLES);
+		ffrb_seek(&msbc->pcm, MSBC_CODESAMPLES);
 		rv += MSBC_CODESAMPLES;
 
 #else
@@ -219,9 +221,9 @@ ssize_t msbc_decode(struct esco_msbc *msbc) {
 	}
 
 	/* record PCM history and blend new data after PLC */
-	plc_rx(msbc->plc, msbc->pcm.tail, MSBC_CODESAMPLES);
+	plc_rx(msbc->plc, ffrb_tail(&msbc->pcm), MSBC_CODESAMPLES);
 
-	ffb_seek(&msbc->pcm, MSBC_CODESAMPLES);
+	ffrb_seek(&msbc->pcm, MSBC_CODESAMPLES);
 	input += sizeof(*frame);
 	rv += MSBC_CODESAMPLES;
 
@@ -238,8 +240,8 @@ ssize_t msbc_encode(struct esco_msbc *msbc) {
 	if (!msbc->initialized)
 		return -EINVAL;
 
-	const int16_t *input = msbc->pcm.data;
-	const size_t input_len = ffb_blen_out(&msbc->pcm);
+	const int16_t *input = ffrb_head(&msbc->pcm);
+	const size_t input_len = ffrb_blen_out(&msbc->pcm);
 	esco_msbc_frame_t *frame = (esco_msbc_frame_t *)msbc->data.tail;
 	size_t output_len = ffb_blen_in(&msbc->data);
 
@@ -261,8 +263,8 @@ ssize_t msbc_encode(struct esco_msbc *msbc) {
 	ffb_seek(&msbc->data, sizeof(*frame));
 	msbc->frames++;
 
-	/* Reshuffle remaining PCM data to the beginning of the buffer. */
-	ffb_shift(&msbc->pcm, input + MSBC_CODESAMPLES - (int16_t *)msbc->pcm.data);
+	/* Release encoded PCM samples from the ring buffer. */
+	ffrb_shift(&msbc->pcm, MSBC_CODESAMPLES);
 
 	return sizeof(*frame);
 }
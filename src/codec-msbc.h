@@ -25,6 +25,7 @@
 #include <spandsp.h>
 
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 
 /* HFP uses SBC encoding with precisely defined parameters. Hence, the size
  * of the input (number of PCM samples) and output is known up front. */
@@ -57,7 +58,7 @@ struct esco_msbc {
 	/* buffer for eSCO frames */
 	ffb_t data;
 	/* buffer for PCM samples */
-	ffb_t pcm;
+	ffrb_t pcm;
 
 	uint8_t seq_initialized : 1;
 	uint8_t seq_number : 2;
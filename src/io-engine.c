@@ -0,0 +1,421 @@
+/*
+ * BlueALSA - io-engine.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "io-engine.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "bluealsa-config.h"
+#include "shared/defs.h"
+#include "shared/log.h"
+
+/**
+ * Epoll data value used for the termination event. */
+#define IO_ENGINE_TERMINATE UINT64_MAX
+
+/**
+ * Registered event source. */
+struct io_engine_source {
+	int fd;
+	uint32_t events;
+	/* source is a timer owned by the engine */
+	bool timer;
+	io_engine_callback *callback;
+	void *userdata;
+	/* generation counter used for dropping stale events */
+	uint32_t gen;
+	bool used;
+	bool removed;
+	/* source callback is being dispatched */
+	bool busy;
+	pthread_t worker;
+};
+
+static struct {
+	int epoll_fd;
+	int event_fd;
+	pthread_t *workers;
+	unsigned int workers_len;
+	/* guard event sources table */
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	struct io_engine_source *sources;
+	size_t sources_len;
+} engine = {
+	.epoll_fd = -1,
+	.event_fd = -1,
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static uint64_t io_engine_source_data(int id) {
+	return ((uint64_t)engine.sources[id].gen << 32) | id;
+}
+
+static int io_engine_source_arm(int id, int op) {
+	struct io_engine_source *src = &engine.sources[id];
+	struct epoll_event event = {
+		.events = src->events | EPOLLONESHOT,
+		.data.u64 = io_engine_source_data(id) };
+	return epoll_ctl(engine.epoll_fd, op, src->fd, &event);
+}
+
+/**
+ * Release event source slot. The engine mutex shall be locked. */
+static void io_engine_source_release(struct io_engine_source *src) {
+	if (src->timer)
+		close(src->fd);
+	src->used = false;
+	src->removed = false;
+	src->gen++;
+}
+
+static void io_engine_dispatch(uint64_t data, uint32_t events) {
+
+	const int id = data & 0xFFFFFFFF;
+	const uint32_t gen = data >> 32;
+	struct io_engine_source *src;
+
+	pthread_mutex_lock(&engine.mutex);
+
+	if ((size_t)id >= engine.sources_len ||
+			!(src = &engine.sources[id])->used ||
+			src->gen != gen || src->removed) {
+		/* event for already removed source */
+		pthread_mutex_unlock(&engine.mutex);
+		return;
+	}
+
+	src->busy = true;
+	src->worker = pthread_self();
+	const struct io_engine_source s = *src;
+
+	pthread_mutex_unlock(&engine.mutex);
+
+	bool dispatch = true;
+	if (s.timer) {
+		uint64_t expirations;
+		/* The timer might have been disarmed in the meantime. */
+		if (read(s.fd, &expirations, sizeof(expirations)) == -1)
+			dispatch = false;
+	}
+
+	if (dispatch)
+		s.callback(s.fd, events, s.userdata);
+
+	pthread_mutex_lock(&engine.mutex);
+
+	/* table might have been reallocated during the callback */
+	src = &engine.sources[id];
+	src->busy = false;
+
+	if (src->removed)
+		io_engine_source_release(src);
+	else if (io_engine_source_arm(id, EPOLL_CTL_MOD) == -1)
+		error("Couldn't re-arm IO engine source: %s", strerror(errno));
+
+	pthread_mutex_unlock(&engine.mutex);
+	pthread_cond_broadcast(&engine.cond);
+
+}
+
+static void *io_engine_worker(void *arg) {
+	(void)arg;
+
+	for (;;) {
+
+		struct epoll_event event;
+		/* Take only one event at a time, so other events can be dispatched by
+		 * other workers in case when the callback blocks for a while. */
+		int rv = epoll_wait(engine.epoll_fd, &event, 1, -1);
+
+		if (rv == -1) {
+			if (errno == EINTR)
+				continue;
+			error("IO engine poll error: %s", strerror(errno));
+			break;
+		}
+
+		if (event.data.u64 == IO_ENGINE_TERMINATE)
+			break;
+
+		io_engine_dispatch(event.data.u64, event.events);
+
+	}
+
+	return NULL;
+}
+
+/**
+ * Start IO engine workers.
+ *
+ * The engine serves auxiliary event sources only, i.e. the transport thread
+ * managers and the SCO connection dispatchers. Callbacks shall not block,
+ * otherwise other sources assigned to the same worker would be stalled.
+ * Audio encoder and decoder threads are not run by the engine, because
+ * their timing relies on the per-thread transfer rate synchronization.
+ *
+ * Workers are pinned to consecutive CPUs. If the real-time priority for IO
+ * threads was configured, workers use the SCHED_FIFO scheduling policy.
+ *
+ * @param workers The number of worker threads.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int io_engine_init(unsigned int workers) {
+
+	if (workers == 0)
+		return errno = EINVAL, -1;
+
+	if ((engine.epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1 ||
+			(engine.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+		goto fail;
+
+	/* Termination event is level-triggered, so it will wake up all workers. */
+	struct epoll_event event = { .events = EPOLLIN, .data.u64 = IO_ENGINE_TERMINATE };
+	if (epoll_ctl(engine.epoll_fd, EPOLL_CTL_ADD, engine.event_fd, &event) == -1)
+		goto fail;
+
+	if ((engine.workers = calloc(workers, sizeof(*engine.workers))) == NULL)
+		goto fail;
+
+	/* See the ba_transport_pcm_start() function for information
+	 * why we have to mask all signals. */
+	sigset_t sigset, oldset;
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int err;
+
+	for (unsigned int i = 0; i < workers; i++) {
+
+		const unsigned int cpu = cpus > 0 ? i % cpus : 0;
+		if ((err = pthread_create(&engine.workers[i], NULL,
+						io_engine_worker, NULL)) != 0) {
+			pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+			errno = err;
+			goto fail;
+		}
+
+		engine.workers_len++;
+		pthread_setname_np(engine.workers[i], "ba-io-worker");
+
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu, &cpuset);
+		if ((err = pthread_setaffinity_np(engine.workers[i], sizeof(cpuset), &cpuset)) != 0)
+			warn("Couldn't pin IO engine worker to CPU %u: %s", cpu, strerror(err));
+
+		if (config.io_thread_rt_priority != 0) {
+			struct sched_param param = { .sched_priority = config.io_thread_rt_priority };
+			if ((err = pthread_setschedparam(engine.workers[i], SCHED_FIFO, &param)) != 0)
+				warn("Couldn't set IO engine worker RT priority: %s", strerror(err));
+		}
+
+	}
+
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+	debug("Created IO engine workers: %u", workers);
+	return 0;
+
+fail:
+	err = errno;
+	io_engine_destroy();
+	errno = err;
+	return -1;
+}
+
+/**
+ * Terminate IO engine workers and release resources. */
+void io_engine_destroy(void) {
+
+	if (engine.event_fd != -1)
+		eventfd_write(engine.event_fd, 1);
+
+	for (unsigned int i = 0; i < engine.workers_len; i++)
+		pthread_join(engine.workers[i], NULL);
+
+	free(engine.workers);
+	engine.workers = NULL;
+	engine.workers_len = 0;
+
+	for (size_t i = 0; i < engine.sources_len; i++)
+		if (engine.sources[i].used)
+			io_engine_source_release(&engine.sources[i]);
+
+	free(engine.sources);
+	engine.sources = NULL;
+	engine.sources_len = 0;
+
+	if (engine.event_fd != -1)
+		close(engine.event_fd);
+	if (engine.epoll_fd != -1)
+		close(engine.epoll_fd);
+	engine.event_fd = -1;
+	engine.epoll_fd = -1;
+
+}
+
+static int io_engine_add_source(int fd, uint32_t events, bool timer,
+		io_engine_callback *callback, void *userdata) {
+
+	int id = -1;
+
+	pthread_mutex_lock(&engine.mutex);
+
+	for (size_t i = 0; i < engine.sources_len; i++)
+		if (!engine.sources[i].used && !engine.sources[i].busy) {
+			id = i;
+			break;
+		}
+
+	if (id == -1) {
+
+		const size_t len = engine.sources_len == 0 ? 16 : engine.sources_len * 2;
+		struct io_engine_source *tmp;
+		if ((tmp = realloc(engine.sources, len * sizeof(*tmp))) == NULL)
+			goto fail;
+
+		memset(&tmp[engine.sources_len], 0,
+				(len - engine.sources_len) * sizeof(*tmp));
+
+		id = engine.sources_len;
+		engine.sources = tmp;
+		engine.sources_len = len;
+
+	}
+
+	struct io_engine_source *src = &engine.sources[id];
+	src->fd = fd;
+	src->events = events;
+	src->timer = timer;
+	src->callback = callback;
+	src->userdata = userdata;
+
+	if (io_engine_source_arm(id, EPOLL_CTL_ADD) == -1) {
+		id = -1;
+		goto fail;
+	}
+
+	src->used = true;
+
+fail:
+	pthread_mutex_unlock(&engine.mutex);
+	return id;
+}
+
+/**
+ * Add file descriptor event source to the IO engine.
+ *
+ * The callback function is never called concurrently for the same source.
+ *
+ * @param fd File descriptor to watch.
+ * @param events Bit mask of epoll events, e.g. EPOLLIN.
+ * @param callback Function called when any of the events occurs.
+ * @param userdata Data passed to the callback function.
+ * @return On success this function returns the ID of the event source.
+ *   Otherwise, -1 is returned and errno is set to indicate the error. */
+int io_engine_add(
+		int fd,
+		uint32_t events,
+		io_engine_callback *callback,
+		void *userdata) {
+	return io_engine_add_source(fd, events, false, callback, userdata);
+}
+
+/**
+ * Add timer event source to the IO engine.
+ *
+ * The timer is initially disarmed. Use the io_engine_timer_set() function
+ * to arm the timer.
+ *
+ * @param callback Function called when the timer expires.
+ * @param userdata Data passed to the callback function.
+ * @return On success this function returns the ID of the event source.
+ *   Otherwise, -1 is returned and errno is set to indicate the error. */
+int io_engine_add_timer(
+		io_engine_callback *callback,
+		void *userdata) {
+
+	int fd;
+	if ((fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1)
+		return -1;
+
+	int id;
+	if ((id = io_engine_add_source(fd, EPOLLIN, true, callback, userdata)) == -1) {
+		int err = errno;
+		close(fd);
+		errno = err;
+	}
+
+	return id;
+}
+
+/**
+ * Arm or disarm one-shot timer.
+ *
+ * @param id The ID of the timer event source.
+ * @param timeout Timeout in milliseconds. If zero, the timer is disarmed.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int io_engine_timer_set(
+		int id,
+		int timeout) {
+
+	pthread_mutex_lock(&engine.mutex);
+	const int fd = engine.sources[id].fd;
+	pthread_mutex_unlock(&engine.mutex);
+
+	struct itimerspec ts = {
+		.it_value.tv_sec = timeout / 1000,
+		.it_value.tv_nsec = (timeout % 1000) * 1000000 };
+	return timerfd_settime(fd, 0, &ts, NULL);
+}
+
+/**
+ * Remove event source from the IO engine.
+ *
+ * After this function returns, the callback function of the given source
+ * will not be called anymore. If the callback is being dispatched by other
+ * worker, this function waits for the callback to return. It is safe to call
+ * this function from the callback of the removed source.
+ *
+ * @param id The ID of the event source. */
+void io_engine_del(int id) {
+
+	pthread_mutex_lock(&engine.mutex);
+
+	struct io_engine_source *src = &engine.sources[id];
+	const uint32_t gen = src->gen;
+
+	epoll_ctl(engine.epoll_fd, EPOLL_CTL_DEL, src->fd, NULL);
+	src->removed = true;
+
+	if (!src->busy)
+		io_engine_source_release(src);
+	else if (!pthread_equal(src->worker, pthread_self()))
+		/* wait for the callback, the source will be released by the worker */
+		while (engine.sources[id].gen == gen && engine.sources[id].busy)
+			pthread_cond_wait(&engine.cond, &engine.mutex);
+
+	pthread_mutex_unlock(&engine.mutex);
+
+}
@@ -0,0 +1,51 @@
+/*
+ * BlueALSA - io-engine.h
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#pragma once
+#ifndef BLUEALSA_IOENGINE_H_
+#define BLUEALSA_IOENGINE_H_
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdint.h>
+
+/**
+ * Callback function for IO engine events.
+ *
+ * @param fd File descriptor of the event source.
+ * @param events Bit mask of epoll events.
+ * @param userdata Data passed to the io_engine_add() function. */
+typedef void io_engine_callback(
+		int fd,
+		uint32_t events,
+		void *userdata);
+
+int io_engine_init(unsigned int workers);
+void io_engine_destroy(void);
+
+int io_engine_add(
+		int fd,
+		uint32_t events,
+		io_engine_callback *callback,
+		void *userdata);
+
+int io_engine_add_timer(
+		io_engine_callback *callback,
+		void *userdata);
+
+int io_engine_timer_set(
+		int id,
+		int timeout);
+
+void io_engine_del(int id);
+
+#endif
@@ -14,9 +14,15 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 #include <glib.h>
@@ -25,6 +31,77 @@
 #include "bluealsa-config.h"
 #include "shared/defs.h"
 #include "shared/log.h"
+#include "shared/trace.h"
+
+/**
+ * Convert time-stamp to microseconds, saturating at UINT32_MAX. */
+static uint32_t io_stats_usec(
+		const struct timespec *ts) {
+	const uint64_t usec = (uint64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+	return usec < UINT32_MAX ? usec : UINT32_MAX;
+}
+
+/**
+ * Get the time difference between two time-stamps in microseconds. */
+static uint32_t io_stats_diff_usec(
+		const struct timespec *ts1,
+		const struct timespec *ts2) {
+	struct timespec ts;
+	timespecsub(ts2, ts1, &ts);
+	return io_stats_usec(&ts);
+}
+
+/**
+ * Record the codec processing time since the last data read. */
+static void io_stats_record_codec(
+		struct ba_transport_pcm *pcm,
+		const struct timespec *ts) {
+	struct timespec *ts_read = &pcm->stats.ts_read;
+	if (ts_read->tv_sec == 0 && ts_read->tv_nsec == 0)
+		return;
+	histogram_record(&pcm->stats.codec, io_stats_diff_usec(ts_read, ts));
+	ts_read->tv_sec = ts_read->tv_nsec = 0;
+}
+
+/**
+ * Record the time from the IO thread start to the first packet. */
+static void io_stats_record_first_packet(
+		struct ba_transport_pcm *pcm,
+		const struct timespec *ts) {
+	struct timespec *ts_start = &pcm->stats.ts_start;
+	if (ts_start->tv_sec == 0 && ts_start->tv_nsec == 0)
+		return;
+	histogram_record(&pcm->stats.first_packet, io_stats_diff_usec(ts_start, ts));
+	ts_start->tv_sec = ts_start->tv_nsec = 0;
+}
+
+/**
+ * Record the time from the PCM Open call to the first packet. */
+static void io_stats_record_open_first_packet(
+		struct ba_transport_pcm *pcm,
+		const struct timespec *ts) {
+	atomic_uint_least64_t *ts_open = &pcm->stats.ts_open;
+	/* Time-stamp is set by the D-Bus thread, so check it with a cheap load
+	 * first and take it only if it is set. */
+	if (atomic_load_explicit(ts_open, memory_order_relaxed) == 0)
+		return;
+	const uint64_t open = atomic_exchange_explicit(ts_open, 0, memory_order_relaxed);
+	const uint64_t now = (uint64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+	if (open == 0 || now < open)
+		return;
+	histogram_record(&pcm->stats.open_first_packet,
+			now - open < UINT32_MAX ? now - open : UINT32_MAX);
+}
+
+/**
+ * Record the time from the poll() wake-up to the data being read. */
+static void io_stats_record_poll_read(
+		struct ba_transport_pcm *pcm,
+		const struct timespec *ts_poll) {
+	gettimestamp(&pcm->stats.ts_read);
+	histogram_record(&pcm->stats.poll_read,
+			io_stats_diff_usec(ts_poll, &pcm->stats.ts_read));
+}
 
 /**
  * Read data from the BT transport (SCO or SEQPACKET) socket. */
@@ -52,6 +129,9 @@ retry:
 			ret = 0;
 	}
 
+	if (ret > 0)
+		trace(TRACE_EVENT_BT_READ, fd, ret, 0);
+
 	if (ret == 0)
 		ba_transport_thread_bt_release(th);
 
@@ -67,12 +147,33 @@ ssize_t io_bt_write(
 		struct ba_transport_thread *th,
 		const void *buffer,
 		size_t count) {
+	const struct iovec iov = { (void *)buffer, count };
+	return io_bt_writev(th, &iov, 1);
+}
+
+/**
+ * Write single packet gathered from many buffers to the BT transport socket.
+ *
+ * Note:
+ * This function may temporally re-enable thread cancellation! */
+ssize_t io_bt_writev(
+		struct ba_transport_thread *th,
+		const struct iovec *iov,
+		size_t iovcnt) {
 
+	struct ba_transport_pcm *pcm = th->pcm;
 	const int fd = th->bt_fd;
+	struct timespec ts_begin;
+	struct timespec ts_end;
 	ssize_t ret;
 
+	gettimestamp(&ts_begin);
+	io_stats_record_codec(pcm, &ts_begin);
+	io_stats_record_first_packet(pcm, &ts_begin);
+	io_stats_record_open_first_packet(pcm, &ts_begin);
+
 retry:
-	if ((ret = write(fd, buffer, count)) == -1)
+	if ((ret = writev(fd, iov, iovcnt)) == -1)
 		switch (errno) {
 		case EINTR:
 			goto retry;
@@ -95,12 +196,307 @@ retry:
 			ret = 0;
 		}
 
+	gettimestamp(&ts_end);
+	histogram_record(&pcm->stats.bt_write, io_stats_diff_usec(&ts_begin, &ts_end));
+
+	if (ret > 0)
+		trace(TRACE_EVENT_BT_WRITE, fd, ret, 0);
+
 	if (ret == 0)
 		ba_transport_thread_bt_release(th);
 
+	/* forward encoded packet to the transport group members */
+	if (ret > 0 && th->t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE)
+		ba_transport_group_writev(th->t, iov, iovcnt);
+
+	return ret;
+}
+
+/**
+ * Synchronize data transfer with the PCM clock.
+ *
+ * This function is a wrapper for the asrsync_sync() which additionally
+ * records the overdue time in the PCM statistics and accounts for the
+ * drift compensation conversion ratio.
+ *
+ * @return This function returns the value returned by asrsync_sync(). */
+int io_asrsync_sync(
+		struct io_poll *io,
+		struct ba_transport_pcm *pcm,
+		unsigned int frames) {
+
+	/* When the drift compensation is enabled, the transfer is paced with
+	 * the number of consumed input frames, so the output frame rate follows
+	 * the conversion ratio. */
+	if (io->asrc.data != NULL)
+		frames = asrc_input_frames(&io->asrc, frames);
+
+	if (config.io_disable_pacing) {
+		io->asrs.frames += frames;
+		return 0;
+	}
+
+	int rv;
+	if ((rv = asrsync_sync(&io->asrs, frames)) == 0 &&
+			(io->asrs.ts_idle.tv_sec > 0 || io->asrs.ts_idle.tv_nsec > 0)) {
+		const uint32_t overdue = io_stats_usec(&io->asrs.ts_idle);
+		histogram_record(&pcm->stats.sync_overdue, overdue);
+		trace(TRACE_EVENT_SYNC_OVERDUE, io->asrs.rate, overdue, 0);
+	}
+
+	return rv;
+}
+
+/**
+ * Initialize batched write queue for the BT transport socket.
+ *
+ * If the batching window is set to zero, batching is disabled and every
+ * packet is written to the BT socket right away.
+ *
+ * @param io Address of the IO poll structure.
+ * @param mtu The maximal size of a single BT packet.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int io_bt_batch_init(
+		struct io_poll *io,
+		size_t mtu) {
+
+	struct io_bt_batch *batch = &io->bt_batch;
+
+	io_bt_batch_free(batch);
+	batch->count = 0;
+	batch->frames = 0;
+
+	if (config.a2dp.write_batch_time == 0)
+		return 0;
+
+	if ((batch->data = malloc(IO_BT_BATCH_MAX_PACKETS * mtu)) == NULL)
+		return -1;
+
+	batch->mtu = mtu;
+	return 0;
+}
+
+/**
+ * Free resources allocated with the io_bt_batch_init(). */
+void io_bt_batch_free(
+		struct io_bt_batch *batch) {
+	free(batch->data);
+	batch->data = NULL;
+}
+
+/**
+ * Write all queued packets to the BT transport socket.
+ *
+ * Note:
+ * This function may temporally re-enable thread cancellation! */
+static ssize_t io_bt_batch_flush(
+		struct io_bt_batch *batch,
+		struct ba_transport_thread *th) {
+
+	ssize_t len = 0;
+	size_t i;
+
+#if HAVE_SENDMMSG
+
+	struct mmsghdr msgs[IO_BT_BATCH_MAX_PACKETS] = { 0 };
+	struct timespec ts_begin;
+	struct timespec ts_end;
+
+	gettimestamp(&ts_begin);
+	io_stats_record_first_packet(th->pcm, &ts_begin);
+	io_stats_record_open_first_packet(th->pcm, &ts_begin);
+
+	for (i = 0; i < batch->count; i++) {
+		msgs[i].msg_hdr.msg_iov = &batch->iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	for (i = 0; i < batch->count;) {
+
+		int ret;
+		if ((ret = sendmmsg(th->bt_fd, &msgs[i], batch->count - i, 0)) == -1)
+			switch (errno) {
+			case EINTR:
+				continue;
+			case EAGAIN:
+				/* In order to provide a way of escaping from the infinite poll()
+				 * we have to temporally re-enable thread cancellation. */
+				pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+				struct pollfd pfd = { th->bt_fd, POLLOUT, 0 };
+				poll(&pfd, 1, -1);
+				pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+				continue;
+			case ECONNRESET:
+			case ENOTCONN:
+				debug("BT socket disconnected: %s", strerror(errno));
+				len = 0;
+				goto final;
+			case ECONNABORTED:
+			case ETIMEDOUT:
+				error("BT write error: %s", strerror(errno));
+				len = 0;
+				goto final;
+			default:
+				len = -1;
+				goto final;
+			}
+
+		for (; ret > 0; ret--, i++)
+			len += msgs[i].msg_len;
+
+	}
+
+	/* forward encoded packets to the transport group members */
+	if (th->t->profile & BA_TRANSPORT_PROFILE_A2DP_SOURCE)
+		ba_transport_group_write(th->t, batch->iov, batch->count);
+
+final:
+	batch->count = 0;
+
+	gettimestamp(&ts_end);
+	histogram_record(&th->pcm->stats.bt_write, io_stats_diff_usec(&ts_begin, &ts_end));
+
+	if (len == 0)
+		ba_transport_thread_bt_release(th);
+
+#else
+
+	for (i = 0; i < batch->count; i++) {
+		ssize_t ret;
+		if ((ret = io_bt_write(th, batch->iov[i].iov_base, batch->iov[i].iov_len)) <= 0) {
+			len = ret;
+			break;
+		}
+		len += ret;
+	}
+
+	batch->count = 0;
+
+#endif
+
+	return len;
+}
+
+/**
+ * Write queued packets and synchronize transfer with the PCM clock. */
+static ssize_t io_bt_batch_commit(
+		struct io_poll *io,
+		struct ba_transport_thread *th) {
+
+	struct io_bt_batch *batch = &io->bt_batch;
+	ssize_t ret = 1;
+
+	if (batch->count > 0 &&
+			(ret = io_bt_batch_flush(batch, th)) <= 0)
+		return ret;
+
+	io_asrsync_sync(io, th->pcm, batch->frames);
+	batch->frames = 0;
+
 	return ret;
 }
 
+/**
+ * Queue data for a batched write to the BT transport socket.
+ *
+ * If batching is not enabled, data is written right away.
+ *
+ * Note:
+ * This function may temporally re-enable thread cancellation! */
+ssize_t io_bt_write_batch(
+		struct io_poll *io,
+		struct ba_transport_thread *th,
+		const void *buffer,
+		size_t count) {
+	const struct iovec iov = { (void *)buffer, count };
+	return io_bt_writev_batch(io, th, &iov, 1);
+}
+
+/**
+ * Queue single packet gathered from many buffers for a batched write.
+ *
+ * If batching is not enabled, the packet is written right away without
+ * copying data into an intermediate buffer.
+ *
+ * Note:
+ * This function may temporally re-enable thread cancellation! */
+ssize_t io_bt_writev_batch(
+		struct io_poll *io,
+		struct ba_transport_thread *th,
+		const struct iovec *iov,
+		size_t iovcnt) {
+
+	struct io_bt_batch *batch = &io->bt_batch;
+	size_t i, count = 0;
+	ssize_t ret;
+
+	if (batch->data == NULL)
+		return io_bt_writev(th, iov, iovcnt);
+
+	for (i = 0; i < iovcnt; i++)
+		count += iov[i].iov_len;
+
+	if (count > batch->mtu)
+		return errno = EMSGSIZE, -1;
+
+	if (batch->count == IO_BT_BATCH_MAX_PACKETS &&
+			(ret = io_bt_batch_flush(batch, th)) <= 0)
+		return ret;
+
+	struct timespec ts;
+	gettimestamp(&ts);
+	io_stats_record_codec(th->pcm, &ts);
+
+	uint8_t *data = batch->data + batch->count * batch->mtu;
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(data, iov[i].iov_base, iov[i].iov_len);
+		data += iov[i].iov_len;
+	}
+
+	batch->iov[batch->count].iov_base = data - count;
+	batch->iov[batch->count].iov_len = count;
+	batch->count++;
+
+	return count;
+}
+
+/**
+ * Synchronize BT transfer with the PCM clock.
+ *
+ * When batching is enabled, queued packets are written once they carry at
+ * least the batching window worth of frames, and the transfer is then
+ * synchronized for all of them at once. In such case, the IO thread wakes
+ * up once per batch instead of once per packet. Batching is bypassed when
+ * the PCM is in the low-latency mode.
+ *
+ * Note:
+ * This function may temporally re-enable thread cancellation!
+ *
+ * @param io Address of the IO poll structure.
+ * @param th Address of the transport thread structure.
+ * @param frames The number of PCM frames carried by packets passed to the
+ *   io_bt_write_batch() since the last synchronization.
+ * @return On success this function returns a positive value. If the BT
+ *   socket was disconnected, 0 is returned. On error, -1 is returned and
+ *   errno is set to indicate the error. */
+ssize_t io_bt_batch_sync(
+		struct io_poll *io,
+		struct ba_transport_thread *th,
+		unsigned int frames) {
+
+	struct io_bt_batch *batch = &io->bt_batch;
+	batch->frames += frames;
+
+	if (batch->data != NULL &&
+			atomic_load_explicit(&th->pcm->latency, memory_order_relaxed) !=
+				BA_TRANSPORT_PCM_LATENCY_LOW &&
+			batch->frames < config.a2dp.write_batch_time * io->asrs.rate / 1000)
+		return 1;
+
+	return io_bt_batch_commit(io, th);
+}
+
 /**
  * Scale PCM signal according to the volume configuration. */
 void io_pcm_scale(
@@ -108,18 +504,15 @@ void io_pcm_scale(
 		void *buffer,
 		size_t samples) {
 
-	pthread_mutex_lock(&pcm->mutex);
+	/* Volume snapshot is read without taking the PCM mutex, so a slow
+	 * D-Bus handler will not stall the IO thread. */
+	struct ba_transport_pcm_volume_snapshot volume;
+	ba_transport_pcm_volume_snapshot(pcm, &volume);
 
 	const unsigned int channels = pcm->channels;
-	const bool pcm_soft_volume = pcm->soft_volume;
-	const double pcm_volume_ch_scales[2] = {
-		pcm->volume[0].scale,
-		pcm->volume[1].scale,
-	};
+	const double *pcm_volume_ch_scales = volume.scale;
 
-	pthread_mutex_unlock(&pcm->mutex);
-
-	if (!pcm_soft_volume) {
+	if (!volume.soft_volume) {
 		/* In case of hardware volume control we will perform mute operation,
 		 * because hardware muting is an equivalent of gain=0 which with some
 		 * headsets does not entirely silence audio. */
@@ -141,13 +534,13 @@ void io_pcm_scale(
 
 	switch (pcm->format) {
 	case BA_TRANSPORT_PCM_FORMAT_S16_2LE:
-		audio_scale_s16_2le(buffer, samples / channels, channels,
-				pcm_volume_ch_scales[0], pcm_volume_ch_scales[1]);
+		audio_scale_s16_2le_q15(buffer, samples / channels, channels,
+				volume.scale_q15[0], volume.scale_q15[1]);
 		break;
 	case BA_TRANSPORT_PCM_FORMAT_S24_4LE:
 	case BA_TRANSPORT_PCM_FORMAT_S32_4LE:
-		audio_scale_s32_4le(buffer, samples / channels, channels,
-				pcm_volume_ch_scales[0], pcm_volume_ch_scales[1]);
+		audio_scale_s32_4le_q31(buffer, samples / channels, channels,
+				volume.scale_q31[0], volume.scale_q31[1]);
 		break;
 	default:
 		g_assert_not_reached();
@@ -156,24 +549,28 @@ void io_pcm_scale(
 }
 
 /**
- * Flush read buffer of the transport PCM FIFO. */
-ssize_t io_pcm_flush(struct ba_transport_pcm *pcm) {
+ * Flush read buffer of the PCM client endpoint.
+ *
+ * This function shall be called with the PCM mutex locked. */
+static ssize_t io_pcm_flush_endpoint(int fd, struct shm_ring *shm,
+		int shm_event_fd, size_t sample_size) {
 
 	ssize_t samples = 0;
 	ssize_t rv;
 
-	pthread_mutex_lock(&pcm->mutex);
-
-	const int fd = pcm->fd;
-	const size_t sample_size = BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format);
+	if (shm->hdr != NULL) {
+		if ((rv = shm_ring_flush(shm)) > 0) {
+			debug("Flushed PCM samples [%d]: %zd", fd, rv / sample_size);
+			eventfd_write(shm_event_fd, 1);
+		}
+		return rv / sample_size;
+	}
 
 	while ((rv = splice(fd, NULL, config.null_fd, NULL, 32 * 1024, SPLICE_F_NONBLOCK)) > 0) {
 		debug("Flushed PCM samples [%d]: %zd", fd, rv / sample_size);
 		samples += rv / sample_size;
 	}
 
-	pthread_mutex_unlock(&pcm->mutex);
-
 	if (rv == -1 && errno != EAGAIN)
 		return rv;
 
@@ -181,7 +578,245 @@ ssize_t io_pcm_flush(struct ba_transport_pcm *pcm) {
 }
 
 /**
- * Read PCM signal from the transport PCM FIFO. */
+ * Flush read buffer of the transport PCM FIFO. */
+ssize_t io_pcm_flush(struct ba_transport_pcm *pcm) {
+	pthread_mutex_lock(&pcm->mutex);
+	ssize_t rv = io_pcm_flush_endpoint(pcm->fd, &pcm->shm, pcm->shm_event_fd,
+			BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format));
+	pthread_mutex_unlock(&pcm->mutex);
+	return rv;
+}
+
+/**
+ * Flush read buffer of the additional PCM client. */
+ssize_t io_pcm_client_flush(struct ba_transport_pcm *pcm, unsigned int id) {
+
+	ssize_t rv = -1;
+
+	pthread_mutex_lock(&pcm->mutex);
+
+	struct ba_transport_pcm_client *c;
+	if ((c = ba_transport_pcm_client_lookup(pcm, id)) == NULL)
+		errno = ENOENT;
+	else {
+		rv = io_pcm_flush_endpoint(c->fd, &c->shm, c->shm_event_fd,
+				BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format));
+		c->partial_len = 0;
+	}
+
+	pthread_mutex_unlock(&pcm->mutex);
+	return rv;
+}
+
+/**
+ * Read PCM data from the shared memory ring buffer.
+ *
+ * @param fd The event fd signaled by the client.
+ * @param len The maximal number of bytes to read.
+ * @param align The number of bytes read will be a multiple of this value.
+ * @return This function returns the number of bytes read, 0 if the ring
+ *   buffer state has been corrupted by the client or -1 with errno set to
+ *   EAGAIN if there is no data to read. */
+static ssize_t io_pcm_read_shm(int fd, struct shm_ring *shm, int shm_event_fd,
+		void *buffer, size_t len, size_t align) {
+
+	/* Clear the client notification. The data is read directly from the
+	 * shared memory, so client disconnection is detected by the PCM
+	 * controller socket instead of the EOF. */
+	eventfd_t event;
+	eventfd_read(fd, &event);
+
+	ssize_t ret;
+	len = MIN(shm_ring_used(shm), len);
+	if ((ret = shm_ring_read(shm, buffer, len - len % align)) == -1) {
+		/* Offsets in the shared header are controlled by the client, so
+		 * inconsistency is a client error - report it as the EOF. */
+		error("Invalid PCM shared memory ring state: %s", strerror(errno));
+		return 0;
+	}
+
+	if (ret > 0)
+		eventfd_write(shm_event_fd, 1);
+	else
+		ret = -1, errno = EAGAIN;
+
+	/* keep the notification armed if there is still data to read */
+	if (shm_ring_used(shm) >= align)
+		eventfd_write(fd, 1);
+
+	return ret;
+}
+
+/**
+ * Read whole frames available in the additional PCM client FIFO.
+ *
+ * Additional clients are read without polling, so only data which is
+ * already in the FIFO is read. The FIFO is drained completely, though, so
+ * it is not reported as readable until the client writes more data. The
+ * trailing partial frame is stored in the client structure and prepended
+ * to the data of the next read.
+ *
+ * @return This function returns the number of bytes read, 0 on EOF or -1
+ *   with errno set to EAGAIN if there is no whole frame to read. */
+static ssize_t io_pcm_read_fifo_frames(struct ba_transport_pcm_client *c,
+		void *buffer, size_t len, size_t align) {
+
+	uint8_t *data = buffer;
+	const size_t partial_len = c->partial_len;
+
+	/* buffer shall be able to hold at least one frame */
+	if ((len -= len % align) == 0)
+		return errno = EAGAIN, -1;
+
+	memcpy(data, c->partial, partial_len);
+
+	ssize_t ret;
+	while ((ret = read(c->fd, data + partial_len, len - partial_len)) == -1 &&
+			errno == EINTR)
+		continue;
+
+	if (ret <= 0)
+		return ret;
+
+	len = partial_len + ret;
+	c->partial_len = len % align;
+	memcpy(c->partial, data + len - c->partial_len, c->partial_len);
+
+	if ((len -= c->partial_len) == 0)
+		return errno = EAGAIN, -1;
+	return len;
+}
+
+/**
+ * Scale PCM signal according to the client mixing volume. */
+static void io_pcm_mix_scale(
+		const struct ba_transport_pcm *pcm,
+		const struct ba_transport_pcm_mix *mix,
+		void *buffer,
+		size_t samples) {
+
+	if (mix->volume == 100)
+		return;
+
+	const unsigned int channels = pcm->channels;
+	switch (pcm->format) {
+	case BA_TRANSPORT_PCM_FORMAT_S16_2LE:
+		audio_scale_s16_2le_q15(buffer, samples / channels, channels,
+				mix->scale_q15, mix->scale_q15);
+		break;
+	case BA_TRANSPORT_PCM_FORMAT_S24_4LE:
+	case BA_TRANSPORT_PCM_FORMAT_S32_4LE:
+		audio_scale_s32_4le_q31(buffer, samples / channels, channels,
+				mix->scale_q31, mix->scale_q31);
+		break;
+	default:
+		g_assert_not_reached();
+	}
+
+}
+
+/**
+ * Mix additional PCM clients into the signal of the main client.
+ *
+ * If the main client has provided some samples, it drives the IO thread, so
+ * from every additional client at most the same number of samples is read.
+ * Otherwise, e.g. when the main client is paused or idle, additional clients
+ * are mixed into silence. Client which does not have enough data is mixed
+ * partially - missing samples are treated as silence.
+ *
+ * This function shall be called with the PCM mutex locked.
+ *
+ * @param pcm Transport PCM structure.
+ * @param buffer Buffer with the signal of the main client.
+ * @param samples The number of samples read from the main client.
+ * @param samples_max The capacity of the buffer in samples.
+ * @return This function returns the number of samples in the buffer. */
+static size_t io_pcm_mix(
+		struct ba_transport_pcm *pcm,
+		void *buffer,
+		size_t samples,
+		size_t samples_max) {
+
+	io_pcm_mix_scale(pcm, &pcm->mix, buffer, samples);
+
+	if (pcm->clients_len == 0)
+		return samples;
+
+	const size_t sample_size = BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format);
+	const size_t frame_size = sample_size * pcm->channels;
+	const size_t size = (samples > 0 ? samples : samples_max) * sample_size;
+
+	if (pcm->mix_buffer_size < size) {
+		void *tmp;
+		if ((tmp = realloc(pcm->mix_buffer, size)) == NULL) {
+			error("Couldn't allocate PCM mixing buffer: %s", strerror(errno));
+			return samples;
+		}
+		pcm->mix_buffer = tmp;
+		pcm->mix_buffer_size = size;
+	}
+
+	for (size_t i = 0; i < pcm->clients_len; i++) {
+		struct ba_transport_pcm_client *c = &pcm->clients[i];
+
+		if (!c->active)
+			continue;
+
+		ssize_t ret;
+		if (c->shm.hdr != NULL)
+			ret = io_pcm_read_shm(c->fd, &c->shm, c->shm_event_fd,
+					pcm->mix_buffer, size, frame_size);
+		else
+			ret = io_pcm_read_fifo_frames(c,
+					pcm->mix_buffer, size, frame_size);
+
+		if (ret == 0) {
+			debug("PCM mixing client closed connection: %d", c->fd);
+			ba_transport_pcm_client_release(pcm, c->mix.id);
+			/* next client has been moved to the current slot */
+			i--;
+			continue;
+		}
+
+		if (ret <= 0)
+			continue;
+
+		const size_t mix_samples = ret / sample_size;
+		io_pcm_mix_scale(pcm, &c->mix, pcm->mix_buffer, mix_samples);
+		trace(TRACE_EVENT_PCM_READ, c->fd, mix_samples, 0);
+
+		/* extend the signal of the main client with silence */
+		if (mix_samples > samples) {
+			memset((uint8_t *)buffer + samples * sample_size, 0,
+					(mix_samples - samples) * sample_size);
+			samples = mix_samples;
+		}
+
+		switch (pcm->format) {
+		case BA_TRANSPORT_PCM_FORMAT_S16_2LE:
+			audio_mix_s16_2le(buffer, pcm->mix_buffer, mix_samples);
+			break;
+		case BA_TRANSPORT_PCM_FORMAT_S24_4LE:
+			audio_mix_s24_4le(buffer, pcm->mix_buffer, mix_samples);
+			break;
+		case BA_TRANSPORT_PCM_FORMAT_S32_4LE:
+			audio_mix_s32_4le(buffer, pcm->mix_buffer, mix_samples);
+			break;
+		default:
+			g_assert_not_reached();
+		}
+
+	}
+
+	return samples;
+}
+
+/**
+ * Read PCM signal from the transport PCM FIFO.
+ *
+ * If there are additional PCM clients, their signal is mixed into the
+ * signal read from the main client FIFO. If the main client is paused or
+ * it has no data to read, additional clients are mixed into silence. */
 ssize_t io_pcm_read(
 		struct ba_transport_pcm *pcm,
 		void *buffer,
@@ -193,13 +828,27 @@ ssize_t io_pcm_read(
 	const size_t sample_size = BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format);
 	ssize_t ret;
 
-	while ((ret = read(fd, buffer, samples * sample_size)) == -1 &&
-			errno == EINTR)
-		continue;
+	if (fd != -1 && !pcm->active)
+		ret = -1, errno = EAGAIN;
+	else if (pcm->shm.hdr != NULL)
+		ret = io_pcm_read_shm(fd, &pcm->shm, pcm->shm_event_fd,
+				buffer, samples * sample_size, sample_size);
+	else
+		while ((ret = read(fd, buffer, samples * sample_size)) == -1 &&
+				errno == EINTR)
+			continue;
 
 	if (ret == 0) {
 		debug("PCM client closed connection: %d", fd);
-		ba_transport_pcm_release(pcm);
+		ba_transport_pcm_client_release(pcm, pcm->mix.id);
+	}
+	else if (ret > 0 || errno == EAGAIN) {
+		const size_t main_samples = ret > 0 ? ret / sample_size : 0;
+		if ((samples = io_pcm_mix(pcm, buffer, main_samples,
+						samples - samples % pcm->channels)) > 0)
+			ret = samples;
+		else
+			ret = -1, errno = EAGAIN;
 	}
 
 	pthread_mutex_unlock(&pcm->mutex);
@@ -207,7 +856,7 @@ ssize_t io_pcm_read(
 	if (ret <= 0)
 		return ret;
 
-	samples = ret / sample_size;
+	trace(TRACE_EVENT_PCM_READ, fd, samples, 0);
 	io_pcm_scale(pcm, buffer, samples);
 	return samples;
 }
@@ -219,6 +868,12 @@ ssize_t io_pcm_write(
 		const void *buffer,
 		size_t samples) {
 
+	struct timespec ts;
+	gettimestamp(&ts);
+	io_stats_record_codec(pcm, &ts);
+	io_stats_record_first_packet(pcm, &ts);
+	io_stats_record_open_first_packet(pcm, &ts);
+
 	pthread_mutex_lock(&pcm->mutex);
 
 	const int fd = pcm->fd;
@@ -226,6 +881,26 @@ ssize_t io_pcm_write(
 	size_t len = samples * BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format);
 	ssize_t ret;
 
+	if (pcm->shm.hdr != NULL) {
+		/* Write as much as possible. If the client is too slow, frames which
+		 * do not fit in the ring buffer are discarded - for the same reason
+		 * as in the FIFO case below. */
+		const size_t frame_size = BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format) * pcm->channels;
+		const size_t space = shm_ring_space(&pcm->shm);
+		if (len > space)
+			len = space - space % frame_size;
+		if ((ret = shm_ring_write(&pcm->shm, buffer_, len)) == -1) {
+			error("Invalid PCM shared memory ring state: %s", strerror(errno));
+			ba_transport_pcm_release(pcm);
+			ret = 0;
+			goto final;
+		}
+		if (ret > 0)
+			eventfd_write(pcm->shm_event_fd, 1);
+		ret = samples;
+		goto final;
+	}
+
 	do {
 
 		if ((ret = write(fd, buffer_, len)) == -1)
@@ -261,6 +936,8 @@ ssize_t io_pcm_write(
 
 final:
 	pthread_mutex_unlock(&pcm->mutex);
+	if (ret > 0)
+		trace(TRACE_EVENT_PCM_WRITE, fd, ret, 0);
 	return ret;
 }
 
@@ -283,7 +960,7 @@ ssize_t io_poll_and_read_bt(
 		size_t count) {
 
 	struct pollfd fds[2] = {
-		{ th->pipe[0], POLLIN, 0 },
+		{ th->event_fd, POLLIN, 0 },
 		{ th->bt_fd, POLLIN, 0 }};
 
 repoll:
@@ -292,6 +969,9 @@ repoll:
 	int poll_rv = poll(fds, ARRAYSIZE(fds), io->timeout);
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
+	struct timespec ts_poll;
+	gettimestamp(&ts_poll);
+
 	if (poll_rv == -1) {
 		if (errno == EINTR)
 			goto repoll;
@@ -299,18 +979,131 @@ repoll:
 	}
 
 	if (fds[0].revents & POLLIN) {
-		/* dispatch incoming event */
+		/* dispatch all pending signals */
 		io_poll_signal_filter *filter = io->signal.filter != NULL ?
 			io->signal.filter : io_poll_signal_filter_none;
-		enum ba_transport_thread_signal signal;
-		ba_transport_thread_signal_recv(th, &signal);
-		switch (filter(signal, io->signal.userdata)) {
-		default:
-			goto repoll;
-		}
+		struct ba_transport_thread_signal_msg msg;
+		while (ba_transport_thread_signal_recv(th, &msg) == 0)
+			filter(msg.signal, io->signal.userdata);
+		goto repoll;
 	}
 
-	return io_bt_read(th, buffer, count);
+	ssize_t len;
+	if ((len = io_bt_read(th, buffer, count)) > 0)
+		io_stats_record_poll_read(th->pcm, &ts_poll);
+
+	return len;
+}
+
+/**
+ * Initialize drift compensation for the PCM IO thread.
+ *
+ * The drift compensation is enabled only if it was requested in the global
+ * configuration. Otherwise, this function is a no-op. PCM data obtained with
+ * the io_poll_and_read_pcm() are then resampled, so the amount of data queued
+ * in the BT socket is kept at the level of one write MTU.
+ *
+ * @param io Address of the IO poll structure.
+ * @param pcm Address of the transport PCM structure.
+ * @param samples The size of the PCM buffer passed to the
+ *   io_poll_and_read_pcm() function, in samples.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int io_asrc_init(
+		struct io_poll *io,
+		struct ba_transport_pcm *pcm,
+		size_t samples) {
+
+	if (!config.a2dp.drift_compensation)
+		return 0;
+
+	if (asrc_init(&io->asrc, pcm->channels,
+				BA_TRANSPORT_PCM_FORMAT_WIDTH(pcm->format),
+				samples / pcm->channels) == -1)
+		return -1;
+
+	asrc_set_target(&io->asrc, pcm->t->mtu_write);
+	return 0;
+}
+
+/**
+ * Update drift compensation ratio based on the BT socket queue level. */
+static void io_asrc_control(
+		struct io_poll *io,
+		struct ba_transport_pcm *pcm) {
+
+	struct ba_transport *t = pcm->t;
+	int outq;
+
+	if (ioctl(t->bt_fd, TIOCOUTQ, &outq) == -1)
+		return;
+
+	asrc_control(&io->asrc, abs(t->a2dp.bt_fd_coutq_init - outq));
+
+}
+
+/**
+ * Initialize adaptive bitrate controller for the PCM IO thread.
+ *
+ * The controller is always initialized with the given value, so the encoder
+ * can use it as the source of the current setting. However, the value will
+ * be adapted only if the adaptive bitrate was requested in the global
+ * configuration.
+ *
+ * @param io Address of the IO poll structure.
+ * @param pcm Address of the transport PCM structure.
+ * @param value_min The minimal value of the codec parameter.
+ * @param value_max The maximal value of the codec parameter.
+ * @param value The initial value of the codec parameter. */
+void io_abr_init(
+		struct io_poll *io,
+		struct ba_transport_pcm *pcm,
+		unsigned int value_min,
+		unsigned int value_max,
+		unsigned int value) {
+
+	abr_init(&io->abr, value_min, value_max, value);
+
+	if (!config.a2dp.abr)
+		return;
+
+	abr_set_thresholds(&io->abr, config.a2dp.abr_queue_low,
+			config.a2dp.abr_queue_high,
+			(uint64_t)config.a2dp.abr_recovery_time * pcm->sampling / 1000);
+
+}
+
+/**
+ * Update adaptive bitrate controller based on the BT socket queue level.
+ *
+ * This function shall be called by the encoder thread after every transfer
+ * of encoded data.
+ *
+ * @param io Address of the IO poll structure.
+ * @param pcm Address of the transport PCM structure.
+ * @param frames The number of PCM frames transferred since the last call.
+ * @return This function returns true if the codec parameter (stored in
+ *   the io->abr.value) shall be changed, otherwise false. */
+bool io_abr_control(
+		struct io_poll *io,
+		struct ba_transport_pcm *pcm,
+		unsigned int frames) {
+
+	if (!config.a2dp.abr)
+		return false;
+
+	struct ba_transport *t = pcm->t;
+	int outq;
+
+	if (ioctl(t->bt_fd, TIOCOUTQ, &outq) == -1)
+		return false;
+
+	const unsigned int queued = abs(t->a2dp.bt_fd_coutq_init - outq) / t->mtu_write;
+	if (!abr_update(&io->abr, queued, frames))
+		return false;
+
+	debug("Adaptive bitrate update: %u: Queued packets: %u", io->abr.value, queued);
+	return true;
 }
 
 /**
@@ -318,28 +1111,45 @@ repoll:
  *
  * Note:
  * This function temporally re-enables thread cancellation! */
-ssize_t io_poll_and_read_pcm(
+static ssize_t io_poll_and_read_pcm_fifo(
 		struct io_poll *io,
 		struct ba_transport_pcm *pcm,
 		void *buffer,
 		size_t samples) {
 
 	struct ba_transport_thread *th = pcm->th;
-	struct pollfd fds[2] = {
-		{ th->pipe[0], POLLIN, 0 },
+	struct pollfd fds[1 + BA_TRANSPORT_PCM_CLIENTS_MAX] = {
+		{ th->event_fd, POLLIN, 0 },
 		{ -1, POLLIN, 0 }};
+	nfds_t nfds;
 
 repoll:
 
 	pthread_mutex_lock(&pcm->mutex);
 	/* Add PCM socket to the poll if it is active. */
 	fds[1].fd = pcm->active ? pcm->fd : -1;
+	/* Poll additional clients as well, so the paused or idle
+	 * main client will not stall the rest of the clients. */
+	for (nfds = 2; nfds - 2 < pcm->clients_len; nfds++) {
+		const struct ba_transport_pcm_client *c = &pcm->clients[nfds - 2];
+		fds[nfds].fd = c->active ? c->fd : -1;
+		fds[nfds].events = POLLIN;
+	}
 	pthread_mutex_unlock(&pcm->mutex);
 
+	/* Do not keep queued BT packets while waiting for new PCM data. */
+	if (io->bt_batch.count > 0 &&
+			poll(fds, nfds, 0) == 0 &&
+			io_bt_batch_commit(io, th) == -1)
+		error("BT write error: %s", strerror(errno));
+
 	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
-	int poll_rv = poll(fds, ARRAYSIZE(fds), io->timeout);
+	int poll_rv = poll(fds, nfds, io->timeout);
 	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
+	struct timespec ts_poll;
+	gettimestamp(&ts_poll);
+
 	/* Poll for reading with optional sync timeout. */
 	switch (poll_rv) {
 	case 0:
@@ -356,34 +1166,44 @@ repoll:
 	}
 
 	if (fds[0].revents & POLLIN) {
-		/* dispatch incoming event */
+		/* dispatch all pending signals */
 		io_poll_signal_filter *filter = io->signal.filter != NULL ?
 			io->signal.filter : io_poll_signal_filter_none;
-		enum ba_transport_thread_signal signal;
-		ba_transport_thread_signal_recv(th, &signal);
-		switch (filter(signal, io->signal.userdata)) {
-		case BA_TRANSPORT_THREAD_SIGNAL_PCM_OPEN:
-		case BA_TRANSPORT_THREAD_SIGNAL_PCM_RESUME:
-			io->asrs.frames = 0;
-			io->timeout = -1;
-			goto repoll;
-		case BA_TRANSPORT_THREAD_SIGNAL_PCM_CLOSE:
-			/* reuse PCM read disconnection logic */
-			break;
-		case BA_TRANSPORT_THREAD_SIGNAL_PCM_SYNC:
-			io->timeout = 100;
-			goto repoll;
-		case BA_TRANSPORT_THREAD_SIGNAL_PCM_DROP:
-			/* Notify caller that the PCM FIFO has been dropped. This will give
-			 * the caller a chance to reinitialize its internal state. */
-			errno = ESTALE;
-			return -1;
-		default:
+		struct ba_transport_thread_signal_msg msg;
+		bool pcm_closed = false;
+		while (ba_transport_thread_signal_recv(th, &msg) == 0)
+			switch (filter(msg.signal, io->signal.userdata)) {
+			case BA_TRANSPORT_THREAD_SIGNAL_PCM_OPEN:
+			case BA_TRANSPORT_THREAD_SIGNAL_PCM_RESUME:
+				io->asrs.frames = 0;
+				io->timeout = -1;
+				break;
+			case BA_TRANSPORT_THREAD_SIGNAL_PCM_CLOSE:
+				pcm_closed = true;
+				break;
+			case BA_TRANSPORT_THREAD_SIGNAL_PCM_SYNC:
+				io->timeout = msg.value;
+				break;
+			case BA_TRANSPORT_THREAD_SIGNAL_PCM_DROP:
+				/* Notify caller that the PCM FIFO has been dropped. This will give
+				 * the caller a chance to reinitialize its internal state. Remaining
+				 * signals (if any) will be dispatched with the next poll. */
+				errno = ESTALE;
+				return -1;
+			default:
+				break;
+			}
+		/* reuse PCM read disconnection logic */
+		if (!pcm_closed)
 			goto repoll;
-		}
 	}
 
-	if (fds[1].revents == 0)
+	bool readable = false;
+	for (nfds_t i = 1; i < nfds; i++)
+		if (fds[i].revents != 0)
+			readable = true;
+
+	if (!readable)
 		return 0;
 
 	ssize_t samples_read;
@@ -398,12 +1218,55 @@ repoll:
 	if (samples_read == 0)
 		return 0;
 
+	io_stats_record_poll_read(pcm, &ts_poll);
+
 	/* When the thread is created, there might be no data in the FIFO. In fact
 	 * there might be no data for a long time - until client starts playback.
 	 * In order to correctly calculate time drift, the zero time point has to
 	 * be obtained after the stream has started. */
-	if (io->asrs.frames == 0)
+	if (io->asrs.frames == 0 && io->bt_batch.frames == 0)
 		asrsync_init(&io->asrs, pcm->sampling);
 
 	return samples_read;
 }
+
+/**
+ * Poll and read data from the PCM FIFO.
+ *
+ * If the drift compensation was initialized with the io_asrc_init(), data
+ * read from the PCM FIFO are resampled before being stored in the buffer.
+ *
+ * Note:
+ * This function temporally re-enables thread cancellation! */
+ssize_t io_poll_and_read_pcm(
+		struct io_poll *io,
+		struct ba_transport_pcm *pcm,
+		void *buffer,
+		size_t samples) {
+
+	struct asrc *asrc = &io->asrc;
+	if (asrc->data == NULL)
+		return io_poll_and_read_pcm_fifo(io, pcm, buffer, samples);
+
+	const size_t frames = samples / asrc->channels;
+	size_t frames_out;
+
+	/* Read new data only if buffered frames are not enough to fill the
+	 * output buffer. This way the conversion latency is kept minimal. */
+	while ((frames_out = asrc_process(asrc, buffer, frames)) == 0) {
+
+		ssize_t samples_read;
+		if ((samples_read = io_poll_and_read_pcm_fifo(io, pcm, asrc_tail(asrc),
+						asrc_space(asrc) * asrc->channels)) <= 0) {
+			if (samples_read == -1 && errno == ESTALE)
+				asrc_reset(asrc);
+			return samples_read;
+		}
+
+		asrc_seek(asrc, samples_read / asrc->channels);
+		io_asrc_control(io, pcm);
+
+	}
+
+	return frames_out * asrc->channels;
+}
@@ -16,10 +16,16 @@
 # include <config.h>
 #endif
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include "ba-transport.h"
 #include "ba-transport-pcm.h"
+#include "shared/abr.h"
+#include "shared/asrc.h"
 #include "shared/rt.h"
 
 /**
@@ -28,6 +34,27 @@ typedef enum ba_transport_thread_signal io_poll_signal_filter(
 		enum ba_transport_thread_signal signal,
 		void *userdata);
 
+/**
+ * Maximal number of BT packets queued for a batched write. */
+#define IO_BT_BATCH_MAX_PACKETS 16
+
+/**
+ * Queue of BT packets for a batched write.
+ *
+ * Packets are copied into the internal storage, so the caller can reuse
+ * its buffer right after the io_bt_write_batch() call. */
+struct io_bt_batch {
+	/* storage for queued packets */
+	uint8_t *data;
+	/* maximal size of a single packet */
+	size_t mtu;
+	/* queued packets */
+	struct iovec iov[IO_BT_BATCH_MAX_PACKETS];
+	size_t count;
+	/* frames carried by queued packets */
+	unsigned int frames;
+};
+
 /**
  * Data associated with IO polling.
  *
@@ -41,6 +68,12 @@ struct io_poll {
 	} signal;
 	/* transfer bit rate synchronization */
 	struct asrsync asrs;
+	/* batched BT write queue */
+	struct io_bt_batch bt_batch;
+	/* drift compensation resampler */
+	struct asrc asrc;
+	/* adaptive bitrate controller */
+	struct abr abr;
 	/* keep-alive and sync timeout */
 	int timeout;
 };
@@ -54,6 +87,55 @@ ssize_t io_bt_write(
 		struct ba_transport_thread *th,
 		const void *buffer,
 		size_t count);
+ssize_t io_bt_writev(
+		struct ba_transport_thread *th,
+		const struct iovec *iov,
+		size_t iovcnt);
+
+int io_asrsync_sync(
+		struct io_poll *io,
+		struct ba_transport_pcm *pcm,
+		unsigned int frames);
+
+int io_bt_batch_init(
+		struct io_poll *io,
+		size_t mtu);
+
+void io_bt_batch_free(
+		struct io_bt_batch *batch);
+
+ssize_t io_bt_write_batch(
+		struct io_poll *io,
+		struct ba_transport_thread *th,
+		const void *buffer,
+		size_t count);
+ssize_t io_bt_writev_batch(
+		struct io_poll *io,
+		struct ba_transport_thread *th,
+		const struct iovec *iov,
+		size_t iovcnt);
+
+ssize_t io_bt_batch_sync(
+		struct io_poll *io,
+		struct ba_transport_thread *th,
+		unsigned int frames);
+
+int io_asrc_init(
+		struct io_poll *io,
+		struct ba_transport_pcm *pcm,
+		size_t samples);
+
+void io_abr_init(
+		struct io_poll *io,
+		struct ba_transport_pcm *pcm,
+		unsigned int value_min,
+		unsigned int value_max,
+		unsigned int value);
+
+bool io_abr_control(
+		struct io_poll *io,
+		struct ba_transport_pcm *pcm,
+		unsigned int frames);
 
 void io_pcm_scale(
 		struct ba_transport_pcm *pcm,
@@ -62,6 +144,9 @@ void io_pcm_scale(
 
 ssize_t io_pcm_flush(
 		struct ba_transport_pcm *pcm);
+ssize_t io_pcm_client_flush(
+		struct ba_transport_pcm *pcm,
+		unsigned int id);
 
 ssize_t io_pcm_read(
 		struct ba_transport_pcm *pcm,
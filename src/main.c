@@ -12,6 +12,7 @@
 # include <config.h>
 #endif
 
+#include <errno.h>
 #include <getopt.h>
 #include <sched.h>
 #include <signal.h>
@@ -22,6 +23,7 @@
 #include <string.h>
 #include <strings.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <gio/gio.h>
 #include <glib-unix.h>
@@ -34,12 +36,14 @@
 #include "a2dp.h"
 #include "a2dp-sbc.h"
 #include "audio.h"
+#include "ba-transport-pcm.h"
 #include "bluealsa-config.h"
 #include "bluealsa-dbus.h"
 #include "bluealsa-iface.h"
 #include "bluez.h"
 #include "codec-sbc.h"
 #include "hfp.h"
+#include "io-engine.h"
 #if ENABLE_OFONO
 # include "ofono.h"
 #endif
@@ -51,6 +55,7 @@
 #include "shared/defs.h"
 #include "shared/log.h"
 #include "shared/nv.h"
+#include "shared/trace.h"
 
 /* If glib does not support immediate return in case of bus
  * name being owned by some other connection (glib < 2.54),
@@ -156,11 +161,19 @@ int main(int argc, char **argv) {
 		{ "codec", required_argument, NULL, 'c' },
 		{ "initial-volume", required_argument, NULL, 17 },
 		{ "keep-alive", required_argument, NULL, 8 },
+		{ "dbus-update-rate", required_argument, NULL, 27 },
 		{ "io-rt-priority", required_argument, NULL, 3 },
+		{ "io-engine", required_argument, NULL, 24 },
+		{ "trace", required_argument, NULL, 28 },
 		{ "disable-realtek-usb-fix", no_argument, NULL, 21 },
 		{ "a2dp-force-mono", no_argument, NULL, 6 },
 		{ "a2dp-force-audio-cd", no_argument, NULL, 7 },
 		{ "a2dp-volume", no_argument, NULL, 9 },
+		{ "a2dp-write-batch", required_argument, NULL, 22 },
+		{ "a2dp-drift-compensation", no_argument, NULL, 23 },
+		{ "a2dp-jitter-buffer", required_argument, NULL, 25 },
+		{ "a2dp-abr", no_argument, NULL, 26 },
+		{ "a2dp-max-clients", required_argument, NULL, 29 },
 		{ "sbc-quality", required_argument, NULL, 14 },
 #if ENABLE_AAC
 		{ "aac-afterburner", no_argument, NULL, 4 },
@@ -206,11 +219,19 @@ int main(int argc, char **argv) {
 					"  -c, --codec=NAME\t\tset enabled BT audio codecs\n"
 					"  --initial-volume=NUM\t\tinitial volume level [0-100]\n"
 					"  --keep-alive=SEC\t\tkeep Bluetooth transport alive\n"
+					"  --dbus-update-rate=HZ\t\tlimit D-Bus property updates rate\n"
 					"  --io-rt-priority=NUM\t\treal-time priority for IO threads\n"
+					"  --io-engine=MODE\t\tset IO engine mode\n"
+					"  --trace=NUM\t\t\trecord NUM trace events per thread\n"
 					"  --disable-realtek-usb-fix\tdisable fix for mSBC on Realtek USB\n"
 					"  --a2dp-force-mono\t\ttry to force monophonic sound\n"
 					"  --a2dp-force-audio-cd\t\ttry to force 44.1 kHz sampling\n"
 					"  --a2dp-volume\t\t\tnative volume control by default\n"
+					"  --a2dp-write-batch=MSEC\tbatch BT writes within time window\n"
+					"  --a2dp-drift-compensation\tresample PCM to follow sink clock\n"
+					"  --a2dp-jitter-buffer=MSEC\tset max SBC jitter buffer depth\n"
+					"  --a2dp-abr\t\t\tenable SBC and AAC adaptive bit rate\n"
+					"  --a2dp-max-clients=NUM\tmix audio of up to NUM PCM clients\n"
 					"  --sbc-quality=MODE\t\tset SBC encoder quality mode\n"
 #if ENABLE_AAC
 					"  --aac-afterburner\t\tenable FDK AAC afterburner\n"
@@ -380,6 +401,16 @@ int main(int argc, char **argv) {
 			config.keep_alive_time = atof(optarg) * 1000;
 			break;
 
+		case 27 /* --dbus-update-rate=HZ */ : {
+			const int rate = atoi(optarg);
+			if (rate < 0 || rate > 1000) {
+				error("Invalid D-Bus update rate [0, 1000]: %s", optarg);
+				return EXIT_FAILURE;
+			}
+			config.dbus_update_rate = rate;
+			break;
+		}
+
 		case 3 /* --io-rt-priority=NUM */ :
 			config.io_thread_rt_priority = atoi(optarg);
 			const int min = sched_get_priority_min(SCHED_FIFO);
@@ -390,6 +421,38 @@ int main(int argc, char **argv) {
 			}
 			break;
 
+		case 24 /* --io-engine=MODE */ : {
+
+			static const nv_entry_t values[] = {
+				{ "threads", .v.ui = 0 },
+				{ "epoll", .v.ui = 1 },
+				{ 0 },
+			};
+
+			const nv_entry_t *entry;
+			if ((entry = nv_find(values, optarg)) == NULL) {
+				error("Invalid IO engine mode {%s}: %s",
+						nv_join_names(values), optarg);
+				return EXIT_FAILURE;
+			}
+
+			config.io_engine_workers = 0;
+			if (entry->v.ui == 1) {
+				/* use one worker per online CPU */
+				const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+				config.io_engine_workers = cpus > 0 ? cpus : 1;
+			}
+
+			break;
+		}
+
+		case 28 /* --trace=NUM */ :
+			if (trace_init(atoi(optarg)) == -1) {
+				error("Invalid number of trace records: %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+
 		case 21 /* --disable-realtek-usb-fix */ :
 			config.disable_realtek_usb_fix = true;
 			break;
@@ -403,6 +466,42 @@ int main(int argc, char **argv) {
 		case 9 /* --a2dp-volume */ :
 			config.a2dp.volume = true;
 			break;
+		case 22 /* --a2dp-write-batch=MSEC */ : {
+			char *tmp;
+			const long msec = strtol(optarg, &tmp, 10);
+			if (msec < 0 || msec > 100 || optarg == tmp || *tmp != '\0') {
+				error("Invalid A2DP write batching time [0, 100]: %s", optarg);
+				return EXIT_FAILURE;
+			}
+			config.a2dp.write_batch_time = msec;
+			break;
+		}
+		case 23 /* --a2dp-drift-compensation */ :
+			config.a2dp.drift_compensation = true;
+			break;
+		case 25 /* --a2dp-jitter-buffer=MSEC */ : {
+			char *tmp;
+			const long msec = strtol(optarg, &tmp, 10);
+			if (msec < 0 || msec > 1000 || optarg == tmp || *tmp != '\0') {
+				error("Invalid A2DP jitter buffer time [0, 1000]: %s", optarg);
+				return EXIT_FAILURE;
+			}
+			config.a2dp.jitter_buffer_time = msec;
+			break;
+		}
+		case 26 /* --a2dp-abr */ :
+			config.a2dp.abr = true;
+			break;
+		case 29 /* --a2dp-max-clients=NUM */ : {
+			const int clients = atoi(optarg);
+			if (clients < 1 || clients > BA_TRANSPORT_PCM_CLIENTS_MAX) {
+				error("Invalid number of A2DP PCM clients [1, %d]: %s",
+						BA_TRANSPORT_PCM_CLIENTS_MAX, optarg);
+				return EXIT_FAILURE;
+			}
+			config.a2dp.max_clients = clients;
+			break;
+		}
 
 		case 14 /* --sbc-quality=MODE */ : {
 
@@ -585,6 +684,13 @@ int main(int argc, char **argv) {
 	config.hfp.codecs.cvsd = true;
 
 	a2dp_codecs_init();
+	audio_init();
+
+	if (config.io_engine_workers > 0 &&
+			io_engine_init(config.io_engine_workers) == -1) {
+		error("Couldn't start IO engine: %s", strerror(errno));
+		return EXIT_FAILURE;
+	}
 
 	const char *storage_base_dir = BLUEALSA_STORAGE_DIR;
 #if ENABLE_SYSTEMD
@@ -613,9 +719,16 @@ int main(int argc, char **argv) {
 	debug("Starting main dispatching loop");
 	g_main_loop_run(loop);
 
+	/* Write pending storage updates while all transports are still
+	 * alive, so the background writer will not release them. */
+	storage_flush();
+
 	/* cleanup internal structures */
 	bluez_destroy();
 
+	if (config.io_engine_workers > 0)
+		io_engine_destroy();
+
 	storage_destroy();
 	g_dbus_connection_close_sync(config.dbus, NULL, NULL);
 	g_main_loop_unref(loop);
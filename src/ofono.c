@@ -521,10 +521,14 @@ static int ofono_call_volume_get_properties(struct ba_transport *t) {
 		g_variant_unref(value);
 	}
 
-	if (mask & OFONO_CALL_VOLUME_SPEAKER)
+	if (mask & OFONO_CALL_VOLUME_SPEAKER) {
+		ba_transport_pcm_volume_sync(&t->sco.pcm_spk);
 		bluealsa_dbus_pcm_update(&t->sco.pcm_spk, BA_DBUS_PCM_UPDATE_VOLUME);
-	if (mask & OFONO_CALL_VOLUME_MICROPHONE)
+	}
+	if (mask & OFONO_CALL_VOLUME_MICROPHONE) {
+		ba_transport_pcm_volume_sync(&t->sco.pcm_mic);
 		bluealsa_dbus_pcm_update(&t->sco.pcm_mic, BA_DBUS_PCM_UPDATE_VOLUME);
+	}
 
 	g_variant_iter_free(properties);
 	goto final;
@@ -1017,10 +1021,14 @@ static void ofono_signal_volume_changed(GDBusConnection *conn, const char *sende
 	debug("Signal: %s.%s(%s, ...)", interface, signal, property);
 
 	unsigned int mask = ofono_call_volume_property_sync(t, property, value);
-	if (mask & OFONO_CALL_VOLUME_SPEAKER)
+	if (mask & OFONO_CALL_VOLUME_SPEAKER) {
+		ba_transport_pcm_volume_sync(&t->sco.pcm_spk);
 		bluealsa_dbus_pcm_update(&t->sco.pcm_spk, BA_DBUS_PCM_UPDATE_VOLUME);
-	if (mask & OFONO_CALL_VOLUME_MICROPHONE)
+	}
+	if (mask & OFONO_CALL_VOLUME_MICROPHONE) {
+		ba_transport_pcm_volume_sync(&t->sco.pcm_mic);
 		bluealsa_dbus_pcm_update(&t->sco.pcm_mic, BA_DBUS_PCM_UPDATE_VOLUME);
+	}
 
 	g_variant_unref(value);
 	ba_transport_unref(t);
@@ -12,11 +12,19 @@
 /* IWYU pragma: no_include "config.h" */
 
 #include <endian.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "shared/defs.h"
 #include "shared/log.h"
+#include "shared/rt.h"
+
+/* Sequence number jumps which are treated as a stream restart,
+ * the values are taken from the RFC 3550 appendix A.1. */
+#define RTP_STATS_MAX_DROPOUT 3000
+#define RTP_STATS_MAX_MISORDER 100
 
 /**
  * Convert clock rate. */
@@ -72,6 +80,24 @@ void *rtp_a2dp_get_payload(const rtp_header_t *hdr) {
 	return (void *)&hdr->csrc[hdr->cc];
 }
 
+/**
+ * Check whether received data is long enough to hold the RTP header.
+ *
+ * @param hdr The pointer to data with RTP header.
+ * @param len The length of the received data.
+ * @return This function returns true if the data contains the complete
+ *   RTP header including all CSRC identifiers, otherwise false. */
+bool rtp_check_header_len(const rtp_header_t *hdr, size_t len) {
+
+	if (len < RTP_HEADER_LEN ||
+			len < RTP_HEADER_LEN + hdr->cc * sizeof(*hdr->csrc)) {
+		debug("RTP packet too short: %zu", len);
+		return false;
+	}
+
+	return true;
+}
+
 /**
  * Initialize RTP local state.
  *
@@ -177,3 +203,443 @@ void rtp_state_update(
 	rtp->ts_pcm_frames += pcm_frames;
 
 }
+
+/**
+ * Initialize RTP packetizer.
+ *
+ * @param p Address of the RTP packetizer structure.
+ * @param headers The RTP headers which will be prepended to every packet.
+ *   Caller might update headers between packets, e.g. the sequence number.
+ * @param headers_len The length of the RTP headers.
+ * @param payload The encoded payload.
+ * @param payload_len The length of the encoded payload.
+ * @param mtu The maximal size of a single RTP packet. */
+void rtp_packetizer_init(
+		struct rtp_packetizer *p,
+		const void *headers,
+		size_t headers_len,
+		const void *payload,
+		size_t payload_len,
+		size_t mtu) {
+
+	p->iov[0].iov_base = (void *)headers;
+	p->iov[0].iov_len = headers_len;
+	p->iov[1].iov_base = NULL;
+	p->iov[1].iov_len = 0;
+
+	p->payload = payload;
+	p->payload_len = payload_len;
+	p->payload_len_max = mtu - headers_len;
+	p->offset = 0;
+
+}
+
+/**
+ * Move to the next RTP packet.
+ *
+ * @param p The RTP packetizer structure.
+ * @return This function returns true if the next packet is available in
+ *   the IO vectors of the packetizer, or false if the whole payload has
+ *   already been packetized. */
+bool rtp_packetizer_next(
+		struct rtp_packetizer *p) {
+
+	if (p->iov[1].iov_base != NULL)
+		p->offset += p->iov[1].iov_len;
+
+	if (p->offset >= p->payload_len)
+		return false;
+
+	size_t len = p->payload_len - p->offset;
+	if (len > p->payload_len_max)
+		len = p->payload_len_max;
+
+	p->iov[1].iov_base = (void *)(p->payload + p->offset);
+	p->iov[1].iov_len = len;
+
+	return true;
+}
+
+/**
+ * Initialize RTP jitter buffer.
+ *
+ * The buffer depth adapts to the observed network jitter. It starts at one
+ * quarter of the maximal depth, grows when packets arrive too late to be
+ * played, and shrinks back after a period of time without late packets.
+ * The maximal depth is further limited to the duration of packets which
+ * can be stored in the buffer, once the packet duration is known.
+ *
+ * @param jb Address of the jitter buffer structure.
+ * @param mtu The maximal size of a single RTP packet.
+ * @param rtp_clockrate The clock rate of the RTP timestamp.
+ * @param depth_max_ms The maximal buffering depth in milliseconds.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int rtp_jitter_buffer_init(
+		struct rtp_jitter_buffer *jb,
+		size_t mtu,
+		unsigned int rtp_clockrate,
+		unsigned int depth_max_ms) {
+
+	if ((jb->data = malloc(RTP_JITTER_BUFFER_SLOTS * mtu)) == NULL)
+		return -1;
+
+	jb->mtu = mtu;
+	jb->rtp_clockrate = rtp_clockrate;
+	jb->depth_max = (uint64_t)rtp_clockrate * depth_max_ms / 1000;
+	jb->depth_min = jb->depth_max / 4;
+	jb->depth_step = jb->depth_max / 8 + 1;
+	jb->depth = jb->depth_min;
+	jb->late = 0;
+	jb->lost = 0;
+
+	rtp_jitter_buffer_reset(jb);
+	return 0;
+}
+
+/**
+ * Free resources allocated with the rtp_jitter_buffer_init(). */
+void rtp_jitter_buffer_free(
+		struct rtp_jitter_buffer *jb) {
+	free(jb->data);
+	jb->data = NULL;
+}
+
+/**
+ * Discard all buffered packets. */
+void rtp_jitter_buffer_reset(
+		struct rtp_jitter_buffer *jb) {
+	memset(jb->len, 0, sizeof(jb->len));
+	jb->synced = false;
+}
+
+/**
+ * Limit the buffering depth to what fits in the packet slots.
+ *
+ * The packet duration is not known until two consecutive packets are
+ * received. If the maximal depth covers more packets than the buffer can
+ * hold, new packets would be ahead of the window before anything could be
+ * released, so the depth range is scaled down accordingly.
+ *
+ * @param jb The RTP jitter buffer structure.
+ * @param duration The duration of a single RTP packet in RTP clock units. */
+static void rtp_jitter_buffer_limit_depth(
+		struct rtp_jitter_buffer *jb,
+		uint32_t duration) {
+
+	/* one slot is occupied by the packet which is about to be released */
+	const uint64_t depth_max = (uint64_t)duration * (RTP_JITTER_BUFFER_SLOTS - 1);
+	if (duration == 0 || depth_max >= jb->depth_max)
+		return;
+
+	jb->depth = (uint64_t)jb->depth * depth_max / jb->depth_max;
+	jb->depth_max = depth_max;
+	jb->depth_min = jb->depth_max / 4;
+	jb->depth_step = jb->depth_max / 8 + 1;
+	if (jb->depth < jb->depth_min)
+		jb->depth = jb->depth_min;
+
+	debug("RTP jitter buffer depth limited: %u", jb->depth_max);
+
+}
+
+/**
+ * Put received RTP packet into the jitter buffer.
+ *
+ * @param jb The RTP jitter buffer structure.
+ * @param packet The RTP packet.
+ * @param len The length of the RTP packet.
+ * @return If the packet was stored, this function returns 1. If the packet
+ *   arrived too late to be played or it is too short to be a valid RTP
+ *   packet, it is dropped and 0 is returned. */
+int rtp_jitter_buffer_put(
+		struct rtp_jitter_buffer *jb,
+		const void *packet,
+		size_t len) {
+
+	const rtp_header_t *hdr = packet;
+
+	if (len < RTP_HEADER_LEN) {
+		debug("RTP packet too short: %zu < %zu", len, RTP_HEADER_LEN);
+		return 0;
+	}
+
+	const uint16_t seq_number = be16toh(hdr->seq_number);
+	const uint32_t timestamp = be32toh(hdr->timestamp);
+
+	if (len > jb->mtu)
+		len = jb->mtu;
+
+	if (!jb->synced) {
+		jb->seq_next = seq_number;
+		jb->seq_last = seq_number;
+		jb->ts_last = timestamp;
+		jb->ts_adjusted = timestamp;
+		jb->synced = true;
+	}
+
+	const int16_t offset = seq_number - jb->seq_next;
+
+	if (offset < 0) {
+		/* Packet which we have already given up on has finally arrived.
+		 * Increase the buffer depth, so it will be possible to play such
+		 * packets in the future. */
+		debug("Late RTP packet [%u < %u]", seq_number, jb->seq_next);
+		jb->late++;
+		if (jb->depth < jb->depth_max) {
+			if ((jb->depth += jb->depth_step) > jb->depth_max)
+				jb->depth = jb->depth_max;
+			debug("RTP jitter buffer depth increased: %u", jb->depth);
+		}
+		jb->ts_adjusted = jb->ts_last;
+		return 0;
+	}
+
+	if (offset >= RTP_JITTER_BUFFER_SLOTS) {
+		/* Sequence number jumped beyond our window - most likely the stream
+		 * was restarted. Resynchronize the buffer with the new stream. */
+		warn("RTP stream discontinuity [%u != %u]", seq_number, jb->seq_next);
+		rtp_jitter_buffer_reset(jb);
+		return rtp_jitter_buffer_put(jb, packet, len);
+	}
+
+	const size_t slot = seq_number % RTP_JITTER_BUFFER_SLOTS;
+	memcpy(jb->data + slot * jb->mtu, packet, len);
+	jb->len[slot] = len;
+
+	if ((int16_t)(seq_number - jb->seq_last) > 0) {
+		if ((uint16_t)(seq_number - jb->seq_last) == 1)
+			rtp_jitter_buffer_limit_depth(jb, timestamp - jb->ts_last);
+		jb->seq_last = seq_number;
+		jb->ts_last = timestamp;
+	}
+
+	return 1;
+}
+
+/**
+ * Get the next RTP packet from the jitter buffer.
+ *
+ * The packet is released if its timestamp is at least the buffer depth
+ * behind the newest received packet. Packets which have not arrived until
+ * then are skipped, so the caller shall conceal them based on the RTP
+ * sequence number and timestamp of the returned packet.
+ *
+ * @param jb The RTP jitter buffer structure.
+ * @param len The address where the length of the packet will be stored.
+ * @return The pointer to the RTP packet or NULL if no packet is ready. The
+ *   returned pointer is valid until the next call to rtp_jitter_buffer_put(). */
+const rtp_header_t *rtp_jitter_buffer_get(
+		struct rtp_jitter_buffer *jb,
+		size_t *len) {
+
+	if (!jb->synced)
+		return NULL;
+
+	uint16_t seq_number = jb->seq_next;
+	for (;;) {
+		if (jb->len[seq_number % RTP_JITTER_BUFFER_SLOTS] != 0)
+			break;
+		if (seq_number == jb->seq_last)
+			return NULL;
+		seq_number++;
+	}
+
+	const size_t slot = seq_number % RTP_JITTER_BUFFER_SLOTS;
+	const rtp_header_t *hdr = (rtp_header_t *)(jb->data + slot * jb->mtu);
+	const uint32_t timestamp = be32toh(hdr->timestamp);
+
+	if (jb->ts_last - timestamp < jb->depth)
+		return NULL;
+
+	if (seq_number != jb->seq_next) {
+		debug("Lost RTP packets [%u != %u]: %u",
+				seq_number, jb->seq_next, (uint16_t)(seq_number - jb->seq_next));
+		jb->lost += (uint16_t)(seq_number - jb->seq_next);
+	}
+
+	/* Decrease the buffer depth if there were no late
+	 * packets for the last 10 seconds of the stream. */
+	if ((int32_t)(timestamp - jb->ts_adjusted) > (int32_t)jb->rtp_clockrate * 10) {
+		if (jb->depth > jb->depth_min) {
+			if (jb->depth - jb->depth_min > jb->depth_step)
+				jb->depth -= jb->depth_step;
+			else
+				jb->depth = jb->depth_min;
+			debug("RTP jitter buffer depth decreased: %u", jb->depth);
+		}
+		jb->ts_adjusted = timestamp;
+	}
+
+	*len = jb->len[slot];
+	jb->len[slot] = 0;
+	jb->seq_next = seq_number + 1;
+
+	return hdr;
+}
+
+/**
+ * Reset RTP receiver statistics.
+ *
+ * @param stats The RTP receiver statistics structure. */
+void rtp_stats_reset(
+		struct rtp_stats *stats) {
+
+	atomic_store_explicit(&stats->expected, 0, memory_order_relaxed);
+	atomic_store_explicit(&stats->received, 0, memory_order_relaxed);
+	atomic_store_explicit(&stats->duplicated, 0, memory_order_relaxed);
+	atomic_store_explicit(&stats->reordered, 0, memory_order_relaxed);
+	atomic_store_explicit(&stats->seq_ext_max, 0, memory_order_relaxed);
+	atomic_store_explicit(&stats->jitter, 0, memory_order_relaxed);
+	atomic_store_explicit(&stats->clockrate, 0, memory_order_relaxed);
+	histogram_reset(&stats->loss_bursts);
+
+	stats->synced = false;
+
+}
+
+/**
+ * Get the packet arrival time in RTP clock units. */
+static uint32_t rtp_stats_arrival(unsigned int rtp_clockrate) {
+	struct timespec ts;
+	gettimestamp(&ts);
+	return (uint64_t)ts.tv_sec * rtp_clockrate +
+		(uint64_t)ts.tv_nsec * rtp_clockrate / 1000000000;
+}
+
+/**
+ * Update RTP receiver statistics with received RTP packet.
+ *
+ * Statistics are accumulated across stream restarts. A sequence number jump
+ * bigger than the allowed dropout or misorder window is treated as the start
+ * of a new stream and it is not accounted as a loss.
+ *
+ * @param stats The RTP receiver statistics structure.
+ * @param hdr The RTP header of received RTP packet.
+ * @param rtp_clockrate The clock rate of the RTP timestamp. */
+void rtp_stats_update(
+		struct rtp_stats *stats,
+		const rtp_header_t *hdr,
+		unsigned int rtp_clockrate) {
+
+	const uint16_t seq = be16toh(hdr->seq_number);
+	const uint32_t transit = rtp_stats_arrival(rtp_clockrate) - be32toh(hdr->timestamp);
+
+	if (!stats->synced)
+		goto sync;
+
+	const int16_t delta = seq - stats->seq_max;
+
+	if (delta > 0) {
+
+		if (delta > RTP_STATS_MAX_DROPOUT)
+			goto sync;
+
+		/* sequence number wrapped around */
+		if (seq < stats->seq_max)
+			stats->seq_cycles += 1 << 16;
+
+		stats->seq_max = seq;
+		stats->seq_window = delta < 64 ? stats->seq_window << delta | 1 : 1;
+
+		atomic_fetch_add_explicit(&stats->expected, delta, memory_order_relaxed);
+		atomic_fetch_add_explicit(&stats->received, 1, memory_order_relaxed);
+		atomic_store_explicit(&stats->seq_ext_max, stats->seq_cycles + seq, memory_order_relaxed);
+
+		if (delta > 1)
+			histogram_record(&stats->loss_bursts, delta - 1);
+
+	}
+	else if (delta == 0) {
+		atomic_fetch_add_explicit(&stats->duplicated, 1, memory_order_relaxed);
+		return;
+	}
+	else {
+
+		if (-delta > RTP_STATS_MAX_MISORDER)
+			goto sync;
+
+		/* Packets older than the window can not be checked for duplication,
+		 * so they are accounted as out-of-order ones. */
+		const uint64_t bit = -delta < 64 ? 1ULL << -delta : 0;
+		if (stats->seq_window & bit) {
+			atomic_fetch_add_explicit(&stats->duplicated, 1, memory_order_relaxed);
+			return;
+		}
+
+		stats->seq_window |= bit;
+		atomic_fetch_add_explicit(&stats->reordered, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&stats->received, 1, memory_order_relaxed);
+
+	}
+
+	/* Update interarrival jitter estimation using the algorithm from the
+	 * RFC 3550 appendix A.8. The jitter value is kept scaled by 16. */
+	uint32_t d = transit - stats->transit;
+	if ((int32_t)d < 0)
+		d = -d;
+
+	uint32_t jitter = atomic_load_explicit(&stats->jitter, memory_order_relaxed);
+	jitter += d - ((jitter + 8) >> 4);
+	atomic_store_explicit(&stats->jitter, jitter, memory_order_relaxed);
+
+	stats->transit = transit;
+	return;
+
+sync:
+	stats->synced = true;
+	stats->seq_cycles = 0;
+	stats->seq_max = seq;
+	stats->seq_window = 1;
+	stats->transit = transit;
+
+	atomic_fetch_add_explicit(&stats->expected, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stats->received, 1, memory_order_relaxed);
+	atomic_store_explicit(&stats->seq_ext_max, seq, memory_order_relaxed);
+	atomic_store_explicit(&stats->clockrate, rtp_clockrate, memory_order_relaxed);
+
+}
+
+/**
+ * Get RTP receiver statistics report.
+ *
+ * Reported values are cumulative, so this function does not modify the
+ * statistics. The report interval values are calculated against the prior
+ * report given by the caller, which allows every reader to keep its own
+ * report interval.
+ *
+ * @param stats The RTP receiver statistics structure.
+ * @param report The address where the report will be stored.
+ * @param prior The previous report of the caller. If NULL, or if the
+ *   statistics were reset since the prior report was taken, the interval
+ *   starts with the beginning of the statistics collection. */
+void rtp_stats_get_report(
+		struct rtp_stats *stats,
+		struct rtp_stats_report *report,
+		const struct rtp_stats_report *prior) {
+
+	/* the prior report might be stored in the same place as the new one */
+	const uint64_t expected_prior = prior != NULL ? prior->expected : 0;
+	const uint64_t received_prior = prior != NULL ? prior->received : 0;
+
+	report->received = atomic_load_explicit(&stats->received, memory_order_relaxed);
+	report->expected = atomic_load_explicit(&stats->expected, memory_order_relaxed);
+	report->duplicated = atomic_load_explicit(&stats->duplicated, memory_order_relaxed);
+	report->reordered = atomic_load_explicit(&stats->reordered, memory_order_relaxed);
+	report->seq_ext_max = atomic_load_explicit(&stats->seq_ext_max, memory_order_relaxed);
+	report->jitter = atomic_load_explicit(&stats->jitter, memory_order_relaxed) >> 4;
+	report->clockrate = atomic_load_explicit(&stats->clockrate, memory_order_relaxed);
+	report->lost = (int64_t)(report->expected - report->received);
+
+	/* statistics were reset since the prior report */
+	if (expected_prior > report->expected || received_prior > report->received) {
+		report->interval_expected = report->expected;
+		report->interval_lost = report->lost;
+		return;
+	}
+
+	report->interval_expected = report->expected - expected_prior;
+	report->interval_lost = (int64_t)report->interval_expected -
+		(int64_t)(report->received - received_prior);
+
+}
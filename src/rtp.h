@@ -17,9 +17,13 @@
 #endif
 
 #include <endian.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
+
+#include "shared/histogram.h"
 
 typedef struct rtp_header {
 #if __BYTE_ORDER == __LITTLE_ENDIAN
@@ -75,6 +79,7 @@ typedef struct rtp_mpeg_audio_header {
 
 void *rtp_a2dp_init(void *s, rtp_header_t **hdr, void **phdr, size_t phdr_size);
 void *rtp_a2dp_get_payload(const rtp_header_t *hdr);
+bool rtp_check_header_len(const rtp_header_t *hdr, size_t len);
 
 /* Structure for storing local state
  * of the ongoing RTP transmission. */
@@ -114,4 +119,175 @@ void rtp_state_update(
 		struct rtp_state *rtp,
 		unsigned int pcm_frames);
 
+/* Scatter-gather RTP packetizer. It splits the encoded payload into
+ * fragments which fit into the BT write MTU. Every packet is described by
+ * two IO vectors: RTP headers (the RTP header optionally followed by the
+ * payload header) and a slice of the payload. Hence, payload data is never
+ * moved after it has been written by the encoder. */
+struct rtp_packetizer {
+
+	/* IO vectors of the current packet */
+	struct iovec iov[2];
+
+	const uint8_t *payload;
+	size_t payload_len;
+	/* the maximal length of the payload slice */
+	size_t payload_len_max;
+	/* offset of the current payload slice */
+	size_t offset;
+
+};
+
+void rtp_packetizer_init(
+		struct rtp_packetizer *p,
+		const void *headers,
+		size_t headers_len,
+		const void *payload,
+		size_t payload_len,
+		size_t mtu);
+
+bool rtp_packetizer_next(
+		struct rtp_packetizer *p);
+
+/**
+ * Get the number of packets (including the current one) which are
+ * required to transfer the rest of the payload. */
+#define rtp_packetizer_remaining(p) \
+	(((p)->payload_len - (p)->offset + (p)->payload_len_max - 1) / (p)->payload_len_max)
+
+/**
+ * Check whether the current packet carries the first payload fragment. */
+#define rtp_packetizer_is_first(p) ((p)->offset == 0)
+
+/**
+ * Check whether the current packet carries the last payload fragment. */
+#define rtp_packetizer_is_last(p) \
+	((p)->offset + (p)->iov[1].iov_len == (p)->payload_len)
+
+/**
+ * The number of RTP packets which can be stored in the jitter buffer. */
+#define RTP_JITTER_BUFFER_SLOTS 64
+
+/* Structure for reordering incoming RTP packets and absorbing
+ * the network jitter before packets are passed to the decoder. */
+struct rtp_jitter_buffer {
+
+	/* storage for buffered packets */
+	uint8_t *data;
+	size_t mtu;
+	size_t len[RTP_JITTER_BUFFER_SLOTS];
+
+	/* If true, buffer was synced with incoming RTP packets. */
+	bool synced;
+
+	/* sequence number of the next packet to be released */
+	uint16_t seq_next;
+	/* sequence number and timestamp of the newest packet */
+	uint16_t seq_last;
+	uint32_t ts_last;
+
+	/* current, minimal and maximal buffering depth in RTP clock units */
+	unsigned int depth;
+	unsigned int depth_min;
+	unsigned int depth_max;
+	unsigned int depth_step;
+	/* timestamp of the last depth adjustment */
+	uint32_t ts_adjusted;
+	unsigned int rtp_clockrate;
+
+	/* the number of dropped late packets */
+	unsigned int late;
+	/* the number of packets which have never arrived */
+	unsigned int lost;
+
+};
+
+int rtp_jitter_buffer_init(
+		struct rtp_jitter_buffer *jb,
+		size_t mtu,
+		unsigned int rtp_clockrate,
+		unsigned int depth_max_ms);
+
+void rtp_jitter_buffer_free(
+		struct rtp_jitter_buffer *jb);
+
+void rtp_jitter_buffer_reset(
+		struct rtp_jitter_buffer *jb);
+
+int rtp_jitter_buffer_put(
+		struct rtp_jitter_buffer *jb,
+		const void *packet,
+		size_t len);
+
+const rtp_header_t *rtp_jitter_buffer_get(
+		struct rtp_jitter_buffer *jb,
+		size_t *len);
+
+/**
+ * Get the current jitter buffer depth in microseconds. */
+#define rtp_jitter_buffer_get_depth_usec(jb) \
+	((unsigned int)((uint64_t)(jb)->depth * 1000000 / (jb)->rtp_clockrate))
+
+/* Receiver statistics of the incoming RTP stream, as described in the
+ * RFC 3550 (section 6.4.1 and appendix A). Statistics are updated by the
+ * IO thread only, but they can be read by other threads at any time. */
+struct rtp_stats {
+
+	/* the number of expected and received packets */
+	_Atomic uint64_t expected;
+	_Atomic uint64_t received;
+	/* the number of duplicated and out-of-order packets */
+	_Atomic uint64_t duplicated;
+	_Atomic uint64_t reordered;
+	/* the extended highest sequence number received */
+	_Atomic uint32_t seq_ext_max;
+	/* interarrival jitter in RTP clock units scaled by 16 */
+	_Atomic uint32_t jitter;
+	_Atomic uint32_t clockrate;
+	/* lengths of lost packet bursts */
+	struct histogram loss_bursts;
+
+	/* If true, stats were synced with incoming RTP packets. */
+	bool synced;
+	/* sequence number cycles shifted by 16 bits */
+	uint32_t seq_cycles;
+	uint16_t seq_max;
+	/* bitmap of received packets preceding the highest one */
+	uint64_t seq_window;
+	/* relative transit time of the previous packet */
+	uint32_t transit;
+
+};
+
+/**
+ * Snapshot of the RTP receiver statistics. */
+struct rtp_stats_report {
+	uint64_t expected;
+	uint64_t received;
+	/* cumulative number of lost packets */
+	int64_t lost;
+	/* the number of expected and lost packets since the prior report */
+	uint64_t interval_expected;
+	int64_t interval_lost;
+	uint64_t duplicated;
+	uint64_t reordered;
+	uint32_t seq_ext_max;
+	/* interarrival jitter in RTP clock units */
+	uint32_t jitter;
+	uint32_t clockrate;
+};
+
+void rtp_stats_reset(
+		struct rtp_stats *stats);
+
+void rtp_stats_update(
+		struct rtp_stats *stats,
+		const rtp_header_t *hdr,
+		unsigned int rtp_clockrate);
+
+void rtp_stats_get_report(
+		struct rtp_stats *stats,
+		struct rtp_stats_report *report,
+		const struct rtp_stats_report *prior);
+
 #endif
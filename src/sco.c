@@ -20,7 +20,9 @@
 #include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <unistd.h>
 
@@ -42,9 +44,11 @@
 #include "hci.h"
 #include "hfp.h"
 #include "io.h"
+#include "io-engine.h"
 #include "shared/bluetooth.h"
 #include "shared/defs.h"
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 #include "shared/log.h"
 #include "shared/rt.h"
 
@@ -55,6 +59,105 @@ struct sco_data {
 	struct pollfd pfd;
 };
 
+/**
+ * Open SCO listening socket for the given adapter. */
+static int sco_dispatcher_open(struct ba_adapter *a) {
+
+	int fd;
+	if ((fd = hci_sco_open(a->hci.dev_id)) == -1) {
+		error("Couldn't open SCO socket: %s", strerror(errno));
+		return -1;
+	}
+
+#if ENABLE_MSBC
+	uint32_t defer = 1;
+	if (setsockopt(fd, SOL_BLUETOOTH, BT_DEFER_SETUP, &defer, sizeof(defer)) == -1) {
+		error("Couldn't set deferred connection setup: %s", strerror(errno));
+		goto fail;
+	}
+#endif
+
+	if (listen(fd, 10) == -1) {
+		error("Couldn't listen on SCO socket: %s", strerror(errno));
+		goto fail;
+	}
+
+	return fd;
+
+fail:
+	close(fd);
+	return -1;
+}
+
+/**
+ * Accept incoming SCO link and start associated transport. */
+static void sco_dispatcher_accept(struct ba_adapter *a, int listen_fd) {
+
+	struct sockaddr_sco addr;
+	socklen_t addrlen = sizeof(addr);
+	struct ba_device *d = NULL;
+	struct ba_transport *t = NULL;
+	char addrstr[18];
+	int fd = -1;
+
+	if ((fd = accept(listen_fd, (struct sockaddr *)&addr, &addrlen)) == -1) {
+		error("Couldn't accept incoming SCO link: %s", strerror(errno));
+		goto cleanup;
+	}
+
+	ba2str(&addr.sco_bdaddr, addrstr);
+	debug("New incoming SCO link: %s: %d", addrstr, fd);
+
+	if ((d = ba_device_lookup(a, &addr.sco_bdaddr)) == NULL) {
+		error("Couldn't lookup device: %s", addrstr);
+		goto cleanup;
+	}
+
+	if ((t = ba_transport_lookup(d, d->bluez_dbus_path)) == NULL) {
+		error("Couldn't lookup transport: %s", d->bluez_dbus_path);
+		goto cleanup;
+	}
+
+#if ENABLE_MSBC
+	struct bt_voice voice = { .setting = BT_VOICE_TRANSPARENT };
+	if (ba_transport_get_codec(t) == HFP_CODEC_MSBC &&
+			setsockopt(fd, SOL_BLUETOOTH, BT_VOICE, &voice, sizeof(voice)) == -1) {
+		error("Couldn't setup transparent voice: %s", strerror(errno));
+		goto cleanup;
+	}
+	/* Authorize deferred connection setup. For a deferred socket the kernel
+	 * returns right away, however, if the setup was not deferred, plain read
+	 * would block until SCO data arrives - stalling the IO engine worker. */
+	if (recv(fd, &voice, 1, MSG_DONTWAIT) == -1 && errno != EAGAIN) {
+		error("Couldn't authorize SCO connection: %s", strerror(errno));
+		goto cleanup;
+	}
+#endif
+
+	ba_transport_stop(t);
+
+	pthread_mutex_lock(&t->bt_fd_mtx);
+
+	t->bt_fd = fd;
+	t->mtu_read = t->mtu_write = hci_sco_get_mtu(fd, a);
+	fd = -1;
+
+	pthread_mutex_unlock(&t->bt_fd_mtx);
+
+	ba_transport_thread_state_set_idle(&t->thread_enc);
+	ba_transport_thread_state_set_idle(&t->thread_dec);
+	ba_transport_start(t);
+
+cleanup:
+	if (d != NULL)
+		ba_device_unref(d);
+	if (t != NULL)
+		ba_transport_unref(t);
+	if (fd != -1)
+		close(fd);
+
+}
+
 static void sco_dispatcher_cleanup(struct sco_data *data) {
 	debug("SCO dispatcher cleanup: %s", data->a->hci.name);
 	if (data->pfd.fd != -1)
@@ -74,23 +177,8 @@ static void *sco_dispatcher_thread(struct ba_adapter *a) {
 	sigfillset(&sigset);
 	pthread_sigmask(SIG_SETMASK, &sigset, NULL);
 
-	if ((data.pfd.fd = hci_sco_open(data.a->hci.dev_id)) == -1) {
-		error("Couldn't open SCO socket: %s", strerror(errno));
-		goto fail;
-	}
-
-#if ENABLE_MSBC
-	uint32_t defer = 1;
-	if (setsockopt(data.pfd.fd, SOL_BLUETOOTH, BT_DEFER_SETUP, &defer, sizeof(defer)) == -1) {
-		error("Couldn't set deferred connection setup: %s", strerror(errno));
-		goto fail;
-	}
-#endif
-
-	if (listen(data.pfd.fd, 10) == -1) {
-		error("Couldn't listen on SCO socket: %s", strerror(errno));
+	if ((data.pfd.fd = sco_dispatcher_open(data.a)) == -1)
 		goto fail;
-	}
 
 	debug("Starting SCO dispatcher loop: %s", a->hci.name);
 	for (;;) {
@@ -106,65 +194,7 @@ static void *sco_dispatcher_thread(struct ba_adapter *a) {
 			goto fail;
 		}
 
-		struct sockaddr_sco addr;
-		socklen_t addrlen = sizeof(addr);
-		struct ba_device *d = NULL;
-		struct ba_transport *t = NULL;
-		char addrstr[18];
-		int fd = -1;
-
-		if ((fd = accept(data.pfd.fd, (struct sockaddr *)&addr, &addrlen)) == -1) {
-			error("Couldn't accept incoming SCO link: %s", strerror(errno));
-			goto cleanup;
-		}
-
-		ba2str(&addr.sco_bdaddr, addrstr);
-		debug("New incoming SCO link: %s: %d", addrstr, fd);
-
-		if ((d = ba_device_lookup(data.a, &addr.sco_bdaddr)) == NULL) {
-			error("Couldn't lookup device: %s", addrstr);
-			goto cleanup;
-		}
-
-		if ((t = ba_transport_lookup(d, d->bluez_dbus_path)) == NULL) {
-			error("Couldn't lookup transport: %s", d->bluez_dbus_path);
-			goto cleanup;
-		}
-
-#if ENABLE_MSBC
-		struct bt_voice voice = { .setting = BT_VOICE_TRANSPARENT };
-		if (ba_transport_get_codec(t) == HFP_CODEC_MSBC &&
-				setsockopt(fd, SOL_BLUETOOTH, BT_VOICE, &voice, sizeof(voice)) == -1) {
-			error("Couldn't setup transparent voice: %s", strerror(errno));
-			goto cleanup;
-		}
-		if (read(fd, &voice, 1) == -1) {
-			error("Couldn't authorize SCO connection: %s", strerror(errno));
-			goto cleanup;
-		}
-#endif
-
-		ba_transport_stop(t);
-
-		pthread_mutex_lock(&t->bt_fd_mtx);
-
-		t->bt_fd = fd;
-		t->mtu_read = t->mtu_write = hci_sco_get_mtu(fd, a);
-		fd = -1;
-
-		pthread_mutex_unlock(&t->bt_fd_mtx);
-
-		ba_transport_thread_state_set_idle(&t->thread_enc);
-		ba_transport_thread_state_set_idle(&t->thread_dec);
-		ba_transport_start(t);
-
-cleanup:
-		if (d != NULL)
-			ba_device_unref(d);
-		if (t != NULL)
-			ba_transport_unref(t);
-		if (fd != -1)
-			close(fd);
+		sco_dispatcher_accept(a, data.pfd.fd);
 
 	}
 
@@ -173,10 +203,18 @@ fail:
 	return NULL;
 }
 
+/**
+ * SCO dispatcher handler for the IO engine mode. */
+static void sco_dispatcher_callback(int fd, uint32_t events, void *userdata) {
+	(void)events;
+	sco_dispatcher_accept(userdata, fd);
+}
+
 int sco_setup_connection_dispatcher(struct ba_adapter *a) {
 
-	/* skip setup if dispatcher thread is already running */
-	if (!pthread_equal(a->sco_dispatcher, config.main_thread))
+	/* skip setup if dispatcher is already running */
+	if (!pthread_equal(a->sco_dispatcher, config.main_thread) ||
+			a->sco_dispatcher_source != -1)
 		return 0;
 
 	/* XXX: It is a known issue with Broadcom chips, that by default, the SCO
@@ -207,6 +245,28 @@ int sco_setup_connection_dispatcher(struct ba_adapter *a) {
 
 	}
 
+	/* In the IO engine mode, incoming SCO links are dispatched by the IO
+	 * engine worker. Similarly to the dispatcher thread, the adapter is not
+	 * referenced, because the engine source is removed in the adapter
+	 * cleanup routine. */
+	if (config.io_engine_workers > 0) {
+
+		int fd;
+		if ((fd = sco_dispatcher_open(a)) == -1)
+			return -1;
+
+		if ((a->sco_dispatcher_source = io_engine_add(fd, EPOLLIN,
+						sco_dispatcher_callback, a)) == -1) {
+			error("Couldn't add SCO dispatcher: %s", strerror(errno));
+			close(fd);
+			return -1;
+		}
+
+		a->sco_dispatcher_fd = fd;
+		debug("Created SCO dispatcher [%s]: %s", "io-engine", a->hci.name);
+		return 0;
+	}
+
 	int ret;
 
 	/* Please note, that during the SCO dispatcher thread creation the adapter
@@ -238,11 +298,11 @@ static void *sco_cvsd_enc_thread(struct ba_transport_pcm *t_pcm) {
 	const size_t mtu_samples = t->mtu_write / sizeof(int16_t);
 	const size_t mtu_write = t->mtu_write;
 
-	ffb_t buffer = { 0 };
-	pthread_cleanup_push(PTHREAD_CLEANUP(ffb_free), &buffer);
+	ffrb_t buffer = { 0 };
+	pthread_cleanup_push(PTHREAD_CLEANUP(ffrb_free), &buffer);
 
 	/* define a bigger buffer to enhance read performance */
-	if (ffb_init_int16_t(&buffer, mtu_samples * 4) == -1) {
+	if (ffrb_init_int16_t(&buffer, mtu_samples * 4) == -1) {
 		error("Couldn't create data buffer: %s", strerror(errno));
 		goto fail_init;
 	}
@@ -250,11 +310,11 @@ static void *sco_cvsd_enc_thread(struct ba_transport_pcm *t_pcm) {
 	debug_transport_pcm_thread_loop(t_pcm, "START");
 	for (ba_transport_thread_state_set_running(th);;) {
 
-		ssize_t samples = ffb_len_in(&buffer);
-		switch (samples = io_poll_and_read_pcm(&io, t_pcm, buffer.tail, samples)) {
+		ssize_t samples = ffrb_len_in(&buffer);
+		switch (samples = io_poll_and_read_pcm(&io, t_pcm, ffrb_tail(&buffer), samples)) {
 		case -1:
 			if (errno == ESTALE) {
-				ffb_rewind(&buffer);
+				ffrb_rewind(&buffer);
 				continue;
 			}
 			error("PCM poll and read error: %s", strerror(errno));
@@ -264,10 +324,10 @@ static void *sco_cvsd_enc_thread(struct ba_transport_pcm *t_pcm) {
 			continue;
 		}
 
-		ffb_seek(&buffer, samples);
-		samples = ffb_len_out(&buffer);
+		ffrb_seek(&buffer, samples);
+		samples = ffrb_len_out(&buffer);
 
-		const int16_t *input = buffer.data;
+		const int16_t *input = ffrb_head(&buffer);
 		size_t input_samples = samples;
 
 		while (input_samples >= mtu_samples) {
@@ -283,13 +343,13 @@ static void *sco_cvsd_enc_thread(struct ba_transport_pcm *t_pcm) {
 			input_samples -= mtu_samples;
 
 			/* keep data transfer at a constant bit rate */
-			asrsync_sync(&io.asrs, mtu_samples);
+			io_asrsync_sync(&io, t_pcm, mtu_samples);
 			/* update busy delay (encoding overhead) */
 			t_pcm->delay = asrsync_get_busy_usec(&io.asrs) / 100;
 
 		}
 
-		ffb_shift(&buffer, samples - input_samples);
+		ffrb_shift(&buffer, samples - input_samples);
 
 	}
 
@@ -365,6 +425,58 @@ fail_ffb:
 	return NULL;
 }
 
+#if ENABLE_MSBC
+struct sco_msbc_ctx {
+	struct ba_transport *t;
+	bool encoder;
+	struct esco_msbc *msbc;
+};
+
+static void sco_msbc_handle_free(void *msbc) {
+	msbc_finish(msbc);
+	free(msbc);
+}
+
+/**
+ * Initialize mSBC codec.
+ *
+ * If there is a cached codec of the previous stream, its buffers and the
+ * PLC state are reused and only the codec state is reset. */
+static int sco_msbc_ctx_init(struct sco_msbc_ctx *ctx, struct ba_transport *t,
+		bool encoder, struct esco_msbc *msbc) {
+
+	ctx->t = t;
+	ctx->encoder = encoder;
+	ctx->msbc = msbc;
+
+	struct esco_msbc *cached;
+	if ((cached = ba_device_codec_cache_take(t->d, t->profile, HFP_CODEC_MSBC,
+					encoder, NULL, 0)) != NULL) {
+		*msbc = *cached;
+		free(cached);
+	}
+
+	return msbc_init(msbc);
+}
+
+/**
+ * Move mSBC codec to the device codec cache. */
+static void sco_msbc_ctx_release(struct sco_msbc_ctx *ctx) {
+
+	struct esco_msbc *msbc;
+	if (!ctx->msbc->initialized ||
+			(msbc = malloc(sizeof(*msbc))) == NULL) {
+		msbc_finish(ctx->msbc);
+		return;
+	}
+
+	*msbc = *ctx->msbc;
+	ba_device_codec_cache_store(ctx->t->d, ctx->t->profile, HFP_CODEC_MSBC,
+			ctx->encoder, NULL, 0, msbc, sco_msbc_handle_free);
+
+}
+#endif
+
 #if ENABLE_MSBC
 static void *sco_msbc_enc_thread(struct ba_transport_pcm *t_pcm) {
 
@@ -377,9 +489,10 @@ static void *sco_msbc_enc_thread(struct ba_transport_pcm *t_pcm) {
 	const size_t mtu_write = t->mtu_write;
 
 	struct esco_msbc msbc = { .initialized = false };
-	pthread_cleanup_push(PTHREAD_CLEANUP(msbc_finish), &msbc);
+	struct sco_msbc_ctx ctx;
+	pthread_cleanup_push(PTHREAD_CLEANUP(sco_msbc_ctx_release), &ctx);
 
-	if (msbc_init(&msbc) != 0) {
+	if (sco_msbc_ctx_init(&ctx, t, true, &msbc) != 0) {
 		error("Couldn't initialize mSBC codec: %s", strerror(errno));
 		goto fail_msbc;
 	}
@@ -387,8 +500,8 @@ static void *sco_msbc_enc_thread(struct ba_transport_pcm *t_pcm) {
 	debug_transport_pcm_thread_loop(t_pcm, "START");
 	for (ba_transport_thread_state_set_running(th);;) {
 
-		ssize_t samples = ffb_len_in(&msbc.pcm);
-		switch (samples = io_poll_and_read_pcm(&io, t_pcm, msbc.pcm.tail, samples)) {
+		ssize_t samples = ffrb_len_in(&msbc.pcm);
+		switch (samples = io_poll_and_read_pcm(&io, t_pcm, ffrb_tail(&msbc.pcm), samples)) {
 		case -1:
 			if (errno == ESTALE) {
 				/* reinitialize mSBC encoder */
@@ -402,9 +515,9 @@ static void *sco_msbc_enc_thread(struct ba_transport_pcm *t_pcm) {
 			continue;
 		}
 
-		ffb_seek(&msbc.pcm, samples);
+		ffrb_seek(&msbc.pcm, samples);
 
-		while (ffb_len_out(&msbc.pcm) >= MSBC_CODESAMPLES) {
+		while (ffrb_len_out(&msbc.pcm) >= MSBC_CODESAMPLES) {
 
 			int err;
 			if ((err = msbc_encode(&msbc)) < 0) {
@@ -430,7 +543,7 @@ static void *sco_msbc_enc_thread(struct ba_transport_pcm *t_pcm) {
 			}
 
 			/* keep data transfer at a constant bit rate */
-			asrsync_sync(&io.asrs, msbc.frames * MSBC_CODESAMPLES);
+			io_asrsync_sync(&io, t_pcm, msbc.frames * MSBC_CODESAMPLES);
 			/* update busy delay (encoding overhead) */
 			t_pcm->delay = asrsync_get_busy_usec(&io.asrs) / 100;
 
@@ -463,9 +576,10 @@ static void *sco_msbc_dec_thread(struct ba_transport_pcm *t_pcm) {
 	struct io_poll io = { .timeout = -1 };
 
 	struct esco_msbc msbc = { .initialized = false };
-	pthread_cleanup_push(PTHREAD_CLEANUP(msbc_finish), &msbc);
+	struct sco_msbc_ctx ctx;
+	pthread_cleanup_push(PTHREAD_CLEANUP(sco_msbc_ctx_release), &ctx);
 
-	if (msbc_init(&msbc) != 0) {
+	if (sco_msbc_ctx_init(&ctx, t, false, &msbc) != 0) {
 		error("Couldn't initialize mSBC codec: %s", strerror(errno));
 		goto fail_msbc;
 	}
@@ -497,16 +611,16 @@ static void *sco_msbc_dec_thread(struct ba_transport_pcm *t_pcm) {
 		}
 
 		ssize_t samples;
-		if ((samples = ffb_len_out(&msbc.pcm)) <= 0)
+		if ((samples = ffrb_len_out(&msbc.pcm)) <= 0)
 			continue;
 
-		io_pcm_scale(t_pcm, msbc.pcm.data, samples);
-		if ((samples = io_pcm_write(t_pcm, msbc.pcm.data, samples)) == -1)
+		io_pcm_scale(t_pcm, ffrb_head(&msbc.pcm), samples);
+		if ((samples = io_pcm_write(t_pcm, ffrb_head(&msbc.pcm), samples)) == -1)
 			error("FIFO write error: %s", strerror(errno));
 		else if (samples == 0)
 			ba_transport_stop_if_no_clients(t);
 
-		ffb_shift(&msbc.pcm, samples);
+		ffrb_shift(&msbc.pcm, samples);
 
 	}
 
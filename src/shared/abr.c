@@ -0,0 +1,108 @@
+/*
+ * BlueALSA - abr.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "shared/abr.h"
+
+#include <string.h>
+
+/**
+ * Initialize adaptive bitrate controller.
+ *
+ * By default, the controller is initialized with thresholds which will
+ * never trigger any change. Use the abr_set_thresholds() function to
+ * enable the adaptation.
+ *
+ * @param abr Pointer to the controller structure.
+ * @param value_min The minimal value of the controlled parameter.
+ * @param value_max The maximal value of the controlled parameter.
+ * @param value The initial value, it is clamped to the given range. */
+void abr_init(struct abr *abr, unsigned int value_min,
+		unsigned int value_max, unsigned int value) {
+
+	if (value_max < value_min)
+		value_max = value_min;
+	if (value < value_min)
+		value = value_min;
+	if (value > value_max)
+		value = value_max;
+
+	memset(abr, 0, sizeof(*abr));
+	abr->value = value;
+	abr->value_min = value_min;
+	abr->value_max = value_max;
+
+	abr->step = (value_max - value_min + ABR_STEPS - 1) / ABR_STEPS;
+	if (abr->step == 0)
+		abr->step = 1;
+
+	abr->queue_high = ~0U;
+
+}
+
+/**
+ * Set the queue level thresholds.
+ *
+ * @param abr Pointer to the controller structure.
+ * @param queue_low The queue level (in packets) at or below which the
+ *   link is considered to have a spare capacity.
+ * @param queue_high The queue level (in packets) at or above which the
+ *   link is considered congested.
+ * @param recovery_frames The number of frames for which the queue level
+ *   has to stay at or below the low threshold before the value is increased.
+ *   One eighth of this period is used as a back-off time between two
+ *   consecutive decreases. */
+void abr_set_thresholds(struct abr *abr, unsigned int queue_low,
+		unsigned int queue_high, unsigned int recovery_frames) {
+	abr->queue_low = queue_low;
+	abr->queue_high = queue_high;
+	abr->recovery_frames = recovery_frames;
+	abr->backoff_frames = recovery_frames / 8;
+}
+
+/**
+ * Update controller with the current queue level.
+ *
+ * @param abr Pointer to the controller structure.
+ * @param queued The number of packets queued for transmission.
+ * @param frames The number of PCM frames transferred since the last update.
+ * @return This function returns true if the value of the controlled
+ *   parameter has been changed, otherwise false. */
+bool abr_update(struct abr *abr, unsigned int queued, unsigned int frames) {
+
+	/* saturate the counter, it is compared with the back-off time only */
+	if (abr->frames_changed < abr->backoff_frames)
+		abr->frames_changed += frames;
+
+	if (queued >= abr->queue_high) {
+		abr->frames_low = 0;
+		if (abr->value == abr->value_min ||
+				abr->frames_changed < abr->backoff_frames)
+			return false;
+		abr->value = abr->value - abr->value_min > abr->step ?
+			abr->value - abr->step : abr->value_min;
+		abr->frames_changed = 0;
+		return true;
+	}
+
+	if (queued > abr->queue_low) {
+		abr->frames_low = 0;
+		return false;
+	}
+
+	if (abr->value == abr->value_max ||
+			(abr->frames_low += frames) < abr->recovery_frames)
+		return false;
+
+	abr->value = abr->value_max - abr->value > abr->step ?
+		abr->value + abr->step : abr->value_max;
+	abr->frames_low = 0;
+	abr->frames_changed = 0;
+	return true;
+}
@@ -0,0 +1,71 @@
+/*
+ * BlueALSA - abr.h
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#pragma once
+#ifndef BLUEALSA_SHARED_ABR_H_
+#define BLUEALSA_SHARED_ABR_H_
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdbool.h>
+
+/**
+ * Number of steps between the minimal and the maximal value of the
+ * controlled parameter. */
+#define ABR_STEPS 8
+
+/**
+ * Adaptive bitrate controller.
+ *
+ * The controller shall be fed with the number of packets queued in the
+ * BT socket. When the queue reaches the high threshold, the controlled
+ * parameter (e.g. the SBC bit-pool or the AAC bitrate) is decreased by
+ * one step. When the queue stays at or below the low threshold for the
+ * recovery period, the parameter is increased by one step. Both directions
+ * are rate-limited, so the queue has a chance to settle after every change.
+ *
+ * All time periods are measured in PCM frames, so the controller does not
+ * depend on the system clock. */
+struct abr {
+
+	/* current value of the controlled parameter */
+	unsigned int value;
+	/* range of the controlled parameter */
+	unsigned int value_min;
+	unsigned int value_max;
+	/* single adjustment step */
+	unsigned int step;
+
+	/* queue level thresholds in packets */
+	unsigned int queue_low;
+	unsigned int queue_high;
+
+	/* number of frames with the low queue level required for increase */
+	unsigned int recovery_frames;
+	/* number of frames which have to pass between two decreases */
+	unsigned int backoff_frames;
+
+	/* frames accounted with the queue level at or below low threshold */
+	unsigned int frames_low;
+	/* frames accounted since the last change */
+	unsigned int frames_changed;
+
+};
+
+void abr_init(struct abr *abr, unsigned int value_min,
+		unsigned int value_max, unsigned int value);
+void abr_set_thresholds(struct abr *abr, unsigned int queue_low,
+		unsigned int queue_high, unsigned int recovery_frames);
+
+bool abr_update(struct abr *abr, unsigned int queued, unsigned int frames);
+
+#endif
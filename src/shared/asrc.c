@@ -0,0 +1,209 @@
+/*
+ * BlueALSA - asrc.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "shared/asrc.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shared/rt.h"
+
+/**
+ * Initialize asynchronous sample rate converter.
+ *
+ * @param asrc Pointer to the converter structure.
+ * @param channels Number of interleaved channels.
+ * @param width The sample bit width - 16, 24 or 32. Samples wider than
+ *   16 bits shall be stored in 4 bytes.
+ * @param capacity The number of input frames which can be buffered.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int asrc_init(struct asrc *asrc, unsigned int channels,
+		unsigned int width, size_t capacity) {
+
+	if (channels == 0 || (width != 16 && width != 24 && width != 32))
+		return errno = EINVAL, -1;
+
+	const size_t sample_size = width == 16 ? sizeof(int16_t) : sizeof(int32_t);
+
+	/* account for frames required by the interpolation */
+	capacity += 3;
+
+	void *data;
+	if ((data = malloc(capacity * channels * sample_size)) == NULL)
+		return -1;
+
+	free(asrc->data);
+	memset(asrc, 0, sizeof(*asrc));
+
+	asrc->channels = channels;
+	asrc->sample_size = sample_size;
+	asrc->sample_min = -ldexp(1, width - 1);
+	asrc->sample_max = ldexp(1, width - 1) - 1;
+	asrc->data = data;
+	asrc->capacity = capacity;
+	asrc->ratio = 1.0;
+	asrc_reset(asrc);
+
+	return 0;
+}
+
+/**
+ * Free resources allocated with the asrc_init(). */
+void asrc_free(struct asrc *asrc) {
+	free(asrc->data);
+	asrc->data = NULL;
+}
+
+/**
+ * Discard all buffered input frames.
+ *
+ * The state of the controller is preserved, since the clock drift does not
+ * depend on the transferred data. */
+void asrc_reset(struct asrc *asrc) {
+	asrc->len = 0;
+	/* The first frame is used as the history for the interpolation. */
+	asrc->pos = 1.0;
+	asrc->frames_carry = 0;
+}
+
+/**
+ * Set the target queue level for the controller. */
+void asrc_set_target(struct asrc *asrc, double level) {
+	asrc->ctrl.target = level;
+	asrc->ctrl.level = level;
+	asrc->ctrl.integral = 0;
+	asrc->ctrl.ts.tv_sec = 0;
+	asrc->ctrl.ts.tv_nsec = 0;
+}
+
+/**
+ * Update the conversion ratio based on the current queue level.
+ *
+ * If the queue level is above the target, the remote sink consumes frames
+ * slower than we produce them, so the ratio is decreased. Otherwise, the
+ * ratio is increased.
+ *
+ * @param asrc Pointer to the converter structure.
+ * @param level Current level of the controlled queue.
+ * @return This function returns the updated conversion ratio. */
+double asrc_control(struct asrc *asrc, double level) {
+
+	struct timespec ts_now, ts_diff;
+	gettimestamp(&ts_now);
+
+	if (asrc->ctrl.target <= 0)
+		return asrc->ratio;
+
+	if (asrc->ctrl.ts.tv_sec == 0 && asrc->ctrl.ts.tv_nsec == 0) {
+		asrc->ctrl.ts = ts_now;
+		return asrc->ratio;
+	}
+
+	timespecsub(&ts_now, &asrc->ctrl.ts, &ts_diff);
+	const double dt = ts_diff.tv_sec + ts_diff.tv_nsec / 1e9;
+	asrc->ctrl.ts = ts_now;
+
+	/* smooth out the queue level, which changes with the packet granularity */
+	asrc->ctrl.level += (level - asrc->ctrl.level) * dt / (dt + ASRC_LEVEL_TAU_MS / 1e3);
+
+	const double error = (asrc->ctrl.level - asrc->ctrl.target) / asrc->ctrl.target;
+	asrc->ctrl.integral += error * dt;
+
+	/* anti-windup: integral term alone shall not exceed the ratio limit */
+	const double integral_max = (double)ASRC_MAX_PPM / ASRC_KI_PPM;
+	asrc->ctrl.integral = fmax(-integral_max, fmin(integral_max, asrc->ctrl.integral));
+
+	double ppm = ASRC_KP_PPM * error + ASRC_KI_PPM * asrc->ctrl.integral;
+	ppm = fmax(-ASRC_MAX_PPM, fmin(ASRC_MAX_PPM, ppm));
+
+	return asrc->ratio = 1.0 - ppm / 1e6;
+}
+
+/**
+ * Cubic Hermite (Catmull-Rom) interpolation between y0 and y1. */
+static double asrc_cubic(double ym1, double y0, double y1, double y2, double t) {
+	const double c1 = 0.5 * (y1 - ym1);
+	const double c2 = ym1 - 2.5 * y0 + 2.0 * y1 - 0.5 * y2;
+	const double c3 = 0.5 * (y2 - ym1) + 1.5 * (y0 - y1);
+	return ((c3 * t + c2) * t + c1) * t + y0;
+}
+
+/**
+ * Convert buffered input frames.
+ *
+ * @param asrc Pointer to the converter structure.
+ * @param buffer Address of the output buffer.
+ * @param frames The number of frames which can be stored in the buffer.
+ * @return This function returns the number of converted frames. */
+size_t asrc_process(struct asrc *asrc, void *buffer, size_t frames) {
+
+	const unsigned int channels = asrc->channels;
+	const double step = 1.0 / asrc->ratio;
+	size_t n;
+
+	for (n = 0; n < frames; n++) {
+
+		const size_t i = asrc->pos;
+		if (i + 2 >= asrc->len)
+			break;
+
+		const double t = asrc->pos - i;
+		for (size_t ch = 0; ch < channels; ch++) {
+			const size_t x = i * channels + ch;
+			if (asrc->sample_size == sizeof(int16_t)) {
+				const int16_t *in = asrc->data;
+				double v = asrc_cubic(in[x - channels], in[x],
+						in[x + channels], in[x + 2 * channels], t);
+				((int16_t *)buffer)[n * channels + ch] =
+					lrint(fmax(asrc->sample_min, fmin(asrc->sample_max, v)));
+			}
+			else {
+				const int32_t *in = asrc->data;
+				double v = asrc_cubic(in[x - channels], in[x],
+						in[x + channels], in[x + 2 * channels], t);
+				((int32_t *)buffer)[n * channels + ch] =
+					llrint(fmax(asrc->sample_min, fmin(asrc->sample_max, v)));
+			}
+		}
+
+		asrc->pos += step;
+
+	}
+
+	/* Drop consumed frames, but keep one frame as the interpolation history.
+	 * The read position is always at least one frame ahead of the buffer
+	 * beginning, so this operation is safe. */
+	const size_t shift = (size_t)asrc->pos - 1;
+	if (shift > 0) {
+		const size_t frame_size = channels * asrc->sample_size;
+		memmove(asrc->data, (uint8_t *)asrc->data + shift * frame_size,
+				(asrc->len - shift) * frame_size);
+		asrc->len -= shift;
+		asrc->pos -= shift;
+	}
+
+	return n;
+}
+
+/**
+ * Convert the number of output frames into the number of input frames.
+ *
+ * This function shall be used to pace the transfer of converted frames
+ * with the input clock. The fractional part of the conversion is carried
+ * over to the next call, so no frames are lost in the long run. */
+unsigned int asrc_input_frames(struct asrc *asrc, unsigned int frames) {
+	const double input = frames / asrc->ratio + asrc->frames_carry;
+	const unsigned int n = input;
+	asrc->frames_carry = input - n;
+	return n;
+}
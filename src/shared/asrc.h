@@ -0,0 +1,107 @@
+/*
+ * BlueALSA - asrc.h
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#pragma once
+#ifndef BLUEALSA_SHARED_ASRC_H_
+#define BLUEALSA_SHARED_ASRC_H_
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Maximal deviation of the conversion ratio from unity in PPM. Crystal
+ * oscillators used in Bluetooth devices are usually specified with the
+ * tolerance of +/-20 PPM, so this value leaves plenty of headroom. */
+#define ASRC_MAX_PPM 1000
+/**
+ * Proportional gain of the controller in PPM per unit of the normalized
+ * queue level error. */
+#define ASRC_KP_PPM 100
+/**
+ * Integral gain of the controller in PPM per unit of the normalized queue
+ * level error integrated over one second. */
+#define ASRC_KI_PPM 10
+/**
+ * Time constant of the queue level low-pass filter in milliseconds. */
+#define ASRC_LEVEL_TAU_MS 500
+
+/**
+ * Asynchronous sample rate converter.
+ *
+ * The converter is a FIFO-like buffer of interleaved PCM frames with the
+ * cubic interpolation applied on the output side. The conversion ratio is
+ * adjusted by the PI controller, which shall be fed with the level of the
+ * queue to be kept at the given target (e.g. the number of bytes queued in
+ * the BT socket). This way the clock drift between the PCM source and the
+ * remote sink can be compensated without any audible artifacts. */
+struct asrc {
+
+	/* number of channels */
+	unsigned int channels;
+	/* size of a single sample in bytes: 2 or 4 */
+	size_t sample_size;
+	/* range of valid sample values */
+	double sample_min;
+	double sample_max;
+
+	/* buffered input frames */
+	void *data;
+	/* capacity and length of the buffer in frames */
+	size_t capacity;
+	size_t len;
+
+	/* read position within the buffer in frames */
+	double pos;
+	/* output to input frame rate ratio */
+	double ratio;
+	/* fractional part of the frame count conversion */
+	double frames_carry;
+
+	struct {
+		/* target queue level */
+		double target;
+		/* low-pass filtered queue level */
+		double level;
+		/* integrated normalized level error */
+		double integral;
+		/* time-stamp of the last update */
+		struct timespec ts;
+	} ctrl;
+
+};
+
+int asrc_init(struct asrc *asrc, unsigned int channels,
+		unsigned int width, size_t capacity);
+void asrc_free(struct asrc *asrc);
+void asrc_reset(struct asrc *asrc);
+
+void asrc_set_target(struct asrc *asrc, double level);
+double asrc_control(struct asrc *asrc, double level);
+
+size_t asrc_process(struct asrc *asrc, void *buffer, size_t frames);
+unsigned int asrc_input_frames(struct asrc *asrc, unsigned int frames);
+
+/**
+ * Get the pointer to the region available for writing input frames. */
+#define asrc_tail(a) ((void *)((uint8_t *)(a)->data + \
+			(a)->len * (a)->channels * (a)->sample_size))
+/**
+ * Get the number of input frames which can be written. */
+#define asrc_space(a) ((a)->capacity - (a)->len)
+/**
+ * Commit the given number of input frames written at the tail. */
+#define asrc_seek(a, n) ((a)->len += (n))
+
+#endif
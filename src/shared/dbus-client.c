@@ -409,6 +409,114 @@ void bluealsa_dbus_props_free(
 	}
 }
 
+/**
+ * Get BlueALSA service trace records. */
+dbus_bool_t bluealsa_dbus_get_trace(
+		struct ba_dbus_ctx *ctx,
+		struct ba_trace *trace,
+		DBusError *error) {
+
+	DBusMessage *msg = NULL, *rep = NULL;
+	dbus_bool_t rv = FALSE;
+
+	trace->records = NULL;
+	trace->records_len = 0;
+
+	if ((msg = dbus_message_new_method_call(ctx->ba_service, "/org/bluealsa",
+					BLUEALSA_INTERFACE_MANAGER, "GetTrace")) == NULL) {
+		dbus_set_error(error, DBUS_ERROR_NO_MEMORY, NULL);
+		goto fail;
+	}
+
+	if ((rep = dbus_connection_send_with_reply_and_block(ctx->conn,
+					msg, DBUS_TIMEOUT_USE_DEFAULT, error)) == NULL)
+		goto fail;
+
+	DBusMessageIter iter;
+	if (!dbus_message_iter_init(rep, &iter)) {
+		dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE, "Empty response message");
+		goto fail;
+	}
+
+	char *signature = dbus_message_iter_get_signature(&iter);
+	if (strcmp(signature, "a(usa(tuuuu))") != 0) {
+		dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE,
+				"Incorrect signature: %s != a(usa(tuuuu))", signature);
+		dbus_free(signature);
+		goto fail;
+	}
+	dbus_free(signature);
+
+	DBusMessageIter iter_threads;
+	for (dbus_message_iter_recurse(&iter, &iter_threads);
+			dbus_message_iter_get_arg_type(&iter_threads) != DBUS_TYPE_INVALID;
+			dbus_message_iter_next(&iter_threads)) {
+
+		DBusMessageIter iter_thread;
+		dbus_message_iter_recurse(&iter_threads, &iter_thread);
+
+		dbus_uint32_t tid;
+		const char *name;
+		dbus_message_iter_get_basic(&iter_thread, &tid);
+		dbus_message_iter_next(&iter_thread);
+		dbus_message_iter_get_basic(&iter_thread, &name);
+		dbus_message_iter_next(&iter_thread);
+
+		DBusMessageIter iter_records;
+		for (dbus_message_iter_recurse(&iter_thread, &iter_records);
+				dbus_message_iter_get_arg_type(&iter_records) != DBUS_TYPE_INVALID;
+				dbus_message_iter_next(&iter_records)) {
+
+			struct ba_trace_record *records;
+			if ((records = realloc(trace->records,
+							(trace->records_len + 1) * sizeof(*records))) == NULL) {
+				dbus_set_error(error, DBUS_ERROR_NO_MEMORY, NULL);
+				goto fail;
+			}
+
+			struct ba_trace_record *record = &records[trace->records_len];
+			trace->records = records;
+			trace->records_len++;
+
+			record->tid = tid;
+			strncpy(record->thread, name, sizeof(record->thread) - 1);
+			record->thread[sizeof(record->thread) - 1] = '\0';
+
+			DBusMessageIter iter_record;
+			dbus_message_iter_recurse(&iter_records, &iter_record);
+			dbus_message_iter_get_basic(&iter_record, &record->timestamp);
+			dbus_message_iter_next(&iter_record);
+			dbus_message_iter_get_basic(&iter_record, &record->event);
+			for (size_t i = 0; i < ARRAYSIZE(record->args); i++) {
+				dbus_message_iter_next(&iter_record);
+				dbus_message_iter_get_basic(&iter_record, &record->args[i]);
+			}
+
+		}
+
+	}
+
+	rv = TRUE;
+
+fail:
+	if (!rv)
+		bluealsa_dbus_trace_free(trace);
+	if (msg != NULL)
+		dbus_message_unref(msg);
+	if (rep != NULL)
+		dbus_message_unref(rep);
+	return rv;
+}
+
+/**
+ * Free BlueALSA service trace structure. */
+void bluealsa_dbus_trace_free(
+		struct ba_trace *trace) {
+	free(trace->records);
+	trace->records = NULL;
+	trace->records_len = 0;
+}
+
 /**
  * Callback function for rfcomm object properties parser. */
 static dbus_bool_t bluealsa_dbus_message_iter_get_rfcomm_props_cb(const char *key,
@@ -669,6 +777,44 @@ dbus_bool_t bluealsa_dbus_pcm_open(
 	return rv;
 }
 
+/**
+ * Open BlueALSA PCM stream using shared memory transport. */
+dbus_bool_t bluealsa_dbus_pcm_open_shm(
+		struct ba_dbus_ctx *ctx,
+		const char *pcm_path,
+		int *fd_shm,
+		int *fd_event_server,
+		int *fd_event_client,
+		int *fd_pcm_ctrl,
+		DBusError *error) {
+
+	DBusMessage *msg;
+	if ((msg = dbus_message_new_method_call(ctx->ba_service, pcm_path,
+					BLUEALSA_INTERFACE_PCM, "OpenShm")) == NULL) {
+		dbus_set_error(error, DBUS_ERROR_NO_MEMORY, NULL);
+		return FALSE;
+	}
+
+	DBusMessage *rep;
+	if ((rep = dbus_connection_send_with_reply_and_block(ctx->conn,
+					msg, DBUS_TIMEOUT_USE_DEFAULT, error)) == NULL) {
+		dbus_message_unref(msg);
+		return FALSE;
+	}
+
+	dbus_bool_t rv;
+	rv = dbus_message_get_args(rep, error,
+			DBUS_TYPE_UNIX_FD, fd_shm,
+			DBUS_TYPE_UNIX_FD, fd_event_server,
+			DBUS_TYPE_UNIX_FD, fd_event_client,
+			DBUS_TYPE_UNIX_FD, fd_pcm_ctrl,
+			DBUS_TYPE_INVALID);
+
+	dbus_message_unref(rep);
+	dbus_message_unref(msg);
+	return rv;
+}
+
 const char *bluealsa_dbus_pcm_get_codec_canonical_name(
 		const char *alias) {
 
@@ -806,6 +952,249 @@ void bluealsa_dbus_pcm_codecs_free(
 	codecs->codecs = NULL;
 }
 
+/**
+ * Callback function for BlueALSA PCM statistics entry parser. */
+static dbus_bool_t bluealsa_dbus_message_iter_pcm_get_stat_props_cb(const char *key,
+		DBusMessageIter *value, void *userdata, DBusError *error) {
+	struct ba_pcm_stat *stat = (struct ba_pcm_stat *)userdata;
+
+	char type;
+	if ((type = dbus_message_iter_get_arg_type(value)) != DBUS_TYPE_VARIANT) {
+		dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE,
+				"Incorrect property value type: %c != %c", type, DBUS_TYPE_VARIANT);
+		return FALSE;
+	}
+
+	DBusMessageIter variant;
+	dbus_message_iter_recurse(value, &variant);
+	type = dbus_message_iter_get_arg_type(&variant);
+
+	char type_expected;
+
+	if (strcmp(key, "Count") == 0) {
+		if (type != (type_expected = DBUS_TYPE_UINT64))
+			goto fail;
+		dbus_uint64_t count;
+		dbus_message_iter_get_basic(&variant, &count);
+		stat->count = count;
+		return TRUE;
+	}
+
+	const struct {
+		const char *key;
+		uint32_t *value;
+	} values[] = {
+		{ "Min", &stat->min },
+		{ "Max", &stat->max },
+		{ "Mean", &stat->mean },
+		{ "P50", &stat->p50 },
+		{ "P90", &stat->p90 },
+		{ "P99", &stat->p99 },
+		{ "P999", &stat->p999 },
+	};
+
+	for (size_t i = 0; i < ARRAYSIZE(values); i++)
+		if (strcmp(key, values[i].key) == 0) {
+			if (type != (type_expected = DBUS_TYPE_UINT32))
+				goto fail;
+			dbus_uint32_t v;
+			dbus_message_iter_get_basic(&variant, &v);
+			*values[i].value = v;
+			break;
+		}
+
+	return TRUE;
+
+fail:
+	dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE,
+			"Incorrect variant for '%s': %c != %c", key, type, type_expected);
+	return FALSE;
+}
+
+/**
+ * Callback function for BlueALSA PCM statistics parser. */
+static dbus_bool_t bluealsa_dbus_message_iter_pcm_get_stats_cb(const char *key,
+		DBusMessageIter *value, void *userdata, DBusError *error) {
+
+	struct ba_pcm_stats *stats = (struct ba_pcm_stats *)userdata;
+	const size_t len = stats->stats_len;
+
+	struct ba_pcm_stat *tmp = stats->stats;
+	if ((tmp = realloc(tmp, (len + 1) * sizeof(*tmp))) == NULL) {
+		dbus_set_error(error, DBUS_ERROR_NO_MEMORY, NULL);
+		return FALSE;
+	}
+
+	struct ba_pcm_stat *stat = &tmp[len];
+	stats->stats = tmp;
+
+	memset(stat, 0, sizeof(*stat));
+	strncpy(stat->name, key, sizeof(stat->name));
+	stat->name[sizeof(stat->name) - 1] = '\0';
+
+	if (!bluealsa_dbus_message_iter_dict(value, error,
+				bluealsa_dbus_message_iter_pcm_get_stat_props_cb, stat))
+		return FALSE;
+
+	stats->stats_len = len + 1;
+	return TRUE;
+}
+
+/**
+ * Get BlueALSA PCM IO thread timing statistics. */
+dbus_bool_t bluealsa_dbus_pcm_get_stats(
+		struct ba_dbus_ctx *ctx,
+		const char *pcm_path,
+		struct ba_pcm_stats *stats,
+		DBusError *error) {
+
+	DBusMessage *msg = NULL, *rep = NULL;
+	dbus_bool_t rv = FALSE;
+
+	if ((msg = dbus_message_new_method_call(ctx->ba_service, pcm_path,
+					BLUEALSA_INTERFACE_PCM, "GetStatistics")) == NULL) {
+		dbus_set_error(error, DBUS_ERROR_NO_MEMORY, NULL);
+		goto fail;
+	}
+
+	if ((rep = dbus_connection_send_with_reply_and_block(ctx->conn,
+					msg, DBUS_TIMEOUT_USE_DEFAULT, error)) == NULL)
+		goto fail;
+
+	DBusMessageIter iter;
+	if (!dbus_message_iter_init(rep, &iter)) {
+		dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE, "Empty response message");
+		goto fail;
+	}
+
+	stats->stats = NULL;
+	stats->stats_len = 0;
+
+	if (!bluealsa_dbus_message_iter_dict(&iter, error,
+				bluealsa_dbus_message_iter_pcm_get_stats_cb, stats)) {
+		free(stats->stats);
+		goto fail;
+	}
+
+	rv = TRUE;
+
+fail:
+	if (msg != NULL)
+		dbus_message_unref(msg);
+	if (rep != NULL)
+		dbus_message_unref(rep);
+	return rv;
+}
+
+/**
+ * Free BlueALSA PCM statistics structure. */
+void bluealsa_dbus_pcm_stats_free(
+		struct ba_pcm_stats *stats) {
+	free(stats->stats);
+	stats->stats = NULL;
+}
+
+/**
+ * Callback function for BlueALSA PCM RTP statistics parser. */
+static dbus_bool_t bluealsa_dbus_message_iter_pcm_get_rtp_stats_cb(const char *key,
+		DBusMessageIter *value, void *userdata, DBusError *error) {
+
+	struct ba_pcm_rtp_stats *stats = (struct ba_pcm_rtp_stats *)userdata;
+
+	char type;
+	if ((type = dbus_message_iter_get_arg_type(value)) != DBUS_TYPE_VARIANT) {
+		dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE,
+				"Incorrect property value type: %c != %c", type, DBUS_TYPE_VARIANT);
+		return FALSE;
+	}
+
+	DBusMessageIter variant;
+	dbus_message_iter_recurse(value, &variant);
+	type = dbus_message_iter_get_arg_type(&variant);
+
+	char type_expected;
+
+	if (strcmp(key, "LossBursts") == 0) {
+		strcpy(stats->loss_bursts.name, key);
+		return bluealsa_dbus_message_iter_dict(&variant, error,
+				bluealsa_dbus_message_iter_pcm_get_stat_props_cb, &stats->loss_bursts);
+	}
+
+	const struct {
+		const char *key;
+		char type;
+		void *value;
+	} values[] = {
+		{ "ExtendedHighestSequence", DBUS_TYPE_UINT32, &stats->seq_ext_max },
+		{ "Expected", DBUS_TYPE_UINT64, &stats->expected },
+		{ "Received", DBUS_TYPE_UINT64, &stats->received },
+		{ "Lost", DBUS_TYPE_INT64, &stats->lost },
+		{ "IntervalExpected", DBUS_TYPE_UINT64, &stats->interval_expected },
+		{ "IntervalLost", DBUS_TYPE_INT64, &stats->interval_lost },
+		{ "Duplicated", DBUS_TYPE_UINT64, &stats->duplicated },
+		{ "Reordered", DBUS_TYPE_UINT64, &stats->reordered },
+		{ "Jitter", DBUS_TYPE_UINT32, &stats->jitter },
+		{ "ClockRate", DBUS_TYPE_UINT32, &stats->clockrate },
+	};
+
+	for (size_t i = 0; i < ARRAYSIZE(values); i++)
+		if (strcmp(key, values[i].key) == 0) {
+			if (type != (type_expected = values[i].type))
+				goto fail;
+			dbus_message_iter_get_basic(&variant, values[i].value);
+			break;
+		}
+
+	return TRUE;
+
+fail:
+	dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE,
+			"Incorrect variant for '%s': %c != %c", key, type, type_expected);
+	return FALSE;
+}
+
+/**
+ * Get BlueALSA PCM RTP receiver statistics. */
+dbus_bool_t bluealsa_dbus_pcm_get_rtp_stats(
+		struct ba_dbus_ctx *ctx,
+		const char *pcm_path,
+		struct ba_pcm_rtp_stats *stats,
+		DBusError *error) {
+
+	DBusMessage *msg = NULL, *rep = NULL;
+	dbus_bool_t rv = FALSE;
+
+	if ((msg = dbus_message_new_method_call(ctx->ba_service, pcm_path,
+					BLUEALSA_INTERFACE_PCM, "GetRTPStatistics")) == NULL) {
+		dbus_set_error(error, DBUS_ERROR_NO_MEMORY, NULL);
+		goto fail;
+	}
+
+	if ((rep = dbus_connection_send_with_reply_and_block(ctx->conn,
+					msg, DBUS_TIMEOUT_USE_DEFAULT, error)) == NULL)
+		goto fail;
+
+	DBusMessageIter iter;
+	if (!dbus_message_iter_init(rep, &iter)) {
+		dbus_set_error(error, DBUS_ERROR_INVALID_SIGNATURE, "Empty response message");
+		goto fail;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	if (!bluealsa_dbus_message_iter_dict(&iter, error,
+				bluealsa_dbus_message_iter_pcm_get_rtp_stats_cb, stats))
+		goto fail;
+
+	rv = TRUE;
+
+fail:
+	if (msg != NULL)
+		dbus_message_unref(msg);
+	if (rep != NULL)
+		dbus_message_unref(rep);
+	return rv;
+}
+
 /**
  * Select BlueALSA PCM Bluetooth audio codec. */
 dbus_bool_t bluealsa_dbus_pcm_select_codec(
@@ -956,6 +1345,7 @@ dbus_bool_t bluealsa_dbus_pcm_update(
 	const char *variant = NULL;
 	const void *value = NULL;
 	int type = -1;
+	const char *latency = NULL;
 
 	switch (property) {
 	case BLUEALSA_PCM_SOFT_VOLUME:
@@ -970,6 +1360,13 @@ dbus_bool_t bluealsa_dbus_pcm_update(
 		value = &pcm->volume.raw;
 		type = DBUS_TYPE_UINT16;
 		break;
+	case BLUEALSA_PCM_LATENCY:
+		_property = "Latency";
+		variant = DBUS_TYPE_STRING_AS_STRING;
+		latency = pcm->latency == BA_PCM_LATENCY_LOW ? "low" : "normal";
+		value = &latency;
+		type = DBUS_TYPE_STRING;
+		break;
 	}
 
 	DBusMessage *msg;
@@ -1288,6 +1685,11 @@ static dbus_bool_t bluealsa_dbus_message_iter_get_pcm_props_cb(const char *key,
 			goto fail;
 		dbus_message_iter_get_basic(&variant, &pcm->delay_adjustment);
 	}
+	else if (strcmp(key, "Bitrate") == 0) {
+		if (type != (type_expected = DBUS_TYPE_UINT32))
+			goto fail;
+		dbus_message_iter_get_basic(&variant, &pcm->bitrate);
+	}
 	else if (strcmp(key, "SoftVolume") == 0) {
 		if (type != (type_expected = DBUS_TYPE_BOOLEAN))
 			goto fail;
@@ -1298,6 +1700,15 @@ static dbus_bool_t bluealsa_dbus_message_iter_get_pcm_props_cb(const char *key,
 			goto fail;
 		dbus_message_iter_get_basic(&variant, &pcm->volume.raw);
 	}
+	else if (strcmp(key, "Latency") == 0) {
+		if (type != (type_expected = DBUS_TYPE_STRING))
+			goto fail;
+		dbus_message_iter_get_basic(&variant, &tmp);
+		if (strcmp(tmp, "normal") == 0)
+			pcm->latency = BA_PCM_LATENCY_NORMAL;
+		else if (strcmp(tmp, "low") == 0)
+			pcm->latency = BA_PCM_LATENCY_LOW;
+	}
 
 	return TRUE;
 
@@ -58,6 +58,9 @@
 #define BA_PCM_MODE_SOURCE           (1 << 0)
 #define BA_PCM_MODE_SINK             (1 << 1)
 
+#define BA_PCM_LATENCY_NORMAL        (0)
+#define BA_PCM_LATENCY_LOW           (1)
+
 /**
  * Determine whether given PCM is transported
  * over A2DP codec main-channel link. */
@@ -125,6 +128,7 @@ struct ba_rfcomm_props {
 enum ba_pcm_property {
 	BLUEALSA_PCM_SOFT_VOLUME,
 	BLUEALSA_PCM_VOLUME,
+	BLUEALSA_PCM_LATENCY,
 };
 
 /**
@@ -173,8 +177,12 @@ struct ba_pcm {
 	dbus_uint16_t delay;
 	/* manual delay adjustment */
 	dbus_int16_t delay_adjustment;
+	/* encoded stream bitrate */
+	dbus_uint32_t bitrate;
 	/* software volume */
 	dbus_bool_t soft_volume;
+	/* latency class */
+	unsigned int latency;
 
 	/* 16-bit packed PCM volume */
 	union {
@@ -205,6 +213,70 @@ struct ba_pcm_codecs {
 	size_t codecs_len;
 };
 
+/**
+ * BlueALSA PCM statistics entry. All time values are in microseconds. */
+struct ba_pcm_stat {
+	/* name of the measured quantity */
+	char name[16];
+	/* number of recorded values */
+	uint64_t count;
+	uint32_t min;
+	uint32_t max;
+	uint32_t mean;
+	uint32_t p50;
+	uint32_t p90;
+	uint32_t p99;
+	uint32_t p999;
+};
+
+/**
+ * BlueALSA PCM statistics object. */
+struct ba_pcm_stats {
+	struct ba_pcm_stat *stats;
+	size_t stats_len;
+};
+
+/**
+ * BlueALSA PCM RTP receiver statistics. */
+struct ba_pcm_rtp_stats {
+	/* extended highest sequence number received */
+	uint32_t seq_ext_max;
+	/* cumulative number of expected, received and lost packets */
+	uint64_t expected;
+	uint64_t received;
+	int64_t lost;
+	/* the number of expected and lost packets since the last query */
+	uint64_t interval_expected;
+	int64_t interval_lost;
+	uint64_t duplicated;
+	uint64_t reordered;
+	/* interarrival jitter in RTP clock units */
+	uint32_t jitter;
+	uint32_t clockrate;
+	/* lengths of lost packet bursts in packets */
+	struct ba_pcm_stat loss_bursts;
+};
+
+/**
+ * BlueALSA service trace record. */
+struct ba_trace_record {
+	/* monotonic time-stamp in nanoseconds */
+	dbus_uint64_t timestamp;
+	/* ID and name of the thread which recorded the event */
+	dbus_uint32_t tid;
+	char thread[16];
+	/* event ID and its arguments */
+	dbus_uint32_t event;
+	dbus_uint32_t args[3];
+};
+
+/**
+ * BlueALSA service trace object. */
+struct ba_trace {
+	struct ba_trace_record *records;
+	size_t records_len;
+};
+
 dbus_bool_t bluealsa_dbus_connection_ctx_init(
 		struct ba_dbus_ctx *ctx,
 		const char *ba_service_name,
@@ -245,6 +317,14 @@ dbus_bool_t bluealsa_dbus_get_props(
 void bluealsa_dbus_props_free(
 		struct ba_service_props *props);
 
+dbus_bool_t bluealsa_dbus_get_trace(
+		struct ba_dbus_ctx *ctx,
+		struct ba_trace *trace,
+		DBusError *error);
+
+void bluealsa_dbus_trace_free(
+		struct ba_trace *trace);
+
 dbus_bool_t bluealsa_dbus_get_rfcomm_props(
 		struct ba_dbus_ctx *ctx,
 		const char *rfcomm_path,
@@ -275,6 +355,15 @@ dbus_bool_t bluealsa_dbus_pcm_open(
 		int *fd_pcm_ctrl,
 		DBusError *error);
 
+dbus_bool_t bluealsa_dbus_pcm_open_shm(
+		struct ba_dbus_ctx *ctx,
+		const char *pcm_path,
+		int *fd_shm,
+		int *fd_event_server,
+		int *fd_event_client,
+		int *fd_pcm_ctrl,
+		DBusError *error);
+
 const char *bluealsa_dbus_pcm_get_codec_canonical_name(
 		const char *alias);
 
@@ -287,6 +376,21 @@ dbus_bool_t bluealsa_dbus_pcm_get_codecs(
 void bluealsa_dbus_pcm_codecs_free(
 		struct ba_pcm_codecs *codecs);
 
+dbus_bool_t bluealsa_dbus_pcm_get_stats(
+		struct ba_dbus_ctx *ctx,
+		const char *pcm_path,
+		struct ba_pcm_stats *stats,
+		DBusError *error);
+
+void bluealsa_dbus_pcm_stats_free(
+		struct ba_pcm_stats *stats);
+
+dbus_bool_t bluealsa_dbus_pcm_get_rtp_stats(
+		struct ba_dbus_ctx *ctx,
+		const char *pcm_path,
+		struct ba_pcm_rtp_stats *stats,
+		DBusError *error);
+
 dbus_bool_t bluealsa_dbus_pcm_select_codec(
 		struct ba_dbus_ctx *ctx,
 		const char *pcm_path,
@@ -0,0 +1,158 @@
+/*
+ * BlueALSA - ffrb.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "shared/ffrb.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if HAVE_MEMFD_CREATE
+/**
+ * Map memory block of the given size twice, back-to-back.
+ *
+ * @param size The size of the memory block. It shall be a multiple of
+ *   the system page size.
+ * @return On success this function returns the address of the mapping,
+ *   otherwise NULL. */
+static void *ffrb_mmap_mirrored(size_t size) {
+
+	uint8_t *addr = MAP_FAILED;
+	int fd;
+
+	if ((fd = memfd_create("ffrb", MFD_CLOEXEC)) == -1)
+		return NULL;
+	if (ftruncate(fd, size) == -1)
+		goto fail;
+
+	/* reserve address space for both mappings */
+	if ((addr = mmap(NULL, size * 2, PROT_NONE,
+					MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+		goto fail;
+
+	if (mmap(addr, size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+			mmap(addr + size, size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+		munmap(addr, size * 2);
+		addr = MAP_FAILED;
+	}
+
+fail:
+	close(fd);
+	return addr != MAP_FAILED ? addr : NULL;
+}
+#endif
+
+/**
+ * Allocate resources for the FIFO-like ring buffer.
+ *
+ * Previously stored data (if any) are discarded.
+ *
+ * @param ffrb Pointer to the buffer structure.
+ * @param nmemb Number of elements in the buffer.
+ * @param size The size of the element.
+ * @return On success this function returns 0, otherwise -1. */
+int ffrb_init(ffrb_t *ffrb, size_t nmemb, size_t size) {
+
+	ffrb_free(ffrb);
+
+	void *ptr = NULL;
+	size_t capacity = nmemb * size;
+	bool mirrored = false;
+
+#if HAVE_MEMFD_CREATE
+	/* Mirrored buffer capacity has to be a power of two, so the free-running
+	 * offsets can be wrapped with a simple mask. It has to be also a multiple
+	 * of the page size, which is a power of two as well. */
+	size_t mirrored_capacity = sysconf(_SC_PAGESIZE);
+	while (mirrored_capacity < capacity)
+		mirrored_capacity <<= 1;
+	if ((ptr = ffrb_mmap_mirrored(mirrored_capacity)) != NULL) {
+		capacity = mirrored_capacity;
+		mirrored = true;
+	}
+#endif
+
+	if (ptr == NULL &&
+			(ptr = malloc(capacity)) == NULL)
+		return -1;
+
+	ffrb->data = ptr;
+	ffrb->capacity = capacity;
+	atomic_init(&ffrb->head, 0);
+	atomic_init(&ffrb->tail, 0);
+	ffrb->nmemb = nmemb;
+	ffrb->size = size;
+	ffrb->mirrored = mirrored;
+
+	return 0;
+}
+
+/**
+ * Free resources allocated with the ffrb_init().
+ *
+ * @param ffrb Pointer to initialized buffer structure. */
+void ffrb_free(ffrb_t *ffrb) {
+	if (ffrb->data == NULL)
+		return;
+	if (ffrb->mirrored)
+		munmap(ffrb->data, ffrb->capacity * 2);
+	else
+		free(ffrb->data);
+	ffrb->data = NULL;
+}
+
+/**
+ * Discard all data available for reading.
+ *
+ * This function shall be called by the consumer.
+ *
+ * @param ffrb Pointer to initialized buffer structure. */
+void ffrb_rewind(ffrb_t *ffrb) {
+	if (ffrb->mirrored)
+		atomic_store_explicit(&ffrb->head,
+				atomic_load_explicit(&ffrb->tail, memory_order_acquire),
+				memory_order_release);
+	else
+		atomic_store_explicit(&ffrb->tail, 0, memory_order_release);
+}
+
+/**
+ * Consume the given number of elements.
+ *
+ * For the mirrored buffer this operation is O(1), it merely moves the
+ * read offset forward. This function shall be called by the consumer.
+ *
+ * @param ffrb Pointer to initialized buffer structure.
+ * @param nmemb Number of elements to consume.
+ * @return Number of consumed elements. Might be less than requested
+ *   nmemb in case where ffrb_len_out(ffrb) < nmemb. */
+size_t ffrb_shift(ffrb_t *ffrb, size_t nmemb) {
+
+	const size_t blen_out = ffrb_blen_out(ffrb);
+	size_t blen_shift = nmemb * ffrb->size;
+
+	if (blen_shift > blen_out)
+		blen_shift = blen_out;
+
+	if (ffrb->mirrored) {
+		atomic_fetch_add_explicit(&ffrb->head, blen_shift, memory_order_release);
+		return blen_shift / ffrb->size;
+	}
+
+	/* In the linear mode the head offset is always zero. */
+	const size_t blen_move = blen_out - blen_shift;
+	memmove(ffrb->data, (uint8_t *)ffrb->data + blen_shift, blen_move);
+	atomic_store_explicit(&ffrb->tail, blen_move, memory_order_release);
+
+	return blen_shift / ffrb->size;
+}
@@ -0,0 +1,101 @@
+/*
+ * BlueALSA - ffrb.h
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#pragma once
+#ifndef BLUEALSA_SHARED_FFRB_H_
+#define BLUEALSA_SHARED_FFRB_H_
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Single-producer single-consumer FIFO-like ring buffer.
+ *
+ * The memory block is mapped twice, back-to-back, in the process address
+ * space. Thanks to that, readable and writable regions of the buffer are
+ * always contiguous, so the buffer can be used as a drop-in replacement for
+ * the linear ffb_t without the need of shifting data after every read.
+ *
+ * If the mirrored mapping can not be created, the buffer falls back to the
+ * linear mode, in which consumed data is moved to the front of the buffer
+ * by the ffrb_shift(). In such case, the producer and the consumer have to
+ * be the same thread. */
+typedef struct {
+	/* pointer to the allocated memory block */
+	void *data;
+	/* size of the memory block in bytes */
+	size_t capacity;
+	/* free-running read and write offsets in bytes */
+	atomic_size_t head;
+	atomic_size_t tail;
+	/* number of elements in the buffer */
+	size_t nmemb;
+	/* the size of each element */
+	size_t size;
+	/* memory block is mirrored */
+	bool mirrored;
+} ffrb_t;
+
+int ffrb_init(ffrb_t *ffrb, size_t nmemb, size_t size);
+void ffrb_free(ffrb_t *ffrb);
+
+#define ffrb_init_uint8_t(p, n) ffrb_init(p, n, sizeof(uint8_t))
+#define ffrb_init_int16_t(p, n) ffrb_init(p, n, sizeof(int16_t))
+#define ffrb_init_int32_t(p, n) ffrb_init(p, n, sizeof(int32_t))
+
+/**
+ * Get number of unite blocks available for writing. */
+#define ffrb_len_in(p) (ffrb_blen_in(p) / (p)->size)
+/**
+ * Get number of unite blocks available for reading. */
+#define ffrb_len_out(p) (ffrb_blen_out(p) / (p)->size)
+
+/**
+ * Get number of bytes available for writing. */
+#define ffrb_blen_in(p) ((p)->nmemb * (p)->size - ffrb_blen_out(p))
+/**
+ * Get number of bytes available for reading. */
+#define ffrb_blen_out(p) ( \
+		atomic_load_explicit(&(p)->tail, memory_order_acquire) - \
+		atomic_load_explicit(&(p)->head, memory_order_acquire))
+
+/**
+ * Get the pointer to the contiguous region available for reading. */
+#define ffrb_head(p) ((void *)((uint8_t *)(p)->data + \
+			ffrb_offset(p, atomic_load_explicit(&(p)->head, memory_order_relaxed))))
+/**
+ * Get the pointer to the contiguous region available for writing. */
+#define ffrb_tail(p) ((void *)((uint8_t *)(p)->data + \
+			ffrb_offset(p, atomic_load_explicit(&(p)->tail, memory_order_relaxed))))
+
+/**
+ * Translate free-running offset into the memory block offset. */
+#define ffrb_offset(p, off) ((p)->mirrored ? (off) & ((p)->capacity - 1) : (off))
+
+/**
+ * Commit the given number of unite blocks written at the tail. */
+#define ffrb_seek(p, n) \
+	atomic_fetch_add_explicit(&(p)->tail, (n) * (p)->size, memory_order_release)
+
+/**
+ * Discard all data available for reading. */
+void ffrb_rewind(ffrb_t *ffrb);
+
+/**
+ * Consume the given number of elements. */
+size_t ffrb_shift(ffrb_t *ffrb, size_t nmemb);
+
+#endif
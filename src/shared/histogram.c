@@ -0,0 +1,124 @@
+/*
+ * BlueALSA - histogram.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "shared/histogram.h"
+
+#include <stddef.h>
+
+/**
+ * Get the index of the bucket for the given value. */
+static unsigned int histogram_bucket(uint32_t value) {
+
+	if (value < 2 * HISTOGRAM_SUB_BUCKETS)
+		return value;
+
+	const unsigned int msb = 31 - __builtin_clz(value);
+	const unsigned int shift = msb - HISTOGRAM_SUB_BUCKET_BITS;
+	return (shift + 1) * HISTOGRAM_SUB_BUCKETS +
+		((value >> shift) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/**
+ * Get the highest value which falls into the given bucket. */
+static uint32_t histogram_bucket_value(unsigned int bucket) {
+
+	if (bucket < 2 * HISTOGRAM_SUB_BUCKETS)
+		return bucket;
+
+	const unsigned int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+	const uint64_t base = (uint64_t)(HISTOGRAM_SUB_BUCKETS +
+			bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+	return base + (UINT64_C(1) << shift) - 1;
+}
+
+/**
+ * Reset the histogram.
+ *
+ * This function shall not be called concurrently with the
+ * histogram_record() function. */
+void histogram_reset(struct histogram *h) {
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+		atomic_init(&h->buckets[i], 0);
+	atomic_init(&h->count, 0);
+	atomic_init(&h->sum, 0);
+	atomic_init(&h->min, UINT32_MAX);
+	atomic_init(&h->max, 0);
+}
+
+/**
+ * Record the value in the histogram. */
+void histogram_record(struct histogram *h, uint32_t value) {
+
+	atomic_fetch_add_explicit(&h->buckets[histogram_bucket(value)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->sum, value, memory_order_relaxed);
+
+	uint32_t v = atomic_load_explicit(&h->min, memory_order_relaxed);
+	while (value < v && !atomic_compare_exchange_weak_explicit(&h->min, &v, value,
+				memory_order_relaxed, memory_order_relaxed))
+		continue;
+	v = atomic_load_explicit(&h->max, memory_order_relaxed);
+	while (value > v && !atomic_compare_exchange_weak_explicit(&h->max, &v, value,
+				memory_order_relaxed, memory_order_relaxed))
+		continue;
+
+	/* The count is updated as the last one, so the reader will never see
+	 * more recorded values than the sum of all buckets. */
+	atomic_fetch_add_explicit(&h->count, 1, memory_order_release);
+
+}
+
+/**
+ * Get the value at the given percentile.
+ *
+ * @param h Pointer to the histogram structure.
+ * @param percentile The percentile in the range [0, 100].
+ * @return The highest value equivalent (within the histogram precision) to
+ *   the value at the given percentile, or 0 if the histogram is empty. */
+uint32_t histogram_get_percentile(const struct histogram *h, double percentile) {
+
+	const uint64_t count = atomic_load_explicit(&h->count, memory_order_acquire);
+	if (count == 0)
+		return 0;
+
+	uint64_t target = percentile / 100 * count + 0.5;
+	if (target == 0)
+		target = 1;
+
+	const uint32_t max = atomic_load_explicit(&h->max, memory_order_relaxed);
+	uint64_t total = 0;
+
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+		if ((total += atomic_load_explicit(&h->buckets[i], memory_order_relaxed)) >= target) {
+			const uint32_t value = histogram_bucket_value(i);
+			return value < max ? value : max;
+		}
+
+	return max;
+}
+
+/**
+ * Get the summary of the histogram values. */
+void histogram_get_summary(const struct histogram *h, struct histogram_summary *s) {
+
+	s->count = atomic_load_explicit(&h->count, memory_order_acquire);
+	s->min = s->max = s->mean = 0;
+
+	if (s->count > 0) {
+		s->min = atomic_load_explicit(&h->min, memory_order_relaxed);
+		s->max = atomic_load_explicit(&h->max, memory_order_relaxed);
+		s->mean = atomic_load_explicit(&h->sum, memory_order_relaxed) / s->count;
+	}
+
+	s->p50 = histogram_get_percentile(h, 50);
+	s->p90 = histogram_get_percentile(h, 90);
+	s->p99 = histogram_get_percentile(h, 99);
+	s->p999 = histogram_get_percentile(h, 99.9);
+
+}
@@ -0,0 +1,62 @@
+/*
+ * BlueALSA - histogram.h
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#pragma once
+#ifndef BLUEALSA_SHARED_HISTOGRAM_H_
+#define BLUEALSA_SHARED_HISTOGRAM_H_
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * Number of bits used for linear sub-buckets within every power of two
+ * range. With 3 bits, the relative error of recorded values is 12.5%. */
+#define HISTOGRAM_SUB_BUCKET_BITS 3
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BUCKET_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+/**
+ * Log-linear (HDR-like) histogram of 32-bit values.
+ *
+ * Recording a value is lock-free and requires no memory allocation, so it
+ * can be done in the IO thread hot path. The histogram can be read at any
+ * time by other threads. */
+struct histogram {
+	_Atomic uint32_t buckets[HISTOGRAM_BUCKETS];
+	_Atomic uint64_t count;
+	_Atomic uint64_t sum;
+	_Atomic uint32_t min;
+	_Atomic uint32_t max;
+};
+
+/**
+ * Summary of the histogram values. */
+struct histogram_summary {
+	uint64_t count;
+	uint32_t min;
+	uint32_t max;
+	uint32_t mean;
+	uint32_t p50;
+	uint32_t p90;
+	uint32_t p99;
+	uint32_t p999;
+};
+
+void histogram_reset(struct histogram *h);
+void histogram_record(struct histogram *h, uint32_t value);
+
+uint32_t histogram_get_percentile(const struct histogram *h, double percentile);
+void histogram_get_summary(const struct histogram *h, struct histogram_summary *s);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * BlueALSA - mpscq.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "shared/mpscq.h"
+
+#include <errno.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define mpscq_slot_seq(q, i) \
+	((atomic_size_t *)((q)->data + ((i) & ((q)->nmemb - 1)) * (q)->slot_size))
+#define mpscq_slot_data(q, i) \
+	((void *)((uint8_t *)mpscq_slot_seq(q, i) + alignof(max_align_t)))
+
+/**
+ * Allocate resources for the queue.
+ *
+ * @param q Pointer to the queue structure.
+ * @param nmemb Number of elements in the queue. It is rounded up to the
+ *   nearest power of two.
+ * @param size The size of the element.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int mpscq_init(mpscq_t *q, size_t nmemb, size_t size) {
+
+	if (nmemb == 0 || size == 0)
+		return errno = EINVAL, -1;
+
+	size_t n = 1;
+	while (n < nmemb)
+		n <<= 1;
+
+	/* keep elements aligned, so they can be accessed directly */
+	const size_t align = alignof(max_align_t);
+	const size_t slot_size = align + (size + align - 1) / align * align;
+
+	uint8_t *data;
+	if ((data = malloc(n * slot_size)) == NULL)
+		return -1;
+
+	q->data = data;
+	q->nmemb = n;
+	q->size = size;
+	q->slot_size = slot_size;
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+
+	for (size_t i = 0; i < n; i++)
+		atomic_init(mpscq_slot_seq(q, i), i);
+
+	return 0;
+}
+
+/**
+ * Free resources allocated with the mpscq_init(). */
+void mpscq_free(mpscq_t *q) {
+	free(q->data);
+	q->data = NULL;
+}
+
+/**
+ * Push element to the queue.
+ *
+ * This function can be called by any number of producers concurrently.
+ *
+ * @param q Pointer to initialized queue structure.
+ * @param element Address of the element to copy into the queue.
+ * @return If the queue is full, this function returns false. */
+bool mpscq_push(mpscq_t *q, const void *element) {
+
+	size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	atomic_size_t *seq;
+
+	for (;;) {
+		seq = mpscq_slot_seq(q, pos);
+		const size_t s = atomic_load_explicit(seq, memory_order_acquire);
+		const intptr_t diff = (intptr_t)s - (intptr_t)pos;
+		if (diff == 0) {
+			/* slot is free, try to claim it */
+			if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+						memory_order_relaxed, memory_order_relaxed))
+				break;
+		}
+		else if (diff < 0)
+			/* slot was not consumed yet */
+			return false;
+		else
+			pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	}
+
+	memcpy(mpscq_slot_data(q, pos), element, q->size);
+	/* publish the element for the consumer */
+	atomic_store_explicit(seq, pos + 1, memory_order_release);
+
+	return true;
+}
+
+/**
+ * Pop element from the queue.
+ *
+ * This function shall be called by the single consumer only.
+ *
+ * @param q Pointer to initialized queue structure.
+ * @param element Address where the element shall be copied to.
+ * @return If the queue is empty, this function returns false. */
+bool mpscq_pop(mpscq_t *q, void *element) {
+
+	const size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+	atomic_size_t *seq = mpscq_slot_seq(q, pos);
+
+	if (atomic_load_explicit(seq, memory_order_acquire) != pos + 1)
+		return false;
+
+	memcpy(element, mpscq_slot_data(q, pos), q->size);
+	atomic_store_explicit(&q->head, pos + 1, memory_order_relaxed);
+	/* release the slot for the next round of producers */
+	atomic_store_explicit(seq, pos + q->nmemb, memory_order_release);
+
+	return true;
+}
@@ -0,0 +1,52 @@
+/*
+ * BlueALSA - mpscq.h
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#pragma once
+#ifndef BLUEALSA_SHARED_MPSCQ_H_
+#define BLUEALSA_SHARED_MPSCQ_H_
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Bounded lock-free multi-producer single-consumer queue.
+ *
+ * Every slot of the queue has a sequence number, which tells whether the
+ * slot is ready for writing or for reading. Producers claim slots with an
+ * atomic compare-and-swap on the tail offset, so elements can be pushed
+ * from any thread without locking. Elements are copied into the queue, so
+ * the queue does not require any memory allocation after initialization. */
+typedef struct {
+	/* pointer to the allocated slots */
+	uint8_t *data;
+	/* number of slots - power of two */
+	size_t nmemb;
+	/* the size of the element */
+	size_t size;
+	/* the size of the slot (sequence number and element) */
+	size_t slot_size;
+	/* free-running read and write offsets */
+	atomic_size_t head;
+	atomic_size_t tail;
+} mpscq_t;
+
+int mpscq_init(mpscq_t *q, size_t nmemb, size_t size);
+void mpscq_free(mpscq_t *q);
+
+bool mpscq_push(mpscq_t *q, const void *element);
+bool mpscq_pop(mpscq_t *q, void *element);
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * BlueALSA - shm-ring.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "shared/shm-ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int shm_ring_mmap(struct shm_ring *ring, int fd, size_t mmap_size) {
+
+	void *addr;
+	if ((addr = mmap(NULL, mmap_size, PROT_READ | PROT_WRITE,
+					MAP_SHARED, fd, 0)) == MAP_FAILED)
+		return -1;
+
+	ring->hdr = addr;
+	ring->data = (uint8_t *)addr + sizeof(*ring->hdr);
+	ring->size = mmap_size - sizeof(*ring->hdr);
+	ring->mmap_size = mmap_size;
+
+	return 0;
+}
+
+/**
+ * Create new shared memory ring buffer.
+ *
+ * @param ring Pointer to the ring buffer structure.
+ * @param size The size of the data area in bytes.
+ * @return On success this function returns the file descriptor of the
+ *   shared memory block, which shall be passed to the other process. The
+ *   size of the block is sealed, so the other process can not truncate it.
+ *   Otherwise, -1 is returned and errno is set to indicate the error. */
+int shm_ring_create(struct shm_ring *ring, size_t size) {
+#if HAVE_MEMFD_CREATE
+
+	const size_t mmap_size = sizeof(*ring->hdr) + size;
+	int fd;
+
+	if (size == 0 || size > UINT32_MAX)
+		return errno = EINVAL, -1;
+
+	if ((fd = memfd_create("bluealsa-pcm", MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1)
+		return -1;
+
+	/* Seal the size of the shared memory block, otherwise the client might
+	 * shrink it and any access to our mapping would raise SIGBUS. */
+	if (ftruncate(fd, mmap_size) == -1 ||
+			fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1 ||
+			shm_ring_mmap(ring, fd, mmap_size) == -1) {
+		int err = errno;
+		close(fd);
+		return errno = err, -1;
+	}
+
+	ring->hdr->magic = SHM_RING_MAGIC;
+	atomic_init(&ring->hdr->tail, 0);
+	atomic_init(&ring->hdr->head, 0);
+	atomic_init(&ring->hdr->closed, false);
+
+	return fd;
+#else
+	(void)ring;
+	(void)size;
+	return errno = ENOSYS, -1;
+#endif
+}
+
+/**
+ * Attach to the shared memory ring buffer created by other process.
+ *
+ * @param ring Pointer to the ring buffer structure.
+ * @param fd File descriptor of the shared memory block.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int shm_ring_attach(struct shm_ring *ring, int fd) {
+
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		return -1;
+
+	if ((size_t)st.st_size <= sizeof(*ring->hdr))
+		return errno = EINVAL, -1;
+
+	if (shm_ring_mmap(ring, fd, st.st_size) == -1)
+		return -1;
+
+	if (ring->hdr->magic != SHM_RING_MAGIC) {
+		shm_ring_free(ring);
+		return errno = EINVAL, -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Release resources associated with the ring buffer. */
+void shm_ring_free(struct shm_ring *ring) {
+	if (ring->hdr == NULL)
+		return;
+	munmap(ring->hdr, ring->mmap_size);
+	ring->hdr = NULL;
+	ring->data = NULL;
+}
+
+/**
+ * Get the number of bytes available for reading.
+ *
+ * The result is clamped to the size of the data area, so it is safe to use
+ * even if the ring buffer header has been corrupted by the other process. */
+size_t shm_ring_used(const struct shm_ring *ring) {
+
+	struct shm_ring_header *hdr = ring->hdr;
+	/* Load the head before the tail, so concurrent reading will not make
+	 * the head to overtake the tail and the difference to wrap around. */
+	const uint64_t head = atomic_load_explicit(&hdr->head, memory_order_acquire);
+	const uint64_t tail = atomic_load_explicit(&hdr->tail, memory_order_acquire);
+
+	if (tail < head)
+		return 0;
+	if (tail - head > ring->size)
+		return ring->size;
+	return tail - head;
+}
+
+/**
+ * Read data from the ring buffer.
+ *
+ * This function shall be called by the consumer only.
+ *
+ * @return The number of bytes read, which might be less than requested. If
+ *   the offsets stored in the shared header are not consistent, -1 is
+ *   returned and errno is set to EBADMSG. */
+ssize_t shm_ring_read(struct shm_ring *ring, void *buffer, size_t len) {
+
+	struct shm_ring_header *hdr = ring->hdr;
+	const size_t size = ring->size;
+	const uint64_t head = atomic_load_explicit(&hdr->head, memory_order_relaxed);
+	const uint64_t tail = atomic_load_explicit(&hdr->tail, memory_order_acquire);
+
+	/* The unsigned difference covers both the tail behind the head and
+	 * the tail ahead of the head by more than the size of the buffer. */
+	if (tail - head > size)
+		return errno = EBADMSG, -1;
+
+	if (len > tail - head)
+		len = tail - head;
+
+	const size_t offset = head % size;
+	const size_t len_1 = len < size - offset ? len : size - offset;
+	memcpy(buffer, ring->data + offset, len_1);
+	memcpy((uint8_t *)buffer + len_1, ring->data, len - len_1);
+
+	atomic_store_explicit(&hdr->head, head + len, memory_order_release);
+	return len;
+}
+
+/**
+ * Write data to the ring buffer.
+ *
+ * This function shall be called by the producer only.
+ *
+ * @return The number of bytes written, which might be less than requested.
+ *   If the offsets stored in the shared header are not consistent, -1 is
+ *   returned and errno is set to EBADMSG. */
+ssize_t shm_ring_write(struct shm_ring *ring, const void *buffer, size_t len) {
+
+	struct shm_ring_header *hdr = ring->hdr;
+	const size_t size = ring->size;
+	const uint64_t tail = atomic_load_explicit(&hdr->tail, memory_order_relaxed);
+	const uint64_t head = atomic_load_explicit(&hdr->head, memory_order_acquire);
+
+	if (tail - head > size)
+		return errno = EBADMSG, -1;
+
+	if (len > size - (tail - head))
+		len = size - (tail - head);
+
+	const size_t offset = tail % size;
+	const size_t len_1 = len < size - offset ? len : size - offset;
+	memcpy(ring->data + offset, buffer, len_1);
+	memcpy(ring->data, (const uint8_t *)buffer + len_1, len - len_1);
+
+	atomic_store_explicit(&hdr->tail, tail + len, memory_order_release);
+	return len;
+}
+
+/**
+ * Discard all data available for reading.
+ *
+ * This function shall be called by the consumer only.
+ *
+ * @return The number of discarded bytes. */
+size_t shm_ring_flush(struct shm_ring *ring) {
+	struct shm_ring_header *hdr = ring->hdr;
+	const uint64_t head = atomic_load_explicit(&hdr->head, memory_order_relaxed);
+	const uint64_t tail = atomic_load_explicit(&hdr->tail, memory_order_acquire);
+	atomic_store_explicit(&hdr->head, tail, memory_order_release);
+	return tail - head > ring->size ? ring->size : tail - head;
+}
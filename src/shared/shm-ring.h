@@ -0,0 +1,78 @@
+/*
+ * BlueALSA - shm-ring.h
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#pragma once
+#ifndef BLUEALSA_SHARED_SHMRING_H_
+#define BLUEALSA_SHARED_SHMRING_H_
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHM_RING_MAGIC 0x42414C52 /* BALR */
+
+/**
+ * Header of the shared memory ring buffer.
+ *
+ * This structure is placed at the beginning of the shared memory block
+ * and it is followed by the data area. Everything in here can be modified
+ * by the other process at any time, so none of these values shall be used
+ * for memory access without validation. */
+struct shm_ring_header {
+	uint32_t magic;
+	/* free-running write and read offsets in bytes */
+	_Atomic uint64_t tail;
+	_Atomic uint64_t head;
+	/* set when the server side has been closed */
+	atomic_bool closed;
+};
+
+/**
+ * Single-producer single-consumer ring buffer placed in the shared memory,
+ * so it can be used to transfer PCM data between processes. */
+struct shm_ring {
+	struct shm_ring_header *hdr;
+	uint8_t *data;
+	/* size of the data area in bytes */
+	size_t size;
+	/* size of the memory mapping */
+	size_t mmap_size;
+};
+
+int shm_ring_create(struct shm_ring *ring, size_t size);
+int shm_ring_attach(struct shm_ring *ring, int fd);
+void shm_ring_free(struct shm_ring *ring);
+
+ssize_t shm_ring_read(struct shm_ring *ring, void *buffer, size_t len);
+ssize_t shm_ring_write(struct shm_ring *ring, const void *buffer, size_t len);
+size_t shm_ring_flush(struct shm_ring *ring);
+
+size_t shm_ring_used(const struct shm_ring *ring);
+
+/**
+ * Get the number of bytes available for writing. */
+#define shm_ring_space(r) ((r)->size - shm_ring_used(r))
+
+/**
+ * Mark the ring buffer as closed by the server. */
+#define shm_ring_close(r) \
+	atomic_store_explicit(&(r)->hdr->closed, true, memory_order_release)
+/**
+ * Check whether the ring buffer was closed by the server. */
+#define shm_ring_is_closed(r) \
+	atomic_load_explicit(&(r)->hdr->closed, memory_order_acquire)
+
+#endif
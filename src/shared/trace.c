@@ -0,0 +1,238 @@
+/*
+ * BlueALSA - trace.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include "shared/trace.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shared/rt.h"
+
+/* upper limit for the number of records in a single ring */
+#define TRACE_RECORDS_MAX (1 << 20)
+
+struct trace_slot {
+	/* position of the stored record plus one, zero if being written */
+	atomic_size_t seq;
+	struct trace_record rec;
+};
+
+/**
+ * Per-thread ring buffer of trace records.
+ *
+ * Every ring has exactly one writer - the owning thread - so recording is
+ * lock-free and wait-free. When the ring is full, the oldest records are
+ * overwritten. Rings are never freed, instead, when the owning thread exits
+ * the ring is released and it can be taken over by a newly created thread. */
+struct trace_ring {
+	struct trace_ring *next;
+	/* ring is owned by a running thread */
+	bool in_use;
+	/* ID and name of the (last) owning thread */
+	pid_t tid;
+	char name[16];
+	/* position of the first record of the owning thread */
+	atomic_size_t tail;
+	/* free-running write position */
+	atomic_size_t head;
+	struct trace_slot slots[];
+};
+
+atomic_bool trace_enabled = false;
+
+/* number of records in every ring - power of two */
+static size_t trace_nmemb = 0;
+/* list of all allocated rings */
+static struct trace_ring *trace_rings = NULL;
+static pthread_mutex_t trace_rings_mtx = PTHREAD_MUTEX_INITIALIZER;
+/* key used for releasing the ring on thread exit */
+static pthread_key_t trace_ring_key;
+/* ring of the calling thread */
+static __thread struct trace_ring *trace_ring = NULL;
+
+static void trace_ring_release(void *ring_) {
+	struct trace_ring *ring = ring_;
+	pthread_mutex_lock(&trace_rings_mtx);
+	ring->in_use = false;
+	pthread_mutex_unlock(&trace_rings_mtx);
+}
+
+static struct trace_ring *trace_ring_acquire(void) {
+
+	struct trace_ring *ring;
+
+	pthread_mutex_lock(&trace_rings_mtx);
+
+	for (ring = trace_rings; ring != NULL; ring = ring->next)
+		if (!ring->in_use)
+			break;
+
+	if (ring == NULL) {
+		if ((ring = calloc(1, sizeof(*ring) +
+						trace_nmemb * sizeof(*ring->slots))) == NULL)
+			goto final;
+		ring->next = trace_rings;
+		trace_rings = ring;
+	}
+
+	ring->in_use = true;
+	ring->tid = syscall(SYS_gettid);
+	pthread_getname_np(pthread_self(), ring->name, sizeof(ring->name));
+	/* do not report records of the previous owner */
+	atomic_store_explicit(&ring->tail,
+			atomic_load_explicit(&ring->head, memory_order_relaxed),
+			memory_order_relaxed);
+
+final:
+	pthread_mutex_unlock(&trace_rings_mtx);
+
+	if (ring != NULL)
+		pthread_setspecific(trace_ring_key, ring);
+
+	return ring;
+}
+
+/**
+ * Enable tracing.
+ *
+ * This function shall be called only once, before any thread which might
+ * record trace events is created.
+ *
+ * @param nmemb Number of records in the per-thread ring buffer. It is
+ *   rounded up to the nearest power of two.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int trace_init(size_t nmemb) {
+
+	if (nmemb == 0 || nmemb > TRACE_RECORDS_MAX)
+		return errno = EINVAL, -1;
+	if (atomic_load_explicit(&trace_enabled, memory_order_relaxed))
+		return errno = EBUSY, -1;
+
+	int err;
+	if ((err = pthread_key_create(&trace_ring_key, trace_ring_release)) != 0)
+		return errno = err, -1;
+
+	size_t n = 1;
+	while (n < nmemb)
+		n <<= 1;
+
+	trace_nmemb = n;
+	atomic_store_explicit(&trace_enabled, true, memory_order_release);
+
+	return 0;
+}
+
+/**
+ * Record trace event.
+ *
+ * Use the trace() macro instead of calling this function directly. */
+void trace_record(enum trace_event event, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+
+	struct trace_ring *ring = trace_ring;
+	if (ring == NULL &&
+			(ring = trace_ring = trace_ring_acquire()) == NULL)
+		return;
+
+	struct timespec ts;
+	gettimestamp(&ts);
+
+	const size_t pos = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	struct trace_slot *slot = &ring->slots[pos & (trace_nmemb - 1)];
+
+	/* invalidate the slot before overwriting the record */
+	atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->rec.timestamp = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+	slot->rec.event = event;
+	slot->rec.args[0] = arg0;
+	slot->rec.args[1] = arg1;
+	slot->rec.args[2] = arg2;
+
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+	atomic_store_explicit(&ring->head, pos + 1, memory_order_release);
+
+}
+
+/**
+ * Read trace records of all threads.
+ *
+ * Records are copied out of the ring buffers without stopping the writers,
+ * records which are being overwritten during the copy are skipped.
+ *
+ * @param cb Callback function called for every thread with records.
+ * @param userdata Data passed to the callback function.
+ * @return On success this function returns 0. Otherwise, -1 is returned
+ *   and errno is set to indicate the error. */
+int trace_dump(trace_dump_cb cb, void *userdata) {
+
+	if (!atomic_load_explicit(&trace_enabled, memory_order_acquire))
+		return 0;
+
+	struct trace_record *records;
+	if ((records = malloc(trace_nmemb * sizeof(*records))) == NULL)
+		return -1;
+
+	pthread_mutex_lock(&trace_rings_mtx);
+
+	for (struct trace_ring *ring = trace_rings; ring != NULL; ring = ring->next) {
+
+		const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+		size_t pos = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		if (head - pos > trace_nmemb)
+			pos = head - trace_nmemb;
+
+		size_t n = 0;
+		for (; pos != head; pos++) {
+			struct trace_slot *slot = &ring->slots[pos & (trace_nmemb - 1)];
+			const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+			if (seq != pos + 1)
+				continue;
+			records[n] = slot->rec;
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq)
+				n++;
+		}
+
+		if (n > 0)
+			cb(ring->tid, ring->name, records, n, userdata);
+
+	}
+
+	pthread_mutex_unlock(&trace_rings_mtx);
+
+	free(records);
+	return 0;
+}
+
+/**
+ * Get the name of the trace event. */
+const char *trace_event_to_string(enum trace_event event) {
+	static const char *names[__TRACE_EVENT_MAX] = {
+		[TRACE_EVENT_NONE] = "none",
+		[TRACE_EVENT_BT_READ] = "bt-read",
+		[TRACE_EVENT_BT_WRITE] = "bt-write",
+		[TRACE_EVENT_PCM_READ] = "pcm-read",
+		[TRACE_EVENT_PCM_WRITE] = "pcm-write",
+		[TRACE_EVENT_SIGNAL_SEND] = "signal-send",
+		[TRACE_EVENT_SIGNAL_RECV] = "signal-recv",
+		[TRACE_EVENT_SYNC_OVERDUE] = "sync-overdue",
+		[TRACE_EVENT_RTP_FRAGMENT] = "rtp-fragment",
+	};
+	if (event < __TRACE_EVENT_MAX)
+		return names[event];
+	return "unknown";
+}
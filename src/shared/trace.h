@@ -0,0 +1,86 @@
+/*
+ * BlueALSA - trace.h
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#pragma once
+#ifndef BLUEALSA_SHARED_TRACE_H_
+#define BLUEALSA_SHARED_TRACE_H_
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+enum trace_event {
+	TRACE_EVENT_NONE = 0,
+	/* args: socket fd, bytes read */
+	TRACE_EVENT_BT_READ,
+	/* args: socket fd, bytes written */
+	TRACE_EVENT_BT_WRITE,
+	/* args: PCM fd, samples read */
+	TRACE_EVENT_PCM_READ,
+	/* args: PCM fd, samples written */
+	TRACE_EVENT_PCM_WRITE,
+	/* args: signal, payload */
+	TRACE_EVENT_SIGNAL_SEND,
+	/* args: signal, payload */
+	TRACE_EVENT_SIGNAL_RECV,
+	/* args: sampling rate, overdue time in microseconds */
+	TRACE_EVENT_SYNC_OVERDUE,
+	/* args: fragment offset, payload length */
+	TRACE_EVENT_RTP_FRAGMENT,
+	__TRACE_EVENT_MAX
+};
+
+/**
+ * Binary trace record.
+ *
+ * Records are stored without any formatting, so tracing is cheap enough to
+ * be used in the IO hot path. Formatting is done offline by the reader. */
+struct trace_record {
+	/* monotonic time-stamp in nanoseconds */
+	uint64_t timestamp;
+	uint32_t event;
+	uint32_t args[3];
+};
+
+/**
+ * Callback used for reading trace records.
+ *
+ * @param tid Kernel thread ID of the thread which recorded the trace.
+ * @param name Name of the thread which recorded the trace.
+ * @param records Trace records in the chronological order.
+ * @param nmemb Number of trace records.
+ * @param userdata Data passed to the trace_dump() function. */
+typedef void (*trace_dump_cb)(pid_t tid, const char *name,
+		const struct trace_record *records, size_t nmemb, void *userdata);
+
+extern atomic_bool trace_enabled;
+
+int trace_init(size_t nmemb);
+void trace_record(enum trace_event event, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+int trace_dump(trace_dump_cb cb, void *userdata);
+
+const char *trace_event_to_string(enum trace_event event);
+
+/**
+ * Record trace event in the calling thread ring buffer.
+ *
+ * If tracing is not enabled, this macro costs a single relaxed load. */
+#define trace(event, arg0, arg1, arg2) do { \
+		if (atomic_load_explicit(&trace_enabled, memory_order_relaxed)) \
+			trace_record(event, arg0, arg1, arg2); \
+	} while (0)
+
+#endif
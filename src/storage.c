@@ -11,13 +11,19 @@
 #include "storage.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <bluetooth/bluetooth.h>
 
@@ -29,23 +35,53 @@
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
 #include "shared/log.h"
+#include "shared/rt.h"
 
 #define BA_STORAGE_KEY_DELAY_ADJUSTMENT "DelayAdjustments"
 #define BA_STORAGE_KEY_SOFT_VOLUME      "SoftVolume"
 #define BA_STORAGE_KEY_VOLUME           "Volume"
 #define BA_STORAGE_KEY_MUTE             "Mute"
+#define BA_STORAGE_KEY_LOW_LATENCY      "LowLatency"
+
+/**
+ * Time window in milliseconds within which storage updates are coalesced
+ * into a single write of the storage file. */
+#define BA_STORAGE_WRITE_DELAY_MS 1000
 
 struct storage {
 	/* remote BT device address */
 	bdaddr_t addr;
 	/* associated storage file */
 	GKeyFile *keyfile;
+	/* storage was modified since the last write */
+	bool dirty;
 };
 
 static char storage_root_dir[128];
 static pthread_mutex_t storage_mutex = PTHREAD_MUTEX_INITIALIZER;
 static GHashTable *storage_map = NULL;
 
+/* Serialize storage file writes, so the file content always reflects the
+ * latest storage snapshot. If both locks are required, this one shall be
+ * taken before the storage_mutex. */
+static pthread_mutex_t storage_io_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Background storage writer. */
+static struct {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool running;
+	/* PCMs with data not yet copied to the storage */
+	GPtrArray *pcms;
+	/* storage write was requested */
+	bool pending;
+	/* end of the coalescing window (CLOCK_MONOTONIC) */
+	struct timespec deadline;
+} storage_writer = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
 static struct storage *storage_lookup(const bdaddr_t *addr) {
 	return g_hash_table_lookup(storage_map, addr);
 }
@@ -62,6 +98,7 @@ static struct storage *storage_new(const bdaddr_t *addr) {
 
 	bacpy(&st->addr, addr);
 	st->keyfile = g_key_file_new();
+	st->dirty = false;
 
 	/* Insert a new storage into the map. Please, note that the key is a pointer
 	 * to memory stored in the value structure. This is fine as long as the value
@@ -80,6 +117,130 @@ static void storage_free(struct storage *st) {
 	free(st);
 }
 
+static void storage_get_path(const bdaddr_t *addr, char *path, size_t size) {
+	char addrstr[18];
+	ba2str(addr, addrstr);
+	snprintf(path, size, "%s/%s", storage_root_dir, addrstr);
+}
+
+/**
+ * Write storage file content with the atomic rename-on-write.
+ *
+ * Data are written to a temporary file which then replaces the target one,
+ * so the storage file is never left truncated, e.g. on power loss. */
+static int storage_file_write(const char *path, const char *data, size_t len) {
+
+	char tmp[PATH_MAX];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	int fd;
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+					S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)) == -1)
+		return -1;
+
+	while (len > 0) {
+		ssize_t ret;
+		if ((ret = write(fd, data, len)) == -1) {
+			if (errno == EINTR)
+				continue;
+			goto fail;
+		}
+		data += ret;
+		len -= ret;
+	}
+
+	if (fsync(fd) == -1)
+		goto fail;
+
+	close(fd);
+	fd = -1;
+
+	if (rename(tmp, path) == -1)
+		goto fail;
+
+	return 0;
+
+fail:
+	if (fd != -1)
+		close(fd);
+	int err = errno;
+	unlink(tmp);
+	errno = err;
+	return -1;
+}
+
+/**
+ * Save given storage into the file.
+ *
+ * The caller shall hold both, the storage_io_mutex and the storage_mutex. */
+static int storage_save(struct storage *st) {
+
+	char path[sizeof(storage_root_dir) + 18];
+	storage_get_path(&st->addr, path, sizeof(path));
+
+	debug("Saving storage: %s", path);
+
+	gsize len;
+	gchar *data = g_key_file_to_data(st->keyfile, &len, NULL);
+	int rv = storage_file_write(path, data, len);
+	g_free(data);
+
+	if (rv == -1)
+		error("Couldn't save storage: %s: %s", path, strerror(errno));
+	else
+		st->dirty = false;
+
+	return rv;
+}
+
+/**
+ * Schedule storage write after the coalescing window.
+ *
+ * The caller shall hold the storage writer mutex. */
+static void storage_writer_schedule(void) {
+
+	if (storage_writer.pending)
+		return;
+
+	clock_gettime(CLOCK_MONOTONIC, &storage_writer.deadline);
+	const struct timespec delay = {
+		.tv_sec = BA_STORAGE_WRITE_DELAY_MS / 1000,
+		.tv_nsec = (BA_STORAGE_WRITE_DELAY_MS % 1000) * 1000000 };
+	timespecadd(&storage_writer.deadline, &delay, &storage_writer.deadline);
+
+	storage_writer.pending = true;
+	pthread_cond_signal(&storage_writer.cond);
+
+}
+
+static void *storage_writer_thread(void *arg) {
+	(void)arg;
+
+	pthread_mutex_lock(&storage_writer.mutex);
+
+	while (storage_writer.running) {
+
+		if (!storage_writer.pending) {
+			pthread_cond_wait(&storage_writer.cond, &storage_writer.mutex);
+			continue;
+		}
+
+		/* Wait for the end of the coalescing window. Updates requested in the
+		 * meantime will be written together with the pending ones. */
+		if (pthread_cond_timedwait(&storage_writer.cond, &storage_writer.mutex,
+					&storage_writer.deadline) != ETIMEDOUT)
+			continue;
+
+		pthread_mutex_unlock(&storage_writer.mutex);
+		storage_flush();
+		pthread_mutex_lock(&storage_writer.mutex);
+
+	}
+
+	pthread_mutex_unlock(&storage_writer.mutex);
+	return NULL;
+}
+
 /**
  * Initialize BlueALSA persistent storage.
  *
@@ -96,26 +257,128 @@ int storage_init(const char *root) {
 		storage_map = g_hash_table_new_full(g_bdaddr_hash, g_bdaddr_equal,
 				NULL, (GDestroyNotify)storage_free);
 
+	if (storage_writer.running)
+		return 0;
+
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&storage_writer.cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	storage_writer.pcms = g_ptr_array_new();
+	storage_writer.pending = false;
+	storage_writer.running = true;
+
+	/* See the ba_transport_pcm_start() function for information
+	 * why we have to mask all signals. */
+	sigset_t sigset, oldset;
+	sigfillset(&sigset);
+	pthread_sigmask(SIG_SETMASK, &sigset, &oldset);
+
+	int err;
+	if ((err = pthread_create(&storage_writer.thread, NULL,
+					storage_writer_thread, NULL)) != 0) {
+		warn("Couldn't create storage writer: %s", strerror(err));
+		/* fall back to the write on device disconnection */
+		storage_writer.running = false;
+	}
+	else
+		pthread_setname_np(storage_writer.thread, "ba-storage");
+
+	pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
 	return 0;
 }
 
 /**
- * Cleanup resources allocated by the persistent storage. */
+ * Cleanup resources allocated by the persistent storage.
+ *
+ * All pending storage updates are written before returning. */
 void storage_destroy(void) {
+
+	pthread_mutex_lock(&storage_writer.mutex);
+	const bool running = storage_writer.running;
+	storage_writer.running = false;
+	pthread_cond_signal(&storage_writer.cond);
+	pthread_mutex_unlock(&storage_writer.mutex);
+
+	if (running) {
+		pthread_join(storage_writer.thread, NULL);
+		pthread_cond_destroy(&storage_writer.cond);
+	}
+
+	storage_flush();
+
+	if (storage_writer.pcms != NULL) {
+		g_ptr_array_free(storage_writer.pcms, TRUE);
+		storage_writer.pcms = NULL;
+	}
+
 	if (storage_map == NULL)
 		return;
 	g_hash_table_unref(storage_map);
 	storage_map = NULL;
 }
 
+/**
+ * Write all pending storage updates.
+ *
+ * Data of PCMs marked with the storage_pcm_data_mark_dirty() are copied to
+ * the storage and then all modified storage files are written.
+ *
+ * @return On success this function returns 0. Otherwise -1 is returned. */
+int storage_flush(void) {
+
+	GPtrArray *pcms = NULL;
+	int rv = 0;
+
+	pthread_mutex_lock(&storage_writer.mutex);
+	if (storage_writer.pcms != NULL && storage_writer.pcms->len > 0) {
+		pcms = storage_writer.pcms;
+		storage_writer.pcms = g_ptr_array_new();
+	}
+	storage_writer.pending = false;
+	pthread_mutex_unlock(&storage_writer.mutex);
+
+	for (size_t i = 0; pcms != NULL && i < pcms->len; i++) {
+		struct ba_transport_pcm *pcm = g_ptr_array_index(pcms, i);
+		/* clear the flag before taking the snapshot, so a concurrent
+		 * modification will mark the PCM as dirty once again */
+		atomic_store(&pcm->storage_dirty, false);
+		storage_pcm_data_update(pcm);
+		/* This might release the transport, so it has to be
+		 * done without holding any storage lock. */
+		ba_transport_pcm_unref(pcm);
+	}
+
+	if (pcms != NULL)
+		g_ptr_array_free(pcms, TRUE);
+
+	pthread_mutex_lock(&storage_io_mutex);
+	pthread_mutex_lock(&storage_mutex);
+
+	if (storage_map != NULL) {
+		GHashTableIter iter;
+		struct storage *st;
+		g_hash_table_iter_init(&iter, storage_map);
+		while (g_hash_table_iter_next(&iter, NULL, (void **)&st))
+			if (st->dirty && storage_save(st) == -1)
+				rv = -1;
+	}
+
+	pthread_mutex_unlock(&storage_mutex);
+	pthread_mutex_unlock(&storage_io_mutex);
+
+	return rv;
+}
+
 /**
  * Load persistent storage file for the given BT device. */
 int storage_device_load(const struct ba_device *d) {
 
-	char addrstr[18];
-	char path[sizeof(storage_root_dir) + sizeof(addrstr)];
-	ba2str(&d->addr, addrstr);
-	snprintf(path, sizeof(path), "%s/%s", storage_root_dir, addrstr);
+	char path[sizeof(storage_root_dir) + 18];
+	storage_get_path(&d->addr, path, sizeof(path));
 	int rv = -1;
 
 	pthread_mutex_lock(&storage_mutex);
@@ -145,26 +408,17 @@ final:
  * Save persistent storage file for the given BT device. */
 int storage_device_save(const struct ba_device *d) {
 
-	char addrstr[18];
-	char path[sizeof(storage_root_dir) + sizeof(addrstr)];
-	ba2str(&d->addr, addrstr);
-	snprintf(path, sizeof(path), "%s/%s", storage_root_dir, addrstr);
 	int rv = -1;
 
+	pthread_mutex_lock(&storage_io_mutex);
 	pthread_mutex_lock(&storage_mutex);
 
 	struct storage *st;
 	if ((st = storage_lookup(&d->addr)) == NULL)
 		goto final;
 
-	debug("Saving storage: %s", path);
-
-	GError *err = NULL;
-	if (!g_key_file_save_to_file(st->keyfile, path, &err)) {
-		error("Couldn't save storage: %s", err->message);
-		g_error_free(err);
+	if (storage_save(st) == -1)
 		goto final;
-	}
 
 	/* remove the storage from the map */
 	g_hash_table_remove(storage_map, &d->addr);
@@ -173,6 +427,7 @@ int storage_device_save(const struct ba_device *d) {
 
 final:
 	pthread_mutex_unlock(&storage_mutex);
+	pthread_mutex_unlock(&storage_io_mutex);
 	return rv;
 }
 
@@ -257,6 +512,14 @@ int storage_pcm_data_sync(struct ba_transport_pcm *pcm) {
 		rv = 1;
 	}
 
+	if (g_key_file_has_key(keyfile, group, BA_STORAGE_KEY_LOW_LATENCY, NULL)) {
+		atomic_store_explicit(&pcm->latency,
+				g_key_file_get_boolean(keyfile, group, BA_STORAGE_KEY_LOW_LATENCY, NULL) ?
+					BA_TRANSPORT_PCM_LATENCY_LOW : BA_TRANSPORT_PCM_LATENCY_NORMAL,
+				memory_order_relaxed);
+		rv = 1;
+	}
+
 final:
 	pthread_mutex_unlock(&storage_mutex);
 	return rv;
@@ -265,6 +528,10 @@ final:
 /**
  * Update persistent storage with PCM data.
  *
+ * This function copies PCM data to the in-memory storage and schedules the
+ * storage file write. Since it allocates memory, it should not be called
+ * in the hot path - use storage_pcm_data_mark_dirty() instead.
+ *
  * @param pcm The PCM structure for which to update the storage.
  * @return On success this function returns 0. Otherwise -1 is returned. */
 int storage_pcm_data_update(const struct ba_transport_pcm *pcm) {
@@ -324,9 +591,51 @@ int storage_pcm_data_update(const struct ba_transport_pcm *pcm) {
 	gboolean mute[2] = { pcm->volume[0].soft_mute, pcm->volume[1].soft_mute };
 	g_key_file_set_boolean_list(keyfile, group, BA_STORAGE_KEY_MUTE, mute, 2);
 
+	g_key_file_set_boolean(keyfile, group, BA_STORAGE_KEY_LOW_LATENCY,
+			atomic_load_explicit(&pcm->latency, memory_order_relaxed) ==
+				BA_TRANSPORT_PCM_LATENCY_LOW);
+
+	st->dirty = true;
 	rv = 0;
 
 final:
 	pthread_mutex_unlock(&storage_mutex);
+
+	if (rv == 0) {
+		pthread_mutex_lock(&storage_writer.mutex);
+		if (storage_writer.running)
+			storage_writer_schedule();
+		pthread_mutex_unlock(&storage_writer.mutex);
+	}
+
 	return rv;
 }
+
+/**
+ * Mark PCM data as modified.
+ *
+ * PCM data will be copied to the persistent storage and written to the
+ * storage file by the background writer after the coalescing window. This
+ * function is cheap if the PCM was already marked, so it is suitable for
+ * the hot path, e.g. volume changes.
+ *
+ * @param pcm The PCM structure which data was modified. */
+void storage_pcm_data_mark_dirty(struct ba_transport_pcm *pcm) {
+
+	if (atomic_exchange(&pcm->storage_dirty, true))
+		return;
+
+	pthread_mutex_lock(&storage_writer.mutex);
+
+	if (!storage_writer.running) {
+		atomic_store(&pcm->storage_dirty, false);
+		goto final;
+	}
+
+	/* keep PCM alive until its data is copied to the storage */
+	g_ptr_array_add(storage_writer.pcms, ba_transport_pcm_ref(pcm));
+	storage_writer_schedule();
+
+final:
+	pthread_mutex_unlock(&storage_writer.mutex);
+}
@@ -21,11 +21,13 @@
 
 int storage_init(const char *root);
 void storage_destroy(void);
+int storage_flush(void);
 
 int storage_device_load(const struct ba_device *d);
 int storage_device_save(const struct ba_device *d);
 
 int storage_pcm_data_sync(struct ba_transport_pcm *pcm);
 int storage_pcm_data_update(const struct ba_transport_pcm *pcm);
+void storage_pcm_data_mark_dirty(struct ba_transport_pcm *pcm);
 
 #endif
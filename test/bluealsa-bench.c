@@ -0,0 +1,759 @@
+/*
+ * bluealsa-bench.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <glib.h>
+
+#include "a2dp.h"
+#if ENABLE_AAC
+# include "a2dp-aac.h"
+#endif
+#if ENABLE_APTX
+# include "a2dp-aptx.h"
+#endif
+#if ENABLE_APTX_HD
+# include "a2dp-aptx-hd.h"
+#endif
+#if ENABLE_FASTSTREAM
+# include "a2dp-faststream.h"
+#endif
+#if ENABLE_LC3PLUS
+# include "a2dp-lc3plus.h"
+#endif
+#if ENABLE_LDAC
+# include "a2dp-ldac.h"
+#endif
+#if ENABLE_MPEG
+# include "a2dp-mpeg.h"
+#endif
+#include "a2dp-sbc.h"
+#include "audio.h"
+#include "ba-adapter.h"
+#include "ba-device.h"
+#include "ba-transport.h"
+#include "ba-transport-pcm.h"
+#include "bluealsa-config.h"
+#include "hfp.h"
+#include "io.h"
+#if ENABLE_LC3PLUS || ENABLE_LDAC
+# include "rtp.h"
+#endif
+#include "shared/a2dp-codecs.h"
+#include "shared/defs.h"
+#include "shared/log.h"
+#include "shared/rt.h"
+
+#include "../src/a2dp.c"
+#include "../src/ba-transport.c"
+#include "inc/io.inc"
+#include "inc/sine.inc"
+
+#if defined(__GLIBC__)
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t nmemb, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+/* number of heap allocations done by the IO threads */
+static atomic_ulong allocations = 0;
+/* allocations done by the benchmark threads are not counted */
+static __thread bool allocations_ignore = false;
+
+void *malloc(size_t size) {
+	if (!allocations_ignore)
+		atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+	if (!allocations_ignore)
+		atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	if (!allocations_ignore)
+		atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+#define allocations_get() atomic_load_explicit(&allocations, memory_order_relaxed)
+#define allocations_ignore_set() (allocations_ignore = true)
+
+#else
+# define allocations_get() 0UL
+# define allocations_ignore_set() do {} while (0)
+#endif
+
+enum bench_format {
+	BENCH_FORMAT_CSV,
+	BENCH_FORMAT_JSON,
+};
+
+/**
+ * Benchmarked codec definition. */
+struct bench_codec {
+	const char *name;
+	/* A2DP codecs and configuration; NULL for SCO */
+	const struct a2dp_codec *a2dp_source;
+	const struct a2dp_codec *a2dp_sink;
+	const void *configuration;
+	/* HFP codec ID for SCO transports */
+	uint16_t hfp_codec_id;
+	size_t mtu;
+	ba_transport_pcm_thread_func enc;
+	ba_transport_pcm_thread_func dec;
+};
+
+/**
+ * Result of a single benchmark run. */
+struct bench_result {
+	const char *codec;
+	const char *mode;
+	unsigned int sampling;
+	unsigned int channels;
+	/* number of processed PCM frames */
+	size_t frames;
+	/* number of BT packets and total size of BT data */
+	size_t packets;
+	size_t bytes;
+	/* wall-clock processing time */
+	struct timespec time;
+	/* heap allocations done while processing */
+	unsigned long allocations;
+};
+
+/**
+ * Encoded BT packets captured in the encoding run. */
+struct bench_packets {
+	uint8_t *data;
+	size_t *lengths;
+	size_t count;
+	size_t size;
+	size_t capacity;
+};
+
+struct bench_writer {
+	pthread_t thread;
+	int fd;
+	/* PCM signal to write */
+	const struct ba_transport_pcm *pcm;
+	size_t frames;
+	/* BT packets to write */
+	const struct bench_packets *packets;
+	atomic_bool done;
+};
+
+static struct ba_adapter *adapter = NULL;
+static struct ba_device *device1 = NULL;
+static struct ba_device *device2 = NULL;
+
+static void *bench_write_pcm(void *userdata) {
+
+	struct bench_writer *w = userdata;
+	struct pollfd pfds[] = {{ w->fd, POLLOUT, 0 }};
+	const size_t channels = w->pcm->channels;
+	const size_t sample_size = BA_TRANSPORT_PCM_FORMAT_BYTES(w->pcm->format);
+	size_t frames = w->frames;
+	int x = 0;
+
+	union {
+		int16_t s16[2 * 1024];
+		int32_t s32[2 * 1024];
+	} buffer;
+
+	allocations_ignore_set();
+
+	while (frames > 0) {
+
+		const size_t count = MIN(frames, 1024);
+		switch (w->pcm->format) {
+		case BA_TRANSPORT_PCM_FORMAT_S16_2LE:
+			x = snd_pcm_sine_s16_2le(buffer.s16, count, channels, x, 1.0 / 128);
+			break;
+		case BA_TRANSPORT_PCM_FORMAT_S24_4LE:
+			x = snd_pcm_sine_s24_4le(buffer.s32, count, channels, x, 1.0 / 128);
+			break;
+		case BA_TRANSPORT_PCM_FORMAT_S32_4LE:
+			x = snd_pcm_sine_s32_4le(buffer.s32, count, channels, x, 1.0 / 128);
+			break;
+		default:
+			g_assert_not_reached();
+		}
+
+		const uint8_t *head = (const uint8_t *)&buffer;
+		size_t len = count * channels * sample_size;
+		while (len > 0) {
+			ssize_t rv;
+			if (poll(pfds, ARRAYSIZE(pfds), -1) == -1 ||
+					(rv = write(w->fd, head, len)) == -1) {
+				if (errno == EAGAIN || errno == EINTR)
+					continue;
+				error("PCM write error: %s", strerror(errno));
+				goto final;
+			}
+			head += rv;
+			len -= rv;
+		}
+
+		frames -= count;
+	}
+
+final:
+	atomic_store(&w->done, true);
+	return NULL;
+}
+
+static void *bench_write_bt(void *userdata) {
+
+	struct bench_writer *w = userdata;
+	struct pollfd pfds[] = {{ w->fd, POLLOUT, 0 }};
+	const uint8_t *head = w->packets->data;
+
+	allocations_ignore_set();
+
+	for (size_t i = 0; i < w->packets->count; i++) {
+		const size_t len = w->packets->lengths[i];
+		ssize_t rv;
+		do
+			if (poll(pfds, ARRAYSIZE(pfds), -1) == -1)
+				goto final;
+		while ((rv = write(w->fd, head, len)) == -1 && errno == EAGAIN);
+		if (rv == -1) {
+			error("BT write error: %s", strerror(errno));
+			break;
+		}
+		head += len;
+	}
+
+final:
+	atomic_store(&w->done, true);
+	return NULL;
+}
+
+static int bench_packets_push(struct bench_packets *packets,
+		const void *data, size_t len) {
+
+	if (packets->lengths == NULL || (packets->count & 1023) == 0) {
+		size_t *tmp;
+		if ((tmp = realloc(packets->lengths,
+						(packets->count + 1024) * sizeof(*tmp))) == NULL)
+			return -1;
+		packets->lengths = tmp;
+	}
+
+	if (packets->size + len > packets->capacity) {
+		const size_t capacity = MAX(packets->capacity * 2, packets->size + len);
+		uint8_t *tmp;
+		if ((tmp = realloc(packets->data, capacity)) == NULL)
+			return -1;
+		packets->data = tmp;
+		packets->capacity = capacity;
+	}
+
+	memcpy(packets->data + packets->size, data, len);
+	packets->lengths[packets->count++] = len;
+	packets->size += len;
+
+	return 0;
+}
+
+static void bench_packets_free(struct bench_packets *packets) {
+	free(packets->data);
+	free(packets->lengths);
+	memset(packets, 0, sizeof(*packets));
+}
+
+/**
+ * Read data from the given file descriptor until the writer is done and
+ * there is no more data to read.
+ *
+ * @return On success this function returns 0, otherwise -1. */
+static int bench_read(int fd, struct bench_writer *w, struct bench_result *r,
+		struct bench_packets *packets, size_t frame_size,
+		const struct timespec *ts0) {
+
+	struct pollfd pfds[] = {{ fd, POLLIN, 0 }};
+	uint8_t buffer[4096];
+	struct timespec ts;
+
+	for (;;) {
+
+		int rv;
+		if ((rv = poll(pfds, ARRAYSIZE(pfds), 500)) == -1)
+			return -1;
+		if (rv == 0) {
+			if (atomic_load(&w->done))
+				return 0;
+			continue;
+		}
+
+		ssize_t len;
+		if ((len = read(fd, buffer, sizeof(buffer))) == -1) {
+			if (errno == EAGAIN)
+				continue;
+			return -1;
+		}
+
+		gettimestamp(&ts);
+		timespecsub(&ts, ts0, &r->time);
+
+		if (packets != NULL) {
+			if (bench_packets_push(packets, buffer, len) == -1)
+				return -1;
+			r->packets++;
+			r->bytes += len;
+		}
+		else
+			r->frames += len / frame_size;
+
+	}
+
+}
+
+/**
+ * Run encoding benchmark.
+ *
+ * PCM signal is written to the encoder thread as fast as possible and
+ * encoded BT packets are captured for the decoding benchmark. */
+static int bench_encode(struct ba_transport *t, ba_transport_pcm_thread_func enc,
+		size_t frames, struct bench_result *r, struct bench_packets *packets) {
+
+	struct ba_transport_pcm *pcm = t->thread_enc.pcm;
+	struct bench_writer w = { .pcm = pcm, .frames = frames };
+	int bt_fds[2] = { -1, -1 };
+	int pcm_fds[2] = { -1, -1 };
+	int rv = -1;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, bt_fds) == -1 ||
+			socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pcm_fds) == -1)
+		goto fail;
+
+	t->bt_fd = bt_fds[1];
+	pcm->fd = pcm_fds[1];
+	w.fd = pcm_fds[0];
+
+	r->sampling = pcm->sampling;
+	r->channels = pcm->channels;
+	r->frames = frames;
+
+	if (ba_transport_pcm_start(pcm, enc, "encode", true) == -1 ||
+			ba_transport_thread_state_wait_running(&t->thread_enc) == -1)
+		goto fail;
+
+	struct timespec ts0;
+	const unsigned long allocations0 = allocations_get();
+
+	gettimestamp(&ts0);
+	pthread_create(&w.thread, NULL, bench_write_pcm, &w);
+
+	rv = bench_read(bt_fds[0], &w, r, packets, 0, &ts0);
+	r->allocations = allocations_get() - allocations0;
+
+	pthread_join(w.thread, NULL);
+
+fail:
+	pthread_mutex_lock(&pcm->mutex);
+	ba_transport_pcm_release(pcm);
+	pthread_mutex_unlock(&pcm->mutex);
+	ba_transport_stop(t);
+	if (bt_fds[0] != -1)
+		close(bt_fds[0]);
+	if (pcm_fds[0] != -1)
+		close(pcm_fds[0]);
+	return rv;
+}
+
+/**
+ * Run decoding benchmark.
+ *
+ * BT packets captured by the encoding benchmark are written to the
+ * decoder thread as fast as possible. */
+static int bench_decode(struct ba_transport *t, ba_transport_pcm_thread_func dec,
+		const struct bench_packets *packets, struct bench_result *r) {
+
+	struct ba_transport_pcm *pcm = t->thread_dec.pcm;
+	struct bench_writer w = { .packets = packets };
+	int bt_fds[2] = { -1, -1 };
+	int pcm_fds[2] = { -1, -1 };
+	int rv = -1;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, bt_fds) == -1 ||
+			socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, pcm_fds) == -1)
+		goto fail;
+
+	t->bt_fd = bt_fds[1];
+	pcm->fd = pcm_fds[1];
+	w.fd = bt_fds[0];
+
+	r->sampling = pcm->sampling;
+	r->channels = pcm->channels;
+	r->packets = packets->count;
+	r->bytes = packets->size;
+
+	if (ba_transport_pcm_start(pcm, dec, "decode", true) == -1 ||
+			ba_transport_thread_state_wait_running(&t->thread_dec) == -1)
+		goto fail;
+
+	struct timespec ts0;
+	const unsigned long allocations0 = allocations_get();
+	const size_t frame_size = pcm->channels * BA_TRANSPORT_PCM_FORMAT_BYTES(pcm->format);
+
+	gettimestamp(&ts0);
+	pthread_create(&w.thread, NULL, bench_write_bt, &w);
+
+	rv = bench_read(pcm_fds[0], &w, r, NULL, frame_size, &ts0);
+	r->allocations = allocations_get() - allocations0;
+
+	pthread_join(w.thread, NULL);
+
+fail:
+	pthread_mutex_lock(&pcm->mutex);
+	ba_transport_pcm_release(pcm);
+	pthread_mutex_unlock(&pcm->mutex);
+	ba_transport_stop(t);
+	if (bt_fds[0] != -1)
+		close(bt_fds[0]);
+	if (pcm_fds[0] != -1)
+		close(pcm_fds[0]);
+	return rv;
+}
+
+static struct ba_transport *bench_transport_new(const struct bench_codec *c,
+		struct ba_device *device, bool source) {
+
+	struct ba_transport *t;
+
+	if (c->a2dp_source != NULL)
+		t = test_transport_new_a2dp(device,
+				source ? BA_TRANSPORT_PROFILE_A2DP_SOURCE : BA_TRANSPORT_PROFILE_A2DP_SINK,
+				"/bench", source ? c->a2dp_source : c->a2dp_sink, c->configuration);
+	else {
+		t = test_transport_new_sco(device, BA_TRANSPORT_PROFILE_HFP_AG, "/bench");
+		ba_transport_set_codec(t, c->hfp_codec_id);
+	}
+
+	t->mtu_read = t->mtu_write = c->mtu;
+
+	return t;
+}
+
+static void bench_result_print(const struct bench_result *r,
+		enum bench_format format, bool first) {
+
+	const double seconds = r->time.tv_sec + r->time.tv_nsec / 1e9;
+	const double frames_per_sec = seconds > 0 ? r->frames / seconds : 0;
+	const double realtime_factor = frames_per_sec / r->sampling;
+	const double ns_per_frame = r->frames > 0 ? seconds * 1e9 / r->frames : 0;
+	const double bytes_per_packet = r->packets > 0 ? 1.0 * r->bytes / r->packets : 0;
+
+	switch (format) {
+	case BENCH_FORMAT_CSV:
+		if (first)
+			printf("codec,mode,sampling,channels,frames,packets,bytes_per_packet,"
+					"time_ms,frames_per_sec,realtime_factor,ns_per_frame,allocations\n");
+		printf("%s,%s,%u,%u,%zu,%zu,%.1f,%.3f,%.0f,%.2f,%.1f,%lu\n",
+				r->codec, r->mode, r->sampling, r->channels, r->frames, r->packets,
+				bytes_per_packet, seconds * 1e3, frames_per_sec, realtime_factor,
+				ns_per_frame, r->allocations);
+		break;
+	case BENCH_FORMAT_JSON:
+		printf("%s{\"codec\": \"%s\", \"mode\": \"%s\", \"sampling\": %u, "
+				"\"channels\": %u, \"frames\": %zu, \"packets\": %zu, "
+				"\"bytes_per_packet\": %.1f, \"time_ms\": %.3f, "
+				"\"frames_per_sec\": %.0f, \"realtime_factor\": %.2f, "
+				"\"ns_per_frame\": %.1f, \"allocations\": %lu}",
+				first ? "[\n  " : ",\n  ",
+				r->codec, r->mode, r->sampling, r->channels, r->frames, r->packets,
+				bytes_per_packet, seconds * 1e3, frames_per_sec, realtime_factor,
+				ns_per_frame, r->allocations);
+		break;
+	}
+
+}
+
+static void bench_volume_scale_double(int32_t *buffer, size_t samples,
+		double ch1, double ch2) {
+	for (size_t i = 0; i < samples; i += 2) {
+		buffer[i + 0] = buffer[i + 0] * ch1;
+		buffer[i + 1] = buffer[i + 1] * ch2;
+	}
+}
+
+/**
+ * Run volume scaling benchmark.
+ *
+ * Stereo S32_4LE signal is scaled with the floating-point reference and
+ * with the Q31 fixed-point gain using every PCM processing implementation
+ * supported by the CPU. */
+static void bench_volume(size_t frames, enum bench_format format, bool *first) {
+
+	const enum audio_impl impls[] = {
+		AUDIO_IMPL_GENERIC, AUDIO_IMPL_SSE2, AUDIO_IMPL_AVX2, AUDIO_IMPL_NEON };
+	const double ch1 = 0.7, ch2 = 0.3;
+	const int64_t ch1_q31 = audio_scale_to_q31(ch1);
+	const int64_t ch2_q31 = audio_scale_to_q31(ch2);
+	static int32_t buffer[2 * 4096];
+	struct timespec ts0, ts;
+	char mode[32];
+
+	const enum audio_impl impl = audio_impl_get();
+
+	srandom(1234);
+	for (size_t i = 0; i < ARRAYSIZE(buffer); i++)
+		buffer[i] = random();
+
+	/* the first run is the floating-point reference */
+	for (ssize_t n = -1; n < (ssize_t)ARRAYSIZE(impls); n++) {
+
+		struct bench_result r = { .codec = "volume", .mode = "double",
+			.sampling = 48000, .channels = 2, .frames = frames };
+
+		if (n >= 0) {
+			if (audio_impl_select(impls[n]) == -1)
+				continue;
+			snprintf(mode, sizeof(mode), "q31-%s", audio_impl_name(impls[n]));
+			r.mode = mode;
+		}
+
+		gettimestamp(&ts0);
+		for (size_t i = 0; i < frames; i += ARRAYSIZE(buffer) / 2) {
+			const size_t count = MIN(frames - i, ARRAYSIZE(buffer) / 2);
+			if (n == -1)
+				bench_volume_scale_double(buffer, count * 2, ch1, ch2);
+			else
+				audio_scale_s32_4le_q31(buffer, count, 2, ch1_q31, ch2_q31);
+		}
+		gettimestamp(&ts);
+		timespecsub(&ts, &ts0, &r.time);
+
+		bench_result_print(&r, format, *first);
+		*first = false;
+
+	}
+
+	audio_impl_select(impl);
+
+}
+
+int main(int argc, char *argv[]) {
+
+	const struct bench_codec codecs[] = {
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_SBC),
+			&a2dp_sbc_source, &a2dp_sbc_sink, &config_sbc_44100_stereo, 0,
+			153 * 3, a2dp_sbc_enc_thread, a2dp_sbc_dec_thread },
+#if ENABLE_MP3LAME
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_MPEG12),
+			&a2dp_mpeg_source, &a2dp_mpeg_sink, &config_mp3_44100_stereo, 0,
+			1024, a2dp_mp3_enc_thread, a2dp_mpeg_dec_thread },
+#endif
+#if ENABLE_AAC
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_MPEG24),
+			&a2dp_aac_source, &a2dp_aac_sink, &config_aac_44100_stereo, 0,
+			450, a2dp_aac_enc_thread, a2dp_aac_dec_thread },
+#endif
+#if ENABLE_APTX
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_VENDOR_APTX),
+			&a2dp_aptx_source, &a2dp_aptx_sink, &config_aptx_44100_stereo, 0,
+# if HAVE_APTX_DECODE
+			400, a2dp_aptx_enc_thread, a2dp_aptx_dec_thread },
+# else
+			400, a2dp_aptx_enc_thread, NULL },
+# endif
+#endif
+#if ENABLE_APTX_HD
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_VENDOR_APTX_HD),
+			&a2dp_aptx_hd_source, &a2dp_aptx_hd_sink, &config_aptx_hd_44100_stereo, 0,
+# if HAVE_APTX_HD_DECODE
+			600, a2dp_aptx_hd_enc_thread, a2dp_aptx_hd_dec_thread },
+# else
+			600, a2dp_aptx_hd_enc_thread, NULL },
+# endif
+#endif
+#if ENABLE_FASTSTREAM
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_VENDOR_FASTSTREAM),
+			&a2dp_faststream_source, &a2dp_faststream_sink, &config_faststream_44100_16000, 0,
+			72 * 3, a2dp_faststream_enc_thread, a2dp_faststream_dec_thread },
+#endif
+#if ENABLE_LC3PLUS
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_VENDOR_LC3PLUS),
+			&a2dp_lc3plus_source, &a2dp_lc3plus_sink, &config_lc3plus_48000_stereo, 0,
+			RTP_HEADER_LEN + sizeof(rtp_media_header_t) + 300,
+			a2dp_lc3plus_enc_thread, a2dp_lc3plus_dec_thread },
+#endif
+#if ENABLE_LDAC
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_VENDOR_LDAC),
+			&a2dp_ldac_source, &a2dp_ldac_sink, &config_ldac_44100_stereo, 0,
+			RTP_HEADER_LEN + sizeof(rtp_media_header_t) + 990 + 6,
+# if HAVE_LDAC_DECODE
+			a2dp_ldac_enc_thread, a2dp_ldac_dec_thread },
+# else
+			a2dp_ldac_enc_thread, NULL },
+# endif
+#endif
+		{ hfp_codec_id_to_string(HFP_CODEC_CVSD),
+			NULL, NULL, NULL, HFP_CODEC_CVSD,
+			48, sco_enc_thread, sco_dec_thread },
+#if ENABLE_MSBC
+		{ hfp_codec_id_to_string(HFP_CODEC_MSBC),
+			NULL, NULL, NULL, HFP_CODEC_MSBC,
+			24, sco_enc_thread, sco_dec_thread },
+#endif
+	};
+
+	int opt;
+	const char *opts = "hf:t:";
+	struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ "format", required_argument, NULL, 'f' },
+		{ "time", required_argument, NULL, 't' },
+		{ 0, 0, 0, 0 },
+	};
+
+	enum bench_format format = BENCH_FORMAT_CSV;
+	unsigned int duration = 10;
+
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */ :
+			printf("Usage:\n"
+					"  %s [OPTION]... [CODEC|volume]...\n"
+					"\nOptions:\n"
+					"  -h, --help\t\tprint this help and exit\n"
+					"  -f, --format=FMT\toutput format: csv (default) or json\n"
+					"  -t, --time=SEC\tprocess SEC seconds of audio per codec\n",
+					argv[0]);
+			return EXIT_SUCCESS;
+		case 'f' /* --format=FMT */ :
+			if (strcasecmp(optarg, "csv") == 0)
+				format = BENCH_FORMAT_CSV;
+			else if (strcasecmp(optarg, "json") == 0)
+				format = BENCH_FORMAT_JSON;
+			else {
+				error("Invalid output format: %s", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 't' /* --time=SEC */ : {
+			char *tmp;
+			const long sec = strtol(optarg, &tmp, 10);
+			if (sec < 1 || sec > 3600 || optarg == tmp || *tmp != '\0') {
+				error("Invalid audio duration [1, 3600]: %s", optarg);
+				return EXIT_FAILURE;
+			}
+			duration = sec;
+			break;
+		}
+		default:
+			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+
+	unsigned int enabled_codecs = 0xFFFF;
+	bool enabled_volume = true;
+
+	if (optind != argc) {
+		enabled_codecs = 0;
+		enabled_volume = false;
+	}
+
+	for (; optind < argc; optind++) {
+		if (strcasecmp(argv[optind], "volume") == 0)
+			enabled_volume = true;
+		for (size_t i = 0; i < ARRAYSIZE(codecs); i++)
+			if (strcasecmp(argv[optind], codecs[i].name) == 0)
+				enabled_codecs |= 1 << i;
+	}
+
+	bluealsa_config_init();
+	audio_init();
+	/* process data as fast as possible */
+	config.io_disable_pacing = true;
+
+	bdaddr_t addr1 = {{ 1, 2, 3, 4, 5, 6 }};
+	bdaddr_t addr2 = {{ 1, 2, 3, 7, 8, 9 }};
+	adapter = ba_adapter_new(0);
+	adapter->hci.features[2] = LMP_TRSP_SCO;
+	adapter->hci.features[3] = LMP_ESCO;
+	device1 = ba_device_new(adapter, &addr1);
+	device2 = ba_device_new(adapter, &addr2);
+
+	allocations_ignore_set();
+
+	bool first = true;
+	int rv = EXIT_SUCCESS;
+
+	for (size_t i = 0; i < ARRAYSIZE(codecs); i++) {
+
+		if (!(enabled_codecs & (1 << i)))
+			continue;
+
+		const struct bench_codec *c = &codecs[i];
+		struct ba_transport *t1 = bench_transport_new(c, device1, true);
+		struct ba_transport *t2 = bench_transport_new(c, device2, false);
+		struct bench_packets packets = { 0 };
+		struct bench_result r_enc = { .codec = c->name, .mode = "encode" };
+		struct bench_result r_dec = { .codec = c->name, .mode = "decode" };
+
+		if (bench_encode(t1, c->enc, duration * t1->thread_enc.pcm->sampling, &r_enc, &packets) == -1) {
+			error("Couldn't benchmark %s encoder: %s", c->name, strerror(errno));
+			rv = EXIT_FAILURE;
+			goto next;
+		}
+
+		bench_result_print(&r_enc, format, first);
+		first = false;
+
+		if (c->dec == NULL)
+			goto next;
+
+		if (bench_decode(t2, c->dec, &packets, &r_dec) == -1) {
+			error("Couldn't benchmark %s decoder: %s", c->name, strerror(errno));
+			rv = EXIT_FAILURE;
+			goto next;
+		}
+
+		bench_result_print(&r_dec, format, first);
+
+next:
+		bench_packets_free(&packets);
+		ba_transport_destroy(t1);
+		ba_transport_destroy(t2);
+
+	}
+
+	if (enabled_volume)
+		bench_volume(duration * 48000, format, &first);
+
+	if (format == BENCH_FORMAT_JSON)
+		printf(first ? "[]\n" : "\n]\n");
+
+	return rv;
+}
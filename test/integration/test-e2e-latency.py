@@ -14,7 +14,9 @@ import time
 from csv import DictWriter
 from math import ceil, floor
 from random import randint
+from statistics import mean
 from struct import Struct
+from threading import Thread
 
 # Format mapping between BlueALSA
 # and Python struct module
@@ -44,6 +46,16 @@ def samplerate_sync(t0: float, frames: int, sampling: int):
         print(f"Rate sync overdue: {-delta:.6f}")
 
 
+def print_reported_delay(pcm_path, options, interval):
+    """Periodically print the PCM delay reported by BlueALSA."""
+    cmd = ['bluealsa-cli', *options, 'info', pcm_path]
+    while True:
+        time.sleep(interval)
+        for line in subprocess.check_output(cmd, text=True).splitlines():
+            if line.startswith('Delay:'):
+                print(f"Reported {line}")
+
+
 def test_pcm_write(pcm, pcm_format, pcm_channels, pcm_sampling, interval):
     """Write PCM test signal.
 
@@ -102,7 +114,18 @@ def test_pcm_write(pcm, pcm_format, pcm_channels, pcm_sampling, interval):
         samplerate_sync(t0, frames, pcm_sampling)
 
 
-def test_pcm_read(pcm, pcm_format, pcm_channels, pcm_sampling, interval):
+def print_latency_summary(latencies):
+    """Print latency statistics to the standard error."""
+    if not latencies:
+        return
+    print(f"Latency: mean {mean(latencies) * 1000:.1f} ms, "
+          f"min {min(latencies) * 1000:.1f} ms, "
+          f"max {max(latencies) * 1000:.1f} ms, "
+          f"samples {len(latencies)}", file=sys.stderr)
+
+
+def test_pcm_read(pcm, pcm_format, pcm_channels, pcm_sampling, interval,
+                  latencies):
     """Read PCM test signal."""
 
     fmt = FORMATS[pcm_format]
@@ -124,6 +147,7 @@ def test_pcm_read(pcm, pcm_format, pcm_channels, pcm_sampling, interval):
             if t_signal > 0:
                 t = time.time()
                 t_expected = floor(t / interval) * interval
+                latencies.append(t - t_expected)
                 csv.writerow({'time': t,
                               'expected': float(t_expected),
                               'latency': t - t_expected,
@@ -142,6 +166,8 @@ parser.add_argument('-i', '--interval', type=int, metavar='SEC', default=2,
                     help='signal interval in seconds; default: 2')
 parser.add_argument('-t', '--timeout', type=int, metavar='SEC', default=60,
                     help='test timeout in seconds; default: 60')
+parser.add_argument('-L', '--latency', type=str, choices=['normal', 'low'],
+                    help='set PCM latency class before running the test')
 parser.add_argument('PCM_PATH', type=str,
                     help='D-Bus path of the BlueALSA PCM device')
 
@@ -152,6 +178,11 @@ options = ["--verbose"]
 if args.dbus:
     options.append(f'--dbus={args.dbus}')
 
+if args.latency:
+    cmd = ['bluealsa-cli', *options, 'latency', args.PCM_PATH, args.latency]
+    if subprocess.call(cmd) != 0:
+        sys.exit(1)
+
 try:  # Get info for given BlueALSA PCM device
     cmd = ['bluealsa-cli', *options, 'info', args.PCM_PATH]
     output = subprocess.check_output(cmd, text=True)
@@ -165,6 +196,7 @@ sampling = int(info['sampling'].split()[0])
 
 print(f"Bluetooth: {info['transport']} {info['selected codec']}")
 print(f"PCM: {info['format']} {channels} channels {sampling} Hz")
+print(f"Latency class: {info.get('latency', 'normal')}")
 print("==========")
 
 cmd = ['bluealsa-cli', *options, 'open', args.PCM_PATH]
@@ -174,9 +206,16 @@ client = subprocess.Popen(cmd, stdin=subprocess.PIPE, stdout=subprocess.PIPE)
 time.sleep(1)
 
 if info['mode'] == 'sink':
+    # Delay is updated by the encoder while the PCM is running, so query
+    # it in the background not to disturb the signal timing.
+    Thread(target=print_reported_delay, daemon=True,
+           args=(args.PCM_PATH, options, args.interval)).start()
     test_pcm_write(client.stdin, info['format'], channels, sampling,
                    args.interval)
 
 if info['mode'] == 'source':
+    latencies = []
+    signal.signal(signal.SIGALRM,
+                  lambda *_: (print_latency_summary(latencies), sys.exit(0)))
     test_pcm_read(client.stdout, info['format'], channels, sampling,
-                  args.interval)
+                  args.interval, latencies)
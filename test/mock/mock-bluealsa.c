@@ -45,6 +45,7 @@
 #include "ba-transport.h"
 #include "ba-transport-pcm.h"
 #include "bluealsa-config.h"
+#include "bluealsa-dbus.h"
 #include "bluez.h"
 #include "codec-sbc.h"
 #include "hfp.h"
@@ -121,7 +122,7 @@ static void *mock_dec(struct ba_transport_pcm *t_pcm) {
 
 	const unsigned int channels = t_pcm->channels;
 	const unsigned int samplerate = t_pcm->sampling;
-	struct pollfd fds[1] = {{ th->pipe[0], POLLIN, 0 }};
+	struct pollfd fds[1] = {{ th->event_fd, POLLIN, 0 }};
 	struct asrsync asrs = { .frames = 0 };
 	int16_t buffer[1024 * 2];
 	int x = 0;
@@ -138,17 +139,18 @@ static void *mock_dec(struct ba_transport_pcm *t_pcm) {
 		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
 		if (poll_rv == 1 && fds[0].revents & POLLIN) {
-			/* dispatch incoming event */
-			enum ba_transport_thread_signal signal;
-			ba_transport_thread_signal_recv(th, &signal);
-			switch (signal) {
-			case BA_TRANSPORT_THREAD_SIGNAL_PCM_OPEN:
-			case BA_TRANSPORT_THREAD_SIGNAL_PCM_RESUME:
-				asrs.frames = 0;
-				continue;
-			default:
-				continue;
-			}
+			/* dispatch all pending signals */
+			struct ba_transport_thread_signal_msg msg;
+			while (ba_transport_thread_signal_recv(th, &msg) == 0)
+				switch (msg.signal) {
+				case BA_TRANSPORT_THREAD_SIGNAL_PCM_OPEN:
+				case BA_TRANSPORT_THREAD_SIGNAL_PCM_RESUME:
+					asrs.frames = 0;
+					break;
+				default:
+					break;
+				}
+			continue;
 		}
 
 		fprintf(stderr, ".");
@@ -338,6 +340,54 @@ static struct ba_transport *mock_transport_new_sco(const char *device_btmac,
 	return t;
 }
 
+/**
+ * Emulate rapid volume changes of the given A2DP transport.
+ *
+ * The first burst of changes shall be announced with two D-Bus signals: the
+ * first change right away and the rest merged into a single signal. Then the
+ * PCM is muted and unmuted, and the transport is destroyed before the second
+ * change can be announced, so only the muted volume shall be reported. */
+static void mock_transport_volume_burst(struct ba_transport *t) {
+
+	struct ba_transport_pcm *pcm = &t->a2dp.pcm;
+	/* interval between two PropertiesChanged signals */
+	const unsigned int interval_us = 1000000 / MAX(config.dbus_update_rate, 1);
+	const bool muted = true;
+	const bool unmuted = false;
+
+	usleep(mock_fuzzing_ms * 1000);
+
+	for (int i = mock_volume_burst - 1; i >= 0; i--) {
+		const int level = -100 * i;
+		pthread_mutex_lock(&pcm->mutex);
+		ba_transport_pcm_volume_set(&pcm->volume[0], &level, NULL, NULL);
+		ba_transport_pcm_volume_set(&pcm->volume[1], &level, NULL, NULL);
+		pthread_mutex_unlock(&pcm->mutex);
+		bluealsa_dbus_pcm_update(pcm, BA_DBUS_PCM_UPDATE_VOLUME);
+	}
+
+	/* wait for the merged update to be emitted */
+	usleep(3 * interval_us);
+
+	pthread_mutex_lock(&pcm->mutex);
+	ba_transport_pcm_volume_set(&pcm->volume[0], NULL, &muted, NULL);
+	ba_transport_pcm_volume_set(&pcm->volume[1], NULL, &muted, NULL);
+	pthread_mutex_unlock(&pcm->mutex);
+	bluealsa_dbus_pcm_update(pcm, BA_DBUS_PCM_UPDATE_VOLUME);
+
+	pthread_mutex_lock(&pcm->mutex);
+	ba_transport_pcm_volume_set(&pcm->volume[0], NULL, &unmuted, NULL);
+	ba_transport_pcm_volume_set(&pcm->volume[1], NULL, &unmuted, NULL);
+	pthread_mutex_unlock(&pcm->mutex);
+	bluealsa_dbus_pcm_update(pcm, BA_DBUS_PCM_UPDATE_VOLUME);
+
+	ba_transport_destroy(t);
+
+	/* make sure that the dropped update would have been emitted by now */
+	usleep(3 * interval_us);
+
+}
+
 static void *mock_bluealsa_service_thread(void *userdata) {
 	(void)userdata;
 
@@ -430,6 +480,12 @@ static void *mock_bluealsa_service_thread(void *userdata) {
 					BA_TRANSPORT_PROFILE_HSP_AG, MOCK_BLUEZ_SCO_PATH_2));
 	}
 
+	if (mock_volume_burst > 0 && config.profile.a2dp_source && tt->len > 0) {
+		/* the first transport is the A2DP Source of the first device */
+		mock_transport_volume_burst(tt->pdata[0]);
+		g_ptr_array_remove_index(tt, 0);
+	}
+
 	mock_sem_wait(mock_sem_timeout);
 
 	for (i = 0; i < tt->len; i++) {
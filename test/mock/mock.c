@@ -47,6 +47,7 @@ GAsyncQueue *mock_sem_timeout = NULL;
 GAsyncQueue *mock_sem_quit = NULL;
 bool mock_dump_output = false;
 int mock_fuzzing_ms = 0;
+int mock_volume_burst = 0;
 
 void mock_sem_signal(GAsyncQueue *sem) {
 	g_async_queue_push(sem, GINT_TO_POINTER(1));
@@ -79,6 +80,7 @@ int main(int argc, char *argv[]) {
 		{ "device-name", required_argument, NULL, 2 },
 		{ "dump-output", no_argument, NULL, 6 },
 		{ "fuzzing", required_argument, NULL, 7 },
+		{ "volume-burst", required_argument, NULL, 8 },
 		{ 0, 0, 0, 0 },
 	};
 
@@ -98,7 +100,8 @@ int main(int argc, char *argv[]) {
 					"  -t, --timeout=MSEC\t\tmock server exit timeout\n"
 					"  --device-name=MAC:NAME\tmock BT device name\n"
 					"  --dump-output\t\t\tdump Bluetooth transport data\n"
-					"  --fuzzing=MSEC\t\tmock human actions with timings\n",
+					"  --fuzzing=MSEC\t\tmock human actions with timings\n"
+					"  --volume-burst=NUM\t\tmock NUM rapid volume changes\n",
 					argv[0]);
 			return EXIT_SUCCESS;
 		case 'B' /* --dbus=NAME */ :
@@ -162,6 +165,9 @@ int main(int argc, char *argv[]) {
 		case 7 /* --fuzzing=MSEC */ :
 			mock_fuzzing_ms = atoi(optarg);
 			break;
+		case 8 /* --volume-burst=NUM */ :
+			mock_volume_burst = atoi(optarg);
+			break;
 		default:
 			fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
 			return EXIT_FAILURE;
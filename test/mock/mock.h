@@ -36,6 +36,7 @@ extern GAsyncQueue *mock_sem_quit;
 
 extern bool mock_dump_output;
 extern int mock_fuzzing_ms;
+extern int mock_volume_burst;
 
 int mock_bluez_device_name_mapping_add(const char *mapping);
 void mock_bluealsa_dbus_name_acquired(GDBusConnection *conn, const char *name, void *userdata);
@@ -27,6 +27,7 @@
 #include "ba-transport.h"
 #include "ba-transport-pcm.h"
 #include "bluealsa-config.h"
+#include "bluealsa-dbus.h"
 #include "codec-sbc.h"
 #include "shared/a2dp-codecs.h"
 #include "shared/defs.h"
@@ -40,6 +41,12 @@ bool ba_transport_pcm_is_active(const struct ba_transport_pcm *pcm) { (void)pcm;
 int ba_transport_pcm_release(struct ba_transport_pcm *pcm) { (void)pcm; return -1; }
 int ba_transport_stop_if_no_clients(struct ba_transport *t) { (void)t; return -1; }
 int ba_transport_thread_bt_release(struct ba_transport_thread *th) { (void)th; return -1; }
+void ba_transport_group_write(struct ba_transport *t,
+		const struct iovec *packets, size_t count) {
+	(void)t; (void)packets; (void)count; }
+void ba_transport_group_writev(struct ba_transport *t,
+		const struct iovec *iov, size_t iovcnt) {
+	(void)t; (void)iov; (void)iovcnt; }
 int ba_transport_pcm_start(struct ba_transport_pcm *pcm,
 		ba_transport_pcm_thread_func th_func, const char *name, bool master) {
 	(void)pcm; (void)th_func; (void)name; (void)master; return -1; }
@@ -47,9 +54,11 @@ int ba_transport_thread_state_set(struct ba_transport_thread *th,
 		enum ba_transport_thread_state state) {
 	(void)th; (void)state; return -1; }
 int ba_transport_thread_signal_recv(struct ba_transport_thread *th,
-		enum ba_transport_thread_signal *signal) {
-	(void)th; (void)signal; return -1; }
+		struct ba_transport_thread_signal_msg *msg) {
+	(void)th; (void)msg; return -1; }
 void ba_transport_pcm_thread_cleanup(struct ba_transport_pcm *pcm) { (void)pcm; }
+void bluealsa_dbus_pcm_update(struct ba_transport_pcm *pcm, unsigned int mask) {
+	(void)pcm; (void)mask; }
 
 CK_START_TEST(test_a2dp_codecs_codec_id_from_string) {
 	ck_assert_int_eq(a2dp_codecs_codec_id_from_string("SBC"), A2DP_CODEC_SBC);
@@ -251,6 +260,30 @@ CK_START_TEST(test_a2dp_select_configuration) {
 
 } CK_END_TEST
 
+CK_START_TEST(test_a2dp_sbc_select_low_latency) {
+
+	a2dp_sbc_t caps = {
+		.block_length = SBC_BLOCK_LENGTH_8 | SBC_BLOCK_LENGTH_16,
+		.subbands = SBC_SUBBANDS_4 | SBC_SUBBANDS_8 };
+	a2dp_sbc_t cfg = {
+		.block_length = SBC_BLOCK_LENGTH_16,
+		.subbands = SBC_SUBBANDS_8 };
+
+	a2dp_sbc_select_low_latency(&a2dp_sbc_source, &cfg, &caps);
+	ck_assert_int_eq(cfg.block_length, SBC_BLOCK_LENGTH_8);
+	ck_assert_int_eq(cfg.subbands, SBC_SUBBANDS_4);
+
+	/* keep selected configuration if nothing smaller is supported */
+	caps.block_length = SBC_BLOCK_LENGTH_16;
+	caps.subbands = SBC_SUBBANDS_8;
+	cfg.block_length = SBC_BLOCK_LENGTH_16;
+	cfg.subbands = SBC_SUBBANDS_8;
+	a2dp_sbc_select_low_latency(&a2dp_sbc_source, &cfg, &caps);
+	ck_assert_int_eq(cfg.block_length, SBC_BLOCK_LENGTH_16);
+	ck_assert_int_eq(cfg.subbands, SBC_SUBBANDS_8);
+
+} CK_END_TEST
+
 int main(void) {
 
 	Suite *s = suite_create(__FILE__);
@@ -272,6 +305,7 @@ int main(void) {
 	tcase_add_test(tc, test_a2dp_check_configuration);
 	tcase_add_test(tc, test_a2dp_filter_capabilities);
 	tcase_add_test(tc, test_a2dp_select_configuration);
+	tcase_add_test(tc, test_a2dp_sbc_select_low_latency);
 
 	srunner_run_all(sr, CK_ENV);
 	int nf = srunner_ntests_failed(sr);
@@ -8,13 +8,17 @@
  *
  */
 
+#include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <check.h>
 
 #include "audio.h"
+#include "audio-plc.h"
 #include "shared/defs.h"
+#include "shared/log.h"
 
 #include "inc/check.inc"
 
@@ -128,6 +132,323 @@ CK_START_TEST(test_audio_scale_s32_4le) {
 
 } CK_END_TEST
 
+CK_START_TEST(test_audio_scale_s32_4le_q31) {
+
+	const int32_t in[] = { 0x12345678, -0x23456789, INT32_MAX / 2, INT32_MIN / 2 };
+	const int32_t sat[] = { INT32_MAX, INT32_MIN, INT32_MAX, INT32_MIN };
+	int32_t tmp[ARRAYSIZE(in)];
+
+	/* gains above 0 dB shall saturate instead of wrapping around */
+	memcpy(tmp, in, sizeof(tmp));
+	audio_scale_s32_4le_q31(tmp, ARRAYSIZE(tmp) / 2, 2,
+			audio_scale_to_q31(8.0), audio_scale_to_q31(8.0));
+	ck_assert_int_eq(memcmp(tmp, sat, sizeof(sat)), 0);
+
+	/* for gains below 0 dB the result shall be exact up to 1 LSB */
+	const double scale = 0.123456789;
+	memcpy(tmp, in, sizeof(tmp));
+	audio_scale_s32_4le_q31(tmp, ARRAYSIZE(tmp), 1, audio_scale_to_q31(scale), 0);
+	for (size_t i = 0; i < ARRAYSIZE(in); i++)
+		ck_assert_int_le(labs(tmp[i] - (long)(in[i] * scale)), 1);
+
+} CK_END_TEST
+
+CK_START_TEST(test_audio_reduce_s32_4le_to_s16_2le) {
+
+	const int32_t in[] = { 0x1234C000, 0x00008000, -0x00008001, INT32_MAX, INT32_MIN };
+	const int16_t out_ref[] = { 0x1235, 1, -1, INT16_MAX, INT16_MIN };
+	int16_t out[ARRAYSIZE(in)];
+
+	/* without dither samples are rounded to the nearest value */
+	audio_reduce_s32_4le_to_s16_2le(in, ARRAYSIZE(in), out, NULL);
+	ck_assert_int_eq(memcmp(out, out_ref, sizeof(out_ref)), 0);
+
+	static int32_t level[4096];
+	static int16_t noise[ARRAYSIZE(level)];
+	uint32_t dither = 0;
+	long sum = 0;
+
+	/* dither shall not exceed +/-1 LSB and shall have zero mean */
+	audio_reduce_s32_4le_to_s16_2le(level, ARRAYSIZE(level), noise, &dither);
+	for (size_t i = 0; i < ARRAYSIZE(noise); i++) {
+		ck_assert_int_le(abs(noise[i]), 1);
+		sum += noise[i];
+	}
+	ck_assert_int_lt(labs(sum), ARRAYSIZE(noise) / 20);
+	ck_assert_uint_ne(dither, 0);
+
+	/* dithered signal shall preserve the sub-LSB level of the source, which
+	 * is 0x1234 + 0x5678 / 0x10000 = 4660.34 in the 16-bit domain */
+	for (size_t i = 0; i < ARRAYSIZE(level); i++)
+		level[i] = 0x12345678;
+	audio_reduce_s32_4le_to_s16_2le(level, ARRAYSIZE(level), noise, &dither);
+	sum = 0;
+	for (size_t i = 0; i < ARRAYSIZE(noise); i++) {
+		ck_assert_int_ge(noise[i], 0x1234 - 1);
+		ck_assert_int_le(noise[i], 0x1234 + 1);
+		sum += noise[i] - 0x1234;
+	}
+	/* without dither the mean would be 0 (all samples rounded down) */
+	ck_assert_int_gt(sum, ARRAYSIZE(noise) * 0x5678 / 0x10000 - ARRAYSIZE(noise) / 20);
+	ck_assert_int_lt(sum, ARRAYSIZE(noise) * 0x5678 / 0x10000 + ARRAYSIZE(noise) / 20);
+
+} CK_END_TEST
+
+CK_START_TEST(test_audio_pack_unpack_s24_3le) {
+
+	const int16_t in16[] = { 0x0123, -0x1234 };
+	const uint8_t out16_ref[] = { 0x00, 0x23, 0x01, 0x00, 0xCC, 0xED };
+	const int32_t in24[] = { 0x012345, -0x123456 };
+	const uint8_t out24_ref[] = { 0x45, 0x23, 0x01, 0xAA, 0xCB, 0xED };
+
+	uint8_t out[6];
+	int16_t out16[ARRAYSIZE(in16)];
+	int32_t out24[ARRAYSIZE(in24)];
+
+	audio_pack_s16_2le_to_s24_3le(in16, ARRAYSIZE(in16), out);
+	ck_assert_int_eq(memcmp(out, out16_ref, sizeof(out16_ref)), 0);
+	audio_unpack_s24_3le_to_s16_2le(out, ARRAYSIZE(in16), out16);
+	ck_assert_int_eq(memcmp(out16, in16, sizeof(in16)), 0);
+
+	audio_pack_s24_4le_to_s24_3le(in24, ARRAYSIZE(in24), out);
+	ck_assert_int_eq(memcmp(out, out24_ref, sizeof(out24_ref)), 0);
+	audio_unpack_s24_3le_to_s24_4le(out, ARRAYSIZE(in24), out24);
+	ck_assert_int_eq(memcmp(out24, in24, sizeof(in24)), 0);
+
+} CK_END_TEST
+
+CK_START_TEST(test_audio_mix) {
+
+	int16_t out16[] = { 0x1000, INT16_MAX - 1, INT16_MIN + 1, -0x1000 };
+	const int16_t in16[] = { 0x0234, 0x0100, -0x0100, 0x0200 };
+	const int16_t out16_ref[] = { 0x1234, INT16_MAX, INT16_MIN, -0x0E00 };
+	int32_t out24[] = { 0x100000, 0x7FFFF0, -0x7FFFF0, 0x7F000000 | 0x000010 };
+	const int32_t in24[] = { 0x023456, 0x000100, -0x000100, 0x000020 };
+	const int32_t out24_ref[] = { 0x123456, 0x7FFFFF, -0x800000, 0x000030 };
+	int32_t out32[] = { 0x10000000, INT32_MAX - 1, INT32_MIN + 1, -0x10000000 };
+	const int32_t in32[] = { 0x02345678, 0x00000100, -0x00000100, 0x02000000 };
+	const int32_t out32_ref[] = { 0x12345678, INT32_MAX, INT32_MIN, -0x0E000000 };
+
+	audio_mix_s16_2le(out16, in16, ARRAYSIZE(in16));
+	ck_assert_int_eq(memcmp(out16, out16_ref, sizeof(out16_ref)), 0);
+
+	/* padding byte of the 24-bit sample shall be ignored */
+	audio_mix_s24_4le(out24, in24, ARRAYSIZE(in24));
+	ck_assert_int_eq(memcmp(out24, out24_ref, sizeof(out24_ref)), 0);
+
+	audio_mix_s32_4le(out32, in32, ARRAYSIZE(in32));
+	ck_assert_int_eq(memcmp(out32, out32_ref, sizeof(out32_ref)), 0);
+
+} CK_END_TEST
+
+CK_START_TEST(test_audio_impl) {
+
+	const double scales[][2] = {
+		{ 0.0, 0.5 }, { 1.0, 0.25 }, { 0.3, 0.7 },
+		{ 0.999, 1.0 }, { 1.5, 0.5 }, { 2.0, 3.0 } };
+
+	int16_t in16[2 * 131], ref16[ARRAYSIZE(in16)], out16[ARRAYSIZE(in16)];
+	int32_t in32[2 * 131], ref32[ARRAYSIZE(in32)], out32[ARRAYSIZE(in32)];
+	int16_t mix16[ARRAYSIZE(in16)];
+	int32_t mix32[ARRAYSIZE(in32)];
+	int16_t ref16_ch[2][ARRAYSIZE(in16) / 2], out16_ch[2][ARRAYSIZE(in16) / 2];
+	int32_t ref32_ch[2][ARRAYSIZE(in32) / 2], out32_ch[2][ARRAYSIZE(in32) / 2];
+	uint8_t ref24[3 * ARRAYSIZE(in32)], out24[3 * ARRAYSIZE(in32)];
+
+	srandom(1234);
+	for (size_t i = 0; i < ARRAYSIZE(in16); i++)
+		in16[i] = random();
+	for (size_t i = 0; i < ARRAYSIZE(in32); i++)
+		in32[i] = random() * 2 + (i % 3 == 0 ? INT32_MIN : 0);
+	/* make sure that extreme values are tested */
+	in16[0] = INT16_MIN; in16[1] = INT16_MAX;
+	in32[0] = INT32_MIN; in32[1] = INT32_MAX;
+	/* mixing with reversed signal covers both saturation directions */
+	for (size_t i = 0; i < ARRAYSIZE(in16); i++)
+		mix16[i] = in16[ARRAYSIZE(in16) - 1 - i];
+	for (size_t i = 0; i < ARRAYSIZE(in32); i++)
+		mix32[i] = in32[ARRAYSIZE(in32) - 1 - i];
+
+	const enum audio_impl impls[] = {
+		AUDIO_IMPL_SSE2, AUDIO_IMPL_SSSE3, AUDIO_IMPL_AVX2, AUDIO_IMPL_NEON };
+
+	for (size_t n = 0; n < ARRAYSIZE(impls); n++) {
+
+		ck_assert_int_eq(audio_impl_select(AUDIO_IMPL_GENERIC), 0);
+		if (audio_impl_select(impls[n]) == -1) {
+			debug("Skipping not supported implementation: %s", audio_impl_name(impls[n]));
+			continue;
+		}
+
+		debug("Testing implementation: %s", audio_impl_name(impls[n]));
+
+		/* check frame counts which do not fit in the vector registers */
+		for (size_t frames = 1; frames <= ARRAYSIZE(in16) / 2; frames += 13) {
+
+			audio_impl_select(AUDIO_IMPL_GENERIC);
+			audio_deinterleave_s16_2le(in16, frames, 2, ref16_ch[0], ref16_ch[1]);
+			audio_deinterleave_s32_4le(in32, frames, 2, ref32_ch[0], ref32_ch[1]);
+			audio_interleave_s16_2le(ref16_ch[0], ref16_ch[1], frames, 2, ref16);
+			audio_interleave_s32_4le(ref32_ch[0], ref32_ch[1], frames, 2, ref32);
+
+			audio_impl_select(impls[n]);
+			audio_deinterleave_s16_2le(in16, frames, 2, out16_ch[0], out16_ch[1]);
+			audio_deinterleave_s32_4le(in32, frames, 2, out32_ch[0], out32_ch[1]);
+			audio_interleave_s16_2le(out16_ch[0], out16_ch[1], frames, 2, out16);
+			audio_interleave_s32_4le(out32_ch[0], out32_ch[1], frames, 2, out32);
+
+			ck_assert_int_eq(memcmp(out16_ch[0], ref16_ch[0], frames * sizeof(int16_t)), 0);
+			ck_assert_int_eq(memcmp(out16_ch[1], ref16_ch[1], frames * sizeof(int16_t)), 0);
+			ck_assert_int_eq(memcmp(out32_ch[0], ref32_ch[0], frames * sizeof(int32_t)), 0);
+			ck_assert_int_eq(memcmp(out32_ch[1], ref32_ch[1], frames * sizeof(int32_t)), 0);
+			ck_assert_int_eq(memcmp(out16, ref16, frames * 2 * sizeof(int16_t)), 0);
+			ck_assert_int_eq(memcmp(out32, ref32, frames * 2 * sizeof(int32_t)), 0);
+
+			audio_impl_select(AUDIO_IMPL_GENERIC);
+			audio_pack_s16_2le_to_s24_3le(in16, frames * 2, ref24);
+			audio_unpack_s24_3le_to_s16_2le(ref24, frames * 2, ref16);
+			audio_impl_select(impls[n]);
+			audio_pack_s16_2le_to_s24_3le(in16, frames * 2, out24);
+			audio_unpack_s24_3le_to_s16_2le(out24, frames * 2, out16);
+			ck_assert_int_eq(memcmp(out24, ref24, frames * 2 * 3), 0);
+			ck_assert_int_eq(memcmp(out16, ref16, frames * 2 * sizeof(int16_t)), 0);
+
+			audio_impl_select(AUDIO_IMPL_GENERIC);
+			audio_pack_s24_4le_to_s24_3le(in32, frames * 2, ref24);
+			audio_unpack_s24_3le_to_s24_4le(ref24, frames * 2, ref32);
+			audio_impl_select(impls[n]);
+			audio_pack_s24_4le_to_s24_3le(in32, frames * 2, out24);
+			audio_unpack_s24_3le_to_s24_4le(out24, frames * 2, out32);
+			ck_assert_int_eq(memcmp(out24, ref24, frames * 2 * 3), 0);
+			ck_assert_int_eq(memcmp(out32, ref32, frames * 2 * sizeof(int32_t)), 0);
+
+			memcpy(ref16, in16, sizeof(ref16));
+			memcpy(out16, in16, sizeof(out16));
+			audio_impl_select(AUDIO_IMPL_GENERIC);
+			audio_mix_s16_2le(ref16, mix16, frames * 2);
+			audio_impl_select(impls[n]);
+			audio_mix_s16_2le(out16, mix16, frames * 2);
+			ck_assert_int_eq(memcmp(out16, ref16, sizeof(out16)), 0);
+
+			memcpy(ref32, in32, sizeof(ref32));
+			memcpy(out32, in32, sizeof(out32));
+			audio_impl_select(AUDIO_IMPL_GENERIC);
+			audio_mix_s24_4le(ref32, mix32, frames * 2);
+			audio_impl_select(impls[n]);
+			audio_mix_s24_4le(out32, mix32, frames * 2);
+			ck_assert_int_eq(memcmp(out32, ref32, sizeof(out32)), 0);
+
+			memcpy(ref32, in32, sizeof(ref32));
+			memcpy(out32, in32, sizeof(out32));
+			audio_impl_select(AUDIO_IMPL_GENERIC);
+			audio_mix_s32_4le(ref32, mix32, frames * 2);
+			audio_impl_select(impls[n]);
+			audio_mix_s32_4le(out32, mix32, frames * 2);
+			ck_assert_int_eq(memcmp(out32, ref32, sizeof(out32)), 0);
+
+			/* silence left, right and both channels */
+			for (unsigned int mask = 1; mask <= 3; mask++) {
+
+				const bool ch1 = mask & 1;
+				const bool ch2 = mask & 2;
+
+				memcpy(ref16, in16, sizeof(ref16));
+				memcpy(ref32, in32, sizeof(ref32));
+				audio_impl_select(AUDIO_IMPL_GENERIC);
+				audio_silence_s16_2le(ref16, frames, 2, ch1, ch2);
+				audio_silence_s32_4le(ref32, frames, 2, ch1, ch2);
+
+				memcpy(out16, in16, sizeof(out16));
+				memcpy(out32, in32, sizeof(out32));
+				audio_impl_select(impls[n]);
+				audio_silence_s16_2le(out16, frames, 2, ch1, ch2);
+				audio_silence_s32_4le(out32, frames, 2, ch1, ch2);
+
+				ck_assert_int_eq(memcmp(out16, ref16, sizeof(out16)), 0);
+				ck_assert_int_eq(memcmp(out32, ref32, sizeof(out32)), 0);
+
+			}
+
+			for (size_t i = 0; i < ARRAYSIZE(scales); i++) {
+
+				memcpy(ref16, in16, sizeof(ref16));
+				memcpy(ref32, in32, sizeof(ref32));
+				audio_impl_select(AUDIO_IMPL_GENERIC);
+				audio_scale_s16_2le(ref16, frames, 2, scales[i][0], scales[i][1]);
+				audio_scale_s32_4le(ref32, frames, 2, scales[i][0], scales[i][1]);
+
+				memcpy(out16, in16, sizeof(out16));
+				memcpy(out32, in32, sizeof(out32));
+				audio_impl_select(impls[n]);
+				audio_scale_s16_2le(out16, frames, 2, scales[i][0], scales[i][1]);
+				audio_scale_s32_4le(out32, frames, 2, scales[i][0], scales[i][1]);
+
+				ck_assert_int_eq(memcmp(out16, ref16, sizeof(out16)), 0);
+				ck_assert_int_eq(memcmp(out32, ref32, sizeof(out32)), 0);
+
+			}
+
+		}
+
+	}
+
+	audio_impl_select(AUDIO_IMPL_GENERIC);
+
+} CK_END_TEST
+
+CK_START_TEST(test_audio_plc) {
+
+	struct audio_plc plc;
+	int16_t in[2 * 480], buffer[ARRAYSIZE(in)];
+	size_t i;
+
+	ck_assert_int_eq(audio_plc_init(&plc, 0), -1);
+	ck_assert_int_eq(errno, EINVAL);
+	ck_assert_int_eq(audio_plc_init(&plc, AUDIO_PLC_MAX_CHANNELS + 1), -1);
+	ck_assert_int_eq(errno, EINVAL);
+
+	/* signal on the left channel and silence on the right one */
+	srandom(1234);
+	for (i = 0; i < ARRAYSIZE(in) / 2; i++) {
+		in[i * 2 + 0] = random() % 16000 - 8000;
+		in[i * 2 + 1] = 0;
+	}
+
+	ck_assert_int_eq(audio_plc_init(&plc, 2), 0);
+
+	/* correctly received signal shall not be modified */
+	memcpy(buffer, in, sizeof(buffer));
+	audio_plc_rx(&plc, buffer, ARRAYSIZE(buffer) / 2);
+	ck_assert_int_eq(memcmp(buffer, in, sizeof(in)), 0);
+
+	/* conceal lost 5 ms of audio */
+	const size_t lost = 240;
+	memcpy(buffer, in, sizeof(buffer));
+	audio_plc_fillin(&plc, buffer, lost);
+
+	int64_t energy = 0;
+	for (i = 0; i < lost; i++) {
+		/* channels shall be concealed independently */
+		ck_assert_int_eq(buffer[i * 2 + 1], 0);
+		energy += (int64_t)buffer[i * 2 + 0] * buffer[i * 2 + 0];
+	}
+
+#if ENABLE_MSBC
+	/* concealment shall continue the received signal */
+	ck_assert_int_gt(energy, 0);
+#else
+	/* without spandsp, missing audio shall be replaced with silence */
+	ck_assert_int_eq(energy, 0);
+#endif
+
+	/* buffer beyond the concealed frames shall not be touched */
+	ck_assert_int_eq(memcmp(&buffer[lost * 2], &in[lost * 2],
+				sizeof(in) - lost * 2 * sizeof(*in)), 0);
+
+	audio_plc_free(&plc);
+
+} CK_END_TEST
+
 int main(void) {
 
 	Suite *s = suite_create(__FILE__);
@@ -140,6 +461,12 @@ int main(void) {
 	tcase_add_test(tc, test_audio_interleave_deinterleave_s32_4le);
 	tcase_add_test(tc, test_audio_scale_s16_2le);
 	tcase_add_test(tc, test_audio_scale_s32_4le);
+	tcase_add_test(tc, test_audio_scale_s32_4le_q31);
+	tcase_add_test(tc, test_audio_reduce_s32_4le_to_s16_2le);
+	tcase_add_test(tc, test_audio_pack_unpack_s24_3le);
+	tcase_add_test(tc, test_audio_mix);
+	tcase_add_test(tc, test_audio_impl);
+	tcase_add_test(tc, test_audio_plc);
 
 	srunner_run_all(sr, CK_ENV);
 	int nf = srunner_ntests_failed(sr);
@@ -14,13 +14,16 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
@@ -42,6 +45,7 @@
 #endif
 #include "storage.h"
 #include "shared/a2dp-codecs.h"
+#include "shared/defs.h"
 #include "shared/log.h"
 
 #include "../src/ba-transport.c"
@@ -120,6 +124,70 @@ CK_START_TEST(test_ba_device) {
 
 } CK_END_TEST
 
+static unsigned int codec_cache_free_count = 0;
+static void codec_cache_free(void *handle) {
+	(void)handle;
+	codec_cache_free_count++;
+}
+
+CK_START_TEST(test_ba_device_codec_cache) {
+
+	struct ba_adapter *a;
+	struct ba_device *d;
+	bdaddr_t addr = { 0 };
+
+	ck_assert_ptr_ne(a = ba_adapter_new(0), NULL);
+	ck_assert_ptr_ne(d = ba_device_new(a, &addr), NULL);
+	ba_adapter_unref(a);
+
+	const a2dp_sbc_t config1 = { .min_bitpool = 2, .max_bitpool = 53 };
+	const a2dp_sbc_t config2 = { .min_bitpool = 2, .max_bitpool = 35 };
+	int handle1, handle2, handle3;
+
+	codec_cache_free_count = 0;
+	ck_assert_ptr_eq(ba_device_codec_cache_take(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE, A2DP_CODEC_SBC, true,
+				&config1, sizeof(config1)), NULL);
+
+	ba_device_codec_cache_store(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE, A2DP_CODEC_SBC, true,
+			&config1, sizeof(config1), &handle1, codec_cache_free);
+	ba_device_codec_cache_store(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE, A2DP_CODEC_SBC, false,
+			&config1, sizeof(config1), &handle2, codec_cache_free);
+
+	/* context is matched by the direction and the configuration */
+	ck_assert_ptr_eq(ba_device_codec_cache_take(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE, A2DP_CODEC_SBC, true,
+				&config2, sizeof(config2)), NULL);
+	ck_assert_ptr_eq(ba_device_codec_cache_take(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE, A2DP_CODEC_SBC, true,
+				&config1, sizeof(config1)), &handle1);
+	/* taken context is removed from the cache */
+	ck_assert_ptr_eq(ba_device_codec_cache_take(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE, A2DP_CODEC_SBC, true,
+				&config1, sizeof(config1)), NULL);
+	ck_assert_uint_eq(codec_cache_free_count, 0);
+
+	/* old context is released when replaced with a new one */
+	ba_device_codec_cache_store(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE, A2DP_CODEC_SBC, false,
+			&config2, sizeof(config2), &handle3, codec_cache_free);
+	ck_assert_uint_eq(codec_cache_free_count, 1);
+	ck_assert_ptr_eq(ba_device_codec_cache_take(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE, A2DP_CODEC_SBC, false,
+				&config1, sizeof(config1)), NULL);
+
+	/* HFP codec IDs shall not collide with the A2DP ones */
+	int handle4;
+	ba_device_codec_cache_store(d, BA_TRANSPORT_PROFILE_HFP_AG, HFP_CODEC_MSBC, true,
+			NULL, 0, &handle4, codec_cache_free);
+	ck_assert_ptr_eq(ba_device_codec_cache_take(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE,
+				A2DP_CODEC_MPEG24, true, NULL, 0), NULL);
+	ck_assert_ptr_eq(ba_device_codec_cache_take(d, BA_TRANSPORT_PROFILE_HFP_AG,
+				HFP_CODEC_MSBC, true, NULL, 0), &handle4);
+	ba_device_codec_cache_store(d, BA_TRANSPORT_PROFILE_HFP_AG, HFP_CODEC_MSBC, true,
+			NULL, 0, &handle4, codec_cache_free);
+	ck_assert_uint_eq(codec_cache_free_count, 1);
+
+	/* cached contexts are released with the device */
+	ba_device_unref(d);
+	ck_assert_uint_eq(codec_cache_free_count, 3);
+
+} CK_END_TEST
+
 CK_START_TEST(test_ba_transport) {
 
 	struct ba_adapter *a;
@@ -254,6 +322,92 @@ CK_START_TEST(test_ba_transport_threads_sync_termination) {
 
 } CK_END_TEST
 
+static int test_signal_fds[2];
+static struct ba_transport_thread_signal_msg test_signal_msgs[
+	BA_TRANSPORT_THREAD_SIGNAL_QUEUE_SIZE + 1];
+
+static void *signal_consumer_thread(struct ba_transport_pcm *t_pcm) {
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+	struct ba_transport_thread *th = t_pcm->th;
+	ba_transport_thread_state_set_running(th);
+
+	/* wait until the signal queue is full */
+	char c;
+	ck_assert_int_eq(read(test_signal_fds[0], &c, 1), 1);
+
+	size_t n = 0;
+	while (n < ARRAYSIZE(test_signal_msgs)) {
+		struct pollfd pfd = { th->event_fd, POLLIN, 0 };
+		ck_assert_int_eq(poll(&pfd, 1, -1), 1);
+		while (n < ARRAYSIZE(test_signal_msgs) &&
+				ba_transport_thread_signal_recv(th, &test_signal_msgs[n]) == 0)
+			n++;
+	}
+
+	ba_transport_pcm_thread_cleanup(t_pcm);
+	return NULL;
+}
+
+CK_START_TEST(test_ba_transport_thread_signal) {
+
+	struct ba_adapter *a;
+	struct ba_device *d;
+	struct ba_transport *t_sco;
+	bdaddr_t addr = { 0 };
+
+	ck_assert_ptr_ne(a = ba_adapter_new(0), NULL);
+	ck_assert_ptr_ne(d = ba_device_new(a, &addr), NULL);
+
+	t_sco = ba_transport_new_sco(d, BA_TRANSPORT_PROFILE_HSP_AG, "/owner", "/path/sco", -1);
+	ck_assert_ptr_ne(t_sco, NULL);
+
+	t_sco->bt_fd = 0;
+	t_sco->mtu_read = 48;
+	t_sco->mtu_write = 48;
+
+	struct ba_transport_thread *th = &t_sco->thread_enc;
+	ck_assert_int_eq(pipe(test_signal_fds), 0);
+	ck_assert_int_eq(ba_transport_pcm_start(th->pcm, signal_consumer_thread, "signal", true), 0);
+	ck_assert_int_eq(ba_transport_thread_state_wait_running(th), 0);
+
+	struct ba_transport_thread_signal_msg msg = {
+		.signal = BA_TRANSPORT_THREAD_SIGNAL_PCM_SYNC };
+	for (size_t i = 0; i < BA_TRANSPORT_THREAD_SIGNAL_QUEUE_SIZE; i++) {
+		msg.value = i;
+		ck_assert_int_eq(ba_transport_thread_signal_send_msg(th, &msg), 0);
+	}
+
+	/* the signal queue shall be full now */
+	ck_assert_int_eq(mpscq_push(&th->signals, &msg), false);
+	ck_assert_int_eq(write(test_signal_fds[1], "", 1), 1);
+
+	/* sending shall wait for the IO thread instead of dropping the signal */
+	msg.value = BA_TRANSPORT_THREAD_SIGNAL_QUEUE_SIZE;
+	ck_assert_int_eq(ba_transport_thread_signal_send_msg(th, &msg), 0);
+
+	ck_assert_int_eq(ba_transport_thread_state_wait_terminated(th), 0);
+
+	/* signals shall be received in order together with the payload */
+	for (size_t i = 0; i < ARRAYSIZE(test_signal_msgs); i++) {
+		ck_assert_int_eq(test_signal_msgs[i].signal, BA_TRANSPORT_THREAD_SIGNAL_PCM_SYNC);
+		ck_assert_int_eq(test_signal_msgs[i].value, i);
+	}
+
+	/* terminated thread shall not accept signals */
+	ck_assert_int_eq(ba_transport_thread_signal_send_msg(th, &msg), -1);
+	ck_assert_int_eq(errno, ESRCH);
+
+	close(test_signal_fds[0]);
+	close(test_signal_fds[1]);
+
+	ba_adapter_unref(a);
+	ba_device_unref(d);
+	ba_transport_unref(t_sco);
+	ck_assert_ptr_eq(ba_adapter_lookup(0), NULL);
+
+} CK_END_TEST
+
 CK_START_TEST(test_ba_transport_pcm_format) {
 
 	uint16_t format_u8 = BA_TRANSPORT_PCM_FORMAT_U8;
@@ -308,6 +462,36 @@ CK_START_TEST(test_ba_transport_pcm_volume) {
 	ck_assert_int_eq(ba_transport_pcm_volume_range_to_level(15, HFP_VOLUME_GAIN_MAX), 0);
 	ck_assert_int_eq(ba_transport_pcm_volume_level_to_range(0, HFP_VOLUME_GAIN_MAX), 15);
 
+	struct ba_transport_pcm *pcm = &t_a2dp->a2dp.pcm;
+	struct ba_transport_pcm_volume_snapshot snapshot;
+	const int level = -600;
+	const bool mute = true;
+
+	pcm->soft_volume = false;
+	ba_transport_pcm_volume_set(&pcm->volume[0], &level, NULL, NULL);
+	ba_transport_pcm_volume_set(&pcm->volume[1], NULL, &mute, NULL);
+	ba_transport_pcm_volume_sync(pcm);
+
+	ba_transport_pcm_volume_snapshot(pcm, &snapshot);
+	ck_assert_int_eq(snapshot.soft_volume, false);
+	ck_assert(snapshot.scale[0] == pcm->volume[0].scale);
+	ck_assert(snapshot.scale[0] > 0.5 && snapshot.scale[0] < 0.51);
+	ck_assert(snapshot.scale[1] == 0);
+	ck_assert_int_eq(snapshot.scale_q31[0], pcm->volume[0].scale_q31);
+	ck_assert_int_eq(snapshot.scale_q15[1], 0);
+	ck_assert_int_eq(snapshot.scale_q31[1], 0);
+
+	/* snapshot shall not change until synced */
+	pcm->soft_volume = true;
+	ba_transport_pcm_volume_snapshot(pcm, &snapshot);
+	ck_assert_int_eq(snapshot.soft_volume, false);
+	ba_transport_pcm_volume_sync(pcm);
+	ba_transport_pcm_volume_snapshot(pcm, &snapshot);
+	ck_assert_int_eq(snapshot.soft_volume, true);
+
+	/* release PCM marked for the storage update */
+	ck_assert_int_eq(storage_flush(), 0);
+
 	ba_transport_unref(t_a2dp);
 	ba_transport_unref(t_sco);
 
@@ -315,6 +499,98 @@ CK_START_TEST(test_ba_transport_pcm_volume) {
 
 } CK_END_TEST
 
+CK_START_TEST(test_ba_transport_group) {
+
+	struct ba_adapter *a;
+	struct ba_device *d;
+	struct ba_transport *t, *m1, *m2, *m3;
+	bdaddr_t addr = { 0 };
+
+	ck_assert_ptr_ne(a = ba_adapter_new(0), NULL);
+	ck_assert_ptr_ne(d = ba_device_new(a, &addr), NULL);
+
+	struct a2dp_codec codec = { .dir = A2DP_SOURCE, .codec_id = A2DP_CODEC_SBC,
+		.capabilities_size = sizeof(a2dp_sbc_t) };
+	a2dp_sbc_t configuration = { .channel_mode = SBC_CHANNEL_MODE_STEREO };
+	a2dp_sbc_t configuration_mono = { .channel_mode = SBC_CHANNEL_MODE_MONO };
+	ck_assert_ptr_ne(t = ba_transport_new_a2dp(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE,
+				"/owner", "/path/a2dp/1", &codec, &configuration), NULL);
+	ck_assert_ptr_ne(m1 = ba_transport_new_a2dp(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE,
+				"/owner", "/path/a2dp/2", &codec, &configuration), NULL);
+	ck_assert_ptr_ne(m2 = ba_transport_new_a2dp(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE,
+				"/owner", "/path/a2dp/3", &codec, &configuration), NULL);
+	ck_assert_ptr_ne(m3 = ba_transport_new_a2dp(d, BA_TRANSPORT_PROFILE_A2DP_SOURCE,
+				"/owner", "/path/a2dp/4", &codec, &configuration_mono), NULL);
+
+	ba_adapter_unref(a);
+	ba_device_unref(d);
+
+	/* leader can not be a member of its own group */
+	struct ba_transport *members_self[] = { m1, t };
+	ck_assert_int_eq(ba_transport_group_set(t, members_self, 2), -1);
+	ck_assert_int_eq(errno, EINVAL);
+
+	/* members have to use the same codec configuration */
+	struct ba_transport *members_mono[] = { m3 };
+	ck_assert_int_eq(ba_transport_group_set(t, members_mono, 1), -1);
+	ck_assert_int_eq(errno, EINVAL);
+
+	struct ba_transport *members[] = { m1, m2 };
+	ck_assert_int_eq(ba_transport_group_set(t, members, 2), 0);
+	ck_assert_int_eq(ba_transport_group_is_member(m1), true);
+	ck_assert_int_eq(ba_transport_group_is_member(t), false);
+
+	/* nested groups are not supported */
+	struct ba_transport *members_nested[] = { m2 };
+	ck_assert_int_eq(ba_transport_group_set(m1, members_nested, 1), -1);
+	ck_assert_int_eq(errno, EBUSY);
+
+	int fds1[2], fds2[2];
+	ck_assert_int_eq(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds1), 0);
+	ck_assert_int_eq(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds2), 0);
+	t->a2dp.group[0].bt_fd = fds1[0];
+	t->a2dp.group[1].bt_fd = fds2[0];
+
+	/* packets shall be forwarded to all members */
+	const struct iovec packets[] = {
+		{ .iov_base = "RTP1", .iov_len = 4 },
+		{ .iov_base = "RTP22", .iov_len = 5 } };
+	ba_transport_group_write(t, packets, ARRAYSIZE(packets));
+
+	char buffer[16];
+	ck_assert_int_eq(read(fds1[1], buffer, sizeof(buffer)), 4);
+	ck_assert_int_eq(read(fds1[1], buffer, sizeof(buffer)), 5);
+	ck_assert_int_eq(read(fds2[1], buffer, sizeof(buffer)), 4);
+	ck_assert_int_eq(read(fds2[1], buffer, sizeof(buffer)), 5);
+	ck_assert_mem_eq(buffer, "RTP22", 5);
+
+	/* disconnected member shall be detached from the group */
+	close(fds2[1]);
+	ba_transport_group_write(t, packets, 1);
+	ck_assert_int_eq(t->a2dp.group[1].bt_fd, -1);
+	ck_assert_int_eq(read(fds1[1], buffer, sizeof(buffer)), 4);
+
+	/* retained member shall keep its BT socket */
+	struct ba_transport *members_one[] = { m1 };
+	ck_assert_int_eq(ba_transport_group_set(t, members_one, 1), 0);
+	ck_assert_int_eq(t->a2dp.group[0].bt_fd, fds1[0]);
+	ck_assert_int_eq(ba_transport_group_is_member(m2), false);
+
+	/* dissolve the group */
+	ck_assert_int_eq(ba_transport_group_set(t, NULL, 0), 0);
+	ck_assert_int_eq(ba_transport_group_is_member(m1), false);
+	ck_assert_int_eq(read(fds1[1], buffer, sizeof(buffer)), 0);
+	close(fds1[1]);
+
+	ba_transport_unref(t);
+	ba_transport_unref(m1);
+	ba_transport_unref(m2);
+	ba_transport_unref(m3);
+
+	ck_assert_ptr_eq(ba_adapter_lookup(0), NULL);
+
+} CK_END_TEST
+
 static int test_cascade_free_transport_unref(struct ba_transport *t) {
 	return ba_transport_unref(t), 0;
 }
@@ -349,7 +625,8 @@ CK_START_TEST(test_storage) {
 		"DelayAdjustments=SBC:-200\n"
 		"SoftVolume=false\n"
 		"Volume=-5600;-4800;\n"
-		"Mute=false;true;\n";
+		"Mute=false;true;\n"
+		"LowLatency=true\n";
 
 	FILE *f;
 	ck_assert_ptr_ne(f = fopen(storage_path, "w"), NULL);
@@ -379,6 +656,7 @@ CK_START_TEST(test_storage) {
 	ck_assert_int_eq(t->a2dp.pcm.volume[1].level, -4800);
 	ck_assert_int_eq(t->a2dp.pcm.volume[1].soft_mute, true);
 	ck_assert_int_eq(ba_transport_pcm_delay_adjustment_get(&t->a2dp.pcm), -200);
+	ck_assert_int_eq(t->a2dp.pcm.latency, BA_TRANSPORT_PCM_LATENCY_LOW);
 
 	bool muted = true;
 	int level = ba_transport_pcm_volume_range_to_level(100, BLUEZ_A2DP_VOLUME_MAX);
@@ -386,6 +664,19 @@ CK_START_TEST(test_storage) {
 	ba_transport_pcm_volume_set(&t->a2dp.pcm.volume[1], &level, &muted, NULL);
 	ba_transport_pcm_delay_adjustment_set(&t->a2dp.pcm, A2DP_CODEC_SBC, 140);
 
+	/* volume change shall be written without device disconnection */
+	ba_transport_pcm_volume_sync(&t->a2dp.pcm);
+	ck_assert_int_eq(t->a2dp.pcm.storage_dirty, true);
+	ck_assert_int_eq(storage_flush(), 0);
+	ck_assert_int_eq(t->a2dp.pcm.storage_dirty, false);
+
+	char buffer_flush[1024] = { 0 };
+	ck_assert_ptr_ne(f = fopen(storage_path, "r"), NULL);
+	ck_assert_int_gt(fread(buffer_flush, 1, sizeof(buffer_flush), f), 0);
+	ck_assert_int_eq(fclose(f), 0);
+	ck_assert_ptr_ne(strstr(buffer_flush, "Volume=-344;-344;\n"), NULL);
+	ck_assert_ptr_ne(strstr(buffer_flush, "DelayAdjustments=SBC:140;\n"), NULL);
+
 	ba_adapter_unref(a);
 	ba_device_unref(d);
 	ba_transport_unref(t);
@@ -393,7 +684,7 @@ CK_START_TEST(test_storage) {
 
 	char buffer[1024] = { 0 };
 	ck_assert_ptr_ne(f = fopen(storage_path, "r"), NULL);
-	ck_assert_int_eq(fread(buffer, 1, sizeof(buffer), f), 256);
+	ck_assert_int_eq(fread(buffer, 1, sizeof(buffer), f), 289);
 	ck_assert_int_eq(fclose(f), 0);
 
 	const char *storage_data_new =
@@ -402,12 +693,14 @@ CK_START_TEST(test_storage) {
 		"SoftVolume=false\n"
 		"Volume=-344;-344;\n"
 		"Mute=true;true;\n"
+		"LowLatency=true\n"
 		"\n"
 		"[/org/bluealsa/hci0/dev_00_11_22_33_44_55/a2dpsnk/sink]\n"
 		"DelayAdjustments=\n"
 		"SoftVolume=true\n"
 		"Volume=0;0;\n"
-		"Mute=false;false;\n";
+		"Mute=false;false;\n"
+		"LowLatency=false\n";
 
 	/* check if persistent storage was updated */
 	ck_assert_str_eq(buffer, storage_data_new);
@@ -427,12 +720,15 @@ int main(void) {
 
 	tcase_add_test(tc, test_ba_adapter);
 	tcase_add_test(tc, test_ba_device);
+	tcase_add_test(tc, test_ba_device_codec_cache);
 	tcase_add_test(tc, test_ba_transport);
 	tcase_add_test(tc, test_ba_transport_sco_one_only);
 	tcase_add_test(tc, test_ba_transport_sco_default_codec);
 	tcase_add_test(tc, test_ba_transport_threads_sync_termination);
+	tcase_add_test(tc, test_ba_transport_thread_signal);
 	tcase_add_test(tc, test_ba_transport_pcm_format);
 	tcase_add_test(tc, test_ba_transport_pcm_volume);
+	tcase_add_test(tc, test_ba_transport_group);
 	tcase_add_test(tc, test_cascade_free);
 	tcase_add_test(tc, test_storage);
 
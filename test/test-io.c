@@ -15,6 +15,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <poll.h>
 #include <pthread.h>
 #include <stdbool.h>
@@ -24,6 +25,7 @@
 #include <string.h>
 #include <strings.h>
 #include <sys/socket.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <bluetooth/bluetooth.h>
@@ -68,6 +70,9 @@
 #include "bluealsa-config.h"
 #include "bluealsa-dbus.h"
 #include "bluez.h"
+#if ENABLE_APTX || ENABLE_APTX_HD
+# include "codec-aptx.h"
+#endif
 #include "hfp.h"
 #include "io.h"
 #if ENABLE_OFONO
@@ -85,6 +90,7 @@
 #include "../src/ba-transport.c"
 #include "inc/btd.inc"
 #include "inc/check.inc"
+#include "inc/io.inc"
 #include "inc/sine.inc"
 
 #define CHECK_VERSION ( \
@@ -92,111 +98,6 @@
 		(CHECK_MINOR_VERSION << 8 & 0x00ff00) | \
 		(CHECK_MICRO_VERSION << 0 & 0x0000ff))
 
-void *a2dp_aac_dec_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_aac_enc_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_aptx_dec_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_aptx_enc_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_aptx_hd_dec_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_aptx_hd_enc_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_faststream_dec_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_faststream_enc_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_lc3plus_dec_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_lc3plus_enc_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_ldac_dec_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_ldac_enc_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_mp3_enc_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_mpeg_dec_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_sbc_dec_thread(struct ba_transport_pcm *t_pcm);
-void *a2dp_sbc_enc_thread(struct ba_transport_pcm *t_pcm);
-void *sco_dec_thread(struct ba_transport_pcm *t_pcm);
-void *sco_enc_thread(struct ba_transport_pcm *t_pcm);
-
-int bluealsa_dbus_pcm_register(struct ba_transport_pcm *pcm) {
-	debug("%s: %p", __func__, (void *)pcm); (void)pcm; return 0; }
-void bluealsa_dbus_pcm_update(struct ba_transport_pcm *pcm, unsigned int mask) {
-	debug("%s: %p %#x", __func__, (void *)pcm, mask); (void)pcm; (void)mask; }
-void bluealsa_dbus_pcm_unregister(struct ba_transport_pcm *pcm) {
-	debug("%s: %p", __func__, (void *)pcm); (void)pcm; }
-struct ba_rfcomm *ba_rfcomm_new(struct ba_transport *sco, int fd) {
-	debug("%s: %p", __func__, (void *)sco); (void)sco; (void)fd; return NULL; }
-void ba_rfcomm_destroy(struct ba_rfcomm *r) {
-	debug("%s: %p", __func__, (void *)r); (void)r; }
-int ba_rfcomm_send_signal(struct ba_rfcomm *r, enum ba_rfcomm_signal sig) {
-	debug("%s: %p: %#x", __func__, (void *)r, sig); (void)r; (void)sig; return 0; }
-bool bluez_a2dp_set_configuration(const char *current_dbus_sep_path,
-		const struct a2dp_sep *sep, GError **error) {
-	debug("%s: %s: %p", __func__, current_dbus_sep_path, sep);
-	(void)current_dbus_sep_path; (void)sep; (void)error; return false; }
-int ofono_call_volume_update(struct ba_transport *t) {
-	debug("%s: %p", __func__, t); (void)t; return 0; }
-int storage_device_load(const struct ba_device *d) { (void)d; return 0; }
-int storage_device_save(const struct ba_device *d) { (void)d; return 0; }
-int storage_pcm_data_sync(struct ba_transport_pcm *pcm) { (void)pcm; return 0; }
-int storage_pcm_data_update(const struct ba_transport_pcm *pcm) { (void)pcm; return 0; }
-
-static const a2dp_sbc_t config_sbc_44100_stereo = {
-	.frequency = SBC_SAMPLING_FREQ_44100,
-	.channel_mode = SBC_CHANNEL_MODE_STEREO,
-	.block_length = SBC_BLOCK_LENGTH_16,
-	.subbands = SBC_SUBBANDS_8,
-	.allocation_method = SBC_ALLOCATION_LOUDNESS,
-	.min_bitpool = SBC_MIN_BITPOOL,
-	.max_bitpool = SBC_MAX_BITPOOL,
-};
-
-__attribute__ ((unused))
-static a2dp_mpeg_t config_mp3_44100_stereo = {
-	.layer = MPEG_LAYER_MP3,
-	.channel_mode = MPEG_CHANNEL_MODE_STEREO,
-	.frequency = MPEG_SAMPLING_FREQ_44100,
-	MPEG_INIT_BITRATE(0xFFFF)
-};
-
-__attribute__ ((unused))
-static a2dp_aac_t config_aac_44100_stereo = {
-	.object_type = AAC_OBJECT_TYPE_MPEG2_AAC_LC,
-	AAC_INIT_FREQUENCY(AAC_SAMPLING_FREQ_44100)
-	.channels = AAC_CHANNELS_2,
-	AAC_INIT_BITRATE(0xFFFF)
-};
-
-__attribute__ ((unused))
-static const a2dp_aptx_t config_aptx_44100_stereo = {
-	.info = A2DP_SET_VENDOR_ID_CODEC_ID(APTX_VENDOR_ID, APTX_CODEC_ID),
-	.frequency = APTX_SAMPLING_FREQ_44100,
-	.channel_mode = APTX_CHANNEL_MODE_STEREO,
-};
-
-__attribute__ ((unused))
-static const a2dp_aptx_hd_t config_aptx_hd_44100_stereo = {
-	.aptx.info = A2DP_SET_VENDOR_ID_CODEC_ID(APTX_HD_VENDOR_ID, APTX_HD_CODEC_ID),
-	.aptx.frequency = APTX_SAMPLING_FREQ_44100,
-	.aptx.channel_mode = APTX_CHANNEL_MODE_STEREO,
-};
-
-__attribute__ ((unused))
-static const a2dp_faststream_t config_faststream_44100_16000 = {
-	.info = A2DP_SET_VENDOR_ID_CODEC_ID(FASTSTREAM_VENDOR_ID, FASTSTREAM_CODEC_ID),
-	.direction = FASTSTREAM_DIRECTION_MUSIC | FASTSTREAM_DIRECTION_VOICE,
-	.frequency_music = FASTSTREAM_SAMPLING_FREQ_MUSIC_44100,
-	.frequency_voice = FASTSTREAM_SAMPLING_FREQ_VOICE_16000,
-};
-
-__attribute__ ((unused))
-static const a2dp_lc3plus_t config_lc3plus_48000_stereo = {
-	.info = A2DP_SET_VENDOR_ID_CODEC_ID(LC3PLUS_VENDOR_ID, LC3PLUS_CODEC_ID),
-	.frame_duration = LC3PLUS_FRAME_DURATION_050,
-	.channels = LC3PLUS_CHANNELS_2,
-	LC3PLUS_INIT_FREQUENCY(LC3PLUS_SAMPLING_FREQ_48000)
-};
-
-__attribute__ ((unused))
-static const a2dp_ldac_t config_ldac_44100_stereo = {
-	.info = A2DP_SET_VENDOR_ID_CODEC_ID(LDAC_VENDOR_ID, LDAC_CODEC_ID),
-	.frequency = LDAC_SAMPLING_FREQ_44100,
-	.channel_mode = LDAC_CHANNEL_MODE_STEREO,
-};
-
 static struct ba_adapter *adapter = NULL;
 static struct ba_device *device1 = NULL;
 static struct ba_device *device2 = NULL;
@@ -689,6 +590,269 @@ CK_START_TEST(test_a2dp_sbc) {
 
 } CK_END_TEST
 
+CK_START_TEST(test_a2dp_sbc_write_batch) {
+
+	struct ba_transport *t1 = test_transport_new_a2dp(device1,
+			BA_TRANSPORT_PROFILE_A2DP_SOURCE, "/path/sbc", &a2dp_sbc_source,
+			&config_sbc_44100_stereo);
+	struct ba_transport *t2 = test_transport_new_a2dp(device2,
+			BA_TRANSPORT_PROFILE_A2DP_SINK, "/path/sbc", &a2dp_sbc_sink,
+			&config_sbc_44100_stereo);
+
+	/* queue packets for 20 ms of audio */
+	config.a2dp.write_batch_time = 20;
+
+	t1->mtu_read = t1->mtu_write = t2->mtu_read = t2->mtu_write = 153 * 3;
+	test_io(t1, t2, a2dp_sbc_enc_thread, test_io_thread_dump_bt, 2 * 1024);
+
+	config.a2dp.write_batch_time = 0;
+
+	ba_transport_destroy(t1);
+	ba_transport_destroy(t2);
+
+} CK_END_TEST
+
+CK_START_TEST(test_io_bt_write_batch) {
+
+	struct ba_transport *t = test_transport_new_a2dp(device1,
+			BA_TRANSPORT_PROFILE_A2DP_SOURCE, "/path/sbc", &a2dp_sbc_source,
+			&config_sbc_44100_stereo);
+	struct ba_transport_thread *th = &t->thread_enc;
+
+	int bt_fds[2];
+	ck_assert_int_eq(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, bt_fds), 0);
+	debug("Created BT socket pair: %d, %d", bt_fds[0], bt_fds[1]);
+	th->bt_fd = bt_fds[1];
+
+	/* queue packets for 10 ms of audio (441 frames) */
+	config.a2dp.write_batch_time = 10;
+	config.io_disable_pacing = true;
+
+	struct io_poll io = { .timeout = -1 };
+	asrsync_init(&io.asrs, 44100);
+	ck_assert_int_eq(io_bt_batch_init(&io, 64), 0);
+
+	const uint8_t packet[64] = { 0 };
+	uint8_t buffer[128];
+
+	/* packets which carry less than the batching window shall be queued */
+	for (size_t i = 0; i < 3; i++) {
+		ck_assert_int_eq(io_bt_write_batch(&io, th, packet, sizeof(packet)), sizeof(packet));
+		ck_assert_int_eq(io_bt_batch_sync(&io, th, 128), 1);
+		ck_assert_int_eq(read(bt_fds[0], buffer, sizeof(buffer)), -1);
+		ck_assert_int_eq(errno, EAGAIN);
+	}
+
+	/* the whole queue shall be written once the window is filled */
+	ck_assert_int_eq(io_bt_write_batch(&io, th, packet, sizeof(packet)), sizeof(packet));
+	ck_assert_int_eq(io_bt_batch_sync(&io, th, 128), 4 * sizeof(packet));
+	for (size_t i = 0; i < 4; i++)
+		ck_assert_int_eq(read(bt_fds[0], buffer, sizeof(buffer)), sizeof(packet));
+	ck_assert_int_eq(read(bt_fds[0], buffer, sizeof(buffer)), -1);
+	ck_assert_uint_eq(io.asrs.frames, 4 * 128);
+
+#if HAVE_SENDMMSG
+	/* all queued packets shall be written with a single system call */
+	struct histogram_summary summary;
+	histogram_get_summary(&th->pcm->stats.bt_write, &summary);
+	ck_assert_uint_eq(summary.count, 1);
+#endif
+
+	io_bt_batch_free(&io.bt_batch);
+	config.io_disable_pacing = false;
+	config.a2dp.write_batch_time = 0;
+
+	th->bt_fd = -1;
+	close(bt_fds[0]);
+	close(bt_fds[1]);
+	ba_transport_destroy(t);
+
+} CK_END_TEST
+
+CK_START_TEST(test_io_pcm_mix) {
+
+	struct ba_transport *t = test_transport_new_a2dp(device1,
+			BA_TRANSPORT_PROFILE_A2DP_SOURCE, "/path/sbc", &a2dp_sbc_source,
+			&config_sbc_44100_stereo);
+	struct ba_transport_pcm *pcm = &t->a2dp.pcm;
+
+	int fds1[2], fds2[2];
+	ck_assert_int_eq(pipe2(fds1, O_NONBLOCK), 0);
+	ck_assert_int_eq(pipe2(fds2, O_NONBLOCK), 0);
+
+	config.a2dp.max_clients = 2;
+
+	pthread_mutex_lock(&pcm->mutex);
+	const unsigned int id1 = ba_transport_pcm_client_attach(pcm, fds1[0], NULL, -1);
+	const unsigned int id2 = ba_transport_pcm_client_attach(pcm, fds2[0], NULL, -1);
+	/* the number of clients is limited by the configuration */
+	ck_assert_uint_eq(ba_transport_pcm_client_attach(pcm, -1, NULL, -1), 0);
+	ck_assert_int_eq(errno, EBUSY);
+	pthread_mutex_unlock(&pcm->mutex);
+
+	ck_assert_uint_ne(id1, 0);
+	ck_assert_uint_ne(id2, 0);
+	ck_assert_int_eq(ba_transport_pcm_client_is_main(pcm, id1), true);
+	ck_assert_int_eq(ba_transport_pcm_client_is_main(pcm, id2), false);
+
+	const int16_t in1[] = { 100, -100, 200, -200 };
+	const int16_t in2[] = { 10, 10, 20, 20, 30, 30 };
+	const int16_t mix[] = { 110, -90, 220, -180 };
+	int16_t out[16];
+
+	/* signals of both clients shall be mixed, but the main client
+	 * limits the number of samples read from the other client */
+	ck_assert_int_eq(write(fds1[1], in1, sizeof(in1)), sizeof(in1));
+	ck_assert_int_eq(write(fds2[1], in2, sizeof(in2)), sizeof(in2));
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), ARRAYSIZE(mix));
+	ck_assert_int_eq(memcmp(out, mix, sizeof(mix)), 0);
+
+	/* idle main client shall not stall the other client */
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), 2);
+	ck_assert_int_eq(memcmp(out, &in2[4], 2 * sizeof(*in2)), 0);
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), -1);
+	ck_assert_int_eq(errno, EAGAIN);
+
+	/* Partial frame of the other client shall be drained from the FIFO, so
+	 * the FIFO will not be reported as readable over and over again. Such
+	 * frame shall be mixed once the rest of it arrives. */
+	struct pollfd pfd = { fds2[0], POLLIN, 0 };
+	ck_assert_int_eq(write(fds2[1], in2, 3), 3);
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), -1);
+	ck_assert_int_eq(errno, EAGAIN);
+	ck_assert_int_eq(poll(&pfd, 1, 0), 0);
+	ck_assert_int_eq(write(fds2[1], (uint8_t *)in2 + 3, 1), 1);
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), 2);
+	ck_assert_int_eq(memcmp(out, in2, 2 * sizeof(*in2)), 0);
+
+	/* paused client shall not be mixed */
+	ck_assert_int_eq(ba_transport_pcm_client_pause(pcm, id2, true), 0);
+	ck_assert_int_eq(write(fds1[1], in1, sizeof(in1)), sizeof(in1));
+	ck_assert_int_eq(write(fds2[1], in2, sizeof(in2)), sizeof(in2));
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), ARRAYSIZE(in1));
+	ck_assert_int_eq(memcmp(out, in1, sizeof(in1)), 0);
+
+	/* dropped client shall lose its queued samples only */
+	ck_assert_int_eq(ba_transport_pcm_client_drop(pcm, id2), ARRAYSIZE(in2));
+	ck_assert_int_eq(ba_transport_pcm_client_pause(pcm, id2, false), 0);
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), -1);
+	ck_assert_int_eq(errno, EAGAIN);
+
+	/* paused main client shall not stall the other client */
+	ba_transport_pcm_client_pause(pcm, id1, true);
+	ck_assert_int_eq(write(fds1[1], in1, sizeof(in1)), sizeof(in1));
+	ck_assert_int_eq(write(fds2[1], in2, sizeof(in2)), sizeof(in2));
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), ARRAYSIZE(in2));
+	ck_assert_int_eq(memcmp(out, in2, sizeof(in2)), 0);
+
+	/* resumed main client shall continue where it was paused */
+	ba_transport_pcm_client_pause(pcm, id1, false);
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), ARRAYSIZE(in1));
+	ck_assert_int_eq(memcmp(out, in1, sizeof(in1)), 0);
+
+	/* the other client shall be promoted when the main client closes */
+	close(fds1[1]);
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), 0);
+	ck_assert_int_eq(ba_transport_pcm_client_is_main(pcm, id2), true);
+	ck_assert_uint_eq(pcm->clients_len, 0);
+	ck_assert_int_eq(write(fds2[1], in2, sizeof(in2)), sizeof(in2));
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), ARRAYSIZE(in2));
+	ck_assert_int_eq(memcmp(out, in2, sizeof(in2)), 0);
+
+	pthread_mutex_lock(&pcm->mutex);
+	ba_transport_pcm_release(pcm);
+	pthread_mutex_unlock(&pcm->mutex);
+
+	config.a2dp.max_clients = 1;
+
+	close(fds2[1]);
+	ba_transport_destroy(t);
+
+} CK_END_TEST
+
+CK_START_TEST(test_io_pcm_mix_volume) {
+
+	struct ba_transport *t = test_transport_new_a2dp(device1,
+			BA_TRANSPORT_PROFILE_A2DP_SOURCE, "/path/sbc", &a2dp_sbc_source,
+			&config_sbc_44100_stereo);
+	struct ba_transport_pcm *pcm = &t->a2dp.pcm;
+
+	int fds1[2], fds2[2];
+	ck_assert_int_eq(pipe2(fds1, O_NONBLOCK), 0);
+	ck_assert_int_eq(pipe2(fds2, O_NONBLOCK), 0);
+
+	config.a2dp.max_clients = 2;
+
+	pthread_mutex_lock(&pcm->mutex);
+	const unsigned int id1 = ba_transport_pcm_client_attach(pcm, fds1[0], NULL, -1);
+	const unsigned int id2 = ba_transport_pcm_client_attach(pcm, fds2[0], NULL, -1);
+	pthread_mutex_unlock(&pcm->mutex);
+
+	const int16_t in1[] = { 100, -100, 200, -200 };
+	const int16_t in2[] = { 10, 10, 20, 20 };
+	int16_t out[16];
+
+	/* volume shall be in the [0, 100] range */
+	ck_assert_int_eq(ba_transport_pcm_client_set_volume(pcm, id2, 101), -1);
+	ck_assert_int_eq(errno, EINVAL);
+	ck_assert_int_eq(ba_transport_pcm_client_set_volume(pcm, id2 + 1, 50), -1);
+	ck_assert_int_eq(errno, ENOENT);
+
+	/* muted client shall not contribute to the mix */
+	ck_assert_int_eq(ba_transport_pcm_client_set_volume(pcm, id2, 0), 0);
+	ck_assert_int_eq(write(fds1[1], in1, sizeof(in1)), sizeof(in1));
+	ck_assert_int_eq(write(fds2[1], in2, sizeof(in2)), sizeof(in2));
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), ARRAYSIZE(in1));
+	ck_assert_int_eq(memcmp(out, in1, sizeof(in1)), 0);
+
+	/* muted main client shall not silence the other client */
+	ck_assert_int_eq(ba_transport_pcm_client_set_volume(pcm, id1, 0), 0);
+	ck_assert_int_eq(ba_transport_pcm_client_set_volume(pcm, id2, 100), 0);
+	ck_assert_int_eq(write(fds1[1], in1, sizeof(in1)), sizeof(in1));
+	ck_assert_int_eq(write(fds2[1], in2, sizeof(in2)), sizeof(in2));
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), ARRAYSIZE(in2));
+	ck_assert_int_eq(memcmp(out, in2, sizeof(in2)), 0);
+
+	/* attenuated client shall be mixed with a lower level */
+	ck_assert_int_eq(ba_transport_pcm_client_set_volume(pcm, id1, 100), 0);
+	ck_assert_int_eq(ba_transport_pcm_client_set_volume(pcm, id2, 50), 0);
+	ck_assert_int_eq(write(fds1[1], in1, sizeof(in1)), sizeof(in1));
+	ck_assert_int_eq(write(fds2[1], in2, sizeof(in2)), sizeof(in2));
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), ARRAYSIZE(in1));
+	for (size_t i = 0; i < ARRAYSIZE(in1); i++) {
+		ck_assert_int_gt(out[i], in1[i]);
+		ck_assert_int_lt(out[i], in1[i] + in2[i]);
+	}
+
+	/* detaching the other client shall not stall the main client */
+	ck_assert_int_eq(write(fds1[1], in1, sizeof(in1)), sizeof(in1));
+	ck_assert_int_eq(write(fds2[1], in2, sizeof(in2)), sizeof(in2));
+	pthread_mutex_lock(&pcm->mutex);
+	ck_assert_int_eq(ba_transport_pcm_client_release(pcm, id2), 0);
+	pthread_mutex_unlock(&pcm->mutex);
+	ck_assert_uint_eq(pcm->clients_len, 0);
+	ck_assert_int_eq(ba_transport_pcm_client_is_main(pcm, id1), true);
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), ARRAYSIZE(in1));
+	ck_assert_int_eq(memcmp(out, in1, sizeof(in1)), 0);
+	ck_assert_int_eq(io_pcm_read(pcm, out, ARRAYSIZE(out)), -1);
+	ck_assert_int_eq(errno, EAGAIN);
+
+	/* volume of the detached client can not be changed anymore */
+	ck_assert_int_eq(ba_transport_pcm_client_set_volume(pcm, id2, 100), -1);
+	ck_assert_int_eq(errno, ENOENT);
+
+	pthread_mutex_lock(&pcm->mutex);
+	ba_transport_pcm_release(pcm);
+	pthread_mutex_unlock(&pcm->mutex);
+
+	config.a2dp.max_clients = 1;
+
+	close(fds1[1]);
+	close(fds2[1]);
+	ba_transport_destroy(t);
+
+} CK_END_TEST
+
 CK_START_TEST(test_a2dp_sbc_invalid_config) {
 
 	const a2dp_sbc_t config_sbc_invalid = { 0 };
@@ -823,6 +987,74 @@ CK_START_TEST(test_a2dp_sbc_pcm_drop) {
 
 } CK_END_TEST
 
+CK_START_TEST(test_a2dp_sbc_pcm_drain) {
+
+	int16_t pcm_zero[1024] = { 0 };
+
+	struct ba_transport *t = test_transport_new_a2dp(device1,
+			BA_TRANSPORT_PROFILE_A2DP_SOURCE, "/path/sbc", &a2dp_sbc_source,
+			&config_sbc_44100_stereo);
+
+	struct ba_transport_thread *th = &t->thread_enc;
+	struct ba_transport_pcm *pcm = th->pcm;
+
+	int bt_fds[2];
+	ck_assert_int_eq(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, bt_fds), 0);
+	debug("Created BT socket pair: %d, %d", bt_fds[0], bt_fds[1]);
+	t->mtu_read = t->mtu_write = 256;
+	t->bt_fd = bt_fds[1];
+
+	int pcm_fds[2];
+	ck_assert_int_eq(pipe2(pcm_fds, O_NONBLOCK), 0);
+	debug("Created PCM pipe pair: %d, %d", pcm_fds[0], pcm_fds[1]);
+	pcm->fd = pcm_fds[0];
+	pcm->active = true;
+
+	/* drain is not possible without the IO thread */
+	ck_assert_int_eq(ba_transport_pcm_drain(pcm), -1);
+	ck_assert_int_eq(errno, ESRCH);
+
+	ck_assert_int_eq(ba_transport_pcm_start(pcm, a2dp_sbc_enc_thread, "sbc", true), 0);
+	ck_assert_int_eq(ba_transport_thread_state_wait_running(th), 0);
+
+	for (size_t i = 0; i < 4; i++)
+		ck_assert_int_eq(write(pcm_fds[1], pcm_zero, sizeof(pcm_zero)), sizeof(pcm_zero));
+
+	/* samples are still in the PCM FIFO */
+	ck_assert_int_eq(ba_transport_pcm_drain(pcm), 0);
+	ck_assert_int_eq(ba_transport_pcm_drain_check(pcm), false);
+
+	/* Wait for the IO thread to process all samples and to report the PCM as
+	 * synced, which happens after the FIFO sync timeout (100 ms). */
+	usleep(300000);
+	pthread_mutex_lock(&pcm->mutex);
+	ck_assert_int_eq(pcm->synced, true);
+	pthread_mutex_unlock(&pcm->mutex);
+
+	/* encoded data are still in the BT socket output queue */
+	ck_assert_int_eq(ba_transport_pcm_drain_check(pcm), false);
+
+	uint8_t bt_buffer[1024];
+	while (read(bt_fds[0], bt_buffer, sizeof(bt_buffer)) > 0)
+		continue;
+
+	/* drain is completed once the BT socket output queue is empty */
+	ck_assert_int_eq(ba_transport_pcm_drain_check(pcm), true);
+
+	ck_assert_int_eq(write(pcm_fds[1], pcm_zero, sizeof(pcm_zero)), sizeof(pcm_zero));
+	ck_assert_int_eq(ba_transport_pcm_drain(pcm), 0);
+	ck_assert_int_eq(ba_transport_pcm_drain_check(pcm), false);
+
+	/* pending drain shall not block the caller when the IO thread is gone */
+	ba_transport_stop(t);
+	ck_assert_int_eq(ba_transport_pcm_drain_check(pcm), true);
+
+	ba_transport_destroy(t);
+	close(pcm_fds[1]);
+	close(bt_fds[0]);
+
+} CK_END_TEST
+
 #if ENABLE_MP3LAME
 CK_START_TEST(test_a2dp_mp3) {
 
@@ -881,7 +1113,66 @@ CK_START_TEST(test_a2dp_aac) {
 } CK_END_TEST
 #endif
 
+#if ENABLE_APTX || ENABLE_APTX_HD
+static double timespec_diff_ms(const struct timespec *t0, const struct timespec *t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1000.0 + (t1->tv_nsec - t0->tv_nsec) / 1000000.0;
+}
+#endif
+
 #if ENABLE_APTX
+CK_START_TEST(test_a2dp_aptx_codec) {
+
+	/* one second of 44.1 kHz stereo signal */
+	static int16_t pcm[2 * 44100];
+	static uint8_t code[ARRAYSIZE(pcm) / 8 * 4];
+	snd_pcm_sine_s16_2le(pcm, ARRAYSIZE(pcm) / 2, 2, 0, 1.0 / 128);
+
+	HANDLE_APTX enc1, enc2;
+	ck_assert_ptr_ne(enc1 = aptxenc_init(), NULL);
+	ck_assert_ptr_ne(enc2 = aptxenc_init(), NULL);
+
+	struct timespec t0, t1;
+	size_t len = sizeof(code);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	ck_assert_int_eq(aptxenc_encode_block(enc1, pcm, ARRAYSIZE(pcm), code, &len), ARRAYSIZE(pcm));
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ck_assert_uint_eq(len, sizeof(code));
+	fprintf(stderr, "Apt-X encode: %.1f x real-time\n", 1000 / timespec_diff_ms(&t0, &t1));
+
+	/* block encoding shall give the same result as one code word at a time */
+	for (size_t i = 0; i < ARRAYSIZE(pcm) / 8; i++) {
+		uint8_t tmp[4];
+		len = sizeof(tmp);
+		ck_assert_int_eq(aptxenc_encode_block(enc2, &pcm[i * 8], 8, tmp, &len), 8);
+		ck_assert_int_eq(memcmp(tmp, &code[i * 4], sizeof(tmp)), 0);
+	}
+
+	aptxenc_destroy(enc1);
+	aptxenc_destroy(enc2);
+
+#if HAVE_APTX_DECODE
+
+	/* space for one extra code word required by the decoder */
+	static int16_t out[ARRAYSIZE(pcm) + 8];
+	size_t samples = ARRAYSIZE(out);
+
+	HANDLE_APTX dec;
+	ck_assert_ptr_ne(dec = aptxdec_init(), NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	ck_assert_int_eq(aptxdec_decode_block(dec, code, sizeof(code), out, &samples), sizeof(code));
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ck_assert_uint_gt(samples, 0);
+	ck_assert_uint_le(samples, ARRAYSIZE(out));
+	fprintf(stderr, "Apt-X decode: %.1f x real-time\n", 1000 / timespec_diff_ms(&t0, &t1));
+
+	aptxdec_destroy(dec);
+
+#endif
+
+} CK_END_TEST
+
 CK_START_TEST(test_a2dp_aptx) {
 
 	struct ba_transport *t1 = test_transport_new_a2dp(device1,
@@ -912,6 +1203,59 @@ CK_START_TEST(test_a2dp_aptx) {
 #endif
 
 #if ENABLE_APTX_HD
+CK_START_TEST(test_a2dp_aptx_hd_codec) {
+
+	/* one second of 44.1 kHz stereo signal */
+	static int32_t pcm[2 * 44100];
+	static uint8_t code[ARRAYSIZE(pcm) / 8 * 6];
+	snd_pcm_sine_s24_4le(pcm, ARRAYSIZE(pcm) / 2, 2, 0, 1.0 / 128);
+
+	HANDLE_APTX enc1, enc2;
+	ck_assert_ptr_ne(enc1 = aptxhdenc_init(), NULL);
+	ck_assert_ptr_ne(enc2 = aptxhdenc_init(), NULL);
+
+	struct timespec t0, t1;
+	size_t len = sizeof(code);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	ck_assert_int_eq(aptxhdenc_encode_block(enc1, pcm, ARRAYSIZE(pcm), code, &len), ARRAYSIZE(pcm));
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ck_assert_uint_eq(len, sizeof(code));
+	fprintf(stderr, "Apt-X HD encode: %.1f x real-time\n", 1000 / timespec_diff_ms(&t0, &t1));
+
+	/* block encoding shall give the same result as one code word at a time */
+	for (size_t i = 0; i < ARRAYSIZE(pcm) / 8; i++) {
+		uint8_t tmp[6];
+		len = sizeof(tmp);
+		ck_assert_int_eq(aptxhdenc_encode_block(enc2, &pcm[i * 8], 8, tmp, &len), 8);
+		ck_assert_int_eq(memcmp(tmp, &code[i * 6], sizeof(tmp)), 0);
+	}
+
+	aptxhdenc_destroy(enc1);
+	aptxhdenc_destroy(enc2);
+
+#if HAVE_APTX_HD_DECODE
+
+	/* space for one extra code word required by the decoder */
+	static int32_t out[ARRAYSIZE(pcm) + 8];
+	size_t samples = ARRAYSIZE(out);
+
+	HANDLE_APTX dec;
+	ck_assert_ptr_ne(dec = aptxhddec_init(), NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	ck_assert_int_eq(aptxhddec_decode_block(dec, code, sizeof(code), out, &samples), sizeof(code));
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ck_assert_uint_gt(samples, 0);
+	ck_assert_uint_le(samples, ARRAYSIZE(out));
+	fprintf(stderr, "Apt-X HD decode: %.1f x real-time\n", 1000 / timespec_diff_ms(&t0, &t1));
+
+	aptxhddec_destroy(dec);
+
+#endif
+
+} CK_END_TEST
+
 CK_START_TEST(test_a2dp_aptx_hd) {
 
 	struct ba_transport *t1 = test_transport_new_a2dp(device1,
@@ -1107,8 +1451,13 @@ int main(int argc, char *argv[]) {
 #endif
 	} codecs[] = {
 		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_SBC), test_a2dp_sbc },
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_SBC), test_a2dp_sbc_write_batch },
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_SBC), test_io_bt_write_batch },
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_SBC), test_io_pcm_mix },
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_SBC), test_io_pcm_mix_volume },
 		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_SBC), test_a2dp_sbc_invalid_config },
 		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_SBC), test_a2dp_sbc_pcm_drop },
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_SBC), test_a2dp_sbc_pcm_drain },
 #if ENABLE_MP3LAME
 		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_MPEG12), test_a2dp_mp3 },
 #endif
@@ -1116,9 +1465,11 @@ int main(int argc, char *argv[]) {
 		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_MPEG24), test_a2dp_aac },
 #endif
 #if ENABLE_APTX
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_VENDOR_APTX), test_a2dp_aptx_codec },
 		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_VENDOR_APTX), test_a2dp_aptx },
 #endif
 #if ENABLE_APTX_HD
+		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_VENDOR_APTX_HD), test_a2dp_aptx_hd_codec },
 		{ a2dp_codecs_codec_id_to_string(A2DP_CODEC_VENDOR_APTX_HD), test_a2dp_aptx_hd },
 #endif
 #if ENABLE_FASTSTREAM
@@ -1188,7 +1539,7 @@ int main(int argc, char *argv[]) {
 			return 1;
 		}
 
-	unsigned int enabled_codecs = 0xFFFF;
+	unsigned int enabled_codecs = UINT_MAX;
 
 	if (optind != argc)
 		enabled_codecs = 0;
@@ -1220,6 +1571,10 @@ int main(int argc, char *argv[]) {
 			break;
 		}
 
+#if DEBUG
+		test_a2dp_configuration = &btdin->a2dp_configuration;
+#endif
+
 		enabled_codecs = 0;
 		for (size_t i = 0; i < ARRAYSIZE(codecs); i++)
 			if (strcmp(codec, codecs[i].name) == 0)
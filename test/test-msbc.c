@@ -19,6 +19,7 @@
 #include "codec-msbc.h"
 #include "shared/defs.h"
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 #include "shared/log.h"
 
 #include "../src/codec-msbc.c"
@@ -31,14 +32,14 @@ CK_START_TEST(test_msbc_init) {
 
 	ck_assert_int_eq(msbc_init(&msbc), 0);
 	ck_assert_int_eq(msbc.initialized, true);
-	ck_assert_int_eq(ffb_len_out(&msbc.pcm), 0);
+	ck_assert_int_eq(ffrb_len_out(&msbc.pcm), 0);
 
-	ffb_seek(&msbc.pcm, 16);
-	ck_assert_int_eq(ffb_len_out(&msbc.pcm), 16);
+	ffrb_seek(&msbc.pcm, 16);
+	ck_assert_int_eq(ffrb_len_out(&msbc.pcm), 16);
 
 	ck_assert_int_eq(msbc_init(&msbc), 0);
 	ck_assert_int_eq(msbc.initialized, true);
-	ck_assert_int_eq(ffb_len_out(&msbc.pcm), 0);
+	ck_assert_int_eq(ffrb_len_out(&msbc.pcm), 0);
 
 	msbc_finish(&msbc);
 
@@ -104,9 +105,9 @@ CK_START_TEST(test_msbc_encode_decode) {
 	ck_assert_int_eq(msbc_init(&msbc), 0);
 	for (rv = 1, i = 0; rv > 0;) {
 
-		len = MIN(ARRAYSIZE(sine) - i, ffb_len_in(&msbc.pcm));
-		memcpy(msbc.pcm.tail, &sine[i], len * msbc.pcm.size);
-		ffb_seek(&msbc.pcm, len);
+		len = MIN(ARRAYSIZE(sine) - i, ffrb_len_in(&msbc.pcm));
+		memcpy(ffrb_tail(&msbc.pcm), &sine[i], len * msbc.pcm.size);
+		ffrb_seek(&msbc.pcm, len);
 		i += len;
 
 		rv = msbc_encode(&msbc);
@@ -136,9 +137,9 @@ CK_START_TEST(test_msbc_encode_decode) {
 
 		rv = msbc_decode(&msbc);
 
-		len = ffb_len_out(&msbc.pcm);
-		memcpy(pcm_tail, msbc.pcm.data, len * msbc.pcm.size);
-		ffb_rewind(&msbc.pcm);
+		len = ffrb_len_out(&msbc.pcm);
+		memcpy(pcm_tail, ffrb_head(&msbc.pcm), len * msbc.pcm.size);
+		ffrb_rewind(&msbc.pcm);
 		pcm_tail += len;
 
 	}
@@ -167,9 +168,9 @@ CK_START_TEST(test_msbc_decode_plc) {
 	for (rv = 1, counter = i = 0; rv > 0; counter++) {
 
 		bool packet_error = false;
-		size_t len = MIN(ARRAYSIZE(sine) - i, ffb_len_in(&msbc.pcm));
-		memcpy(msbc.pcm.tail, &sine[i], len * msbc.pcm.size);
-		ffb_seek(&msbc.pcm, len);
+		size_t len = MIN(ARRAYSIZE(sine) - i, ffrb_len_in(&msbc.pcm));
+		memcpy(ffrb_tail(&msbc.pcm), &sine[i], len * msbc.pcm.size);
+		ffrb_seek(&msbc.pcm, len);
 		i += len;
 
 		rv = msbc_encode(&msbc);
@@ -213,8 +214,8 @@ CK_START_TEST(test_msbc_decode_plc) {
 
 		rv = msbc_decode(&msbc);
 
-		samples += ffb_len_out(&msbc.pcm);
-		ffb_rewind(&msbc.pcm);
+		samples += ffrb_len_out(&msbc.pcm);
+		ffrb_rewind(&msbc.pcm);
 
 	}
 
@@ -15,6 +15,7 @@
 #include <endian.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <check.h>
@@ -61,6 +62,14 @@ CK_START_TEST(test_rtp_a2dp_get_payload) {
 	ck_assert_ptr_ne(payload, NULL);
 	ck_assert_int_eq(payload[0], 12);
 
+	header->cc = 0;
+	ck_assert_int_eq(rtp_check_header_len(header, RTP_HEADER_LEN - 1), false);
+	ck_assert_int_eq(rtp_check_header_len(header, RTP_HEADER_LEN), true);
+	/* CSRC identifiers shall be a part of the header */
+	header->cc = 2;
+	ck_assert_int_eq(rtp_check_header_len(header, RTP_HEADER_LEN + 4), false);
+	ck_assert_int_eq(rtp_check_header_len(header, RTP_HEADER_LEN + 8), true);
+
 } CK_END_TEST
 
 CK_START_TEST(test_rtp_state_new_frame) {
@@ -174,6 +183,312 @@ CK_START_TEST(test_rtp_state_update) {
 
 } CK_END_TEST
 
+static int test_rtp_jitter_buffer_put(struct rtp_jitter_buffer *jb,
+		uint16_t seq_number, uint32_t timestamp) {
+	uint8_t packet[RTP_HEADER_LEN + 1] = { 0 };
+	rtp_header_t *header = (rtp_header_t *)packet;
+	header->seq_number = htobe16(seq_number);
+	header->timestamp = htobe32(timestamp);
+	packet[RTP_HEADER_LEN] = seq_number & 0xFF;
+	return rtp_jitter_buffer_put(jb, packet, sizeof(packet));
+}
+
+static int test_rtp_jitter_buffer_get(struct rtp_jitter_buffer *jb) {
+	const rtp_header_t *header;
+	size_t len;
+	if ((header = rtp_jitter_buffer_get(jb, &len)) == NULL)
+		return -1;
+	ck_assert_uint_eq(len, RTP_HEADER_LEN + 1);
+	return be16toh(header->seq_number);
+}
+
+CK_START_TEST(test_rtp_stats) {
+
+	struct rtp_stats stats;
+	struct rtp_stats_report report;
+	rtp_stats_reset(&stats);
+
+	rtp_header_t hdr = { 0 };
+	const uint16_t seqs[] = {
+		65534, 65535, 0,
+		/* burst of 2 lost packets */
+		3,
+		/* out-of-order packet */
+		5, 4,
+		/* duplicated packets */
+		5, 4,
+		/* single lost packet */
+		7 };
+
+	for (size_t i = 0; i < ARRAYSIZE(seqs); i++) {
+		hdr.seq_number = htobe16(seqs[i]);
+		rtp_stats_update(&stats, &hdr, 8000);
+	}
+
+	rtp_stats_get_report(&stats, &report, NULL);
+	ck_assert_uint_eq(report.expected, 10);
+	ck_assert_uint_eq(report.received, 7);
+	ck_assert_int_eq(report.lost, 3);
+	ck_assert_uint_eq(report.interval_expected, 10);
+	ck_assert_int_eq(report.interval_lost, 3);
+	ck_assert_uint_eq(report.duplicated, 2);
+	ck_assert_uint_eq(report.reordered, 1);
+	ck_assert_uint_eq(report.seq_ext_max, 65536 + 7);
+	ck_assert_uint_eq(report.clockrate, 8000);
+	/* gaps are recorded when detected, including the reordered packet */
+	ck_assert_uint_eq(stats.loss_bursts.count, 3);
+	ck_assert_uint_eq(stats.loss_bursts.max, 2);
+
+	/* late arrival of the lost packet */
+	hdr.seq_number = htobe16(6);
+	rtp_stats_update(&stats, &hdr, 8000);
+
+	/* getting the report shall not modify statistics */
+	struct rtp_stats_report report2;
+	rtp_stats_get_report(&stats, &report2, NULL);
+	rtp_stats_get_report(&stats, &report2, NULL);
+	ck_assert_uint_eq(report2.expected, 10);
+	ck_assert_int_eq(report2.lost, 2);
+
+	/* interval shall be counted since the prior report of the caller */
+	rtp_stats_get_report(&stats, &report, &report);
+	ck_assert_int_eq(report.lost, 2);
+	ck_assert_uint_eq(report.interval_expected, 0);
+	ck_assert_int_eq(report.interval_lost, -1);
+
+	/* big sequence number jump restarts the stream */
+	hdr.seq_number = htobe16(30000);
+	rtp_stats_update(&stats, &hdr, 8000);
+
+	rtp_stats_get_report(&stats, &report, NULL);
+	ck_assert_uint_eq(report.expected, 11);
+	ck_assert_int_eq(report.lost, 2);
+	ck_assert_uint_eq(report.seq_ext_max, 30000);
+
+} CK_END_TEST
+
+CK_START_TEST(test_rtp_jitter_buffer) {
+
+	struct rtp_jitter_buffer jb;
+	/* 8 kHz clock with 40 ms maximal depth (320 ticks) */
+	ck_assert_int_eq(rtp_jitter_buffer_init(&jb, 64, 8000, 40), 0);
+	ck_assert_uint_eq(jb.depth, 80);
+	ck_assert_uint_eq(rtp_jitter_buffer_get_depth_usec(&jb), 10000);
+
+	/* packets shall be held until the buffer depth is reached */
+	ck_assert_int_eq(test_rtp_jitter_buffer_put(&jb, 65534, 0), 1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), -1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_put(&jb, 65535, 40), 1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), -1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_put(&jb, 0, 80), 1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), 65534);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), -1);
+
+	/* out-of-order packets shall be reordered */
+	ck_assert_int_eq(test_rtp_jitter_buffer_put(&jb, 2, 160), 1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_put(&jb, 1, 120), 1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), 65535);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), 0);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), -1);
+	ck_assert_uint_eq(jb.lost, 0);
+
+	/* missing packet shall be skipped once the depth is reached */
+	ck_assert_int_eq(test_rtp_jitter_buffer_put(&jb, 4, 240), 1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), 1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), 2);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), -1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_put(&jb, 5, 280), 1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_put(&jb, 6, 320), 1);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), 4);
+	ck_assert_uint_eq(jb.lost, 1);
+
+	/* late packet shall be dropped and the depth increased */
+	ck_assert_int_eq(test_rtp_jitter_buffer_put(&jb, 3, 200), 0);
+	ck_assert_uint_eq(jb.late, 1);
+	ck_assert_uint_gt(jb.depth, 80);
+	ck_assert_int_eq(test_rtp_jitter_buffer_get(&jb), -1);
+
+	/* discontinuity shall resynchronize the buffer */
+	ck_assert_int_eq(test_rtp_jitter_buffer_put(&jb, 1000, 10000), 1);
+	ck_assert_uint_eq(jb.seq_next, 1000);
+
+	/* truncated packet shall be dropped */
+	const uint8_t truncated[RTP_HEADER_LEN - 1] = { 0 };
+	ck_assert_int_eq(rtp_jitter_buffer_put(&jb, truncated, sizeof(truncated)), 0);
+	ck_assert_uint_eq(jb.seq_next, 1000);
+
+	rtp_jitter_buffer_free(&jb);
+
+} CK_END_TEST
+
+CK_START_TEST(test_rtp_jitter_buffer_depth_limit) {
+
+	struct rtp_jitter_buffer jb;
+	/* 8 kHz clock with 1 s maximal depth, which is 400 packets of 20 ticks */
+	ck_assert_int_eq(rtp_jitter_buffer_init(&jb, 64, 8000, 1000), 0);
+	ck_assert_uint_eq(jb.depth, 2000);
+
+	/* The depth shall be limited to what fits in the buffer, so packets
+	 * are released in order without resynchronizing the buffer. */
+	uint16_t seq_number = 0;
+	for (uint16_t i = 0; i < 4 * RTP_JITTER_BUFFER_SLOTS; i++) {
+		ck_assert_int_eq(test_rtp_jitter_buffer_put(&jb, i, i * 20), 1);
+		int seq;
+		while ((seq = test_rtp_jitter_buffer_get(&jb)) != -1)
+			ck_assert_int_eq(seq, seq_number++);
+	}
+
+	ck_assert_uint_eq(jb.depth_max, (RTP_JITTER_BUFFER_SLOTS - 1) * 20);
+	ck_assert_uint_le(jb.depth, jb.depth_max);
+	ck_assert_uint_gt(seq_number, 2 * RTP_JITTER_BUFFER_SLOTS);
+	ck_assert_uint_eq(jb.lost, 0);
+
+	rtp_jitter_buffer_free(&jb);
+
+} CK_END_TEST
+
+CK_START_TEST(test_rtp_stats_interval) {
+
+	struct rtp_stats stats;
+	struct rtp_stats_report report1 = { 0 };
+	struct rtp_stats_report report2 = { 0 };
+	rtp_stats_reset(&stats);
+
+	rtp_header_t hdr = { 0 };
+	const uint16_t seqs[] = { 0, 1, 3, 4, 5, 8, 9 };
+
+	for (size_t i = 0; i < 5; i++) {
+		hdr.seq_number = htobe16(seqs[i]);
+		rtp_stats_update(&stats, &hdr, 8000);
+	}
+
+	/* the first reader starts its interval */
+	rtp_stats_get_report(&stats, &report1, &report1);
+	ck_assert_uint_eq(report1.interval_expected, 6);
+	ck_assert_int_eq(report1.interval_lost, 1);
+
+	for (size_t i = 5; i < ARRAYSIZE(seqs); i++) {
+		hdr.seq_number = htobe16(seqs[i]);
+		rtp_stats_update(&stats, &hdr, 8000);
+	}
+
+	/* the second reader shall not affect the first reader's interval */
+	rtp_stats_get_report(&stats, &report2, &report2);
+	ck_assert_uint_eq(report2.interval_expected, 10);
+	ck_assert_int_eq(report2.interval_lost, 3);
+
+	rtp_stats_get_report(&stats, &report1, &report1);
+	ck_assert_uint_eq(report1.expected, 10);
+	ck_assert_int_eq(report1.lost, 3);
+	ck_assert_uint_eq(report1.interval_expected, 4);
+	ck_assert_int_eq(report1.interval_lost, 2);
+
+	/* statistics reset shall start a new interval */
+	rtp_stats_reset(&stats);
+	hdr.seq_number = htobe16(100);
+	rtp_stats_update(&stats, &hdr, 8000);
+
+	rtp_stats_get_report(&stats, &report1, &report1);
+	ck_assert_uint_eq(report1.interval_expected, 1);
+	ck_assert_int_eq(report1.interval_lost, 0);
+
+} CK_END_TEST
+
+CK_START_TEST(test_rtp_stats_jitter) {
+
+	struct rtp_stats stats;
+	struct rtp_stats_report report;
+	rtp_stats_reset(&stats);
+
+	rtp_header_t hdr = { 0 };
+	uint16_t seq = 0;
+
+	/* Packets with the same RTP timestamp are received in a row, so the
+	 * transit time is constant and there shall be no jitter. */
+	for (size_t i = 0; i < 10; i++) {
+		hdr.seq_number = htobe16(seq++);
+		rtp_stats_update(&stats, &hdr, 8000);
+	}
+
+	rtp_stats_get_report(&stats, &report, NULL);
+	ck_assert_uint_le(report.jitter, 1);
+
+	/* Packets which are received in a row but with the RTP timestamp
+	 * advanced by 100 ms, have the transit time difference of 800 clock
+	 * units. The jitter shall converge to this value with the 1/16 gain
+	 * as described in the RFC 3550. */
+	uint32_t timestamp = 0;
+	double jitter = 0;
+	for (size_t i = 0; i < 64; i++) {
+		hdr.seq_number = htobe16(seq++);
+		hdr.timestamp = htobe32(timestamp += 800);
+		rtp_stats_update(&stats, &hdr, 8000);
+		jitter += (800 - jitter) / 16;
+	}
+
+	rtp_stats_get_report(&stats, &report, NULL);
+	ck_assert_uint_gt(report.jitter, 700);
+	ck_assert_uint_le(abs((int)report.jitter - (int)jitter), 2);
+
+	/* without transit time variation the jitter shall decay */
+	for (size_t i = 0; i < 64; i++) {
+		hdr.seq_number = htobe16(seq++);
+		rtp_stats_update(&stats, &hdr, 8000);
+		jitter -= jitter / 16;
+	}
+
+	rtp_stats_get_report(&stats, &report, NULL);
+	ck_assert_uint_lt(report.jitter, 50);
+	ck_assert_uint_le(abs((int)report.jitter - (int)jitter), 2);
+
+} CK_END_TEST
+
+CK_START_TEST(test_rtp_packetizer) {
+
+	uint8_t headers[RTP_HEADER_LEN + 1] = { 0 };
+	uint8_t payload[250];
+	for (size_t i = 0; i < sizeof(payload); i++)
+		payload[i] = i;
+
+	struct rtp_packetizer pkt;
+	rtp_packetizer_init(&pkt, headers, sizeof(headers), payload, sizeof(payload),
+			sizeof(headers) + 100);
+	ck_assert_uint_eq(rtp_packetizer_remaining(&pkt), 3);
+
+	ck_assert_int_eq(rtp_packetizer_next(&pkt), true);
+	ck_assert_ptr_eq(pkt.iov[0].iov_base, headers);
+	ck_assert_uint_eq(pkt.iov[0].iov_len, sizeof(headers));
+	ck_assert_ptr_eq(pkt.iov[1].iov_base, payload);
+	ck_assert_uint_eq(pkt.iov[1].iov_len, 100);
+	ck_assert_int_eq(rtp_packetizer_is_first(&pkt), true);
+	ck_assert_int_eq(rtp_packetizer_is_last(&pkt), false);
+	ck_assert_uint_eq(rtp_packetizer_remaining(&pkt), 3);
+
+	ck_assert_int_eq(rtp_packetizer_next(&pkt), true);
+	ck_assert_ptr_eq(pkt.iov[1].iov_base, &payload[100]);
+	ck_assert_uint_eq(pkt.iov[1].iov_len, 100);
+	ck_assert_int_eq(rtp_packetizer_is_first(&pkt), false);
+	ck_assert_int_eq(rtp_packetizer_is_last(&pkt), false);
+	ck_assert_uint_eq(rtp_packetizer_remaining(&pkt), 2);
+
+	ck_assert_int_eq(rtp_packetizer_next(&pkt), true);
+	ck_assert_ptr_eq(pkt.iov[1].iov_base, &payload[200]);
+	ck_assert_uint_eq(pkt.iov[1].iov_len, 50);
+	ck_assert_int_eq(rtp_packetizer_is_last(&pkt), true);
+	ck_assert_uint_eq(rtp_packetizer_remaining(&pkt), 1);
+
+	ck_assert_int_eq(rtp_packetizer_next(&pkt), false);
+
+	/* payload which fits into a single packet */
+	rtp_packetizer_init(&pkt, headers, sizeof(headers), payload, 10, 1000);
+	ck_assert_int_eq(rtp_packetizer_next(&pkt), true);
+	ck_assert_uint_eq(pkt.iov[1].iov_len, 10);
+	ck_assert_int_eq(rtp_packetizer_is_first(&pkt), true);
+	ck_assert_int_eq(rtp_packetizer_is_last(&pkt), true);
+	ck_assert_int_eq(rtp_packetizer_next(&pkt), false);
+
+} CK_END_TEST
+
 int main(void) {
 
 	Suite *s = suite_create(__FILE__);
@@ -188,6 +503,12 @@ int main(void) {
 	tcase_add_test(tc, test_rtp_state_new_frame);
 	tcase_add_test(tc, test_rtp_state_sync_stream);
 	tcase_add_test(tc, test_rtp_state_update);
+	tcase_add_test(tc, test_rtp_packetizer);
+	tcase_add_test(tc, test_rtp_jitter_buffer);
+	tcase_add_test(tc, test_rtp_jitter_buffer_depth_limit);
+	tcase_add_test(tc, test_rtp_stats);
+	tcase_add_test(tc, test_rtp_stats_interval);
+	tcase_add_test(tc, test_rtp_stats_jitter);
 
 	srunner_run_all(sr, CK_ENV);
 	int nf = srunner_ntests_failed(sr);
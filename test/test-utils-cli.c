@@ -275,6 +275,33 @@ CK_START_TEST(test_delay_adjustment) {
 
 } CK_END_TEST
 
+CK_START_TEST(test_stats) {
+
+	struct spawn_process sp_ba_mock;
+	ck_assert_int_ne(spawn_bluealsa_mock(&sp_ba_mock, NULL, true,
+				"--profile=a2dp-source",
+				NULL), -1);
+
+	char output[4096];
+
+	/* check printing help text */
+	ck_assert_int_eq(run_bluealsa_cli(output, sizeof(output),
+				"stats", "--help", NULL), 0);
+	ck_assert_ptr_ne(strstr(output, "-h, --help"), NULL);
+
+	/* check statistics of not running PCM */
+	ck_assert_int_eq(run_bluealsa_cli(output, sizeof(output),
+				"stats", "/org/bluealsa/hci0/dev_12_34_56_78_9A_BC/a2dpsrc/sink",
+				NULL), 0);
+	ck_assert_ptr_ne(strstr(output, "Codec: count="), NULL);
+	ck_assert_ptr_ne(strstr(output, "BTWrite: count="), NULL);
+	ck_assert_ptr_ne(strstr(output, "SyncOverdue: count="), NULL);
+
+	spawn_terminate(&sp_ba_mock, 0);
+	spawn_close(&sp_ba_mock, NULL);
+
+} CK_END_TEST
+
 CK_START_TEST(test_volume) {
 
 	struct spawn_process sp_ba_mock;
@@ -345,6 +372,45 @@ CK_START_TEST(test_volume) {
 
 } CK_END_TEST
 
+CK_START_TEST(test_latency) {
+
+	struct spawn_process sp_ba_mock;
+	ck_assert_int_ne(spawn_bluealsa_mock(&sp_ba_mock, NULL, true,
+				"--profile=a2dp-source",
+				NULL), -1);
+
+	char output[4096];
+
+	/* check printing help text */
+	ck_assert_int_eq(run_bluealsa_cli(output, sizeof(output),
+				"latency", "--help", NULL), 0);
+	ck_assert_ptr_ne(strstr(output, "-h, --help"), NULL);
+
+	/* check default latency class */
+	ck_assert_int_eq(run_bluealsa_cli(output, sizeof(output),
+				"latency", "/org/bluealsa/hci0/dev_12_34_56_78_9A_BC/a2dpsrc/sink",
+				NULL), 0);
+	ck_assert_ptr_ne(strstr(output, "Latency: normal"), NULL);
+
+	/* check setting latency class */
+	ck_assert_int_eq(run_bluealsa_cli(output, sizeof(output),
+				"latency", "/org/bluealsa/hci0/dev_12_34_56_78_9A_BC/a2dpsrc/sink", "low",
+				NULL), 0);
+	ck_assert_int_eq(run_bluealsa_cli(output, sizeof(output),
+				"latency", "/org/bluealsa/hci0/dev_12_34_56_78_9A_BC/a2dpsrc/sink",
+				NULL), 0);
+	ck_assert_ptr_ne(strstr(output, "Latency: low"), NULL);
+
+	/* check invalid latency class */
+	ck_assert_int_eq(run_bluealsa_cli(output, sizeof(output),
+				"latency", "/org/bluealsa/hci0/dev_12_34_56_78_9A_BC/a2dpsrc/sink", "high",
+				NULL), EXIT_FAILURE);
+
+	spawn_terminate(&sp_ba_mock, 0);
+	spawn_close(&sp_ba_mock, NULL);
+
+} CK_END_TEST
+
 CK_START_TEST(test_monitor) {
 
 	struct spawn_process sp_ba_mock;
@@ -402,6 +468,50 @@ CK_START_TEST(test_monitor) {
 
 } CK_END_TEST
 
+static unsigned int count_substrings(const char *str, const char *sub) {
+	unsigned int count = 0;
+	while ((str = strstr(str, sub)) != NULL) {
+		str += strlen(sub);
+		count++;
+	}
+	return count;
+}
+
+CK_START_TEST(test_monitor_volume_burst) {
+
+	struct spawn_process sp_ba_mock;
+	ck_assert_int_ne(spawn_bluealsa_mock(&sp_ba_mock, NULL, false,
+				"--timeout=0",
+				"--fuzzing=200",
+				"--volume-burst=5",
+				"--profile=a2dp-source",
+				NULL), -1);
+
+	char output[4096];
+
+	ck_assert_int_eq(run_bluealsa_cli(output, sizeof(output),
+				"monitor", "--properties=volume",
+				NULL), 0);
+
+	const char *path = "/org/bluealsa/hci0/dev_12_34_56_78_9A_BC/a2dpsrc/sink";
+	char volume[128];
+
+	/* first change announced right away, the rest of the burst merged into
+	 * a single signal, the last change dropped together with the PCM */
+	sprintf(volume, "PropertyChanged %s Volume ", path);
+	ck_assert_uint_eq(count_substrings(output, volume), 3);
+
+	/* merged update reports the final volume of the burst */
+	sprintf(volume, "PropertyChanged %s Volume 0x7F7F", path);
+	ck_assert_uint_eq(count_substrings(output, volume), 1);
+	sprintf(volume, "PropertyChanged %s Volume 0xFFFF", path);
+	ck_assert_uint_eq(count_substrings(output, volume), 1);
+
+	spawn_terminate(&sp_ba_mock, 0);
+	spawn_close(&sp_ba_mock, NULL);
+
+} CK_END_TEST
+
 CK_START_TEST(test_open) {
 
 	struct spawn_process sp_ba_mock;
@@ -445,6 +555,89 @@ CK_START_TEST(test_open) {
 
 } CK_END_TEST
 
+CK_START_TEST(test_open_concurrent) {
+
+	struct spawn_process sp_ba_mock;
+	ck_assert_int_ne(spawn_bluealsa_mock(&sp_ba_mock, NULL, true,
+				"--profile=hsp-ag",
+				NULL), -1);
+
+	char * ba_cli_argv[32] = {
+		bluealsa_cli_path, "open",
+		"/org/bluealsa/hci0/dev_23_45_67_89_AB_CD/hspag/sink",
+		NULL };
+
+	FILE *f_zero;
+	ck_assert_ptr_ne(f_zero = fopen("/dev/zero", "r"), NULL);
+
+	struct spawn_process sp_ba_cli[4];
+	for (size_t i = 0; i < 4; i++)
+		ck_assert_int_ne(spawn(&sp_ba_cli[i], ba_cli_argv,
+					f_zero, SPAWN_FLAG_NONE), -1);
+
+	/* let it run for a while */
+	sleep(1);
+
+	unsigned int opened = 0;
+	for (size_t i = 0; i < 4; i++) {
+		int wstatus = 0;
+		spawn_terminate(&sp_ba_cli[i], 0);
+		spawn_close(&sp_ba_cli[i], &wstatus);
+		if (WIFSIGNALED(wstatus) && WTERMSIG(wstatus) == SIGTERM)
+			opened++;
+	}
+
+	/* SCO PCM does not support mixing, so only one of the concurrent Open
+	 * calls shall succeed and the rest of them shall be rejected without
+	 * blocking the PCM Open workers. */
+	ck_assert_uint_eq(opened, 1);
+
+	fclose(f_zero);
+	spawn_terminate(&sp_ba_mock, 0);
+	spawn_close(&sp_ba_mock, NULL);
+
+} CK_END_TEST
+
+CK_START_TEST(test_open_teardown) {
+
+	struct spawn_process sp_ba_mock;
+	ck_assert_int_ne(spawn_bluealsa_mock(&sp_ba_mock, NULL, true,
+				"--timeout=250",
+				"--profile=hsp-ag",
+				NULL), -1);
+
+	char * ba_cli_argv[32] = {
+		bluealsa_cli_path, "open",
+		"/org/bluealsa/hci0/dev_23_45_67_89_AB_CD/hspag/sink",
+		NULL };
+
+	FILE *f_zero;
+	ck_assert_ptr_ne(f_zero = fopen("/dev/zero", "r"), NULL);
+
+	/* Keep opening the PCM until the mock destroys the transport, so some
+	 * Open calls will be processed during the transport teardown. */
+	struct spawn_process sp_ba_cli[8];
+	for (size_t i = 0; i < 8; i++) {
+		ck_assert_int_ne(spawn(&sp_ba_cli[i], ba_cli_argv,
+					f_zero, SPAWN_FLAG_NONE), -1);
+		usleep(50000);
+	}
+
+	/* all clients shall exit on their own, either because the Open call
+	 * has failed or because the PCM has been closed by the teardown */
+	for (size_t i = 0; i < 8; i++)
+		spawn_close(&sp_ba_cli[i], NULL);
+
+	int wstatus = 0;
+	/* mock shall exit gracefully after the timeout */
+	spawn_close(&sp_ba_mock, &wstatus);
+	ck_assert_int_eq(WIFEXITED(wstatus), 1);
+	ck_assert_int_eq(WEXITSTATUS(wstatus), 0);
+
+	fclose(f_zero);
+
+} CK_END_TEST
+
 int main(int argc, char *argv[], char *envp[]) {
 	preload(argc, argv, envp, ".libs/aloader.so");
 
@@ -469,9 +662,14 @@ int main(int argc, char *argv[], char *envp[]) {
 	tcase_add_test(tc, test_info);
 	tcase_add_test(tc, test_codec);
 	tcase_add_test(tc, test_delay_adjustment);
+	tcase_add_test(tc, test_stats);
 	tcase_add_test(tc, test_volume);
+	tcase_add_test(tc, test_latency);
 	tcase_add_test(tc, test_monitor);
+	tcase_add_test(tc, test_monitor_volume_burst);
 	tcase_add_test(tc, test_open);
+	tcase_add_test(tc, test_open_concurrent);
+	tcase_add_test(tc, test_open_teardown);
 
 	srunner_run_all(sr, CK_ENV);
 	int nf = srunner_ntests_failed(sr);
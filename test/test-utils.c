@@ -13,20 +13,33 @@
 #endif
 
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <time.h>
+#include <unistd.h>
 
 #include <bluetooth/bluetooth.h>
 #include <check.h>
 
 #include "hci.h"
+#include "io-engine.h"
 #include "utils.h"
+#include "shared/abr.h"
+#include "shared/asrc.h"
 #include "shared/ffb.h"
+#include "shared/ffrb.h"
 #include "shared/hex.h"
+#include "shared/histogram.h"
+#include "shared/mpscq.h"
 #include "shared/nv.h"
 #include "shared/rt.h"
+#include "shared/shm-ring.h"
+#include "shared/trace.h"
 
 #include "inc/check.inc"
 
@@ -78,6 +91,338 @@ CK_START_TEST(test_batostr_) {
 } CK_END_TEST
 #endif
 
+struct test_io_engine_source {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned int calls;
+	/* remove source from within the callback */
+	bool remove;
+	int id;
+};
+
+static void test_io_engine_callback(int fd, uint32_t events, void *userdata) {
+	struct test_io_engine_source *src = userdata;
+
+	eventfd_t value;
+	if (!src->remove && events & EPOLLIN)
+		eventfd_read(fd, &value);
+	if (src->remove)
+		io_engine_del(src->id);
+
+	pthread_mutex_lock(&src->mutex);
+	src->calls++;
+	pthread_mutex_unlock(&src->mutex);
+	pthread_cond_signal(&src->cond);
+
+}
+
+static void test_io_engine_wait(struct test_io_engine_source *src, unsigned int calls) {
+	pthread_mutex_lock(&src->mutex);
+	while (src->calls < calls)
+		pthread_cond_wait(&src->cond, &src->mutex);
+	pthread_mutex_unlock(&src->mutex);
+}
+
+CK_START_TEST(test_io_engine) {
+
+	struct test_io_engine_source src1 = {
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+	struct test_io_engine_source src2 = {
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+	struct test_io_engine_source tim1 = {
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+	struct test_io_engine_source tim2 = {
+		PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+	ck_assert_int_eq(io_engine_init(0), -1);
+	ck_assert_int_eq(errno, EINVAL);
+
+	/* single worker makes the order of dispatching predictable */
+	ck_assert_int_eq(io_engine_init(1), 0);
+
+	int efd1, efd2;
+	ck_assert_int_ne(efd1 = eventfd(0, EFD_NONBLOCK), -1);
+	ck_assert_int_ne(efd2 = eventfd(0, EFD_NONBLOCK), -1);
+
+	ck_assert_int_ne(src1.id = io_engine_add(efd1, EPOLLIN,
+				test_io_engine_callback, &src1), -1);
+	ck_assert_int_ne(tim1.id = io_engine_add_timer(test_io_engine_callback, &tim1), -1);
+	ck_assert_int_ne(tim2.id = io_engine_add_timer(test_io_engine_callback, &tim2), -1);
+
+	/* source shall be re-armed after every dispatch */
+	eventfd_write(efd1, 1);
+	test_io_engine_wait(&src1, 1);
+	eventfd_write(efd1, 1);
+	test_io_engine_wait(&src1, 2);
+
+	/* timer shall expire not earlier than requested */
+	struct timespec ts0, ts1, ts_diff;
+	gettimestamp(&ts0);
+	ck_assert_int_eq(io_engine_timer_set(tim1.id, 20), 0);
+	test_io_engine_wait(&tim1, 1);
+	gettimestamp(&ts1);
+	timespecsub(&ts1, &ts0, &ts_diff);
+	ck_assert_int_ge(ts_diff.tv_sec * 1000 + ts_diff.tv_nsec / 1000000, 20);
+
+	/* disarmed timer shall not expire */
+	ck_assert_int_eq(io_engine_timer_set(tim1.id, 5), 0);
+	ck_assert_int_eq(io_engine_timer_set(tim1.id, 0), 0);
+	ck_assert_int_eq(io_engine_timer_set(tim2.id, 20), 0);
+	test_io_engine_wait(&tim2, 1);
+	ck_assert_uint_eq(tim1.calls, 1);
+
+	/* removed source shall not be dispatched */
+	io_engine_del(src1.id);
+	eventfd_write(efd1, 1);
+	ck_assert_int_eq(io_engine_timer_set(tim2.id, 10), 0);
+	test_io_engine_wait(&tim2, 2);
+	ck_assert_uint_eq(src1.calls, 2);
+
+	/* source can be removed from within its own callback */
+	src2.remove = true;
+	ck_assert_int_ne(src2.id = io_engine_add(efd2, EPOLLIN,
+				test_io_engine_callback, &src2), -1);
+	eventfd_write(efd2, 1);
+	test_io_engine_wait(&src2, 1);
+	ck_assert_int_eq(io_engine_timer_set(tim2.id, 10), 0);
+	test_io_engine_wait(&tim2, 3);
+	ck_assert_uint_eq(src2.calls, 1);
+
+	/* released slot shall be reused */
+	ck_assert_int_eq(io_engine_add(efd1, EPOLLIN,
+				test_io_engine_callback, &src1), src1.id);
+
+	io_engine_destroy();
+	close(efd1);
+	close(efd2);
+
+} CK_END_TEST
+
+CK_START_TEST(test_abr) {
+
+	struct abr abr;
+
+	abr_init(&abr, 10, 50, 60);
+	ck_assert_uint_eq(abr.value, 50);
+	ck_assert_uint_eq(abr.step, 5);
+
+	/* without thresholds the value is never changed */
+	ck_assert_int_eq(abr_update(&abr, 100, 1000), false);
+	ck_assert_int_eq(abr_update(&abr, 0, 100000), false);
+	ck_assert_uint_eq(abr.value, 50);
+
+	abr_set_thresholds(&abr, 1, 4, 800);
+
+	/* congested link decreases the value with a back-off */
+	ck_assert_int_eq(abr_update(&abr, 4, 100), true);
+	ck_assert_uint_eq(abr.value, 45);
+	ck_assert_int_eq(abr_update(&abr, 5, 50), false);
+	ck_assert_int_eq(abr_update(&abr, 5, 50), true);
+	ck_assert_uint_eq(abr.value, 40);
+
+	/* moderate queue level keeps the value */
+	ck_assert_int_eq(abr_update(&abr, 2, 1000), false);
+	ck_assert_uint_eq(abr.value, 40);
+
+	/* the value is increased after the recovery period */
+	ck_assert_int_eq(abr_update(&abr, 1, 500), false);
+	ck_assert_int_eq(abr_update(&abr, 0, 300), true);
+	ck_assert_uint_eq(abr.value, 45);
+	ck_assert_int_eq(abr_update(&abr, 0, 800), true);
+	ck_assert_int_eq(abr_update(&abr, 0, 800), false);
+	ck_assert_uint_eq(abr.value, 50);
+
+	/* the value shall not go below the minimum */
+	for (size_t i = 0; i < 20; i++)
+		abr_update(&abr, 10, 100);
+	ck_assert_uint_eq(abr.value, 10);
+
+} CK_END_TEST
+
+CK_START_TEST(test_asrc) {
+
+	const struct timespec ts_10ms = { .tv_nsec = 10000000 };
+	struct asrc asrc = { 0 };
+	int16_t in[2 * 100], out[2 * 100];
+
+	ck_assert_int_eq(asrc_init(&asrc, 2, 8, 100), -1);
+	ck_assert_int_eq(errno, EINVAL);
+
+	ck_assert_int_eq(asrc_init(&asrc, 2, 16, 100), 0);
+	ck_assert_uint_ge(asrc_space(&asrc), 100);
+
+	for (size_t i = 0; i < 2 * 100; i++)
+		in[i] = i * 100;
+	memcpy(asrc_tail(&asrc), in, sizeof(in));
+	asrc_seek(&asrc, 100);
+
+	/* with the unity ratio the input is passed through unchanged */
+	ck_assert_uint_eq(asrc_process(&asrc, out, 50), 50);
+	ck_assert_mem_eq(out, &in[2 * 1], 2 * 50 * sizeof(*in));
+	ck_assert_uint_eq(asrc_process(&asrc, out, 100), 47);
+	ck_assert_mem_eq(out, &in[2 * 51], 2 * 47 * sizeof(*in));
+	ck_assert_uint_eq(asrc_process(&asrc, out, 100), 0);
+
+	/* with the ratio above unity more frames are produced */
+	asrc_reset(&asrc);
+	asrc.ratio = 1.1;
+	memcpy(asrc_tail(&asrc), in, sizeof(in));
+	asrc_seek(&asrc, 100);
+	ck_assert_uint_eq(asrc_process(&asrc, out, 100), 100);
+	/* interpolation of the linear ramp shall be linear as well */
+	ck_assert_int_eq(out[2 * 11], 2200);
+	ck_assert_int_eq(out[2 * 11 + 1], 2300);
+
+	/* frames are paced with the input clock */
+	asrc.ratio = 0.5;
+	ck_assert_uint_eq(asrc_input_frames(&asrc, 1000), 2000);
+	asrc.ratio = 1.0 / 0.75;
+	ck_assert_uint_eq(asrc_input_frames(&asrc, 1), 0);
+	ck_assert_uint_eq(asrc_input_frames(&asrc, 1), 1);
+	ck_assert_uint_eq(asrc_input_frames(&asrc, 2), 2);
+
+	/* queue level above the target decreases the ratio */
+	asrc.ratio = 1.0;
+	asrc_set_target(&asrc, 1000);
+	ck_assert_double_eq(asrc_control(&asrc, 2000), 1.0);
+	/* move the controller timestamp back, so the time has elapsed */
+	timespecsub(&asrc.ctrl.ts, &ts_10ms, &asrc.ctrl.ts);
+	ck_assert_double_lt(asrc_control(&asrc, 2000), 1.0);
+	ck_assert_double_ge(asrc.ratio, 1.0 - ASRC_MAX_PPM / 1e6);
+
+	/* queue level below the target increases the ratio */
+	asrc_set_target(&asrc, 1000);
+	asrc_control(&asrc, 0);
+	timespecsub(&asrc.ctrl.ts, &ts_10ms, &asrc.ctrl.ts);
+	ck_assert_double_gt(asrc_control(&asrc, 0), 1.0);
+	ck_assert_double_le(asrc.ratio, 1.0 + ASRC_MAX_PPM / 1e6);
+
+	asrc_free(&asrc);
+
+} CK_END_TEST
+
+CK_START_TEST(test_histogram) {
+
+	struct histogram h;
+	struct histogram_summary s;
+
+	histogram_reset(&h);
+	histogram_get_summary(&h, &s);
+	ck_assert_uint_eq(s.count, 0);
+	ck_assert_uint_eq(s.max, 0);
+	ck_assert_uint_eq(s.p99, 0);
+
+	/* values below 16 are recorded exactly */
+	for (uint32_t i = 1; i <= 10; i++)
+		histogram_record(&h, i);
+	histogram_get_summary(&h, &s);
+	ck_assert_uint_eq(s.count, 10);
+	ck_assert_uint_eq(s.min, 1);
+	ck_assert_uint_eq(s.max, 10);
+	ck_assert_uint_eq(s.mean, 5);
+	ck_assert_uint_eq(s.p50, 5);
+	ck_assert_uint_eq(s.p90, 9);
+
+	histogram_reset(&h);
+	for (uint32_t i = 0; i < 1000; i++)
+		histogram_record(&h, 1000);
+	histogram_record(&h, 1000000);
+	histogram_record(&h, UINT32_MAX);
+	histogram_get_summary(&h, &s);
+	ck_assert_uint_eq(s.count, 1002);
+	ck_assert_uint_eq(s.min, 1000);
+	ck_assert_uint_eq(s.max, UINT32_MAX);
+
+	/* values are reported with the relative error of 12.5% */
+	ck_assert_uint_ge(s.p50, 1000);
+	ck_assert_uint_le(s.p50, 1000 + 1000 / 8);
+	ck_assert_uint_ge(s.p999, 1000000);
+	ck_assert_uint_le(s.p999, 1000000 + 1000000 / 8);
+	ck_assert_uint_eq(histogram_get_percentile(&h, 100), UINT32_MAX);
+
+} CK_END_TEST
+
+struct test_mpscq_element {
+	unsigned int producer;
+	unsigned int seq;
+};
+
+struct test_mpscq_producer {
+	mpscq_t *q;
+	unsigned int id;
+};
+
+static void *test_mpscq_producer(void *userdata) {
+	const struct test_mpscq_producer *p = userdata;
+	struct test_mpscq_element e = { .producer = p->id };
+	for (e.seq = 0; e.seq < 10000; e.seq++)
+		while (!mpscq_push(p->q, &e))
+			sched_yield();
+	return NULL;
+}
+
+CK_START_TEST(test_mpscq) {
+
+	mpscq_t q = { 0 };
+	unsigned int v;
+
+	ck_assert_int_eq(mpscq_init(&q, 0, sizeof(v)), -1);
+	ck_assert_int_eq(mpscq_init(&q, 3, sizeof(v)), 0);
+	/* number of elements is rounded up to the power of two */
+	ck_assert_uint_eq(q.nmemb, 4);
+
+	ck_assert_int_eq(mpscq_pop(&q, &v), false);
+
+	/* check wrapping around the end of the queue */
+	for (unsigned int i = 0; i < 10; i++) {
+		for (unsigned int j = 0; j < 3; j++)
+			ck_assert_int_eq(mpscq_push(&q, &(unsigned int){ i * 10 + j }), true);
+		for (unsigned int j = 0; j < 3; j++) {
+			ck_assert_int_eq(mpscq_pop(&q, &v), true);
+			ck_assert_uint_eq(v, i * 10 + j);
+		}
+	}
+
+	for (unsigned int i = 0; i < 4; i++)
+		ck_assert_int_eq(mpscq_push(&q, &i), true);
+	/* queue is full */
+	ck_assert_int_eq(mpscq_push(&q, &v), false);
+	ck_assert_int_eq(mpscq_pop(&q, &v), true);
+	ck_assert_uint_eq(v, 0);
+	ck_assert_int_eq(mpscq_push(&q, &v), true);
+
+	mpscq_free(&q);
+
+	/* check concurrent producers */
+	struct test_mpscq_element e;
+	ck_assert_int_eq(mpscq_init(&q, 16, sizeof(e)), 0);
+
+	pthread_t threads[4];
+	struct test_mpscq_producer producers[4];
+	for (unsigned int i = 0; i < 4; i++) {
+		producers[i] = (struct test_mpscq_producer){ &q, i };
+		ck_assert_int_eq(pthread_create(&threads[i], NULL,
+					test_mpscq_producer, &producers[i]), 0);
+	}
+
+	/* elements from every producer shall be received in order */
+	unsigned int next[4] = { 0 };
+	for (unsigned int received = 0; received < 4 * 10000; received++) {
+		while (!mpscq_pop(&q, &e))
+			sched_yield();
+		ck_assert_uint_lt(e.producer, 4);
+		ck_assert_uint_eq(e.seq, next[e.producer]++);
+	}
+
+	for (size_t i = 0; i < 4; i++)
+		pthread_join(threads[i], NULL);
+
+	ck_assert_int_eq(mpscq_pop(&q, &e), false);
+
+	mpscq_free(&q);
+
+} CK_END_TEST
+
 CK_START_TEST(test_nv_find) {
 
 	const nv_entry_t entries[] = {
@@ -253,6 +598,204 @@ CK_START_TEST(test_ffb_resize) {
 
 } CK_END_TEST
 
+CK_START_TEST(test_ffrb) {
+
+	ffrb_t ffrb = { 0 };
+
+	/* allow free before allocation */
+	ffrb_free(&ffrb);
+
+	ck_assert_int_eq(ffrb_init_uint8_t(&ffrb, 64), 0);
+	ck_assert_ptr_eq(ffrb_head(&ffrb), ffrb_tail(&ffrb));
+	ck_assert_int_eq(ffrb.nmemb, 64);
+
+	memcpy(ffrb_tail(&ffrb), "1234567890ABCDEFGHIJKLMNOPQRSTUVWXYZ", 36);
+	ffrb_seek(&ffrb, 36);
+
+	ck_assert_int_eq(ffrb_len_in(&ffrb), 64 - 36);
+	ck_assert_int_eq(ffrb_blen_in(&ffrb), 64 - 36);
+	ck_assert_int_eq(ffrb_len_out(&ffrb), 36);
+	ck_assert_int_eq(ffrb_blen_out(&ffrb), 36);
+	ck_assert_int_eq(((uint8_t *)ffrb_tail(&ffrb))[-1], 'Z');
+
+	ck_assert_int_eq(ffrb_shift(&ffrb, 15), 15);
+	ck_assert_int_eq(ffrb_len_in(&ffrb), 64 - (36 - 15));
+	ck_assert_int_eq(ffrb_len_out(&ffrb), 36 - 15);
+	ck_assert_int_eq(memcmp(ffrb_head(&ffrb), "FGHIJKLMNOPQRSTUVWXYZ", ffrb_len_out(&ffrb)), 0);
+
+	ck_assert_int_eq(ffrb_shift(&ffrb, 100), 36 - 15);
+	ck_assert_ptr_eq(ffrb_head(&ffrb), ffrb_tail(&ffrb));
+
+	ffrb_seek(&ffrb, 4);
+	ck_assert_int_eq(ffrb_len_out(&ffrb), 4);
+
+	ffrb_rewind(&ffrb);
+	ck_assert_int_eq(ffrb_len_out(&ffrb), 0);
+	ck_assert_int_eq(ffrb_len_in(&ffrb), 64);
+
+	ffrb_free(&ffrb);
+	ck_assert_ptr_eq(ffrb.data, NULL);
+
+} CK_END_TEST
+
+CK_START_TEST(test_ffrb_wrap) {
+
+	ffrb_t ffrb = { 0 };
+	ck_assert_int_eq(ffrb_init_int16_t(&ffrb, 1000), 0);
+
+	int16_t value = 0;
+	int16_t expected = 0;
+	size_t i, j;
+
+	/* Produce and consume enough data to wrap around the buffer several
+	 * times. The readable region shall always be contiguous. */
+	for (i = 0; i < 64; i++) {
+
+		const size_t len = ffrb_len_in(&ffrb);
+		int16_t *tail = ffrb_tail(&ffrb);
+		for (j = 0; j < len; j++)
+			tail[j] = value++;
+		ffrb_seek(&ffrb, len);
+
+		ck_assert_int_eq(ffrb_len_out(&ffrb), 1000);
+
+		const int16_t *head = ffrb_head(&ffrb);
+		for (j = 0; j < 333; j++)
+			ck_assert_int_eq(head[j], expected++);
+		ck_assert_int_eq(ffrb_shift(&ffrb, 333), 333);
+
+	}
+
+	ffrb_free(&ffrb);
+
+} CK_END_TEST
+
+#if HAVE_MEMFD_CREATE
+CK_START_TEST(test_shm_ring) {
+
+	struct shm_ring server = { 0 };
+	struct shm_ring client = { 0 };
+	uint8_t data[100], buffer[100];
+	int fd;
+
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = i;
+
+	ck_assert_int_ne(fd = shm_ring_create(&server, 64), -1);
+	ck_assert_int_eq(shm_ring_attach(&client, fd), 0);
+	ck_assert_uint_eq(client.size, 64);
+
+	/* the size of the shared memory block shall be sealed */
+	ck_assert_int_eq(ftruncate(fd, 0), -1);
+	ck_assert_int_eq(errno, EPERM);
+	close(fd);
+
+	ck_assert_uint_eq(shm_ring_used(&client), 0);
+	ck_assert_uint_eq(shm_ring_space(&client), 64);
+
+	/* write more than the ring can hold */
+	ck_assert_uint_eq(shm_ring_write(&client, data, sizeof(data)), 64);
+	ck_assert_uint_eq(shm_ring_used(&server), 64);
+	ck_assert_uint_eq(shm_ring_read(&server, buffer, 40), 40);
+	ck_assert_int_eq(memcmp(buffer, data, 40), 0);
+
+	/* write and read with the wrap-around */
+	ck_assert_uint_eq(shm_ring_write(&client, &data[64], 36), 36);
+	ck_assert_uint_eq(shm_ring_read(&server, buffer, sizeof(buffer)), 60);
+	ck_assert_int_eq(memcmp(buffer, &data[40], 60), 0);
+
+	ck_assert_uint_eq(shm_ring_write(&client, data, 10), 10);
+	ck_assert_uint_eq(shm_ring_flush(&server), 10);
+	ck_assert_uint_eq(shm_ring_used(&client), 0);
+
+	/* offsets corrupted by the other side shall not be trusted */
+	atomic_store(&client.hdr->tail, atomic_load(&client.hdr->head) + 65);
+	ck_assert_uint_eq(shm_ring_used(&server), 64);
+	ck_assert_int_eq(shm_ring_read(&server, buffer, sizeof(buffer)), -1);
+	ck_assert_int_eq(errno, EBADMSG);
+	atomic_store(&client.hdr->head, atomic_load(&client.hdr->tail) + 1);
+	ck_assert_uint_eq(shm_ring_used(&server), 0);
+	ck_assert_int_eq(shm_ring_write(&server, data, 10), -1);
+	ck_assert_int_eq(errno, EBADMSG);
+
+	ck_assert_int_eq(shm_ring_is_closed(&client), false);
+	shm_ring_close(&server);
+	ck_assert_int_eq(shm_ring_is_closed(&client), true);
+
+	shm_ring_free(&server);
+	shm_ring_free(&client);
+
+} CK_END_TEST
+#endif
+
+struct test_trace_dump {
+	unsigned int threads;
+	size_t records;
+	uint32_t last_arg;
+	bool ordered;
+};
+
+static void test_trace_dump_cb(pid_t tid, const char *name,
+		const struct trace_record *records, size_t nmemb, void *userdata) {
+	(void)tid;
+	(void)name;
+	struct test_trace_dump *dump = userdata;
+	for (size_t i = 1; i < nmemb; i++)
+		if (records[i].timestamp < records[i - 1].timestamp ||
+				records[i].args[0] != records[i - 1].args[0] + 1)
+			dump->ordered = false;
+	dump->last_arg = records[nmemb - 1].args[0];
+	dump->records += nmemb;
+	dump->threads++;
+}
+
+static void *test_trace_thread(void *userdata) {
+	(void)userdata;
+	for (unsigned int i = 0; i < 10; i++)
+		trace(TRACE_EVENT_BT_WRITE, i, 0, 0);
+	return NULL;
+}
+
+CK_START_TEST(test_trace) {
+
+	struct test_trace_dump dump = { .ordered = true };
+
+	/* tracing is disabled by default */
+	trace(TRACE_EVENT_BT_READ, 0, 0, 0);
+	ck_assert_int_eq(trace_dump(test_trace_dump_cb, &dump), 0);
+	ck_assert_uint_eq(dump.threads, 0);
+
+	ck_assert_int_eq(trace_init(0), -1);
+	ck_assert_int_eq(trace_init(3), 0);
+	ck_assert_int_eq(trace_init(3), -1);
+	ck_assert_int_eq(errno, EBUSY);
+
+	/* ring buffer overwrites the oldest records */
+	for (unsigned int i = 0; i < 10; i++)
+		trace(TRACE_EVENT_BT_READ, i, 0, 0);
+	ck_assert_int_eq(trace_dump(test_trace_dump_cb, &dump), 0);
+	ck_assert_uint_eq(dump.threads, 1);
+	ck_assert_uint_eq(dump.records, 4);
+	ck_assert_uint_eq(dump.last_arg, 9);
+	ck_assert_int_eq(dump.ordered, true);
+
+	/* every thread records events in its own ring */
+	pthread_t thread;
+	ck_assert_int_eq(pthread_create(&thread, NULL, test_trace_thread, NULL), 0);
+	pthread_join(thread, NULL);
+
+	memset(&dump, 0, sizeof(dump));
+	dump.ordered = true;
+	ck_assert_int_eq(trace_dump(test_trace_dump_cb, &dump), 0);
+	ck_assert_uint_eq(dump.threads, 2);
+	ck_assert_uint_eq(dump.records, 8);
+	ck_assert_int_eq(dump.ordered, true);
+
+	ck_assert_str_eq(trace_event_to_string(TRACE_EVENT_BT_READ), "bt-read");
+	ck_assert_str_eq(trace_event_to_string(__TRACE_EVENT_MAX), "unknown");
+
+} CK_END_TEST
+
 CK_START_TEST(test_bin2hex) {
 
 	const uint8_t bin[] = { 0xDE, 0xAD, 0xBE, 0xEF };
@@ -285,14 +828,30 @@ int main(void) {
 
 	suite_add_tcase(s, tc);
 
+	/* shared/abr.c */
+	tcase_add_test(tc, test_abr);
+
+	/* shared/asrc.c */
+	tcase_add_test(tc, test_asrc);
+
 	/* shared/ffb.c */
 	tcase_add_test(tc, test_ffb);
 	tcase_add_test(tc, test_ffb_resize);
 
+	/* shared/ffrb.c */
+	tcase_add_test(tc, test_ffrb);
+	tcase_add_test(tc, test_ffrb_wrap);
+
 	/* shared/hex.c */
 	tcase_add_test(tc, test_bin2hex);
 	tcase_add_test(tc, test_hex2bin);
 
+	/* shared/histogram.c */
+	tcase_add_test(tc, test_histogram);
+
+	/* shared/mpscq.c */
+	tcase_add_test(tc, test_mpscq);
+
 	/* shared/nv.c */
 	tcase_add_test(tc, test_nv_find);
 	tcase_add_test(tc, test_nv_join_names);
@@ -300,6 +859,14 @@ int main(void) {
 	/* shared/rt.c */
 	tcase_add_test(tc, test_difftimespec);
 
+#if HAVE_MEMFD_CREATE
+	/* shared/shm-ring.c */
+	tcase_add_test(tc, test_shm_ring);
+#endif
+
+	/* shared/trace.c */
+	tcase_add_test(tc, test_trace);
+
 	tcase_add_test(tc, test_g_dbus_bluez_object_path_to_hci_dev_id);
 	tcase_add_test(tc, test_g_dbus_bluez_object_path_to_bdaddr);
 	tcase_add_test(tc, test_g_variant_sanitize_object_path);
@@ -307,6 +874,9 @@ int main(void) {
 	tcase_add_test(tc, test_batostr_);
 #endif
 
+	/* io-engine.c */
+	tcase_add_test(tc, test_io_engine);
+
 	srunner_run_all(sr, CK_ENV);
 	int nf = srunner_ntests_failed(sr);
 	srunner_free(sr);
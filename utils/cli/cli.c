@@ -256,6 +256,10 @@ void cli_print_pcm_soft_volume(const struct ba_pcm *pcm) {
 	printf("SoftVolume: %s\n", pcm->soft_volume ? "true" : "false");
 }
 
+void cli_print_pcm_latency(const struct ba_pcm *pcm) {
+	printf("Latency: %s\n", pcm->latency == BA_PCM_LATENCY_LOW ? "low" : "normal");
+}
+
 void cli_print_pcm_volume(const struct ba_pcm *pcm) {
 	if (pcm->channels == 2)
 		printf("Volume: L: %u R: %u\n", pcm->volume.ch1_volume, pcm->volume.ch2_volume);
@@ -284,9 +288,12 @@ void cli_print_pcm_properties(const struct ba_pcm *pcm, DBusError *err) {
 	cli_print_pcm_selected_codec(pcm);
 	printf("Delay: %#.1f ms\n", (double)pcm->delay / 10);
 	printf("DelayAdjustment: %#.1f ms\n", (double)pcm->delay_adjustment / 10);
+	if (pcm->bitrate != 0)
+		printf("Bitrate: %u bps\n", pcm->bitrate);
 	cli_print_pcm_soft_volume(pcm);
 	cli_print_pcm_volume(pcm);
 	cli_print_pcm_mute(pcm);
+	cli_print_pcm_latency(pcm);
 }
 
 static const char *progname = NULL;
@@ -308,10 +315,13 @@ extern const struct cli_command cmd_status;
 extern const struct cli_command cmd_info;
 extern const struct cli_command cmd_codec;
 extern const struct cli_command cmd_delay_adjustment;
+extern const struct cli_command cmd_latency;
 extern const struct cli_command cmd_monitor;
 extern const struct cli_command cmd_mute;
 extern const struct cli_command cmd_open;
 extern const struct cli_command cmd_softvol;
+extern const struct cli_command cmd_stats;
+extern const struct cli_command cmd_trace;
 extern const struct cli_command cmd_volume;
 
 static const struct cli_command *commands[] = {
@@ -324,6 +334,9 @@ static const struct cli_command *commands[] = {
 	&cmd_volume,
 	&cmd_mute,
 	&cmd_softvol,
+	&cmd_latency,
+	&cmd_stats,
+	&cmd_trace,
 	&cmd_monitor,
 	&cmd_open,
 };
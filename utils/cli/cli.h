@@ -49,6 +49,7 @@ void cli_print_pcm_selected_codec(const struct ba_pcm *pcm);
 void cli_print_pcm_soft_volume(const struct ba_pcm *pcm);
 void cli_print_pcm_volume(const struct ba_pcm *pcm);
 void cli_print_pcm_mute(const struct ba_pcm *pcm);
+void cli_print_pcm_latency(const struct ba_pcm *pcm);
 void cli_print_pcm_properties(const struct ba_pcm *pcm, DBusError *err);
 void cli_print_usage(const char *format, ...);
 
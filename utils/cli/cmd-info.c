@@ -9,6 +9,7 @@
  */
 
 #include <getopt.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -28,6 +29,27 @@ static void usage(const char *command) {
 	);
 }
 
+static void print_rtp_stats(const char *path, DBusError *err) {
+
+	struct ba_pcm_rtp_stats stats;
+	if (!bluealsa_dbus_pcm_get_rtp_stats(&config.dbus, path, &stats, err))
+		return;
+
+	printf("RTP Sequence: %" PRIu32 "\n", stats.seq_ext_max);
+	printf("RTP Received: %" PRIu64 "\n", stats.received);
+	printf("RTP Lost: %" PRId64 " of %" PRIu64 "\n", stats.lost, stats.expected);
+	printf("RTP Interval Lost: %" PRId64 " of %" PRIu64 "\n",
+			stats.interval_lost, stats.interval_expected);
+	printf("RTP Duplicated: %" PRIu64 "\n", stats.duplicated);
+	printf("RTP Reordered: %" PRIu64 "\n", stats.reordered);
+	if (stats.clockrate != 0)
+		printf("RTP Jitter: %#.1f ms\n", 1000.0 * stats.jitter / stats.clockrate);
+	printf("RTP Loss Bursts: count=%" PRIu64 " mean=%u p90=%u max=%u\n",
+			stats.loss_bursts.count, stats.loss_bursts.mean,
+			stats.loss_bursts.p90, stats.loss_bursts.max);
+
+}
+
 static int cmd_info_func(int argc, char *argv[]) {
 
 	int opt;
@@ -70,6 +92,14 @@ static int cmd_info_func(int argc, char *argv[]) {
 	if (dbus_error_is_set(&err))
 		warn("Unable to read available codecs: %s", err.message);
 
+	if (pcm.transport & BA_PCM_TRANSPORT_A2DP_SINK &&
+			BA_PCM_A2DP_MAIN_CHANNEL(&pcm)) {
+		dbus_error_free(&err);
+		print_rtp_stats(path, &err);
+		if (dbus_error_is_set(&err))
+			warn("Unable to read RTP statistics: %s", err.message);
+	}
+
 	return EXIT_SUCCESS;
 }
 
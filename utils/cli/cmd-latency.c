@@ -0,0 +1,97 @@
+/*
+ * BlueALSA - cmd-latency.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+
+#include <dbus/dbus.h>
+
+#include "cli.h"
+#include "shared/dbus-client.h"
+
+static void usage(const char *command) {
+	printf("Get or set the latency class of the given PCM.\n\n");
+	cli_print_usage("%s [OPTION]... PCM-PATH [CLASS]", command);
+	printf("\nOptions:\n"
+			"  -h, --help\t\tShow this message and exit\n"
+			"\nPositional arguments:\n"
+			"  PCM-PATH\tBlueALSA PCM D-Bus object path\n"
+			"  CLASS\t\tLatency class [normal, low]\n"
+	);
+}
+
+static int cmd_latency_func(int argc, char *argv[]) {
+
+	int opt;
+	const char *opts = "h";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ 0 },
+	};
+
+	opterr = 0;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */ :
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			cmd_print_error("Invalid argument '%s'", argv[optind - 1]);
+			return EXIT_FAILURE;
+		}
+
+	if (argc - optind < 1) {
+		cmd_print_error("Missing BlueALSA PCM path argument");
+		return EXIT_FAILURE;
+	}
+	if (argc - optind > 2) {
+		cmd_print_error("Invalid number of arguments");
+		return EXIT_FAILURE;
+	}
+
+	DBusError err = DBUS_ERROR_INIT;
+	const char *path = argv[optind];
+
+	struct ba_pcm pcm;
+	if (!cli_get_ba_pcm(path, &pcm, &err)) {
+		cmd_print_error("Couldn't get BlueALSA PCM: %s", err.message);
+		return EXIT_FAILURE;
+	}
+
+	if (argc - optind == 1) {
+		cli_print_pcm_latency(&pcm);
+		return EXIT_SUCCESS;
+	}
+
+	const char *value = argv[optind + 1];
+	if (strcasecmp(value, "normal") == 0)
+		pcm.latency = BA_PCM_LATENCY_NORMAL;
+	else if (strcasecmp(value, "low") == 0)
+		pcm.latency = BA_PCM_LATENCY_LOW;
+	else {
+		cmd_print_error("Invalid argument: %s", value);
+		return EXIT_FAILURE;
+	}
+
+	if (!bluealsa_dbus_pcm_update(&config.dbus, &pcm, BLUEALSA_PCM_LATENCY, &err)) {
+		cmd_print_error("Latency update failed: %s", err.message);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+const struct cli_command cmd_latency = {
+	"latency",
+	"Get or set PCM latency class",
+	cmd_latency_func,
+};
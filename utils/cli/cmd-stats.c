@@ -0,0 +1,87 @@
+/*
+ * BlueALSA - cmd-stats.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <dbus/dbus.h>
+
+#include "cli.h"
+#include "shared/dbus-client.h"
+
+static void usage(const char *command) {
+	printf("Show the IO thread timing statistics of the given PCM.\n\n");
+	cli_print_usage("%s [OPTION]... PCM-PATH", command);
+	printf("\nOptions:\n"
+			"  -h, --help\t\tShow this message and exit\n"
+			"\nPositional arguments:\n"
+			"  PCM-PATH\tBlueALSA PCM D-Bus object path\n"
+	);
+}
+
+static int cmd_stats_func(int argc, char *argv[]) {
+
+	int opt;
+	const char *opts = "h";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ 0 },
+	};
+
+	opterr = 0;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */ :
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			cmd_print_error("Invalid argument '%s'", argv[optind - 1]);
+			return EXIT_FAILURE;
+		}
+
+	if (argc - optind < 1) {
+		cmd_print_error("Missing BlueALSA PCM path argument");
+		return EXIT_FAILURE;
+	}
+	if (argc - optind > 1) {
+		cmd_print_error("Invalid number of arguments");
+		return EXIT_FAILURE;
+	}
+
+	DBusError err = DBUS_ERROR_INIT;
+	const char *path = argv[optind];
+
+	struct ba_pcm_stats stats;
+	if (!bluealsa_dbus_pcm_get_stats(&config.dbus, path, &stats, &err)) {
+		cmd_print_error("Couldn't get BlueALSA PCM statistics: %s", err.message);
+		return EXIT_FAILURE;
+	}
+
+	for (size_t i = 0; i < stats.stats_len; i++) {
+		const struct ba_pcm_stat *stat = &stats.stats[i];
+		printf("%s: count=%" PRIu64, stat->name, stat->count);
+		if (stat->count > 0)
+			printf(" min=%u mean=%u p50=%u p90=%u p99=%u p99.9=%u max=%u [us]",
+					stat->min, stat->mean, stat->p50, stat->p90, stat->p99,
+					stat->p999, stat->max);
+		printf("\n");
+	}
+
+	bluealsa_dbus_pcm_stats_free(&stats);
+	return EXIT_SUCCESS;
+}
+
+const struct cli_command cmd_stats = {
+	"stats",
+	"Show PCM IO thread timing statistics",
+	cmd_stats_func,
+};
@@ -0,0 +1,89 @@
+/*
+ * BlueALSA - cmd-trace.c
+ * Copyright (c) 2016-2023 Arkadiusz Bokowy
+ *
+ * This file is a part of bluez-alsa.
+ *
+ * This project is licensed under the terms of the MIT license.
+ *
+ */
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <dbus/dbus.h>
+
+#include "cli.h"
+#include "shared/dbus-client.h"
+#include "shared/trace.h"
+
+static void usage(const char *command) {
+	printf("Dump the hot path trace records of the BlueALSA service.\n\n");
+	cli_print_usage("%s [OPTION]...", command);
+	printf("\nOptions:\n"
+			"  -h, --help\t\tShow this message and exit\n"
+	);
+}
+
+static int trace_record_cmp(const void *a, const void *b) {
+	const struct ba_trace_record *ra = a;
+	const struct ba_trace_record *rb = b;
+	if (ra->timestamp != rb->timestamp)
+		return ra->timestamp < rb->timestamp ? -1 : 1;
+	return 0;
+}
+
+static int cmd_trace_func(int argc, char *argv[]) {
+
+	int opt;
+	const char *opts = "h";
+	const struct option longopts[] = {
+		{ "help", no_argument, NULL, 'h' },
+		{ 0 },
+	};
+
+	opterr = 0;
+	while ((opt = getopt_long(argc, argv, opts, longopts, NULL)) != -1)
+		switch (opt) {
+		case 'h' /* --help */ :
+			usage(argv[0]);
+			return EXIT_SUCCESS;
+		default:
+			cmd_print_error("Invalid argument '%s'", argv[optind - 1]);
+			return EXIT_FAILURE;
+		}
+
+	if (argc - optind > 0) {
+		cmd_print_error("Invalid number of arguments");
+		return EXIT_FAILURE;
+	}
+
+	DBusError err = DBUS_ERROR_INIT;
+	struct ba_trace trace;
+	if (!bluealsa_dbus_get_trace(&config.dbus, &trace, &err)) {
+		cmd_print_error("Couldn't get BlueALSA trace: %s", err.message);
+		return EXIT_FAILURE;
+	}
+
+	/* merge records of all threads in the chronological order */
+	qsort(trace.records, trace.records_len, sizeof(*trace.records), trace_record_cmp);
+
+	for (size_t i = 0; i < trace.records_len; i++) {
+		const struct ba_trace_record *r = &trace.records[i];
+		printf("%" PRIu64 ".%09" PRIu64 " %u %s: %s %u %u %u\n",
+				r->timestamp / 1000000000, r->timestamp % 1000000000,
+				r->tid, r->thread, trace_event_to_string(r->event),
+				r->args[0], r->args[1], r->args[2]);
+	}
+
+	bluealsa_dbus_trace_free(&trace);
+	return EXIT_SUCCESS;
+}
+
+const struct cli_command cmd_trace = {
+	"trace",
+	"Dump hot path trace records",
+	cmd_trace_func,
+};